@@ -0,0 +1,198 @@
+#include <string.h>
+
+#include "hash.h"
+
+#define HASH64_SEED 0x27D4EB2F165667C5ULL
+
+#define HASH64_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH64_PRIME_2 0xC2B2AE3D27D4EB4FULL
+
+static uint64_t hash64_rotl(uint64_t value, uint32_t bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t hash64_read(const uint8_t* p) {
+    return (uint64_t) p[0] | ((uint64_t) p[1] << 8) | ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24)
+           | ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40) | ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+}
+
+static uint64_t hash64_round(uint64_t state, uint64_t word) {
+    state ^= word * HASH64_PRIME_2;
+    return hash64_rotl(state, 31) * HASH64_PRIME_1;
+}
+
+void hash64_init(hash64_ctx* ctx) {
+    ctx->state = HASH64_SEED;
+    ctx->length = 0;
+    ctx->tailSize = 0;
+}
+
+void hash64_update(hash64_ctx* ctx, const void* data, uint32_t size) {
+    const uint8_t* p = (const uint8_t*) data;
+
+    ctx->length += size;
+
+    if(ctx->tailSize > 0) {
+        uint32_t fill = 8 - ctx->tailSize;
+        if(fill > size) {
+            fill = size;
+        }
+
+        memcpy(ctx->tail + ctx->tailSize, p, fill);
+        ctx->tailSize += fill;
+        p += fill;
+        size -= fill;
+
+        if(ctx->tailSize < 8) {
+            return;
+        }
+
+        ctx->state = hash64_round(ctx->state, hash64_read(ctx->tail));
+        ctx->tailSize = 0;
+    }
+
+    uint64_t state = ctx->state;
+    for(; size >= 8; p += 8, size -= 8) {
+        state = hash64_round(state, hash64_read(p));
+    }
+
+    ctx->state = state;
+
+    memcpy(ctx->tail, p, size);
+    ctx->tailSize = size;
+}
+
+uint64_t hash64_final(hash64_ctx* ctx) {
+    uint64_t state = ctx->state ^ ctx->length;
+
+    for(uint32_t i = 0; i < ctx->tailSize; i++) {
+        state = hash64_rotl(state ^ (ctx->tail[i] * HASH64_PRIME_1), 11) * HASH64_PRIME_2;
+    }
+
+    state ^= state >> 33;
+    state *= HASH64_PRIME_2;
+    state ^= state >> 29;
+    state *= HASH64_PRIME_1;
+    state ^= state >> 32;
+
+    return state;
+}
+
+uint64_t hash64(const void* data, uint32_t size) {
+    hash64_ctx ctx;
+    hash64_init(&ctx);
+    hash64_update(&ctx, data, size);
+    return hash64_final(&ctx);
+}
+
+static const uint32_t sha256_k[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static uint32_t sha256_rotr(uint32_t value, uint32_t bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static void sha256_block(uint32_t* state, const uint8_t* p) {
+    uint32_t w[64];
+    for(uint32_t i = 0; i < 16; i++) {
+        w[i] = ((uint32_t) p[i * 4] << 24) | ((uint32_t) p[i * 4 + 1] << 16) | ((uint32_t) p[i * 4 + 2] << 8) | p[i * 4 + 3];
+    }
+
+    for(uint32_t i = 16; i < 64; i++) {
+        uint32_t s0 = sha256_rotr(w[i - 15], 7) ^ sha256_rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = sha256_rotr(w[i - 2], 17) ^ sha256_rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for(uint32_t i = 0; i < 64; i++) {
+        uint32_t t1 = h + (sha256_rotr(e, 6) ^ sha256_rotr(e, 11) ^ sha256_rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (sha256_rotr(a, 2) ^ sha256_rotr(a, 13) ^ sha256_rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void sha256_init(sha256_ctx* ctx) {
+    static const uint32_t initial[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->blockSize = 0;
+}
+
+void sha256_update(sha256_ctx* ctx, const void* data, uint32_t size) {
+    const uint8_t* p = (const uint8_t*) data;
+
+    ctx->length += size;
+
+    if(ctx->blockSize > 0) {
+        uint32_t fill = 64 - ctx->blockSize;
+        if(fill > size) {
+            fill = size;
+        }
+
+        memcpy(ctx->block + ctx->blockSize, p, fill);
+        ctx->blockSize += fill;
+        p += fill;
+        size -= fill;
+
+        if(ctx->blockSize < 64) {
+            return;
+        }
+
+        sha256_block(ctx->state, ctx->block);
+        ctx->blockSize = 0;
+    }
+
+    for(; size >= 64; p += 64, size -= 64) {
+        sha256_block(ctx->state, p);
+    }
+
+    memcpy(ctx->block, p, size);
+    ctx->blockSize = size;
+}
+
+void sha256_final(sha256_ctx* ctx, uint8_t* hash) {
+    uint64_t bits = ctx->length * 8;
+
+    uint8_t padding[72] = {0x80};
+    uint32_t padSize = (ctx->blockSize < 56 ? 56 : 120) - ctx->blockSize;
+    for(uint32_t i = 0; i < 8; i++) {
+        padding[padSize + i] = (uint8_t) (bits >> (56 - i * 8));
+    }
+
+    sha256_update(ctx, padding, padSize + 8);
+
+    for(uint32_t i = 0; i < 8; i++) {
+        hash[i * 4] = (uint8_t) (ctx->state[i] >> 24);
+        hash[i * 4 + 1] = (uint8_t) (ctx->state[i] >> 16);
+        hash[i * 4 + 2] = (uint8_t) (ctx->state[i] >> 8);
+        hash[i * 4 + 3] = (uint8_t) ctx->state[i];
+    }
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Streaming 64-bit non-cryptographic hash. Input is consumed eight bytes at a time, with a
+// multiply-rotate round per word and a final avalanche, so it keeps up with SD and network
+// transfers on the ARM11. Words are read little-endian; results match across hosts.
+
+typedef struct {
+    uint64_t state;
+    uint64_t length;
+
+    uint8_t tail[8];
+    uint32_t tailSize;
+} hash64_ctx;
+
+void hash64_init(hash64_ctx* ctx);
+void hash64_update(hash64_ctx* ctx, const void* data, uint32_t size);
+uint64_t hash64_final(hash64_ctx* ctx);
+
+uint64_t hash64(const void* data, uint32_t size);
+
+// SHA-256, for checking data against the hashes in title metadata.
+
+#define SHA256_SIZE 32
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+
+    uint8_t block[64];
+    uint32_t blockSize;
+} sha256_ctx;
+
+void sha256_init(sha256_ctx* ctx);
+void sha256_update(sha256_ctx* ctx, const void* data, uint32_t size);
+void sha256_final(sha256_ctx* ctx, uint8_t* hash);
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include <string.h>
+
+#include "lz.h"
+
+static uint32_t lz_read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t lz_hash(uint32_t value) {
+    return (value * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t* lz_write_length(uint8_t* op, uint8_t* opEnd, uint32_t length) {
+    while(length >= 255) {
+        if(op >= opEnd) {
+            return NULL;
+        }
+
+        *op++ = 255;
+        length -= 255;
+    }
+
+    if(op >= opEnd) {
+        return NULL;
+    }
+
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+static uint8_t* lz_write_sequence(uint8_t* op, uint8_t* opEnd, const uint8_t* literals, uint32_t literalLength, uint32_t offset, uint32_t matchLength) {
+    if(op >= opEnd) {
+        return NULL;
+    }
+
+    uint32_t matchCode = matchLength > 0 ? matchLength - LZ_MIN_MATCH : 0;
+
+    *op++ = (uint8_t) (((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+    if(literalLength >= 15 && (op = lz_write_length(op, opEnd, literalLength - 15)) == NULL) {
+        return NULL;
+    }
+
+    if((uint32_t) (opEnd - op) < literalLength) {
+        return NULL;
+    }
+
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+
+    if(matchLength > 0) {
+        if(opEnd - op < 2) {
+            return NULL;
+        }
+
+        *op++ = (uint8_t) (offset & 0xFF);
+        *op++ = (uint8_t) (offset >> 8);
+
+        if(matchCode >= 15 && (op = lz_write_length(op, opEnd, matchCode - 15)) == NULL) {
+            return NULL;
+        }
+    }
+
+    return op;
+}
+
+uint32_t lz_compress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity, void* work) {
+    uint32_t* table = (uint32_t*) work;
+    memset(table, 0, LZ_WORK_SIZE);
+
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* end = src + srcSize;
+
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + dstCapacity;
+
+    while(end - ip >= LZ_MIN_MATCH) {
+        uint32_t value = lz_read32(ip);
+        uint32_t hash = lz_hash(value);
+
+        const uint8_t* ref = src + table[hash];
+        table[hash] = (uint32_t) (ip - src);
+
+        if(ref < ip && ip - ref <= LZ_MAX_OFFSET && lz_read32(ref) == value) {
+            const uint8_t* matchEnd = ip + LZ_MIN_MATCH;
+            ref += LZ_MIN_MATCH;
+            while(matchEnd < end && *matchEnd == *ref) {
+                matchEnd++;
+                ref++;
+            }
+
+            uint32_t matchLength = (uint32_t) (matchEnd - ip);
+            if((op = lz_write_sequence(op, opEnd, anchor, (uint32_t) (ip - anchor), (uint32_t) (matchEnd - ref), matchLength)) == NULL) {
+                return 0;
+            }
+
+            ip = matchEnd;
+            anchor = ip;
+        } else {
+            ip++;
+        }
+    }
+
+    if((op = lz_write_sequence(op, opEnd, anchor, (uint32_t) (end - anchor), 0, 0)) == NULL) {
+        return 0;
+    }
+
+    return (uint32_t) (op - dst);
+}
+
+static int lz_read_length(const uint8_t** ip, const uint8_t* ipEnd, uint32_t* length) {
+    uint8_t b = 0;
+    do {
+        if(*ip >= ipEnd) {
+            return -1;
+        }
+
+        b = *(*ip)++;
+        *length += b;
+    } while(b == 255);
+
+    return 0;
+}
+
+int32_t lz_decompress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity) {
+    const uint8_t* ip = src;
+    const uint8_t* ipEnd = src + srcSize;
+
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + dstCapacity;
+
+    while(ip < ipEnd) {
+        uint8_t token = *ip++;
+
+        uint32_t literalLength = token >> 4;
+        if(literalLength == 15 && lz_read_length(&ip, ipEnd, &literalLength) < 0) {
+            return -1;
+        }
+
+        if((uint32_t) (ipEnd - ip) < literalLength || (uint32_t) (opEnd - op) < literalLength) {
+            return -1;
+        }
+
+        memcpy(op, ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        if(ip == ipEnd) {
+            break;
+        }
+
+        if(ipEnd - ip < 2) {
+            return -1;
+        }
+
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if(offset == 0 || offset > (uint32_t) (op - dst)) {
+            return -1;
+        }
+
+        uint32_t matchLength = token & 0xF;
+        if(matchLength == 15 && lz_read_length(&ip, ipEnd, &matchLength) < 0) {
+            return -1;
+        }
+
+        matchLength += LZ_MIN_MATCH;
+        if((uint32_t) (opEnd - op) < matchLength) {
+            return -1;
+        }
+
+        // Matches may overlap their own output, so copy a byte at a time.
+        const uint8_t* ref = op - offset;
+        while(matchLength-- > 0) {
+            *op++ = *ref++;
+        }
+    }
+
+    return (int32_t) (op - dst);
+}
\ No newline at end of file
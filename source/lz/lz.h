@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// Byte-oriented LZ77 block codec. A block is a series of sequences, each a token byte (literal length
+// in the high nibble, match length - LZ_MIN_MATCH in the low nibble, 15 meaning more length bytes
+// follow), the literals, then a little-endian 16-bit match offset. The last sequence has no match.
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xFFFF
+
+#define LZ_HASH_BITS 12
+#define LZ_WORK_SIZE (sizeof(uint32_t) << LZ_HASH_BITS)
+
+// Returns the compressed size, or 0 if the output would not fit in dstCapacity.
+// work must point to LZ_WORK_SIZE bytes of scratch memory.
+uint32_t lz_compress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity, void* work);
+
+// Returns the decompressed size, or -1 if the block is malformed or does not fit in dstCapacity.
+int32_t lz_decompress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity);
\ No newline at end of file
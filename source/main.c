@@ -4,6 +4,7 @@
 
 #include "screen.h"
 #include "util.h"
+#include "net/netconfig.h"
 #include "svchax/svchax.h"
 #include "ui/mainmenu.h"
 #include "ui/section/action/clipboard.h"
@@ -27,6 +28,7 @@ void cleanup() {
 
     amExit();
     httpcExit();
+    psExit();
     ptmuExit();
     acExit();
     cfguExit();
@@ -58,14 +60,18 @@ int main(int argc, const char* argv[]) {
     cfguInit();
     acInit();
     ptmuInit();
+    psInit();
     httpcInit(0);
 
     amInit();
     AM_InitializeExternalTitleDatabase(false);
 
-    soc_buffer = memalign(0x1000, 0x100000);
+    netconfig_load();
+
+    u32 socBufferSize = netconfig_get()->socBufferSize;
+    soc_buffer = memalign(0x1000, socBufferSize);
     if(soc_buffer != NULL) {
-        socInit(soc_buffer, 0x100000);
+        socInit(soc_buffer, socBufferSize);
     }
 
     screen_init();
@@ -0,0 +1,377 @@
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cdncache.h"
+#include "netconfig.h"
+
+#define CDNCACHE_INDEX_PATH CDNCACHE_DIR "/index"
+#define CDNCACHE_INDEX_TEMP_PATH CDNCACHE_DIR "/index.tmp"
+
+// Contents being added are written here first, and renamed into place once they check out.
+#define CDNCACHE_INCOMING_PATH CDNCACHE_DIR "/incoming"
+
+#define CDNCACHE_NAME_MAX 96
+#define CDNCACHE_PATH_MAX (sizeof(CDNCACHE_DIR) + CDNCACHE_NAME_MAX)
+
+typedef struct {
+    char name[CDNCACHE_NAME_MAX];
+    uint64_t size;
+    uint8_t hash[SHA256_SIZE];
+
+    // Higher stamps were used more recently.
+    uint64_t stamp;
+} cdncache_entry;
+
+static cdncache_entry* entries = NULL;
+static uint32_t entryCount = 0;
+static uint32_t entryCapacity = 0;
+static uint64_t nextStamp = 1;
+static bool loaded = false;
+
+// Set when use stamps have changed since the index was last saved.
+static bool dirty = false;
+
+static void cdncache_get_name(const cdncache_key* key, char* name) {
+    snprintf(name, CDNCACHE_NAME_MAX, "%016llX-%08lX-%llX", (unsigned long long) key->titleId, (unsigned long) key->contentId, (unsigned long long) key->size);
+}
+
+static void cdncache_format_hash(const uint8_t* hash, char* hex) {
+    for(uint32_t i = 0; i < SHA256_SIZE; i++) {
+        snprintf(hex + i * 2, 3, "%02X", hash[i]);
+    }
+}
+
+static bool cdncache_parse_hash(const char* hex, uint8_t* hash) {
+    if(strlen(hex) != SHA256_SIZE * 2) {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < SHA256_SIZE; i++) {
+        unsigned int byte = 0;
+        if(sscanf(hex + i * 2, "%2x", &byte) != 1) {
+            return false;
+        }
+
+        hash[i] = (uint8_t) byte;
+    }
+
+    return true;
+}
+
+static void cdncache_get_path(const char* name, char* path) {
+    snprintf(path, CDNCACHE_PATH_MAX, "%s/%s", CDNCACHE_DIR, name);
+}
+
+static uint64_t cdncache_limit() {
+    return (uint64_t) netconfig_get()->cdnCacheSize * 1024 * 1024;
+}
+
+static cdncache_entry* cdncache_add_entry() {
+    if(entryCount == entryCapacity) {
+        uint32_t capacity = entryCapacity > 0 ? entryCapacity * 2 : 32;
+
+        cdncache_entry* grown = (cdncache_entry*) realloc(entries, capacity * sizeof(cdncache_entry));
+        if(grown == NULL) {
+            return NULL;
+        }
+
+        entries = grown;
+        entryCapacity = capacity;
+    }
+
+    return &entries[entryCount++];
+}
+
+static void cdncache_load() {
+    if(loaded) {
+        return;
+    }
+
+    loaded = true;
+
+    FILE* fd = fopen(CDNCACHE_INDEX_PATH, "r");
+    if(fd == NULL) {
+        return;
+    }
+
+    char line[CDNCACHE_NAME_MAX + SHA256_SIZE * 2 + 64];
+    while(fgets(line, sizeof(line), fd) != NULL) {
+        char name[CDNCACHE_NAME_MAX];
+        unsigned long long size = 0;
+        unsigned long long stamp = 0;
+        char hex[SHA256_SIZE * 2 + 2];
+        uint8_t hash[SHA256_SIZE];
+        if(sscanf(line, "%95s %llu %llu %65s", name, &size, &stamp, hex) != 4 || !cdncache_parse_hash(hex, hash)) {
+            continue;
+        }
+
+        cdncache_entry* entry = cdncache_add_entry();
+        if(entry == NULL) {
+            break;
+        }
+
+        strcpy(entry->name, name);
+        entry->size = size;
+        memcpy(entry->hash, hash, SHA256_SIZE);
+        entry->stamp = stamp;
+
+        if(stamp >= nextStamp) {
+            nextStamp = stamp + 1;
+        }
+    }
+
+    fclose(fd);
+}
+
+static void cdncache_save() {
+    dirty = false;
+
+    FILE* fd = fopen(CDNCACHE_INDEX_TEMP_PATH, "w");
+    if(fd == NULL) {
+        return;
+    }
+
+    bool written = true;
+    for(uint32_t i = 0; i < entryCount && written; i++) {
+        char hex[SHA256_SIZE * 2 + 1];
+        cdncache_format_hash(entries[i].hash, hex);
+
+        written = fprintf(fd, "%s %llu %llu %s\n", entries[i].name, (unsigned long long) entries[i].size, (unsigned long long) entries[i].stamp, hex) > 0;
+    }
+
+    if(fclose(fd) != 0 || !written) {
+        remove(CDNCACHE_INDEX_TEMP_PATH);
+        return;
+    }
+
+    // SD renames don't replace existing files.
+    remove(CDNCACHE_INDEX_PATH);
+    rename(CDNCACHE_INDEX_TEMP_PATH, CDNCACHE_INDEX_PATH);
+}
+
+static cdncache_entry* cdncache_find(const cdncache_key* key) {
+    char name[CDNCACHE_NAME_MAX];
+    cdncache_get_name(key, name);
+
+    for(uint32_t i = 0; i < entryCount; i++) {
+        if(strcmp(entries[i].name, name) == 0 && entries[i].size == key->size) {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void cdncache_remove_entry(cdncache_entry* entry) {
+    char path[CDNCACHE_PATH_MAX];
+    cdncache_get_path(entry->name, path);
+    remove(path);
+
+    *entry = entries[--entryCount];
+}
+
+bool cdncache_contains(const cdncache_key* key) {
+    if(cdncache_limit() == 0) {
+        return false;
+    }
+
+    cdncache_load();
+    return cdncache_find(key) != NULL;
+}
+
+bool cdncache_open(cdncache_file* file, const cdncache_key* key) {
+    memset(file, 0, sizeof(*file));
+
+    if(cdncache_limit() == 0) {
+        return false;
+    }
+
+    cdncache_load();
+
+    cdncache_entry* entry = cdncache_find(key);
+    if(entry == NULL) {
+        return false;
+    }
+
+    char path[CDNCACHE_PATH_MAX];
+    cdncache_get_path(entry->name, path);
+
+    if((file->fd = fopen(path, "rb")) == NULL) {
+        // Deleted from under the index.
+        cdncache_remove_entry(entry);
+        cdncache_save();
+
+        return false;
+    }
+
+    file->key = *key;
+    memcpy(file->hash, entry->hash, SHA256_SIZE);
+    sha256_init(&file->sha);
+
+    // Saved with the next change to the index, or by cdncache_flush.
+    entry->stamp = nextStamp++;
+    dirty = true;
+
+    return true;
+}
+
+int cdncache_read(cdncache_file* file, void* buf, uint32_t size, uint32_t* bytesRead) {
+    *bytesRead = 0;
+
+    if(size > file->key.size - file->offset) {
+        size = (uint32_t) (file->key.size - file->offset);
+    }
+
+    if(fread(buf, 1, size, file->fd) < size) {
+        if(ferror(file->fd)) {
+            errno = EIO;
+        } else {
+            errno = EBADMSG;
+        }
+
+        file->failed = true;
+        return -1;
+    }
+
+    sha256_update(&file->sha, buf, size);
+    file->offset += size;
+
+    if(file->offset == file->key.size) {
+        uint8_t hash[SHA256_SIZE];
+        sha256_final(&file->sha, hash);
+
+        if(memcmp(hash, file->hash, SHA256_SIZE) != 0) {
+            errno = EBADMSG;
+
+            file->failed = true;
+            return -1;
+        }
+    }
+
+    *bytesRead = size;
+    return 0;
+}
+
+bool cdncache_begin(cdncache_file* file, const cdncache_key* key) {
+    memset(file, 0, sizeof(*file));
+
+    uint64_t limit = cdncache_limit();
+    if(limit == 0 || key->size > limit) {
+        return false;
+    }
+
+    cdncache_load();
+
+    mkdir("sdmc:/fbi", 0777);
+    mkdir(CDNCACHE_DIR, 0777);
+
+    if((file->fd = fopen(CDNCACHE_INCOMING_PATH, "wb")) == NULL) {
+        return false;
+    }
+
+    file->key = *key;
+    file->writing = true;
+    sha256_init(&file->sha);
+
+    return true;
+}
+
+void cdncache_write(cdncache_file* file, const void* buf, uint32_t size) {
+    if(file->fd == NULL || file->failed) {
+        return;
+    }
+
+    if(file->offset + size > file->key.size || fwrite(buf, 1, size, file->fd) != size) {
+        file->failed = true;
+        return;
+    }
+
+    sha256_update(&file->sha, buf, size);
+    file->offset += size;
+}
+
+static bool cdncache_commit(cdncache_file* file) {
+    if(file->failed || file->offset != file->key.size) {
+        return false;
+    }
+
+    // An older copy of the same content is replaced.
+    cdncache_entry* existing = cdncache_find(&file->key);
+    if(existing != NULL) {
+        cdncache_remove_entry(existing);
+    }
+
+    uint64_t used = 0;
+    for(uint32_t i = 0; i < entryCount; i++) {
+        used += entries[i].size;
+    }
+
+    uint64_t limit = cdncache_limit();
+    while(entryCount > 0 && used + file->key.size > limit) {
+        cdncache_entry* oldest = &entries[0];
+        for(uint32_t i = 1; i < entryCount; i++) {
+            if(entries[i].stamp < oldest->stamp) {
+                oldest = &entries[i];
+            }
+        }
+
+        used -= oldest->size;
+        cdncache_remove_entry(oldest);
+    }
+
+    cdncache_entry* entry = cdncache_add_entry();
+    if(entry == NULL) {
+        cdncache_save();
+        return false;
+    }
+
+    cdncache_get_name(&file->key, entry->name);
+    entry->size = file->key.size;
+    sha256_final(&file->sha, entry->hash);
+    entry->stamp = nextStamp++;
+
+    char path[CDNCACHE_PATH_MAX];
+    cdncache_get_path(entry->name, path);
+
+    remove(path);
+    if(rename(CDNCACHE_INCOMING_PATH, path) != 0) {
+        entryCount--;
+        cdncache_save();
+
+        return false;
+    }
+
+    cdncache_save();
+    return true;
+}
+
+void cdncache_close(cdncache_file* file, bool commit) {
+    if(file->fd == NULL) {
+        return;
+    }
+
+    bool closed = fclose(file->fd) == 0;
+    file->fd = NULL;
+
+    if(file->writing) {
+        if(!closed || !commit || !cdncache_commit(file)) {
+            remove(CDNCACHE_INCOMING_PATH);
+        }
+    } else if(file->failed) {
+        // Whatever was wrong with it, the next install downloads it again.
+        cdncache_entry* entry = cdncache_find(&file->key);
+        if(entry != NULL) {
+            cdncache_remove_entry(entry);
+            cdncache_save();
+        }
+    }
+}
+
+void cdncache_flush() {
+    if(dirty) {
+        cdncache_save();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../hash/hash.h"
+
+// SD-backed cache of CDN contents, so titles installed before need not be downloaded again.
+// Entries are keyed by title ID, content ID and size. Once they outgrow the cdncache limit in
+// NETCONFIG_PATH, the least recently used are evicted. The CDN serves contents encrypted, so the
+// hashes in their TMD say nothing about the data kept here; instead, a SHA-256 of the data is taken
+// as it is added and kept in the index, and contents are checked against it as they are read.
+//
+// The cache is not thread-safe; it is meant for one install at a time.
+
+#define CDNCACHE_DIR "sdmc:/fbi/cdncache"
+
+typedef struct {
+    uint64_t titleId;
+    uint32_t contentId;
+    uint64_t size;
+} cdncache_key;
+
+typedef struct {
+    cdncache_key key;
+    FILE* fd;
+    bool writing;
+
+    // What a content being read hashed to when it was added.
+    uint8_t hash[SHA256_SIZE];
+
+    sha256_ctx sha;
+    uint64_t offset;
+    bool failed;
+} cdncache_file;
+
+bool cdncache_contains(const cdncache_key* key);
+
+// Opens a cached content for reading and marks it most recently used, in memory until the index
+// is next saved. Returns false if it is not cached.
+bool cdncache_open(cdncache_file* file, const cdncache_key* key);
+// Reads the next bytes of a cached content. Returns 0, or -1 with errno set; reading the end of a
+// content that no longer matches the hash taken when it was added fails with EBADMSG and drops it
+// from the cache.
+int cdncache_read(cdncache_file* file, void* buf, uint32_t size, uint32_t* bytesRead);
+
+// Starts adding a content as it downloads. Returns false if the cache is turned off or the
+// content would not fit in it.
+bool cdncache_begin(cdncache_file* file, const cdncache_key* key);
+// Appends the next bytes of a content being added. Write errors only keep it out of the cache.
+void cdncache_write(cdncache_file* file, const void* buf, uint32_t size);
+
+// Closes a content. One being added is kept if commit is set and all of it was written, evicting
+// older contents as needed to make room. Callers only commit contents that checked out, such as
+// ones AM accepted. One being read is dropped if failed is set, by cdncache_read or by a caller
+// whose install turned it away.
+void cdncache_close(cdncache_file* file, bool commit);
+
+// Saves the use stamps of contents opened since the index was last written. Called once an
+// install is over.
+void cdncache_flush();
@@ -0,0 +1,586 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "net.h"
+#include "netconfig.h"
+#include "httpclient.h"
+
+static uint64_t httpclient_now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+bool httpclient_supports(const char* url) {
+    return strncasecmp(url, "http://", 7) == 0;
+}
+
+static int httpclient_parse_url(const char* url, char* host, uint16_t* port, char* path) {
+    if(!httpclient_supports(url)) {
+        errno = EPROTONOSUPPORT;
+        return -1;
+    }
+
+    const char* start = url + 7;
+
+    size_t hostLength = strcspn(start, ":/?#");
+    if(hostLength == 0 || hostLength >= HTTPCLIENT_HOST_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memcpy(host, start, hostLength);
+    host[hostLength] = '\0';
+
+    const char* rest = start + hostLength;
+
+    *port = 80;
+    if(*rest == ':') {
+        char* end = NULL;
+        unsigned long value = strtoul(rest + 1, &end, 10);
+        if(end == rest + 1 || value == 0 || value > 0xFFFF || (*end != '\0' && *end != '/' && *end != '?' && *end != '#')) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        *port = (uint16_t) value;
+        rest = end;
+    }
+
+    // Fragments stay on the client.
+    int pathLength = (int) strcspn(rest, "#");
+    if(snprintf(path, HTTPCLIENT_PATH_MAX, "%s%.*s", *rest == '/' ? "" : "/", pathLength, rest) >= HTTPCLIENT_PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void httpclient_disconnect(httpclient_conn* conn) {
+    if(conn->socket >= 0) {
+        close(conn->socket);
+        conn->socket = -1;
+    }
+}
+
+static int httpclient_connect(httpclient_conn* conn, int timeoutMs) {
+    struct hostent* entry = gethostbyname(conn->host);
+    if(entry == NULL || entry->h_addrtype != AF_INET || entry->h_addr_list[0] == NULL) {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(conn->port);
+    memcpy(&addr.sin_addr, entry->h_addr_list[0], sizeof(addr.sin_addr));
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if(sock < 0) {
+        return -1;
+    }
+
+    int bufSize = (int) netconfig_get()->recvBufferSize;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+
+    // Connect without blocking so a host that doesn't answer is given up on in time.
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+    if(connect(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        int err = errno;
+        if(err == EINPROGRESS) {
+            int ready = net_wait(sock, POLLOUT, timeoutMs);
+            if(ready > 0) {
+                socklen_t errLength = sizeof(err);
+                if(getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &errLength) < 0) {
+                    err = errno;
+                }
+            } else {
+                err = ready == 0 ? ETIMEDOUT : errno;
+            }
+        }
+
+        if(err != 0) {
+            close(sock);
+
+            errno = err;
+            return -1;
+        }
+    }
+
+    conn->socket = sock;
+    conn->generation++;
+    conn->sent = 0;
+    conn->received = 0;
+
+    return 0;
+}
+
+// Idle keep-alive connections have nothing to read; anything there means the server closed it.
+static bool httpclient_is_stale(httpclient_conn* conn) {
+    return net_wait(conn->socket, POLLIN, 0) != 0;
+}
+
+static httpclient_conn* httpclient_acquire(httpclient_pool* pool, const char* host, uint16_t port) {
+    httpclient_conn* unused = NULL;
+    httpclient_conn* other = NULL;
+
+    for(uint32_t i = 0; i < HTTPCLIENT_POOL_MAX; i++) {
+        httpclient_conn* conn = &pool->conns[i];
+        if(conn->pending != 0) {
+            continue;
+        }
+
+        if(conn->socket >= 0 && conn->port == port && strcasecmp(conn->host, host) == 0) {
+            if(!httpclient_is_stale(conn)) {
+                return conn;
+            }
+
+            httpclient_disconnect(conn);
+        }
+
+        if(conn->socket < 0) {
+            if(unused == NULL) {
+                unused = conn;
+            }
+        } else if(other == NULL) {
+            other = conn;
+        }
+    }
+
+    // Idle connections to other hosts are only closed when there is no free slot.
+    httpclient_conn* conn = unused != NULL ? unused : other;
+    if(conn == NULL) {
+        errno = EBUSY;
+        return NULL;
+    }
+
+    httpclient_disconnect(conn);
+
+    strncpy(conn->host, host, sizeof(conn->host) - 1);
+    conn->host[sizeof(conn->host) - 1] = '\0';
+    conn->port = port;
+
+    return conn;
+}
+
+static int httpclient_transmit(httpclient_request* request, int timeoutMs) {
+    httpclient_conn* conn = request->conn;
+
+    request->reused = conn->socket >= 0;
+    request->connectMs = 0;
+
+    if(conn->socket < 0) {
+        uint64_t start = httpclient_now();
+        if(httpclient_connect(conn, timeoutMs) < 0) {
+            return -1;
+        }
+
+        request->connectMs = (uint32_t) (httpclient_now() - start);
+    }
+
+    char port[8] = {'\0'};
+    if(conn->port != 80) {
+        snprintf(port, sizeof(port), ":%u", conn->port);
+    }
+
+    char range[48] = {'\0'};
+    if(request->rangeStart > 0) {
+        snprintf(range, sizeof(range), "Range: bytes=%llu-\r\n", (unsigned long long) request->rangeStart);
+    }
+
+    char head[HTTPCLIENT_PATH_MAX + HTTPCLIENT_HOST_MAX + 96];
+    int headLength = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s%s\r\nUser-Agent: FBI\r\n%s\r\n", request->method, request->path, conn->host, port, range);
+    if(headLength < 0 || (size_t) headLength >= sizeof(head)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    request->seq = conn->sent;
+    request->sendTime = httpclient_now();
+
+    if(net_send_all(conn->socket, head, (size_t) headLength, 0, timeoutMs) < 0) {
+        // Responses to requests already sent may still be read, but a partly sent head leaves
+        // nothing more to send on the connection.
+        int err = errno;
+        shutdown(conn->socket, SHUT_WR);
+
+        errno = err;
+        return -1;
+    }
+
+    request->generation = conn->generation;
+    conn->sent++;
+    return 0;
+}
+
+static int httpclient_prepare(httpclient_request* request, const char* method, const char* url, char* host, uint16_t* port) {
+    memset(request, 0, sizeof(*request));
+
+    if(strlen(method) >= sizeof(request->method)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    strcpy(request->method, method);
+
+    return httpclient_parse_url(url, host, port, request->path);
+}
+
+static int httpclient_send_on(httpclient_conn* conn, httpclient_request* request, int timeoutMs) {
+    request->conn = conn;
+    conn->pending++;
+
+    if(httpclient_transmit(request, timeoutMs) < 0) {
+        // Pipelined behind requests still waiting for their responses, it is sent again on a new
+        // connection once those are read, as it would be had the server closed after it went out.
+        if(errno != ENAMETOOLONG && conn->socket >= 0 && conn->received < conn->sent) {
+            return 0;
+        }
+
+        httpclient_disconnect(conn);
+        conn->pending--;
+        request->conn = NULL;
+
+        return -1;
+    }
+
+    return 0;
+}
+
+int httpclient_send(httpclient_pool* pool, const char* method, const char* url, httpclient_request* request, int timeoutMs) {
+    char host[HTTPCLIENT_HOST_MAX];
+    uint16_t port = 0;
+    if(httpclient_prepare(request, method, url, host, &port) < 0) {
+        return -1;
+    }
+
+    httpclient_conn* conn = httpclient_acquire(pool, host, port);
+    if(conn == NULL) {
+        return -1;
+    }
+
+    return httpclient_send_on(conn, request, timeoutMs);
+}
+
+int httpclient_send_range(httpclient_pool* pool, const char* url, uint64_t offset, httpclient_request* request, int timeoutMs) {
+    char host[HTTPCLIENT_HOST_MAX];
+    uint16_t port = 0;
+    if(httpclient_prepare(request, "GET", url, host, &port) < 0) {
+        return -1;
+    }
+
+    request->rangeStart = offset;
+
+    httpclient_conn* conn = httpclient_acquire(pool, host, port);
+    if(conn == NULL) {
+        return -1;
+    }
+
+    return httpclient_send_on(conn, request, timeoutMs);
+}
+
+int httpclient_resume(httpclient_retry* retry, uint64_t offset, httpclient_wait_func wait, httpclient_reopen_func reopen, void* arg) {
+    if(offset > retry->offset) {
+        retry->attempts = 0;
+        retry->offset = offset;
+    }
+
+    while(retry->attempts < HTTPCLIENT_RESUME_ATTEMPTS) {
+        uint32_t delay = (uint32_t) HTTPCLIENT_RESUME_DELAY << retry->attempts++;
+        if(!wait(arg, delay)) {
+            errno = ECANCELED;
+            return -1;
+        }
+
+        if(reopen(arg) >= 0) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int httpclient_send_after(httpclient_pool* pool, const httpclient_request* prev, const char* method, const char* url, httpclient_request* request, int timeoutMs) {
+    char host[HTTPCLIENT_HOST_MAX];
+    uint16_t port = 0;
+    if(httpclient_prepare(request, method, url, host, &port) < 0) {
+        return -1;
+    }
+
+    httpclient_conn* conn = prev->conn;
+    if(conn == NULL || conn->socket < 0 || conn->port != port || strcasecmp(conn->host, host) != 0 || (prev->headRead && !prev->keepAlive)) {
+        if((conn = httpclient_acquire(pool, host, port)) == NULL) {
+            return -1;
+        }
+    }
+
+    return httpclient_send_on(conn, request, timeoutMs);
+}
+
+static int httpclient_read_headers(httpclient_request* request, int timeoutMs, bool* started) {
+    int sock = request->conn->socket;
+
+    // The first byte is read alone to tell a connection the server had already closed apart from
+    // one that failed mid-response.
+    char head[HTTPD_HEAD_MAX];
+    if(net_recv_all(sock, head, 1, 0, timeoutMs) < 0) {
+        return -1;
+    }
+
+    *started = true;
+
+    if(httpd_read_head(sock, head, sizeof(head), 1, timeoutMs) < 0) {
+        return -1;
+    }
+
+    char* pos = head;
+    char* line = httpd_next_line(&pos);
+
+    char* end = NULL;
+    if(strncmp(line, "HTTP/1.", 7) != 0 || (line[7] != '0' && line[7] != '1') || line[8] != ' '
+       || (request->status = (int) strtol(line + 9, &end, 10)) < 100 || request->status > 999 || (*end != ' ' && *end != '\0')) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    // HTTP/1.1 connections persist unless told otherwise; HTTP/1.0 ones only on request.
+    request->keepAlive = line[7] == '1';
+    request->hasLength = false;
+    request->contentLength = 0;
+
+    bool chunked = false;
+    bool hasRange = false;
+
+    while((line = httpd_next_line(&pos)) != NULL && *line != '\0') {
+        char* name = NULL;
+        char* value = NULL;
+        if(httpd_split_header(line, &name, &value) < 0) {
+            return -1;
+        }
+
+        if(strcasecmp(name, "Content-Length") == 0) {
+            request->contentLength = strtoull(value, &end, 10);
+            if(*value < '0' || *value > '9' || *end != '\0') {
+                errno = EBADMSG;
+                return -1;
+            }
+
+            request->hasLength = true;
+        } else if(strcasecmp(name, "Transfer-Encoding") == 0) {
+            if(strcasecmp(value, "chunked") != 0) {
+                errno = EBADMSG;
+                return -1;
+            }
+
+            chunked = true;
+        } else if(strcasecmp(name, "Connection") == 0) {
+            if(strcasecmp(value, "close") == 0) {
+                request->keepAlive = false;
+            } else if(strcasecmp(value, "keep-alive") == 0) {
+                request->keepAlive = true;
+            }
+        } else if(strcasecmp(name, "Content-Range") == 0 && request->status == 206) {
+            // A partial body must start where it was asked to.
+            if(strncasecmp(value, "bytes ", 6) != 0 || value[6] < '0' || value[6] > '9'
+               || strtoull(value + 6, &end, 10) != request->rangeStart || *end != '-') {
+                errno = EBADMSG;
+                return -1;
+            }
+
+            hasRange = true;
+        }
+    }
+
+    // Without a single range saying where it starts, as with multipart/byteranges, a partial body
+    // can't be placed.
+    if(request->status == 206 && (request->rangeStart == 0 || !hasRange)) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    bool noBody = strcmp(request->method, "HEAD") == 0 || request->status < 200 || request->status == 204 || request->status == 304;
+
+    httpd_request framing;
+    memset(&framing, 0, sizeof(framing));
+    framing.chunked = chunked && !noBody;
+    framing.contentLength = noBody || chunked ? 0 : request->contentLength;
+
+    httpd_body_init(&request->body, &framing);
+
+    request->hasLength = request->hasLength && !chunked;
+    request->untilClose = !noBody && !chunked && !request->hasLength;
+    if(request->untilClose) {
+        request->keepAlive = false;
+        request->body.done = false;
+    }
+
+    return 0;
+}
+
+// Discards the start of a whole body sent in answer to a range request.
+static int httpclient_skip(httpclient_request* request, uint64_t len, int timeoutMs) {
+    if(request->hasLength) {
+        if(request->contentLength < len) {
+            errno = EBADMSG;
+            return -1;
+        }
+
+        request->contentLength -= len;
+    }
+
+    char buf[0x1000];
+    while(len > 0) {
+        size_t size = len < sizeof(buf) ? (size_t) len : sizeof(buf);
+
+        size_t received = 0;
+        if(httpclient_read(request, buf, size, timeoutMs, &received) < 0) {
+            return -1;
+        }
+
+        if(received < size) {
+            errno = EBADMSG;
+            return -1;
+        }
+
+        len -= received;
+    }
+
+    return 0;
+}
+
+int httpclient_read_head(httpclient_request* request, int timeoutMs) {
+    httpclient_conn* conn = request->conn;
+    if(conn == NULL || request->headRead) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for(uint32_t attempt = 0; ; attempt++) {
+        bool started = false;
+        int ret = 0;
+
+        // The connection this was pipelined on has been replaced since, or was closed before it
+        // could be sent.
+        if(conn->socket < 0 || request->generation != conn->generation) {
+            ret = httpclient_transmit(request, timeoutMs);
+        }
+
+        if(ret >= 0) {
+            // Responses come back in request order, so earlier ones must be finished first.
+            if(conn->received != request->seq) {
+                errno = EINVAL;
+                return -1;
+            }
+
+            do {
+                ret = httpclient_read_headers(request, timeoutMs, &started);
+            } while(ret >= 0 && request->status < 200);
+
+            if(ret >= 0) {
+                break;
+            }
+        }
+
+        int err = errno;
+        httpclient_disconnect(conn);
+
+        // A kept-alive connection may have been closed by the server before it saw the request.
+        if(started || !request->reused || attempt > 0) {
+            errno = err;
+            return -1;
+        }
+    }
+
+    request->headRead = true;
+    request->waitMs = (uint32_t) (httpclient_now() - request->sendTime);
+
+    if(request->rangeStart > 0 && request->status == 200) {
+        return httpclient_skip(request, request->rangeStart, timeoutMs);
+    }
+
+    return 0;
+}
+
+int httpclient_read(httpclient_request* request, void* buf, size_t len, int timeoutMs, size_t* received) {
+    *received = 0;
+
+    if(request->conn == NULL || !request->headRead) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(!request->untilClose) {
+        return httpd_body_read_some(request->conn->socket, &request->body, buf, len, timeoutMs, received);
+    }
+
+    if(request->body.done) {
+        return 0;
+    }
+
+    if(net_recv_all_partial(request->conn->socket, buf, len, 0, timeoutMs, received) < 0) {
+        if(errno != ECONNRESET) {
+            return -1;
+        }
+
+        request->body.done = true;
+    }
+
+    return 0;
+}
+
+void httpclient_finish(httpclient_request* request, int timeoutMs) {
+    httpclient_conn* conn = request->conn;
+    if(conn == NULL) {
+        return;
+    }
+
+    bool current = conn->socket >= 0 && request->generation == conn->generation;
+
+    bool reusable = current && request->headRead && request->keepAlive;
+    if(reusable && !request->body.done) {
+        // Only the end of a chunked body may be left to read; anything more would have to be
+        // drained first.
+        reusable = request->body.chunked && request->body.remaining == 0 && httpd_body_finish(conn->socket, &request->body, timeoutMs) >= 0;
+    }
+
+    if(reusable) {
+        conn->received++;
+    } else if(current) {
+        // Requests pipelined behind this one are sent again on a new connection.
+        httpclient_disconnect(conn);
+    }
+
+    conn->pending--;
+
+    request->totalMs = (uint32_t) (httpclient_now() - request->sendTime);
+    request->conn = NULL;
+}
+
+void httpclient_pool_init(httpclient_pool* pool) {
+    memset(pool, 0, sizeof(*pool));
+
+    for(uint32_t i = 0; i < HTTPCLIENT_POOL_MAX; i++) {
+        pool->conns[i].socket = -1;
+    }
+}
+
+void httpclient_pool_close(httpclient_pool* pool) {
+    for(uint32_t i = 0; i < HTTPCLIENT_POOL_MAX; i++) {
+        httpclient_disconnect(&pool->conns[i]);
+    }
+}
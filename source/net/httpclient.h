@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "httpd.h"
+
+// Minimal HTTP/1.1 client for plain http:// URLs that keeps connections alive and reuses them
+// per host. Requests on one connection may be pipelined with httpclient_send_after: several can
+// be sent before any response is read, as long as responses are read in the order their requests
+// were sent. A request whose connection was closed before its response arrived is sent again on
+// a new one. Functions return 0, or -1 with errno set.
+//
+// A pool is not thread-safe. Threads sharing one must serialize httpclient_send,
+// httpclient_send_after and httpclient_finish; reading responses needs no locking.
+
+#define HTTPCLIENT_HOST_MAX 128
+#define HTTPCLIENT_PATH_MAX 1024
+#define HTTPCLIENT_POOL_MAX 4
+
+typedef struct {
+    int socket;
+    char host[HTTPCLIENT_HOST_MAX];
+    uint16_t port;
+
+    // Requests not yet finished, including ones waiting to be sent again. The connection only
+    // goes to other requests once this drops to zero.
+    uint32_t pending;
+
+    // Bumped on every reconnect. Requests are numbered in send order within a generation.
+    uint32_t generation;
+    uint32_t sent;
+    uint32_t received;
+} httpclient_conn;
+
+typedef struct {
+    httpclient_conn conns[HTTPCLIENT_POOL_MAX];
+} httpclient_pool;
+
+typedef struct {
+    httpclient_conn* conn;
+    uint32_t generation;
+    uint32_t seq;
+
+    char method[8];
+    char path[HTTPCLIENT_PATH_MAX];
+
+    // Offset the body was requested from with a Range header, or 0 for the whole body.
+    uint64_t rangeStart;
+
+    int status;
+    bool keepAlive;
+    bool hasLength;
+    uint64_t contentLength;
+
+    // Responses without a length or chunked encoding run until the server closes the connection.
+    bool untilClose;
+    bool headRead;
+    httpd_body body;
+
+    // Timing, in milliseconds. connectMs is 0 on a reused connection; waitMs runs from sending
+    // the request to receiving the response head, and totalMs on to httpclient_finish.
+    bool reused;
+    uint32_t connectMs;
+    uint32_t waitMs;
+    uint32_t totalMs;
+    uint64_t sendTime;
+} httpclient_request;
+
+void httpclient_pool_init(httpclient_pool* pool);
+void httpclient_pool_close(httpclient_pool* pool);
+
+// Returns whether url can be fetched with this client rather than httpc.
+bool httpclient_supports(const char* url);
+
+int httpclient_send(httpclient_pool* pool, const char* method, const char* url, httpclient_request* request, int timeoutMs);
+// Pipelines request behind prev on prev's connection if both go to the same host, and otherwise
+// sends it as httpclient_send does.
+int httpclient_send_after(httpclient_pool* pool, const httpclient_request* prev, const char* method, const char* url, httpclient_request* request, int timeoutMs);
+
+// Sends a GET for the body of url from offset on, to resume a download that broke off. Once the
+// head is read, the body starts at offset and contentLength counts from there, whether the server
+// answered with 206 or ignored the range and sent the whole body with 200.
+int httpclient_send_range(httpclient_pool* pool, const char* url, uint64_t offset, httpclient_request* request, int timeoutMs);
+
+// Downloads that break off are picked up where they stopped, typically with
+// httpclient_send_range, waiting HTTPCLIENT_RESUME_DELAY ms before the first attempt and twice as
+// long before each one after it. The attempts start over once a resumed download makes progress.
+#define HTTPCLIENT_RESUME_ATTEMPTS 5
+#define HTTPCLIENT_RESUME_DELAY 1000
+
+typedef struct {
+    uint32_t attempts;
+    // Offset the attempts were counted from.
+    uint64_t offset;
+} httpclient_retry;
+
+// Sleeps for ms, returning false if cancelled in the meantime.
+typedef bool (*httpclient_wait_func)(void* arg, uint32_t ms);
+// Reopens the download, returning 0 or -1 with errno set.
+typedef int (*httpclient_reopen_func)(void* arg);
+
+// Resumes a download that broke off at offset, calling reopen after each wait until it succeeds
+// or the attempts run out. Fails with ECANCELED if a wait is cancelled, and otherwise with the
+// errno of the last attempt, leaving errno alone if none were left to make.
+int httpclient_resume(httpclient_retry* retry, uint64_t offset, httpclient_wait_func wait, httpclient_reopen_func reopen, void* arg);
+
+// Reads the status line and headers. Interim 1xx responses are skipped.
+int httpclient_read_head(httpclient_request* request, int timeoutMs);
+// Reads up to len bytes of the body, stopping short only at its end.
+int httpclient_read(httpclient_request* request, void* buf, size_t len, int timeoutMs, size_t* received);
+// Hands the connection back to the pool if the body was read to the end and the server keeps it
+// open, and closes it otherwise.
+void httpclient_finish(httpclient_request* request, int timeoutMs);
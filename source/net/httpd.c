@@ -0,0 +1,426 @@
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "net.h"
+#include "httpd.h"
+
+// Chunk size lines and trailers are short; anything longer is treated as malformed.
+#define HTTPD_LINE_MAX 256
+
+bool httpd_is_request(const void* prefix) {
+    return memcmp(prefix, "PUT ", 4) == 0 || memcmp(prefix, "POST", 4) == 0 || memcmp(prefix, "GET ", 4) == 0 || memcmp(prefix, "HEAD", 4) == 0;
+}
+
+typedef size_t (*httpd_find_func)(const char* buf, size_t len, size_t from);
+
+static uint64_t httpd_now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// Finders return the length of buf up to and including the terminator, or 0 if it hasn't arrived;
+// from is where the bytes not yet searched start.
+static size_t httpd_find_line(const char* buf, size_t len, size_t from) {
+    const char* end = (const char*) memchr(buf + from, '\n', len - from);
+    return end != NULL ? (size_t) (end - buf) + 1 : 0;
+}
+
+static size_t httpd_find_head(const char* buf, size_t len, size_t from) {
+    for(size_t i = from > 2 ? from - 2 : 0; i < len; i++) {
+        if(buf[i] == '\n') {
+            if(i + 1 < len && buf[i + 1] == '\n') {
+                return i + 2;
+            }
+
+            if(i + 2 < len && buf[i + 1] == '\r' && buf[i + 2] == '\n') {
+                return i + 3;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Appends to the len bytes already in buf until find sees its terminator, all within one timeout.
+// Whatever is queued is peeked at in one go, and only the bytes up to the terminator are taken, so
+// a body or pipelined response behind it stays on the socket.
+static int httpd_recv_until(int sock, char* buf, size_t size, size_t len, httpd_find_func find, int timeoutMs) {
+    uint64_t deadline = httpd_now() + timeoutMs;
+
+    size_t end = find(buf, len, 0);
+    while(end == 0) {
+        if(len >= size - 1) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+
+        int ret = recv(sock, buf + len, size - 1 - len, MSG_PEEK);
+        if(ret > 0) {
+            end = find(buf, len + ret, len);
+
+            size_t take = end != 0 ? end - len : (size_t) ret;
+            if(net_recv_all(sock, buf + len, take, 0, timeoutMs) < 0) {
+                return -1;
+            }
+
+            len += take;
+        } else if(ret == 0) {
+            errno = ECONNRESET;
+            return -1;
+        } else if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return -1;
+        } else {
+            uint64_t now = httpd_now();
+            if(now >= deadline || (ret = net_wait(sock, POLLIN, (int) (deadline - now))) == 0) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+
+            if(ret < 0) {
+                return -1;
+            }
+        }
+    }
+
+    buf[len] = '\0';
+    return (int) len;
+}
+
+int httpd_read_line(int sock, char* line, size_t size, int timeoutMs) {
+    int len = httpd_recv_until(sock, line, size, 0, httpd_find_line, timeoutMs);
+    if(len < 0) {
+        return -1;
+    }
+
+    line[--len] = '\0';
+    if(len > 0 && line[len - 1] == '\r') {
+        line[--len] = '\0';
+    }
+
+    return len;
+}
+
+int httpd_read_head(int sock, char* head, size_t size, size_t len, int timeoutMs) {
+    return httpd_recv_until(sock, head, size, len, httpd_find_head, timeoutMs);
+}
+
+char* httpd_next_line(char** pos) {
+    char* line = *pos;
+
+    char* end = strchr(line, '\n');
+    if(end == NULL) {
+        return NULL;
+    }
+
+    *pos = end + 1;
+
+    if(end > line && end[-1] == '\r') {
+        end--;
+    }
+
+    *end = '\0';
+    return line;
+}
+
+static char* httpd_trim(char* str) {
+    while(*str == ' ' || *str == '\t') {
+        str++;
+    }
+
+    size_t len = strlen(str);
+    while(len > 0 && (str[len - 1] == ' ' || str[len - 1] == '\t')) {
+        str[--len] = '\0';
+    }
+
+    return str;
+}
+
+static int httpd_parse_request_line(char* line, httpd_request* request) {
+    char* target = strchr(line, ' ');
+    char* version = target != NULL ? strchr(target + 1, ' ') : NULL;
+    if(version == NULL) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    *target++ = '\0';
+    *version++ = '\0';
+
+    if(strlen(line) >= sizeof(request->method) || strlen(target) >= sizeof(request->path)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    strcpy(request->method, line);
+    strcpy(request->path, target);
+
+    // HTTP/1.1 connections persist unless told otherwise; HTTP/1.0 ones only on request.
+    if(strcmp(version, "HTTP/1.1") == 0) {
+        request->keepAlive = true;
+    } else if(strcmp(version, "HTTP/1.0") == 0) {
+        request->keepAlive = false;
+    } else {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    return 0;
+}
+
+int httpd_split_header(char* line, char** name, char** value) {
+    char* colon = strchr(line, ':');
+    if(colon == NULL) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    *colon = '\0';
+
+    *name = httpd_trim(line);
+    *value = httpd_trim(colon + 1);
+    return 0;
+}
+
+static int httpd_parse_header(char* line, httpd_request* request) {
+    char* name = NULL;
+    char* value = NULL;
+    if(httpd_split_header(line, &name, &value) < 0) {
+        return -1;
+    }
+
+    if(strcasecmp(name, "Content-Length") == 0) {
+        char* end = NULL;
+        request->contentLength = strtoull(value, &end, 10);
+        if(*value < '0' || *value > '9' || *end != '\0') {
+            errno = EBADMSG;
+            return -1;
+        }
+
+        request->hasLength = true;
+    } else if(strcasecmp(name, "Transfer-Encoding") == 0) {
+        // No other codings are understood.
+        if(strcasecmp(value, "chunked") != 0) {
+            errno = EBADMSG;
+            return -1;
+        }
+
+        request->chunked = true;
+    } else if(strcasecmp(name, "Connection") == 0) {
+        if(strcasecmp(value, "close") == 0) {
+            request->keepAlive = false;
+        } else if(strcasecmp(value, "keep-alive") == 0) {
+            request->keepAlive = true;
+        }
+    } else if(strcasecmp(name, "Expect") == 0) {
+        request->expectContinue = strcasecmp(value, "100-continue") == 0;
+    }
+
+    return 0;
+}
+
+int httpd_read_request(int sock, const char* prefix, size_t prefixLen, httpd_request* request, int timeoutMs) {
+    memset(request, 0, sizeof(*request));
+
+    char head[HTTPD_HEAD_MAX];
+    if(prefixLen >= sizeof(head)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    memcpy(head, prefix, prefixLen);
+
+    if(httpd_read_head(sock, head, sizeof(head), prefixLen, timeoutMs) < 0) {
+        return -1;
+    }
+
+    char* pos = head;
+    char* line = httpd_next_line(&pos);
+    if(httpd_parse_request_line(line, request) < 0) {
+        return -1;
+    }
+
+    while((line = httpd_next_line(&pos)) != NULL && *line != '\0') {
+        if(httpd_parse_header(line, request) < 0) {
+            return -1;
+        }
+    }
+
+    // The chunked framing wins over any length sent alongside it.
+    if(request->chunked) {
+        request->hasLength = false;
+        request->contentLength = 0;
+    }
+
+    return 0;
+}
+
+void httpd_body_init(httpd_body* body, const httpd_request* request) {
+    body->chunked = request->chunked;
+    body->started = false;
+    body->remaining = request->chunked ? 0 : request->contentLength;
+    body->done = !request->chunked && request->contentLength == 0;
+}
+
+// Chunk sizes are bare hex digits; strtoull would also take leading space, a sign or a 0x prefix.
+// Chunk extensions after ';' are ignored.
+static int httpd_parse_chunk_size(const char* line, uint64_t* size) {
+    const char* c = line;
+
+    *size = 0;
+    for(; isxdigit((unsigned char) *c); c++) {
+        if(*size > UINT64_MAX >> 4) {
+            errno = EBADMSG;
+            return -1;
+        }
+
+        *size = (*size << 4) | (uint64_t) (*c <= '9' ? *c - '0' : (*c | 0x20) - 'a' + 10);
+    }
+
+    while(*c == ' ' || *c == '\t') {
+        c++;
+    }
+
+    if(c == line || (*c != '\0' && *c != ';')) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int httpd_body_next_chunk(int sock, httpd_body* body, int timeoutMs) {
+    char line[HTTPD_LINE_MAX];
+
+    // Every chunk but the first follows the CRLF that ends the data of the one before.
+    if(body->started) {
+        int len = httpd_read_line(sock, line, sizeof(line), timeoutMs);
+        if(len != 0) {
+            if(len > 0) {
+                errno = EBADMSG;
+            }
+
+            return -1;
+        }
+    }
+
+    body->started = true;
+
+    if(httpd_read_line(sock, line, sizeof(line), timeoutMs) < 0) {
+        return -1;
+    }
+
+    uint64_t size = 0;
+    if(httpd_parse_chunk_size(line, &size) < 0) {
+        return -1;
+    }
+
+    if(size == 0) {
+        int len = 0;
+        while((len = httpd_read_line(sock, line, sizeof(line), timeoutMs)) != 0) {
+            if(len < 0) {
+                return -1;
+            }
+        }
+
+        body->done = true;
+    }
+
+    body->remaining = size;
+    return 0;
+}
+
+int httpd_body_read_some(int sock, httpd_body* body, void* buf, size_t len, int timeoutMs, size_t* received) {
+    *received = 0;
+
+    while(*received < len) {
+        if(body->remaining == 0) {
+            if(!body->chunked || body->done) {
+                break;
+            }
+
+            if(httpd_body_next_chunk(sock, body, timeoutMs) < 0) {
+                return -1;
+            }
+
+            continue;
+        }
+
+        size_t n = len - *received;
+        if(n > body->remaining) {
+            n = (size_t) body->remaining;
+        }
+
+        size_t got = 0;
+        int ret = net_recv_all_partial(sock, (char*) buf + *received, n, 0, timeoutMs, &got);
+
+        *received += got;
+        body->remaining -= got;
+
+        if(ret < 0) {
+            return -1;
+        }
+    }
+
+    if(!body->chunked) {
+        body->done = body->remaining == 0;
+    }
+
+    return 0;
+}
+
+int httpd_body_read(int sock, httpd_body* body, void* buf, size_t len, int timeoutMs, size_t* received) {
+    if(httpd_body_read_some(sock, body, buf, len, timeoutMs, received) < 0) {
+        return -1;
+    }
+
+    if(*received < len) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    return 0;
+}
+
+int httpd_body_finish(int sock, httpd_body* body, int timeoutMs) {
+    if(!body->done && body->chunked && body->remaining == 0 && httpd_body_next_chunk(sock, body, timeoutMs) < 0) {
+        return -1;
+    }
+
+    if(!body->done) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    return 0;
+}
+
+int httpd_send_continue(int sock, int timeoutMs) {
+    static const char response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    return net_send_all(sock, response, sizeof(response) - 1, 0, timeoutMs) < 0 ? -1 : 0;
+}
+
+int httpd_send_json(int sock, int status, const char* reason, const char* headers, const char* json, bool keepAlive, int timeoutMs) {
+    char head[512];
+    int headLen = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\n%sContent-Type: application/json\r\nContent-Length: %lu\r\nConnection: %s\r\n\r\n",
+                           status, reason, headers != NULL ? headers : "", (unsigned long) strlen(json), keepAlive ? "keep-alive" : "close");
+
+    if(headLen < 0 || (size_t) headLen >= sizeof(head)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if(net_send_all(sock, head, (size_t) headLen, 0, timeoutMs) < 0 || net_send_all(sock, json, strlen(json), 0, timeoutMs) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal HTTP/1.1 server side, for clients that push files with PUT or POST. Bodies may be sent
+// with Content-Length or chunked transfer encoding. Functions return 0, or -1 with errno set;
+// malformed requests fail with EBADMSG and oversized heads with EMSGSIZE. The line and body
+// readers are shared with httpclient, which parses responses the same way.
+
+#define HTTPD_HEAD_MAX 4096
+#define HTTPD_PATH_MAX 256
+
+typedef struct {
+    char method[8];
+    char path[HTTPD_PATH_MAX];
+
+    bool keepAlive;
+    bool expectContinue;
+
+    bool chunked;
+    bool hasLength;
+    uint64_t contentLength;
+} httpd_request;
+
+typedef struct {
+    bool chunked;
+    bool started;
+
+    // Bytes left in the body, or in the current chunk of a chunked body.
+    uint64_t remaining;
+    bool done;
+} httpd_body;
+
+// Reads a line, taking nothing past it from the socket, and strips the CRLF. Returns the line's
+// length.
+int httpd_read_line(int sock, char* line, size_t size, int timeoutMs);
+// Reads a whole message head into head, after the len bytes of it already there, with timeoutMs
+// covering all of it; nothing past the blank line that ends it is taken from the socket. The head
+// is NUL-terminated, and its length returned.
+int httpd_read_head(int sock, char* head, size_t size, size_t len, int timeoutMs);
+// Returns the line of a head read by httpd_read_head that pos points at, with its CRLF stripped,
+// and moves pos to the next one. The blank line ending the head comes back empty.
+char* httpd_next_line(char** pos);
+// Splits a header line in place into its trimmed name and value.
+int httpd_split_header(char* line, char** name, char** value);
+
+// Returns whether the first four bytes of a connection look like the start of an HTTP request.
+bool httpd_is_request(const void* prefix);
+
+// Reads a request head; prefix holds the bytes of it already taken from the socket.
+int httpd_read_request(int sock, const char* prefix, size_t prefixLen, httpd_request* request, int timeoutMs);
+
+void httpd_body_init(httpd_body* body, const httpd_request* request);
+// Reads exactly len bytes of the body, keeping received updated as net_recv_all_partial does.
+// Fails with EBADMSG if the body ends first.
+int httpd_body_read(int sock, httpd_body* body, void* buf, size_t len, int timeoutMs, size_t* received);
+// As httpd_body_read, but stops early, without failing, if the body ends first.
+int httpd_body_read_some(int sock, httpd_body* body, void* buf, size_t len, int timeoutMs, size_t* received);
+// Consumes the end of the body, which must hold no more data, along with any chunked trailers.
+int httpd_body_finish(int sock, httpd_body* body, int timeoutMs);
+
+int httpd_send_continue(int sock, int timeoutMs);
+// Sends a response with a JSON body; reason is the status line's reason phrase, and headers, if not
+// NULL, holds extra CRLF-terminated header lines.
+int httpd_send_json(int sock, int status, const char* reason, const char* headers, const char* json, bool keepAlive, int timeoutMs);
\ No newline at end of file
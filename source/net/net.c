@@ -0,0 +1,80 @@
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "net.h"
+
+int net_wait(int sockfd, short events, int timeoutMs) {
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = events;
+    pfd.revents = 0;
+
+    int ret = 0;
+    while((ret = poll(&pfd, 1, timeoutMs)) < 0 && errno == EINTR) {
+    }
+
+    if(ret > 0 && (pfd.revents & (events | POLLHUP | POLLERR | POLLNVAL)) == 0) {
+        ret = 0;
+    }
+
+    return ret;
+}
+
+// Readiness is only awaited after an attempt fails with EAGAIN, so data that is already buffered
+// costs no extra poll() call.
+static int net_wait_again(int sockfd, short events, int timeoutMs) {
+    if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        return -1;
+    }
+
+    int ret = net_wait(sockfd, events, timeoutMs);
+    if(ret == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    return ret < 0 ? -1 : 0;
+}
+
+int net_recv_all(int sockfd, void* buf, size_t len, int flags, int timeoutMs) {
+    size_t received;
+    return net_recv_all_partial(sockfd, buf, len, flags, timeoutMs, &received);
+}
+
+int net_recv_all_partial(int sockfd, void* buf, size_t len, int flags, int timeoutMs, size_t* received) {
+    size_t read = 0;
+    *received = 0;
+
+    while(read < len) {
+        int ret = recv(sockfd, (char*) buf + read, len - read, flags);
+        if(ret > 0) {
+            read += ret;
+            *received = read;
+        } else if(ret == 0) {
+            errno = ECONNRESET;
+            return -1;
+        } else if(net_wait_again(sockfd, POLLIN, timeoutMs) < 0) {
+            return -1;
+        }
+    }
+
+    return (int) read;
+}
+
+int net_send_all(int sockfd, const void* buf, size_t len, int flags, int timeoutMs) {
+    size_t written = 0;
+    while(written < len) {
+        int ret = send(sockfd, (const char*) buf + written, len - written, flags);
+        if(ret > 0) {
+            written += ret;
+        } else if(ret == 0) {
+            errno = ECONNRESET;
+            return -1;
+        } else if(net_wait_again(sockfd, POLLOUT, timeoutMs) < 0) {
+            return -1;
+        }
+    }
+
+    return (int) written;
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+// Whole-buffer socket I/O that sleeps in poll() until the socket is ready instead of spinning on
+// EAGAIN. Works on blocking and non-blocking sockets alike. Each call fails with errno set to
+// ETIMEDOUT once timeoutMs pass without any progress (a negative timeout waits forever), and
+// with ECONNRESET if the peer closes the connection before len bytes were received.
+
+// Returns 1 once the socket is ready for events, 0 on timeout, or -1 on error.
+int net_wait(int sockfd, short events, int timeoutMs);
+
+// Returns len, or -1 with errno set.
+int net_recv_all(int sockfd, void* buf, size_t len, int flags, int timeoutMs);
+int net_send_all(int sockfd, const void* buf, size_t len, int flags, int timeoutMs);
+
+// As net_recv_all, but keeps received updated with the bytes stored so far, including on failure.
+int net_recv_all_partial(int sockfd, void* buf, size_t len, int flags, int timeoutMs, size_t* received);
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "netconfig.h"
+
+static netconfig config = {
+    .socBufferSize = 0x100000,
+    .recvBufferSize = 1024 * 32,
+    .sendBufferSize = 1024 * 32,
+    .chunkSize = 1024 * 128,
+    .bufferCount = 0,
+    .cdnCacheSize = 1024
+};
+
+static void netconfig_set(uint32_t* field, const char* value, uint32_t min, uint32_t max) {
+    char* end = NULL;
+    unsigned long parsed = strtoul(value, &end, 0);
+    if(end != value && *end == '\0' && parsed >= min && parsed <= max) {
+        *field = (uint32_t) parsed;
+    }
+}
+
+void netconfig_load() {
+    FILE* fd = fopen(NETCONFIG_PATH, "r");
+    if(fd == NULL) {
+        return;
+    }
+
+    char line[128];
+    while(fgets(line, sizeof(line), fd) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char* equals = strchr(line, '=');
+        if(equals == NULL) {
+            continue;
+        }
+
+        *equals = '\0';
+
+        const char* key = line;
+        const char* value = equals + 1;
+
+        if(strcasecmp(key, "socbuffer") == 0) {
+            netconfig_set(&config.socBufferSize, value, 0x20000, 0x800000);
+        } else if(strcasecmp(key, "recvbuffer") == 0) {
+            netconfig_set(&config.recvBufferSize, value, 0x1000, 0x100000);
+        } else if(strcasecmp(key, "sendbuffer") == 0) {
+            netconfig_set(&config.sendBufferSize, value, 0x1000, 0x100000);
+        } else if(strcasecmp(key, "chunksize") == 0) {
+            netconfig_set(&config.chunkSize, value, 0x10000, 0x100000);
+        } else if(strcasecmp(key, "buffercount") == 0) {
+            netconfig_set(&config.bufferCount, value, 2, 8);
+        } else if(strcasecmp(key, "cdncache") == 0) {
+            netconfig_set(&config.cdnCacheSize, value, 0, 0x10000);
+        }
+    }
+
+    fclose(fd);
+
+    // SOC takes whole pages.
+    config.socBufferSize = (config.socBufferSize + 0xFFF) & ~0xFFF;
+}
+
+const netconfig* netconfig_get() {
+    return &config;
+}
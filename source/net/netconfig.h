@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// Network tuning, read once at startup from NETCONFIG_PATH. The file holds key=value lines, with
+// sizes in bytes (decimal, or hex with 0x); unknown keys are ignored and missing or out of range
+// values keep their defaults.
+//
+//   socbuffer   - memory handed to the SOC service, rounded up to a page
+//   recvbuffer  - SO_RCVBUF of network install sockets
+//   sendbuffer  - SO_SNDBUF of sockets that send dumps and files
+//   chunksize   - bytes each network install read waits for before handing them to AM
+//   buffercount - transfer buffers a network install keeps in flight
+//   cdncache    - MiB of SD space kept for CDN contents already downloaded, or 0 to turn it off
+
+#define NETCONFIG_PATH "sdmc:/fbi/network.cfg"
+
+typedef struct {
+    uint32_t socBufferSize;
+    uint32_t recvBufferSize;
+    uint32_t sendBufferSize;
+    uint32_t chunkSize;
+    uint32_t bufferCount;
+    uint32_t cdnCacheSize;
+} netconfig;
+
+void netconfig_load();
+const netconfig* netconfig_get();
@@ -0,0 +1,211 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lz/lz.h"
+#include "net.h"
+#include "netinstall.h"
+
+// Converts between host and big-endian order, in either direction.
+static uint64_t netinstall_be64(uint64_t value) {
+    uint8_t bytes[8];
+    for(int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t) (value >> (56 - i * 8));
+    }
+
+    uint64_t result;
+    memcpy(&result, bytes, sizeof(result));
+    return result;
+}
+
+static int netinstall_bad_message() {
+    errno = EBADMSG;
+    return -1;
+}
+
+static int netinstall_read_entries(int sock, netinstall_session* session, int timeoutMs) {
+    if(session->fileCount == 0 || session->fileCount > NETINSTALL_FILES_MAX) {
+        return netinstall_bad_message();
+    }
+
+    if((session->files = (netinstall_file*) calloc(session->fileCount, sizeof(netinstall_file))) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    uint64_t totalSize = 0;
+    for(uint32_t i = 0; i < session->fileCount; i++) {
+        netinstall_file* file = &session->files[i];
+
+        netinstall_entry entry;
+        if(net_recv_all(sock, &entry, sizeof(entry), 0, timeoutMs) < 0) {
+            return -1;
+        }
+
+        uint32_t nameLength = ntohl(entry.nameLength);
+        if(nameLength > NETINSTALL_NAME_MAX) {
+            return netinstall_bad_message();
+        }
+
+        if(net_recv_all(sock, file->name, nameLength, 0, timeoutMs) < 0) {
+            return -1;
+        }
+
+        file->name[nameLength] = '\0';
+
+        file->size = netinstall_be64(entry.size);
+        file->hash = netinstall_be64(entry.hash);
+        file->flags = ntohl(entry.flags);
+
+        if((file->flags & NETINSTALL_ENTRY_LZ) && !(session->flags & NETINSTALL_CAP_LZ)) {
+            return netinstall_bad_message();
+        }
+
+        totalSize += file->size;
+    }
+
+    return totalSize == session->totalSize ? 0 : netinstall_bad_message();
+}
+
+static int netinstall_read_body(int sock, netinstall_session* session, uint32_t capabilities, int timeoutMs) {
+    uint32_t version = 0;
+    if(net_recv_all(sock, &version, sizeof(version), 0, timeoutMs) < 0) {
+        return -1;
+    }
+
+    session->version = ntohl(version) < NETINSTALL_VERSION ? ntohl(version) : NETINSTALL_VERSION;
+    if(session->version < 2) {
+        return netinstall_bad_message();
+    }
+
+    netinstall_hello_reply reply;
+    reply.magic = htonl(NETINSTALL_MAGIC);
+    reply.version = htonl(session->version);
+    reply.capabilities = htonl(capabilities);
+    reply.maxStreams = htonl(NETINSTALL_STREAMS_MAX);
+
+    netinstall_manifest manifest;
+    if(net_send_all(sock, &reply, sizeof(reply), 0, timeoutMs) < 0 || net_recv_all(sock, &manifest, sizeof(manifest), 0, timeoutMs) < 0) {
+        return -1;
+    }
+
+    session->flags = ntohl(manifest.flags);
+    session->fileCount = ntohl(manifest.fileCount);
+    session->totalSize = netinstall_be64(manifest.totalSize);
+
+    uint32_t knownFlags = capabilities | NETINSTALL_MANIFEST_RESUME | NETINSTALL_MANIFEST_BENCHMARK | NETINSTALL_MANIFEST_STREAMS_MASK;
+    if((session->flags & ~knownFlags) != 0) {
+        return netinstall_bad_message();
+    }
+
+    uint32_t streams = NETINSTALL_MANIFEST_GET_STREAMS(session->flags);
+    if(streams > NETINSTALL_STREAMS_MAX || (streams > 1 && !(session->flags & NETINSTALL_CAP_STREAMS))) {
+        return netinstall_bad_message();
+    }
+
+    // Reconnections and extra streams only name the session they belong to; the install still
+    // holds the manifest.
+    if(session->flags & NETINSTALL_MANIFEST_RESUME) {
+        uint64_t token = 0;
+        if(net_recv_all(sock, &token, sizeof(token), 0, timeoutMs) < 0) {
+            return -1;
+        }
+
+        session->resume = true;
+        session->token = netinstall_be64(token);
+        session->stream = session->fileCount;
+        session->fileCount = 0;
+        session->totalSize = 0;
+
+        return session->token != 0 && session->stream < NETINSTALL_STREAMS_MAX ? 0 : netinstall_bad_message();
+    }
+
+    return netinstall_read_entries(sock, session, timeoutMs);
+}
+
+int netinstall_read_manifest(int sock, netinstall_session* session, uint32_t capabilities, int timeoutMs) {
+    session->files = NULL;
+
+    if(netinstall_read_body(sock, session, capabilities, timeoutMs) < 0) {
+        int err = errno;
+        free(session->files);
+        session->files = NULL;
+        errno = err;
+
+        return -1;
+    }
+
+    return 0;
+}
+
+int netinstall_send_frame(int sock, uint32_t type, uint32_t index, uint64_t value, int timeoutMs) {
+    netinstall_frame frame;
+    frame.type = htonl(type);
+    frame.index = htonl(index);
+    frame.value = netinstall_be64(value);
+
+    return net_send_all(sock, &frame, sizeof(frame), 0, timeoutMs) < 0 ? -1 : 0;
+}
+
+int netinstall_send_ack(int sock, bool more, int timeoutMs) {
+    uint8_t ack = more ? 1 : 0;
+    return net_send_all(sock, &ack, sizeof(ack), 0, timeoutMs) < 0 ? -1 : 0;
+}
+
+int netinstall_recv_size(int sock, uint64_t* size, int timeoutMs) {
+    uint64_t netSize = 0;
+    if(net_recv_all(sock, &netSize, sizeof(netSize), 0, timeoutMs) < 0) {
+        return -1;
+    }
+
+    *size = netinstall_be64(netSize);
+    return 0;
+}
+
+static uint32_t netinstall_unit_size(uint32_t flags) {
+    return (flags & NETINSTALL_ENTRY_LZ) ? NETINSTALL_BLOCK_SIZE : NETINSTALL_STRIPE_SIZE;
+}
+
+uint32_t netinstall_unit_stream(uint64_t pos, uint32_t flags, uint32_t streams) {
+    return streams > 1 ? (uint32_t) ((pos / netinstall_unit_size(flags)) % streams) : 0;
+}
+
+uint32_t netinstall_unit_span(uint64_t pos, uint32_t len, uint32_t flags, uint32_t streams) {
+    if(streams <= 1 && !(flags & NETINSTALL_ENTRY_LZ)) {
+        return len;
+    }
+
+    uint32_t left = netinstall_unit_size(flags) - (uint32_t) (pos % netinstall_unit_size(flags));
+    return len < left ? len : left;
+}
+
+int netinstall_recv_block(int sock, void* dst, uint32_t size, void* packed, bool* compressed, int timeoutMs) {
+    uint32_t header = 0;
+    if(net_recv_all(sock, &header, sizeof(header), 0, timeoutMs) < 0) {
+        return -1;
+    }
+
+    header = ntohl(header);
+
+    uint32_t storedSize = header & ~NETINSTALL_BLOCK_LZ;
+    bool lz = (header & NETINSTALL_BLOCK_LZ) != 0;
+
+    if(lz ? storedSize > NETINSTALL_BLOCK_SIZE : storedSize != size) {
+        return netinstall_bad_message();
+    }
+
+    if(net_recv_all(sock, lz ? packed : dst, storedSize, 0, timeoutMs) < 0) {
+        return -1;
+    }
+
+    if(lz && lz_decompress((const uint8_t*) packed, storedSize, (uint8_t*) dst, size) != (int32_t) size) {
+        return netinstall_bad_message();
+    }
+
+    if(compressed != NULL) {
+        *compressed = lz;
+    }
+
+    return 0;
+}
\ No newline at end of file
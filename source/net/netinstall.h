@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "httpd.h"
+
+// Network install protocol, shared with tools/fbisend.c. All integers are big-endian.
+//
+// Version 1: the sender writes a u32 file count. For each file, the device writes a one byte
+// ack (1) once it is ready, and the sender replies with a u64 size and the file contents. The
+// device writes a final 0 ack when done, or instead of the first ack if the user declines.
+//
+// Version 2: the sender writes a netinstall_hello, and the device answers with its own hello
+// and the capabilities it supports. Since "FBI2" is never a sensible v1 file count, devices
+// tell the versions apart from the first word; a sender that gets no hello back should
+// reconnect and speak v1. The sender then writes a netinstall_manifest followed by one
+// netinstall_entry and its name per file. Once the user accepts (or declines), the device
+// writes an ACCEPT (or REJECT) frame, after which the sender streams every file back to back
+// without waiting. The device reports PROGRESS, FILE_DONE and ERROR frames as it installs,
+// and ends the session with a DONE frame. Files flagged NETINSTALL_ENTRY_HASH are hashed as they
+// are written and fail with an ERROR frame, instead of being committed, if the hash differs.
+//
+// The same port also takes plain HTTP/1.1 uploads (source/net/httpd.h), told apart by the request
+// method in the first word: a PUT or POST body, sent with Content-Length or chunked encoding, is
+// installed as one file and answered with a JSON status. Keep-alive connections may send more.
+//
+// Capabilities are offered by the device in its hello and picked by the sender in the manifest
+// flags. With NETINSTALL_CAP_LZ, files flagged NETINSTALL_ENTRY_LZ are sent as a series of blocks,
+// each a u32 header (NETINSTALL_BLOCK_LZ if the payload is compressed with source/lz, and the
+// payload size) and the payload. Every block but the last of a file holds NETINSTALL_BLOCK_SIZE
+// bytes once unpacked, and stored blocks are never larger than that. Senders should leave files
+// that do not shrink uncompressed.
+//
+// With NETINSTALL_CAP_RESUME, the ACCEPT frame carries a session token. If the connection drops
+// mid-install, the device keeps the install open for a grace period. A sender may reconnect,
+// exchange hellos and send a manifest flagged NETINSTALL_MANIFEST_RESUME with no entries, a
+// fileCount of 0 and the u64 token after it. Once the device notices the old connection is gone,
+// it answers with a RESUME frame naming the file and unpacked offset to continue from, which for
+// compressed files is always the start of a block.
+//
+// With NETINSTALL_CAP_STREAMS, a sender may ask for up to maxStreams connections by setting
+// NETINSTALL_MANIFEST_STREAMS. Once accepted, it opens the extra streams the same way as a
+// resume, with fileCount set to the stream index. Each file is then cut into units, every block
+// of a compressed file or NETINSTALL_STRIPE_SIZE bytes of any other file, and unit n of a file
+// travels on stream n % streams. Frames only use the first stream. After a resume, the install
+// carries on over the resumed stream alone.
+//
+// Manifests flagged NETINSTALL_MANIFEST_BENCHMARK are received and thrown away without asking
+// the user, to measure throughput.
+
+#define NETINSTALL_PORT 5000
+
+#define NETINSTALL_MAGIC 0x46424932 // "FBI2"
+#define NETINSTALL_VERSION 2
+
+#define NETINSTALL_FILES_MAX 1024
+#define NETINSTALL_NAME_MAX 255
+
+// Capabilities.
+#define NETINSTALL_CAP_LZ 0x1
+#define NETINSTALL_CAP_RESUME 0x2
+#define NETINSTALL_CAP_STREAMS 0x4
+
+#define NETINSTALL_STREAMS_MAX 4
+#define NETINSTALL_STRIPE_SIZE (16 * 1024)
+
+// Manifest flags, besides the chosen capabilities.
+#define NETINSTALL_MANIFEST_RESUME 0x80000000
+#define NETINSTALL_MANIFEST_BENCHMARK 0x40000000
+#define NETINSTALL_MANIFEST_STREAMS_SHIFT 8
+#define NETINSTALL_MANIFEST_STREAMS(streams) (((uint32_t) (streams) - 1) << NETINSTALL_MANIFEST_STREAMS_SHIFT)
+#define NETINSTALL_MANIFEST_STREAMS_MASK NETINSTALL_MANIFEST_STREAMS(16)
+#define NETINSTALL_MANIFEST_GET_STREAMS(flags) ((((flags) & NETINSTALL_MANIFEST_STREAMS_MASK) >> NETINSTALL_MANIFEST_STREAMS_SHIFT) + 1)
+
+#define NETINSTALL_BLOCK_SIZE (64 * 1024)
+#define NETINSTALL_BLOCK_LZ 0x80000000
+
+// Entry flags.
+#define NETINSTALL_ENTRY_HASH 0x1 // hash holds the hash64 of the file contents.
+#define NETINSTALL_ENTRY_LZ 0x2 // The file is sent as blocks; size is the unpacked size.
+
+typedef enum {
+    NETINSTALL_FRAME_ACCEPT = 1, // value: session token, with NETINSTALL_CAP_RESUME.
+    NETINSTALL_FRAME_REJECT = 2,
+    NETINSTALL_FRAME_PROGRESS = 3, // value: bytes installed so far, across all files.
+    NETINSTALL_FRAME_FILE_DONE = 4,
+    NETINSTALL_FRAME_ERROR = 5, // value: result code; the sender should stop sending.
+    NETINSTALL_FRAME_DONE = 6, // value: 1 if the session ended early.
+    NETINSTALL_FRAME_RESUME = 7 // index: file to continue with; value: offset into it.
+} netinstall_frame_type;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} netinstall_hello;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capabilities;
+    uint32_t maxStreams;
+} netinstall_hello_reply;
+
+typedef struct {
+    uint32_t flags;
+    uint32_t fileCount;
+    uint64_t totalSize;
+} netinstall_manifest;
+
+typedef struct {
+    uint64_t size;
+    uint64_t hash;
+    uint32_t flags;
+    uint32_t nameLength;
+} netinstall_entry;
+
+typedef struct {
+    uint32_t type;
+    uint32_t index;
+    uint64_t value;
+} netinstall_frame;
+
+// Device side, shared with tools/fbisend_test.c. Functions return 0, or -1 with errno set;
+// anything the protocol doesn't allow fails with EBADMSG.
+
+typedef struct {
+    char name[NETINSTALL_NAME_MAX + 1];
+    uint64_t size;
+    uint64_t hash;
+    uint32_t flags;
+} netinstall_file;
+
+typedef struct {
+    int socket;
+    uint32_t address;
+
+    // Protocol version. Version 1 sessions have no manifest; files is NULL. Version 0 is an HTTP
+    // upload of the single file in files, with its body still to be read from socket.
+    uint32_t version;
+    uint32_t flags;
+
+    // Set when the sender is reconnecting stream 0, or attaching another stream, to the
+    // install identified by token.
+    bool resume;
+    uint64_t token;
+    uint32_t stream;
+
+    uint32_t fileCount;
+    uint64_t totalSize;
+    netinstall_file* files;
+
+    httpd_request request;
+} netinstall_session;
+
+// Reads the rest of a version 2 hello, whose magic has already been taken from the socket,
+// answers it offering capabilities, and reads the manifest and entries that follow into session.
+// Resumes and extra streams fill in token and stream instead of files. On failure, files is
+// left NULL.
+int netinstall_read_manifest(int sock, netinstall_session* session, uint32_t capabilities, int timeoutMs);
+int netinstall_send_frame(int sock, uint32_t type, uint32_t index, uint64_t value, int timeoutMs);
+
+// Version 1: asks for the next file, or ends the session if more is false, and reads the size
+// the sender answers with.
+int netinstall_send_ack(int sock, bool more, int timeoutMs);
+int netinstall_recv_size(int sock, uint64_t* size, int timeoutMs);
+
+// Returns the stream carrying the byte at pos of a file sent with the given entry flags.
+uint32_t netinstall_unit_stream(uint64_t pos, uint32_t flags, uint32_t streams);
+// Returns how many of the len bytes from pos can be read in one go: up to the end of the unit,
+// or all of them if an uncompressed file is sent over a single stream.
+uint32_t netinstall_unit_span(uint64_t pos, uint32_t len, uint32_t flags, uint32_t streams);
+// Reads the block holding the next size bytes of a NETINSTALL_ENTRY_LZ file into dst. packed
+// holds NETINSTALL_BLOCK_SIZE bytes, and compressed, if not NULL, is set to whether the block
+// was.
+int netinstall_recv_block(int sock, void* dst, uint32_t size, void* packed, bool* compressed, int timeoutMs);
\ No newline at end of file
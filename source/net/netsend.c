@@ -0,0 +1,240 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "net.h"
+#include "netconfig.h"
+#include "netsend.h"
+
+// How often discovery wakes up to check for cancellation.
+#define NETSEND_POLL_INTERVAL 100
+
+#define NETSEND_TIMEOUT 30000
+
+// Converts between host and big-endian order, in either direction.
+static uint64_t netsend_be64(uint64_t value) {
+    uint8_t bytes[8];
+    for(int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t) (value >> (56 - i * 8));
+    }
+
+    uint64_t result;
+    memcpy(&result, bytes, sizeof(result));
+    return result;
+}
+
+int netsend_discover(netsend_receiver* receiver, int timeoutMs, bool (*cancelled)(void* data), void* data) {
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if(sock < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(NETSEND_PORT);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if(bind(sock, (struct sockaddr*) &local, sizeof(local)) < 0) {
+        int err = errno;
+        close(sock);
+        errno = err;
+        return -1;
+    }
+
+    int ret = -1;
+    errno = ETIMEDOUT;
+
+    for(int waited = 0; waited < timeoutMs; waited += NETSEND_POLL_INTERVAL) {
+        if(cancelled != NULL && cancelled(data)) {
+            errno = ECANCELED;
+            break;
+        }
+
+        int ready = net_wait(sock, POLLIN, NETSEND_POLL_INTERVAL);
+        if(ready < 0) {
+            break;
+        } else if(ready == 0) {
+            continue;
+        }
+
+        netsend_beacon beacon;
+        struct sockaddr_in source;
+        socklen_t addrLen = sizeof(source);
+        if(recvfrom(sock, &beacon, sizeof(beacon), 0, (struct sockaddr*) &source, &addrLen) == sizeof(beacon)
+           && ntohl(beacon.magic) == NETSEND_MAGIC && ntohl(beacon.version) == NETSEND_VERSION && ntohl(beacon.port) <= 0xFFFF
+           && ntohl(beacon.code) < NETSEND_CODE_MAX) {
+            receiver->address = source.sin_addr.s_addr;
+            receiver->port = (uint16_t) ntohl(beacon.port);
+            receiver->code = ntohl(beacon.code);
+
+            ret = 0;
+            break;
+        }
+    }
+
+    int err = errno;
+    close(sock);
+    errno = err;
+
+    return ret;
+}
+
+static int netsend_recv_status(netsend_conn* conn, int timeoutMs) {
+    uint32_t status = 0;
+    if(net_recv_all(conn->socket, &status, sizeof(status), 0, timeoutMs) < 0) {
+        return -1;
+    }
+
+    switch(ntohl(status)) {
+        case NETSEND_STATUS_OK:
+            return 0;
+        case NETSEND_STATUS_BAD_NAME:
+            errno = EINVAL;
+            break;
+        case NETSEND_STATUS_HASH_MISMATCH:
+            errno = EBADMSG;
+            break;
+        case NETSEND_STATUS_ABORTED:
+            errno = ECANCELED;
+            break;
+        default:
+            errno = EIO;
+            break;
+    }
+
+    return -1;
+}
+
+static int netsend_send_entry(netsend_conn* conn, netsend_entry_type type, const char* name, uint64_t size) {
+    size_t nameLength = name != NULL ? strlen(name) : 0;
+    if(nameLength > NETSEND_NAME_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    netsend_entry entry;
+    entry.type = htonl(type);
+    entry.nameLength = htonl((uint32_t) nameLength);
+    entry.size = netsend_be64(size);
+
+    if(net_send_all(conn->socket, &entry, sizeof(entry), 0, NETSEND_TIMEOUT) < 0
+       || (nameLength > 0 && net_send_all(conn->socket, name, nameLength, 0, NETSEND_TIMEOUT) < 0)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int netsend_open(netsend_conn* conn, const netsend_receiver* receiver) {
+    conn->socket = -1;
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(receiver->port);
+    address.sin_addr.s_addr = receiver->address;
+
+    if((conn->socket = socket(AF_INET, SOCK_STREAM, IPPROTO_IP)) < 0) {
+        return -1;
+    }
+
+    int bufSize = (int) netconfig_get()->sendBufferSize;
+    setsockopt(conn->socket, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+
+    netsend_hello hello;
+    hello.magic = htonl(NETSEND_MAGIC);
+    hello.version = htonl(NETSEND_VERSION);
+
+    netsend_hello reply;
+
+    int ret = -1;
+    if(connect(conn->socket, (struct sockaddr*) &address, sizeof(address)) >= 0
+       && net_send_all(conn->socket, &hello, sizeof(hello), 0, NETSEND_TIMEOUT) >= 0
+       && net_recv_all(conn->socket, &reply, sizeof(reply), 0, NETSEND_TIMEOUT) >= 0) {
+        if(ntohl(reply.magic) == NETSEND_MAGIC && ntohl(reply.version) == NETSEND_VERSION) {
+            ret = 0;
+        } else {
+            errno = EPROTO;
+        }
+    }
+
+    if(ret < 0) {
+        int err = errno;
+
+        close(conn->socket);
+        conn->socket = -1;
+
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+void netsend_close(netsend_conn* conn, int timeoutMs) {
+    if(conn->socket < 0) {
+        return;
+    }
+
+    netsend_entry entry;
+    entry.type = htonl(NETSEND_ENTRY_END);
+    entry.nameLength = 0;
+    entry.size = 0;
+
+    if(net_send_all(conn->socket, &entry, sizeof(entry), 0, timeoutMs) >= 0) {
+        netsend_recv_status(conn, timeoutMs);
+    }
+
+    close(conn->socket);
+    conn->socket = -1;
+}
+
+int netsend_send_directory(netsend_conn* conn, const char* name) {
+    if(netsend_send_entry(conn, NETSEND_ENTRY_DIRECTORY, name, 0) < 0) {
+        return -1;
+    }
+
+    return netsend_recv_status(conn, NETSEND_TIMEOUT);
+}
+
+int netsend_begin_file(netsend_conn* conn, const char* name, uint64_t size) {
+    hash64_init(&conn->hash);
+
+    return netsend_send_entry(conn, NETSEND_ENTRY_FILE, name, size);
+}
+
+int netsend_write_file(netsend_conn* conn, const void* buf, uint32_t size) {
+    if(size == 0) {
+        return 0;
+    }
+
+    uint32_t length = htonl(size);
+    if(net_send_all(conn->socket, &length, sizeof(length), 0, NETSEND_TIMEOUT) < 0
+       || net_send_all(conn->socket, buf, size, 0, NETSEND_TIMEOUT) < 0) {
+        return -1;
+    }
+
+    hash64_update(&conn->hash, buf, size);
+    return 0;
+}
+
+int netsend_finish_file(netsend_conn* conn, bool aborted) {
+    struct {
+        uint32_t length;
+        uint64_t hash;
+    } __attribute__((packed)) trailer;
+
+    trailer.length = aborted ? htonl(NETSEND_CHUNK_ABORT) : 0;
+    trailer.hash = netsend_be64(hash64_final(&conn->hash));
+
+    if(net_send_all(conn->socket, &trailer, aborted ? sizeof(trailer.length) : sizeof(trailer), 0, NETSEND_TIMEOUT) < 0) {
+        return -1;
+    }
+
+    return netsend_recv_status(conn, NETSEND_TIMEOUT);
+}
\ No newline at end of file
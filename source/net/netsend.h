@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../hash/hash.h"
+
+// Network send protocol, spoken by FBI's "send to network" destinations and tools/fbirecv.c. All
+// integers are big-endian.
+//
+// The receiver listens for TCP connections on NETSEND_PORT and announces itself by sending a
+// netsend_beacon to UDP port NETSEND_PORT every second, broadcast or aimed at the device. Since
+// anyone on the network can send a beacon, the device shows its source address and pairing code,
+// which the receiver also prints, and waits for the user to confirm them. It then connects back to
+// the beacon's source address on the port it names, and both sides exchange a netsend_hello. The device then sends one netsend_entry and its name per item: a
+// relative path with '/' separators. Directories have no body. Files are followed by their
+// contents as a series of chunks, each a u32 length and that many bytes, ending with a zero
+// length and the u64 hash64 of the contents, or with NETSEND_CHUNK_ABORT if the device gave up
+// on the file. The receiver answers every entry with a u32 status once the directory exists or
+// the file is safely stored. A NETSEND_ENTRY_END entry with no name ends the session.
+
+#define NETSEND_PORT 5001
+
+#define NETSEND_MAGIC 0x46424952 // "FBIR"
+#define NETSEND_VERSION 2
+
+#define NETSEND_NAME_MAX 1024
+
+// How long devices wait for a receiver's beacon, and for the receiver to end a session.
+#define NETSEND_DISCOVER_TIMEOUT 60000
+#define NETSEND_CLOSE_TIMEOUT 1000
+
+#define NETSEND_CHUNK_ABORT 0xFFFFFFFF
+
+// Pairing codes are shown as four digits.
+#define NETSEND_CODE_MAX 10000
+
+typedef enum {
+    NETSEND_ENTRY_FILE = 1, // size: the expected size, if known.
+    NETSEND_ENTRY_DIRECTORY = 2,
+    NETSEND_ENTRY_END = 3
+} netsend_entry_type;
+
+typedef enum {
+    NETSEND_STATUS_OK = 0,
+    NETSEND_STATUS_IO_ERROR = 1, // The receiver could not store the item.
+    NETSEND_STATUS_BAD_NAME = 2, // The name is absolute or leaves the output directory.
+    NETSEND_STATUS_HASH_MISMATCH = 3,
+    NETSEND_STATUS_ABORTED = 4
+} netsend_status;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t port;
+    uint32_t code; // Below NETSEND_CODE_MAX, picked by the receiver at startup.
+} netsend_beacon;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} netsend_hello;
+
+typedef struct {
+    uint32_t type;
+    uint32_t nameLength;
+    uint64_t size;
+} netsend_entry;
+
+// Device side. Functions return 0, or -1 with errno set; failed statuses are reported as EIO,
+// EINVAL, EBADMSG or ECANCELED in the order above.
+
+typedef struct {
+    uint32_t address; // In network byte order.
+    uint16_t port;
+    uint32_t code;
+} netsend_receiver;
+
+typedef struct {
+    int socket;
+
+    hash64_ctx hash;
+} netsend_conn;
+
+// Waits up to timeoutMs for a receiver's beacon, checking cancelled (if set) as it goes. Fails
+// with ETIMEDOUT if no receiver showed up, or ECANCELED. The receiver should be shown to the user
+// to confirm before connecting to it.
+int netsend_discover(netsend_receiver* receiver, int timeoutMs, bool (*cancelled)(void* data), void* data);
+int netsend_open(netsend_conn* conn, const netsend_receiver* receiver);
+// Ends the session. Safe to call on a connection that failed to open.
+void netsend_close(netsend_conn* conn, int timeoutMs);
+
+int netsend_send_directory(netsend_conn* conn, const char* name);
+
+int netsend_begin_file(netsend_conn* conn, const char* name, uint64_t size);
+int netsend_write_file(netsend_conn* conn, const void* buf, uint32_t size);
+// Waits for the receiver to store the file, or tells it to throw the file away if aborted.
+int netsend_finish_file(netsend_conn* conn, bool aborted);
\ No newline at end of file
@@ -102,4 +102,55 @@ void info_display(const char* name, const char* info, bool bar, void* data, void
 void info_destroy(ui_view* view) {
     free(view->data);
     free(view);
+}
+
+void info_get_data_op_progress(data_op_info* info, float* progress, char* text) {
+    if(info->totalBytes != 0) {
+        *progress = (float) ((double) info->doneBytes / (double) info->totalBytes);
+    } else {
+        *progress = info->currTotal != 0 ? (float) ((double) info->currProcessed / (double) info->currTotal) : 0;
+    }
+
+    if(info->prescanning) {
+        snprintf(text, PROGRESS_TEXT_MAX, "Calculating size...");
+        return;
+    }
+
+    size_t len = 0;
+
+    if(info->total > 1) {
+        len += snprintf(text + len, PROGRESS_TEXT_MAX - len, "%lu / %lu\n", info->processed, info->total);
+    }
+
+    len += snprintf(text + len, PROGRESS_TEXT_MAX - len, "%.2f MB / %.2f MB", info->currProcessed / 1024.0 / 1024.0, info->currTotal / 1024.0 / 1024.0);
+
+    if(info->totalBytes != 0 && info->total > 1) {
+        len += snprintf(text + len, PROGRESS_TEXT_MAX - len, "\nTotal: %.2f MB / %.2f MB", info->doneBytes / 1024.0 / 1024.0, info->totalBytes / 1024.0 / 1024.0);
+    }
+
+    // Average chunk times of the files in progress, showing whether reads or writes are holding the copy back.
+    u32 readChunks = 0;
+    u64 readTicks = 0;
+    u32 writeChunks = 0;
+    u64 writeTicks = 0;
+    for(u32 i = 0; i < DATAOP_WORKERS_MAX; i++) {
+        readChunks += info->workerProgress[i].stats.readChunks;
+        readTicks += info->workerProgress[i].stats.readTicks;
+        writeChunks += info->workerProgress[i].stats.writeChunks;
+        writeTicks += info->workerProgress[i].stats.writeTicks;
+    }
+
+    if(readChunks != 0 && writeChunks != 0) {
+        len += snprintf(text + len, PROGRESS_TEXT_MAX - len, "\nRead %.1f ms, write %.1f ms per chunk",
+                        readTicks * 1000.0 / SYSCLOCK_ARM11 / readChunks, writeTicks * 1000.0 / SYSCLOCK_ARM11 / writeChunks);
+    }
+
+    if(info->bytesPerSecond != 0) {
+        len += snprintf(text + len, PROGRESS_TEXT_MAX - len, "\n%.2f MB/s", info->bytesPerSecond / 1024.0 / 1024.0);
+
+        if(info->totalBytes != 0) {
+            u64 remaining = info->estimatedRemaining;
+            snprintf(text + len, PROGRESS_TEXT_MAX - len, ", %02lu:%02lu:%02lu remaining", (u32) (remaining / 3600), (u32) ((remaining / 60) % 60), (u32) (remaining % 60));
+        }
+    }
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "ui.h"
+#include "section/task/task.h"
 
 #define PROGRESS_TEXT_MAX 512
 
 void info_display(const char* name, const char* info, bool bar, void* data, void (*update)(ui_view* view, void* data, float* progress, char* text),
                                                                             void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2));
-void info_destroy(ui_view* view);
\ No newline at end of file
+void info_destroy(ui_view* view);
+void info_get_data_op_progress(data_op_info* info, float* progress, char* text);
\ No newline at end of file
@@ -138,14 +138,14 @@ static void prompt_draw_bottom(ui_view* view, void* data, float x1, float y1, fl
     screen_draw_string(promptData->text, x1 + (x2 - x1 - textWidth) / 2, y1 + (y2 - 5 - buttonHeight - y1 - textHeight) / 2, 0.5f, 0.5f, promptData->rgba, false);
 }
 
-void prompt_display(const char* name, const char* text, u32 rgba, bool option, void* data, void (*update)(ui_view* view, void* data),
-                                                                                           void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2),
-                                                                                           void (*onResponse)(ui_view* view, void* data, bool response)) {
+static bool prompt_push(const char* name, const char* text, u32 rgba, bool option, void* data, void (*update)(ui_view* view, void* data),
+                                                                                         void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2),
+                                                                                         void (*onResponse)(ui_view* view, void* data, bool response)) {
     prompt_data* promptData = (prompt_data*) calloc(1, sizeof(prompt_data));
     if(promptData == NULL) {
         error_display(NULL, NULL, NULL, "Failed to allocate prompt data.");
 
-        return;
+        return false;
     }
 
     promptData->text = text;
@@ -161,7 +161,7 @@ void prompt_display(const char* name, const char* text, u32 rgba, bool option, v
         error_display(NULL, NULL, NULL, "Failed to allocate UI view.");
 
         free(promptData);
-        return;
+        return false;
     }
 
     view->name = name;
@@ -171,4 +171,53 @@ void prompt_display(const char* name, const char* text, u32 rgba, bool option, v
     view->drawTop = prompt_draw_top;
     view->drawBottom = prompt_draw_bottom;
     ui_push(view);
+
+    return true;
+}
+
+void prompt_display(const char* name, const char* text, u32 rgba, bool option, void* data, void (*update)(ui_view* view, void* data),
+                                                                                           void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2),
+                                                                                           void (*onResponse)(ui_view* view, void* data, bool response)) {
+    prompt_push(name, text, rgba, option, data, update, drawTop, onResponse);
+}
+
+typedef struct {
+    void* data;
+    void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2);
+
+    volatile bool answered;
+    volatile bool response;
+} prompt_wait_data;
+
+static void prompt_wait_draw_top(ui_view* view, void* data, float x1, float y1, float x2, float y2) {
+    prompt_wait_data* waitData = (prompt_wait_data*) data;
+
+    if(waitData->drawTop != NULL) {
+        waitData->drawTop(view, waitData->data, x1, y1, x2, y2);
+    }
+}
+
+static void prompt_wait_onresponse(ui_view* view, void* data, bool response) {
+    prompt_wait_data* waitData = (prompt_wait_data*) data;
+
+    waitData->response = response;
+    waitData->answered = true;
+}
+
+bool prompt_display_wait(const char* name, const char* text, u32 rgba, void* data, void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2)) {
+    prompt_wait_data waitData;
+    waitData.data = data;
+    waitData.drawTop = drawTop;
+    waitData.answered = false;
+    waitData.response = false;
+
+    if(!prompt_push(name, text, rgba, true, &waitData, NULL, prompt_wait_draw_top, prompt_wait_onresponse)) {
+        return false;
+    }
+
+    while(!waitData.answered) {
+        svcSleepThread(1000000);
+    }
+
+    return waitData.response;
 }
\ No newline at end of file
@@ -4,4 +4,7 @@
 
 void prompt_display(const char* name, const char* text, u32 rgba, bool option, void* data, void (*update)(ui_view* view, void* data),
                                                                                                void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2),
-                                                                                               void (*onResponse)(ui_view* view, void* data, bool response));
\ No newline at end of file
+                                                                                               void (*onResponse)(ui_view* view, void* data, bool response));
+
+// Displays a yes/no prompt from a background thread and blocks until it is answered.
+bool prompt_display_wait(const char* name, const char* text, u32 rgba, void* data, void (*drawTop)(ui_view* view, void* data, float x1, float y1, float x2, float y2));
\ No newline at end of file
@@ -18,12 +18,15 @@ void action_delete_dir(file_info* info, bool* populated);
 void action_delete_dir_contents(file_info* info, bool* populated);
 void action_delete_dir_cias(file_info* info, bool* populated);
 void action_paste_contents(file_info* info, bool* populated);
+void action_send_contents(file_info* info, bool* populated);
 
 void action_delete_pending_title(pending_title_info* info, bool* populated);
 void action_delete_all_pending_titles(pending_title_info* info, bool* populated);
 
 void action_delete_ticket(ticket_info* info, bool* populated);
 void action_install_cdn(ticket_info* info, bool* populated);
+void action_queue_cdn(ticket_info* info, bool* populated);
+void action_install_cdn_queue(ticket_info* info, bool* populated);
 
 void action_delete_title(title_info* info, bool* populated);
 void action_launch_title(title_info* info, bool* populated);
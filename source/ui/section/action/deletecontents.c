@@ -20,6 +20,13 @@ typedef struct {
     Handle cancelEvent;
 } delete_contents_data;
 
+static Result action_delete_contents_is_src_directory(void* data, u32 index, bool* isDirectory) {
+    delete_contents_data* deleteData = (delete_contents_data*) data;
+
+    *isDirectory = util_is_dir(deleteData->base->archive, deleteData->contents[index]);
+    return 0;
+}
+
 static Result action_delete_contents_delete(void* data, u32 index) {
     delete_contents_data* deleteData = (delete_contents_data*) data;
 
@@ -62,7 +69,9 @@ static bool action_delete_contents_error(void* data, u32 index, Result res) {
         }
     }
 
-    return index < deleteData->deleteInfo.total - 1;
+    // Workers finish out of order, so the index says nothing about what is left. The pool
+    // stops by itself once every item has been claimed; only a cancel ends it early.
+    return svcWaitSynchronization(deleteData->cancelEvent, 0) != 0;
 }
 
 static void action_delete_contents_draw_top(ui_view* view, void* data, float x1, float y1, float x2, float y2) {
@@ -134,8 +143,14 @@ static void action_delete_contents_internal(file_info* info, bool* populated, co
 
     data->deleteInfo.data = data;
 
+    data->deleteInfo.name = "Delete";
+
     data->deleteInfo.op = DATAOP_DELETE;
 
+    data->deleteInfo.workers = DATAOP_WORKERS_MAX;
+
+    data->deleteInfo.isSrcDirectory = action_delete_contents_is_src_directory;
+
     data->deleteInfo.delete = action_delete_contents_delete;
 
     data->deleteInfo.error = action_delete_contents_error;
@@ -124,6 +124,8 @@ void action_delete_pending_titles(pending_title_info* info, bool* populated, con
 
     data->deleteInfo.data = data;
 
+    data->deleteInfo.name = "Delete pending titles";
+
     data->deleteInfo.op = DATAOP_DELETE;
 
     data->deleteInfo.total = sdTotal + nandTotal;
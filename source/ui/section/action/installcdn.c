@@ -1,5 +1,7 @@
+#include <errno.h>
 #include <malloc.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <3ds.h>
 
@@ -7,23 +9,128 @@
 #include "../../error.h"
 #include "../../info.h"
 #include "../../prompt.h"
+#include "../../../net/cdncache.h"
+#include "../../../net/httpclient.h"
 #include "../../../screen.h"
 
-#define CONTENTS_MAX 64
+#define CDN_URL "http://ccs.cdn.c.shop.nintendowifi.net/ccs/download"
+
+// TMDs are all fetched before anything is installed, so the whole install can be sized up front.
+// This many are requested at a time on one connection.
+#define CDN_TMD_PIPELINE_DEPTH 4
+#define CDN_TMD_SIZE_MAX (1024 * 1024 * 4)
+
+// Contents after the one being installed are requested ahead of time, so each download's request
+// setup overlaps with the AM writes of the one before. Up to CDN_PREFETCH_SIZE of each is
+// buffered; the rest waits in its open connection.
+#define CDN_PREFETCH_DEPTH 2
+#define CDN_PREFETCH_SIZE (1024 * 1024 * 2)
+#define CDN_PREFETCH_READ_SIZE (1024 * 64)
+
+#define CDN_TIMEOUT 30000
 
 typedef struct {
-    ticket_info* ticket;
+    char url[256];
+    httpclient_request request;
+
+    // Contents found in the cache are read from it instead; downloaded ones are added to it.
+    bool cached;
+    cdncache_file cache;
+
+    // Size of the whole body, and how much of it has been downloaded so far.
+    u64 size;
+    u64 offset;
+
+    // Set when the download broke off, until it is resumed; err holds the failure's errno.
+    bool broken;
+    int err;
+    httpclient_retry retry;
+
+    // Bytes downloaded ahead of time, handed out before the rest of the download.
+    u8* buffer;
+    u32 bufferSize;
+    u32 bufferOffset;
+} cdn_source;
+
+typedef struct {
+    void* data;
+    u32 index;
+
+    // NULL while the slot is free. Owned by the slot until taken by open_src.
+    cdn_source* source;
+    Result res;
+    int err;
+
+    Thread thread;
+    volatile bool abort;
+} cdn_prefetch;
+
+typedef struct {
+    u32 id;
+    u16 index;
+    u64 size;
+} cdn_content;
 
+typedef struct {
+    u64 titleId;
+
+    // The TMD, until it is handed to AM, and the contents it lists.
+    u8* tmd;
+    u32 tmdSize;
+    cdn_content* contents;
     u32 contentCount;
-    u16 contentIndices[CONTENTS_MAX];
-    u32 contentIds[CONTENTS_MAX];
+
+    // Operation index of the TMD. The title's contents follow it.
+    u32 firstIndex;
+
+    // Set while AM has the title's install open.
+    bool started;
+    bool installed;
+
+    // The title's first failure; errno or the HTTP response code go with it where they apply.
+    Result res;
+    int err;
+    u32 responseCode;
+} cdn_title;
+
+typedef struct {
+    // The ticket installed from, or NULL for a queue install.
+    ticket_info* ticket;
+
+    cdn_title* titles;
+    u32 titleCount;
+
+    // Operation indices are assigned to contents once every TMD has been fetched.
+    bool laidOut;
+    u32 currTitle;
+
+    // TMD requests in flight while sizing up, by title index modulo CDN_TMD_PIPELINE_DEPTH.
+    httpclient_request tmdRequests[CDN_TMD_PIPELINE_DEPTH];
+    u32 tmdSent;
 
     u32 responseCode;
 
+    cdn_prefetch prefetch[CDN_PREFETCH_DEPTH];
+
+    // Connections to the CDN are kept alive between contents. The mutex serializes pool access
+    // between the install and prefetch threads.
+    httpclient_pool pool;
+    Handle poolMutex;
+
+    // Timing of the most recent request, for the progress display.
+    u32 lastWaitMs;
+    bool lastReused;
+    u32 resumeCount;
+    u32 cachedCount;
+
     data_op_info installInfo;
     Handle cancelEvent;
 } install_cdn_data;
 
+// Titles queued from the tickets list, installed together by action_install_cdn_queue.
+static u64* cdn_queue = NULL;
+static u32 cdn_queue_count = 0;
+
 static Result action_install_cdn_is_src_directory(void* data, u32 index, bool* isDirectory) {
     *isDirectory = false;
     return 0;
@@ -33,105 +140,713 @@ static Result action_install_cdn_make_dst_directory(void* data, u32 index) {
     return 0;
 }
 
+static cdn_title* action_install_cdn_find_title(install_cdn_data* data, u32 index) {
+    for(u32 i = data->titleCount; i > 0; i--) {
+        if(index >= data->titles[i - 1].firstIndex) {
+            return &data->titles[i - 1];
+        }
+    }
+
+    return NULL;
+}
+
+// Returns the content at index, or NULL for a TMD.
+static cdn_content* action_install_cdn_find_content(install_cdn_data* data, u32 index) {
+    cdn_title* title = action_install_cdn_find_title(data, index);
+    return title != NULL && index > title->firstIndex ? &title->contents[index - title->firstIndex - 1] : NULL;
+}
+
+static void action_install_cdn_get_url(install_cdn_data* data, u32 index, char* url) {
+    cdn_title* title = action_install_cdn_find_title(data, index);
+    cdn_content* content = action_install_cdn_find_content(data, index);
+
+    if(content == NULL) {
+        snprintf(url, 256, CDN_URL "/%016llX/tmd", title->titleId);
+    } else {
+        snprintf(url, 256, CDN_URL "/%016llX/%08lX", title->titleId, content->id);
+    }
+}
+
+static void action_install_cdn_get_cache_key(install_cdn_data* data, u32 index, cdncache_key* key) {
+    cdn_content* content = action_install_cdn_find_content(data, index);
+
+    key->titleId = action_install_cdn_find_title(data, index)->titleId;
+    key->contentId = content->id;
+    key->size = content->size;
+}
+
+static void action_install_cdn_finish_request(install_cdn_data* data, cdn_source* source) {
+    svcWaitSynchronization(data->poolMutex, U64_MAX);
+    httpclient_finish(&source->request, CDN_TIMEOUT);
+    svcReleaseMutex(data->poolMutex);
+}
+
+static Result action_install_cdn_open_request(install_cdn_data* data, cdn_source* source) {
+    svcWaitSynchronization(data->poolMutex, U64_MAX);
+    int ret = source->offset > 0 ? httpclient_send_range(&data->pool, source->url, source->offset, &source->request, CDN_TIMEOUT)
+                                 : httpclient_send(&data->pool, "GET", source->url, &source->request, CDN_TIMEOUT);
+    svcReleaseMutex(data->poolMutex);
+
+    if(ret < 0) {
+        return R_FBI_ERRNO;
+    }
+
+    if(httpclient_read_head(&source->request, CDN_TIMEOUT) < 0) {
+        int err = errno;
+        action_install_cdn_finish_request(data, source);
+
+        errno = err;
+        return R_FBI_ERRNO;
+    }
+
+    if(source->request.status != 200 && (source->offset == 0 || source->request.status != 206)) {
+        action_install_cdn_finish_request(data, source);
+        return R_FBI_HTTP_RESPONSE_CODE;
+    }
+
+    if(source->offset == 0) {
+        source->size = source->request.contentLength;
+    } else if(source->request.contentLength != source->size - source->offset) {
+        // The content changed size since the download started.
+        action_install_cdn_finish_request(data, source);
+
+        errno = EBADMSG;
+        return R_FBI_ERRNO;
+    }
+
+    return 0;
+}
+
+// Marks a download as broken off, to be resumed when its next bytes are needed.
+static void action_install_cdn_break_source(install_cdn_data* data, cdn_source* source) {
+    source->err = errno;
+    source->broken = true;
+
+    action_install_cdn_finish_request(data, source);
+}
+
+typedef struct {
+    install_cdn_data* data;
+    cdn_source* source;
+
+    Result res;
+    bool cancelled;
+} cdn_resume_attempt;
+
+static bool action_install_cdn_resume_wait(void* arg, u32 ms) {
+    cdn_resume_attempt* attempt = (cdn_resume_attempt*) arg;
+
+    attempt->cancelled = task_is_quit_all() || svcWaitSynchronization(attempt->data->cancelEvent, (u64) ms * 1000000) == 0;
+    return !attempt->cancelled;
+}
+
+static int action_install_cdn_resume_reopen(void* arg) {
+    cdn_resume_attempt* attempt = (cdn_resume_attempt*) arg;
+
+    if(R_FAILED(attempt->res = action_install_cdn_open_request(attempt->data, attempt->source))) {
+        attempt->data->responseCode = (u32) attempt->source->request.status;
+        return -1;
+    }
+
+    return 0;
+}
+
+static Result action_install_cdn_resume_source(install_cdn_data* data, cdn_source* source) {
+    cdn_resume_attempt attempt = {data, source, R_FBI_ERRNO, false};
+
+    errno = source->err;
+    if(httpclient_resume(&source->retry, source->offset, action_install_cdn_resume_wait, action_install_cdn_resume_reopen, &attempt) < 0) {
+        return attempt.cancelled ? R_FBI_CANCELLED : attempt.res;
+    }
+
+    source->broken = false;
+    data->resumeCount++;
+
+    return 0;
+}
+
+static void action_install_cdn_free_source(cdn_source* source) {
+    cdncache_close(&source->cache, false);
+
+    free(source->buffer);
+    free(source);
+}
+
+static void action_install_cdn_prefetch_thread(void* arg) {
+    cdn_prefetch* prefetch = (cdn_prefetch*) arg;
+    cdn_source* source = prefetch->source;
+
+    // errno is per thread, so it is handed over along with the result.
+    if(R_FAILED(prefetch->res = action_install_cdn_open_request(prefetch->data, source))) {
+        prefetch->err = errno;
+        return;
+    }
+
+    while(!prefetch->abort && source->bufferSize < CDN_PREFETCH_SIZE) {
+        u32 size = CDN_PREFETCH_SIZE - source->bufferSize;
+        if(size > CDN_PREFETCH_READ_SIZE) {
+            size = CDN_PREFETCH_READ_SIZE;
+        }
+
+        size_t bytesRead = 0;
+        int ret = httpclient_read(&source->request, source->buffer + source->bufferSize, size, CDN_TIMEOUT, &bytesRead);
+
+        source->bufferSize += bytesRead;
+        source->offset += bytesRead;
+
+        // What was buffered is kept, and the rest is resumed when the install gets to it.
+        if(ret < 0) {
+            action_install_cdn_break_source(prefetch->data, source);
+            break;
+        }
+
+        if(bytesRead < size) {
+            break;
+        }
+    }
+}
+
+static void action_install_cdn_start_prefetch(install_cdn_data* data, u32 index) {
+    // TMDs are already in memory, and failed titles are skipped.
+    cdn_title* title = action_install_cdn_find_title(data, index);
+    if(action_install_cdn_find_content(data, index) == NULL || R_FAILED(title->res)) {
+        return;
+    }
+
+    cdn_prefetch* slot = NULL;
+    for(u32 i = 0; i < CDN_PREFETCH_DEPTH; i++) {
+        cdn_prefetch* prefetch = &data->prefetch[i];
+        if(prefetch->source == NULL) {
+            if(slot == NULL) {
+                slot = prefetch;
+            }
+        } else if(prefetch->index == index) {
+            return;
+        }
+    }
+
+    if(slot == NULL) {
+        return;
+    }
+
+    cdncache_key key;
+    action_install_cdn_get_cache_key(data, index, &key);
+    if(cdncache_contains(&key)) {
+        return;
+    }
+
+    // Contents that can't be prefetched are simply downloaded when their turn comes.
+    cdn_source* source = (cdn_source*) calloc(1, sizeof(cdn_source));
+    if(source == NULL) {
+        return;
+    }
+
+    if((source->buffer = (u8*) malloc(CDN_PREFETCH_SIZE)) == NULL) {
+        action_install_cdn_free_source(source);
+        return;
+    }
+
+    action_install_cdn_get_url(data, index, source->url);
+
+    slot->data = data;
+    slot->index = index;
+
+    slot->source = source;
+    slot->res = 0;
+    slot->abort = false;
+
+    if((slot->thread = threadCreate(action_install_cdn_prefetch_thread, slot, 0x4000, 0x18, 1, false)) == NULL) {
+        action_install_cdn_free_source(source);
+        slot->source = NULL;
+    }
+}
+
+// Waits for the prefetch of index, if there is one, and takes over its source.
+static Result action_install_cdn_take_prefetch(install_cdn_data* data, u32 index, cdn_source** source) {
+    *source = NULL;
+
+    for(u32 i = 0; i < CDN_PREFETCH_DEPTH; i++) {
+        cdn_prefetch* prefetch = &data->prefetch[i];
+        if(prefetch->source != NULL && prefetch->index == index) {
+            threadJoin(prefetch->thread, U64_MAX);
+            threadFree(prefetch->thread);
+            prefetch->thread = NULL;
+
+            Result res = prefetch->res;
+            data->responseCode = (u32) prefetch->source->request.status;
+
+            if(R_SUCCEEDED(res)) {
+                *source = prefetch->source;
+            } else {
+                action_install_cdn_free_source(prefetch->source);
+                errno = prefetch->err;
+            }
+
+            prefetch->source = NULL;
+            return res;
+        }
+    }
+
+    return 0;
+}
+
+static void action_install_cdn_stop_prefetch(install_cdn_data* data) {
+    for(u32 i = 0; i < CDN_PREFETCH_DEPTH; i++) {
+        cdn_prefetch* prefetch = &data->prefetch[i];
+        if(prefetch->source != NULL) {
+            prefetch->abort = true;
+
+            threadJoin(prefetch->thread, U64_MAX);
+            threadFree(prefetch->thread);
+            prefetch->thread = NULL;
+
+            if(R_SUCCEEDED(prefetch->res) && !prefetch->source->broken) {
+                action_install_cdn_finish_request(data, prefetch->source);
+            }
+
+            action_install_cdn_free_source(prefetch->source);
+            prefetch->source = NULL;
+        }
+    }
+}
+
+static void action_install_cdn_prefetch_after(install_cdn_data* data, u32 index) {
+    for(u32 next = index + 1; next <= index + CDN_PREFETCH_DEPTH && next < data->installInfo.total; next++) {
+        action_install_cdn_start_prefetch(data, next);
+    }
+}
+
+// Looks for the content at index in the cache, which holds everything but TMDs.
+static Result action_install_cdn_open_cached(install_cdn_data* data, u32 index, cdn_source** source) {
+    *source = NULL;
+
+    if(action_install_cdn_find_content(data, index) == NULL) {
+        return 0;
+    }
+
+    if((*source = (cdn_source*) calloc(1, sizeof(cdn_source))) == NULL) {
+        return R_FBI_OUT_OF_MEMORY;
+    }
+
+    cdncache_key key;
+    action_install_cdn_get_cache_key(data, index, &key);
+
+    if(!cdncache_open(&(*source)->cache, &key)) {
+        free(*source);
+        *source = NULL;
+
+        return 0;
+    }
+
+    (*source)->cached = true;
+    (*source)->size = key.size;
+
+    data->cachedCount++;
+    return 0;
+}
+
+static Result action_install_cdn_parse_tmd(cdn_title* title) {
+    static u32 dataOffsets[6] = {0x240, 0x140, 0x80, 0x240, 0x140, 0x80};
+
+    u8* tmd = title->tmd;
+    if(title->tmdSize < 4 || tmd[0x03] >= 6 || title->tmdSize < dataOffsets[tmd[0x03]] + 0x9C4) {
+        return R_FBI_BAD_DATA;
+    }
+
+    u32 dataOffset = dataOffsets[tmd[0x03]];
+
+    u32 contentCount = __builtin_bswap16(*(u16*) &tmd[dataOffset + 0x9E]);
+    if(title->tmdSize < dataOffset + 0x9C4 + contentCount * 0x30) {
+        return R_FBI_BAD_DATA;
+    }
+
+    if(contentCount > 0 && (title->contents = (cdn_content*) calloc(contentCount, sizeof(cdn_content))) == NULL) {
+        return R_FBI_OUT_OF_MEMORY;
+    }
+
+    for(u32 i = 0; i < contentCount; i++) {
+        u8* contentChunk = &tmd[dataOffset + 0x9C4 + (i * 0x30)];
+        cdn_content* content = &title->contents[i];
+
+        content->id = __builtin_bswap32(*(u32*) &contentChunk[0x00]);
+        content->index = __builtin_bswap16(*(u16*) &contentChunk[0x04]);
+        content->size = __builtin_bswap64(*(u64*) &contentChunk[0x08]);
+    }
+
+    title->contentCount = contentCount;
+    return 0;
+}
+
+// Keeps up to CDN_TMD_PIPELINE_DEPTH TMD requests, starting from that of title, in flight.
+static void action_install_cdn_send_tmds(install_cdn_data* data, u32 title) {
+    svcWaitSynchronization(data->poolMutex, U64_MAX);
+
+    for(; data->tmdSent < data->titleCount && data->tmdSent < title + CDN_TMD_PIPELINE_DEPTH; data->tmdSent++) {
+        char url[256];
+        snprintf(url, sizeof(url), CDN_URL "/%016llX/tmd", data->titles[data->tmdSent].titleId);
+
+        httpclient_request* request = &data->tmdRequests[data->tmdSent % CDN_TMD_PIPELINE_DEPTH];
+
+        int ret = 0;
+        if(data->tmdSent > title) {
+            ret = httpclient_send_after(&data->pool, &data->tmdRequests[(data->tmdSent - 1) % CDN_TMD_PIPELINE_DEPTH], "GET", url, request, CDN_TIMEOUT);
+        } else {
+            ret = httpclient_send(&data->pool, "GET", url, request, CDN_TIMEOUT);
+        }
+
+        // The failure comes up again when the TMD is read.
+        if(ret < 0) {
+            cdn_title* failed = &data->titles[data->tmdSent];
+            failed->res = R_FBI_ERRNO;
+            failed->err = errno;
+        }
+    }
+
+    svcReleaseMutex(data->poolMutex);
+}
+
+static Result action_install_cdn_read_tmd(install_cdn_data* data, cdn_title* title, httpclient_request* request) {
+    if(httpclient_read_head(request, CDN_TIMEOUT) < 0) {
+        title->err = errno;
+        return R_FBI_ERRNO;
+    }
+
+    if(request->status != 200) {
+        title->responseCode = (u32) request->status;
+        return R_FBI_HTTP_RESPONSE_CODE;
+    }
+
+    if(!request->hasLength || request->contentLength > CDN_TMD_SIZE_MAX) {
+        return R_FBI_BAD_DATA;
+    }
+
+    title->tmdSize = (u32) request->contentLength;
+    if((title->tmd = (u8*) malloc(title->tmdSize > 0 ? title->tmdSize : 1)) == NULL) {
+        return R_FBI_OUT_OF_MEMORY;
+    }
+
+    size_t received = 0;
+    if(httpclient_read(request, title->tmd, title->tmdSize, CDN_TIMEOUT, &received) < 0) {
+        title->err = errno;
+        return R_FBI_ERRNO;
+    }
+
+    if(received < title->tmdSize) {
+        return R_FBI_BAD_DATA;
+    }
+
+    return action_install_cdn_parse_tmd(title);
+}
+
+// Sizes up the title at index, before any operation indices are assigned, from its TMD. TMDs of
+// the titles after it are requested on the same connection in the meantime.
+static Result action_install_cdn_prescan_src_size(void* data, u32 index, u64* size) {
+    install_cdn_data* installData = (install_cdn_data*) data;
+
+    if(installData->laidOut || index >= installData->titleCount) {
+        return 0;
+    }
+
+    cdn_title* title = &installData->titles[index];
+
+    action_install_cdn_send_tmds(installData, index);
+
+    if(R_FAILED(title->res)) {
+        return title->res;
+    }
+
+    httpclient_request* request = &installData->tmdRequests[index % CDN_TMD_PIPELINE_DEPTH];
+
+    title->res = action_install_cdn_read_tmd(installData, title, request);
+
+    svcWaitSynchronization(installData->poolMutex, U64_MAX);
+    httpclient_finish(request, CDN_TIMEOUT);
+    svcReleaseMutex(installData->poolMutex);
+
+    if(R_FAILED(title->res)) {
+        free(title->tmd);
+        title->tmd = NULL;
+
+        return title->res;
+    }
+
+    *size = title->tmdSize;
+    for(u32 i = 0; i < title->contentCount; i++) {
+        *size += title->contents[i].size;
+    }
+
+    return 0;
+}
+
+// Assigns each title's TMD and contents their operation indices, once sizing up is over.
+static void action_install_cdn_lay_out(install_cdn_data* data) {
+    if(data->laidOut) {
+        return;
+    }
+
+    data->laidOut = true;
+
+    u32 index = 0;
+    for(u32 i = 0; i < data->titleCount; i++) {
+        cdn_title* title = &data->titles[i];
+
+        // Titles never sized up were cut short by a cancel.
+        if(title->tmd == NULL && R_SUCCEEDED(title->res)) {
+            title->res = R_FBI_CANCELLED;
+        }
+
+        title->firstIndex = index;
+        index += 1 + title->contentCount;
+    }
+
+    // Requests sent ahead for titles that were never read.
+    svcWaitSynchronization(data->poolMutex, U64_MAX);
+
+    for(u32 i = 0; i < CDN_TMD_PIPELINE_DEPTH; i++) {
+        httpclient_finish(&data->tmdRequests[i], CDN_TIMEOUT);
+    }
+
+    svcReleaseMutex(data->poolMutex);
+
+    data->installInfo.total = index;
+}
+
+// TMDs are handed to AM straight from memory.
+static Result action_install_cdn_open_tmd(cdn_title* title, cdn_source** source) {
+    if((*source = (cdn_source*) calloc(1, sizeof(cdn_source))) == NULL) {
+        return R_FBI_OUT_OF_MEMORY;
+    }
+
+    (*source)->buffer = title->tmd;
+    (*source)->bufferSize = title->tmdSize;
+    (*source)->size = title->tmdSize;
+    (*source)->offset = title->tmdSize;
+
+    title->tmd = NULL;
+    return 0;
+}
+
 static Result action_install_cdn_open_src(void* data, u32 index, u32* handle) {
     install_cdn_data* installData = (install_cdn_data*) data;
 
+    action_install_cdn_lay_out(installData);
+
+    cdn_title* title = action_install_cdn_find_title(installData, index);
+    installData->currTitle = (u32) (title - installData->titles);
+
+    // The rest of a failed title is skipped, along with anything fetched for it ahead of time.
+    if(R_FAILED(title->res)) {
+        cdn_source* stale = NULL;
+        if(R_SUCCEEDED(action_install_cdn_take_prefetch(installData, index, &stale)) && stale != NULL) {
+            action_install_cdn_finish_request(installData, stale);
+            action_install_cdn_free_source(stale);
+        }
+
+        errno = title->err;
+        installData->responseCode = title->responseCode;
+
+        return title->res;
+    }
+
+    cdn_source* source = NULL;
     Result res = 0;
 
-    httpcContext* context = (httpcContext*) calloc(1, sizeof(httpcContext));
-    if(context != NULL) {
-        char url[256];
-        if(index == 0) {
-            snprintf(url, 256, "http://ccs.cdn.c.shop.nintendowifi.net/ccs/download/%016llX/tmd", installData->ticket->titleId);
-        } else {
-            snprintf(url, 256, "http://ccs.cdn.c.shop.nintendowifi.net/ccs/download/%016llX/%08lX", installData->ticket->titleId, installData->contentIds[index - 1]);
+    if(index == title->firstIndex) {
+        res = action_install_cdn_open_tmd(title, &source);
+    } else {
+        res = action_install_cdn_take_prefetch(installData, index, &source);
+
+        if(R_SUCCEEDED(res) && source == NULL) {
+            res = action_install_cdn_open_cached(installData, index, &source);
         }
 
-        if(R_SUCCEEDED(res = httpcOpenContext(context, HTTPC_METHOD_GET, url, 1))) {
-            httpcSetSSLOpt(context, SSLCOPT_DisableVerify);
-            if(R_SUCCEEDED(res = httpcBeginRequest(context)) && R_SUCCEEDED(res = httpcGetResponseStatusCode(context, &installData->responseCode, 0))) {
-                if(installData->responseCode == 200) {
-                    *handle = (u32) context;
-                } else {
-                    res = R_FBI_HTTP_RESPONSE_CODE;
-                }
-            }
+        if(R_SUCCEEDED(res) && source == NULL) {
+            if((source = (cdn_source*) calloc(1, sizeof(cdn_source))) != NULL) {
+                action_install_cdn_get_url(installData, index, source->url);
 
-            if(R_FAILED(res)) {
-                httpcCloseContext(context);
+                res = action_install_cdn_open_request(installData, source);
+                installData->responseCode = (u32) source->request.status;
+
+                if(R_FAILED(res)) {
+                    action_install_cdn_free_source(source);
+                }
+            } else {
+                res = R_FBI_OUT_OF_MEMORY;
             }
         }
 
-        if(R_FAILED(res)) {
-            free(context);
+        if(R_SUCCEEDED(res) && !source->cached) {
+            installData->lastWaitMs = source->request.waitMs;
+            installData->lastReused = source->request.reused;
+
+            cdncache_key key;
+            action_install_cdn_get_cache_key(installData, index, &key);
+
+            cdncache_begin(&source->cache, &key);
         }
-    } else {
-        res = R_FBI_OUT_OF_MEMORY;
+    }
+
+    if(R_SUCCEEDED(res)) {
+        *handle = (u32) source;
+
+        // Contents of the next title are fetched ahead too, so installs run back to back.
+        action_install_cdn_prefetch_after(installData, index);
     }
 
     return res;
 }
 
 static Result action_install_cdn_close_src(void* data, u32 index, bool succeeded, u32 handle) {
-    return httpcCloseContext((httpcContext*) handle);
+    install_cdn_data* installData = (install_cdn_data*) data;
+    cdn_source* source = (cdn_source*) handle;
+
+    // A cached content that reads back intact can still be one AM turns away, so it is dropped
+    // and downloaded again next time, unless the install was only cancelled.
+    if(source->cached && !succeeded && !task_is_quit_all() && svcWaitSynchronization(installData->cancelEvent, 0) != 0) {
+        source->cache.failed = true;
+    }
+
+    // Downloads are only kept once AM has accepted them.
+    cdncache_close(&source->cache, succeeded);
+
+    action_install_cdn_finish_request(installData, source);
+    action_install_cdn_free_source(source);
+
+    return 0;
 }
 
 static Result action_install_cdn_get_src_size(void* data, u32 handle, u64* size) {
-    u32 downloadSize = 0;
-    Result res = httpcGetDownloadSizeState((httpcContext*) handle, NULL, &downloadSize);
-
-    *size = downloadSize;
-    return res;
+    *size = ((cdn_source*) handle)->size;
+    return 0;
 }
 
 static Result action_install_cdn_read_src(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size) {
-    Result res = httpcDownloadData((httpcContext*) handle, buffer, size, bytesRead);
-    return res != HTTPC_RESULTCODE_DOWNLOADPENDING ? res : 0;
-}
+    cdn_source* source = (cdn_source*) handle;
 
-static Result action_install_cdn_open_dst(void* data, u32 index, void* initialReadBlock, u32* handle) {
-    install_cdn_data* installData = (install_cdn_data*) data;
+    if(source->cached) {
+        return cdncache_read(&source->cache, buffer, size, bytesRead) < 0 ? R_FBI_ERRNO : 0;
+    }
+
+    u32 copied = 0;
+    if(source->buffer != NULL) {
+        copied = source->bufferSize - source->bufferOffset;
+        if(copied > size) {
+            copied = size;
+        }
 
-    if(index == 0) {
-        static u32 dataOffsets[6] = {0x240, 0x140, 0x80, 0x240, 0x140, 0x80};
+        memcpy(buffer, source->buffer + source->bufferOffset, copied);
+        source->bufferOffset += copied;
 
-        u8* tmd = (u8*) initialReadBlock;
-        u8 sigType = tmd[0x03];
+        // Drained prefetch buffers are given back right away.
+        if(source->bufferOffset == source->bufferSize) {
+            free(source->buffer);
+            source->buffer = NULL;
+        }
+    }
 
-        installData->contentCount = __builtin_bswap16(*(u16*) &tmd[dataOffsets[sigType] + 0x9E]);
-        if(installData->contentCount > CONTENTS_MAX) {
-            return MAKERESULT(RL_PERMANENT, RS_INVALIDARG, RM_APPLICATION, RD_OUT_OF_RANGE);
+    Result res = 0;
+
+    while(copied < size && source->offset < source->size) {
+        if(source->broken && R_FAILED(res = action_install_cdn_resume_source((install_cdn_data*) data, source))) {
+            break;
         }
 
-        for(u32 i = 0; i < installData->contentCount; i++) {
-            u8* contentChunk = &tmd[dataOffsets[sigType] + 0x9C4 + (i * 0x30)];
+        size_t downloaded = 0;
+        int ret = httpclient_read(&source->request, (u8*) buffer + copied, size - copied, CDN_TIMEOUT, &downloaded);
+
+        copied += downloaded;
+        source->offset += downloaded;
 
-            installData->contentIds[i] = __builtin_bswap32(*(u32*) &contentChunk[0x00]);
-            installData->contentIndices[i] = __builtin_bswap16(*(u16*) &contentChunk[0x04]);
+        if(ret < 0) {
+            action_install_cdn_break_source((install_cdn_data*) data, source);
+        } else if(downloaded == 0) {
+            break;
         }
+    }
 
-        installData->installInfo.total += installData->contentCount;
+    cdncache_write(&source->cache, buffer, copied);
 
-        return AM_InstallTmdBegin(handle);
-    } else {
-        return AM_InstallContentBegin(handle, installData->contentIndices[index - 1]);
+    *bytesRead = copied;
+    return res;
+}
+
+static Result action_install_cdn_begin_title(cdn_title* title) {
+    u8 n3ds = false;
+    if(R_SUCCEEDED(APT_CheckNew3DS(&n3ds)) && !n3ds && ((title->titleId >> 28) & 0xF) == 2) {
+        return R_FBI_WRONG_SYSTEM;
+    }
+
+    FS_MediaType dest = ((title->titleId >> 32) & 0x8010) != 0 ? MEDIATYPE_NAND : MEDIATYPE_SD;
+
+    AM_DeleteTitle(dest, title->titleId);
+    if(dest == MEDIATYPE_SD) {
+        AM_QueryAvailableExternalTitleDatabase(NULL);
+    }
+
+    Result res = AM_InstallTitleBegin(dest, title->titleId, false);
+    if(R_SUCCEEDED(res)) {
+        title->started = true;
     }
+
+    return res;
 }
 
-static Result action_install_cdn_close_dst(void* data, u32 index, bool succeeded, u32 handle) {
-    if(succeeded) {
-        if(index == 0) {
-            return AM_InstallTmdFinish(handle, true);
-        } else {
-            return AM_InstallContentFinish(handle);
+static Result action_install_cdn_finish_title(cdn_title* title) {
+    title->started = false;
+
+    Result res = 0;
+    if(R_SUCCEEDED(res = AM_InstallTitleFinish())
+       && R_SUCCEEDED(res = AM_CommitImportTitles(((title->titleId >> 32) & 0x8010) != 0 ? MEDIATYPE_NAND : MEDIATYPE_SD, 1, false, &title->titleId))) {
+        if(title->titleId == 0x0004013800000002 || title->titleId == 0x0004013820000002) {
+            res = AM_InstallFirm(title->titleId);
         }
+    }
+
+    if(R_FAILED(res)) {
+        AM_InstallTitleAbort();
     } else {
-        if(index == 0) {
-            return AM_InstallTmdAbort(handle);
-        } else {
-            return AM_InstallContentCancel(handle);
+        title->installed = true;
+    }
+
+    return res;
+}
+
+static Result action_install_cdn_open_dst(void* data, u32 index, void* initialReadBlock, u32* handle) {
+    install_cdn_data* installData = (install_cdn_data*) data;
+
+    cdn_title* title = action_install_cdn_find_title(installData, index);
+    cdn_content* content = action_install_cdn_find_content(installData, index);
+
+    if(content == NULL) {
+        Result res = 0;
+        if(R_FAILED(res = action_install_cdn_begin_title(title))) {
+            return res;
         }
+
+        return AM_InstallTmdBegin(handle);
+    } else {
+        return AM_InstallContentBegin(handle, content->index);
+    }
+}
+
+static Result action_install_cdn_close_dst(void* data, u32 index, bool succeeded, u32 handle) {
+    install_cdn_data* installData = (install_cdn_data*) data;
+
+    cdn_title* title = action_install_cdn_find_title(installData, index);
+    bool tmd = index == title->firstIndex;
+
+    if(!succeeded) {
+        return tmd ? AM_InstallTmdAbort(handle) : AM_InstallContentCancel(handle);
+    }
+
+    Result res = tmd ? AM_InstallTmdFinish(handle, true) : AM_InstallContentFinish(handle);
+
+    // Each title is committed as soon as its last content is in.
+    if(R_SUCCEEDED(res) && index == title->firstIndex + title->contentCount) {
+        res = action_install_cdn_finish_title(title);
     }
+
+    return res;
 }
 
 static Result action_install_cdn_write_dst(void* data, u32 handle, u32* bytesWritten, void* buffer, u64 offset, u32 size) {
@@ -141,10 +856,33 @@ static Result action_install_cdn_write_dst(void* data, u32 handle, u32* bytesWri
 bool action_install_cdn_error(void* data, u32 index, Result res) {
     install_cdn_data* installData = (install_cdn_data*) data;
 
+    cdn_title* title = installData->laidOut ? action_install_cdn_find_title(installData, index) : NULL;
+    if(title != NULL) {
+        if(title->started) {
+            AM_InstallTitleAbort();
+            title->started = false;
+        }
+
+        if(R_SUCCEEDED(title->res)) {
+            title->res = res;
+            title->err = errno;
+            title->responseCode = installData->responseCode;
+        }
+    }
+
+    // Queue installs move on to the next title and report failures at the end.
+    if(installData->ticket == NULL) {
+        return res != R_FBI_CANCELLED && index < installData->installInfo.total - 1;
+    }
+
     if(res == R_FBI_CANCELLED) {
         prompt_display("Failure", "Install cancelled.", COLOR_TEXT, false, installData->ticket, NULL, ui_draw_ticket_info, NULL);
     } else if(res == R_FBI_HTTP_RESPONSE_CODE) {
         error_display(NULL, installData->ticket, ui_draw_ticket_info, "Failed to install CDN title.\nHTTP server returned response code %d", installData->responseCode);
+    } else if(res == R_FBI_ERRNO) {
+        error_display_errno(NULL, installData->ticket, ui_draw_ticket_info, errno, "Failed to install CDN title.");
+    } else if(res == R_FBI_WRONG_SYSTEM) {
+        error_display(NULL, installData->ticket, ui_draw_ticket_info, "Failed to install CDN title.\nAttempted to install N3DS title to O3DS.");
     } else {
         error_display_res(NULL, installData->ticket, ui_draw_ticket_info, res, "Failed to install CDN title.");
     }
@@ -153,13 +891,93 @@ bool action_install_cdn_error(void* data, u32 index, Result res) {
 }
 
 static void action_install_cdn_draw_top(ui_view* view, void* data, float x1, float y1, float x2, float y2) {
-    ui_draw_ticket_info(view, ((install_cdn_data*) data)->ticket, x1, y1, x2, y2);
+    install_cdn_data* installData = (install_cdn_data*) data;
+
+    if(installData->ticket != NULL) {
+        ui_draw_ticket_info(view, installData->ticket, x1, y1, x2, y2);
+    }
 }
 
 static void action_install_cdn_free_data(install_cdn_data* data) {
+    action_install_cdn_stop_prefetch(data);
+
+    cdncache_flush();
+
+    svcWaitSynchronization(data->poolMutex, U64_MAX);
+
+    for(u32 i = 0; i < CDN_TMD_PIPELINE_DEPTH; i++) {
+        httpclient_finish(&data->tmdRequests[i], CDN_TIMEOUT);
+    }
+
+    svcReleaseMutex(data->poolMutex);
+
+    httpclient_pool_close(&data->pool);
+    svcCloseHandle(data->poolMutex);
+
+    for(u32 i = 0; i < data->titleCount; i++) {
+        free(data->titles[i].tmd);
+        free(data->titles[i].contents);
+    }
+
+    free(data->titles);
     free(data);
 }
 
+static void action_install_cdn_describe_failure(cdn_title* title, char* text, size_t size) {
+    if(title->res == R_FBI_CANCELLED) {
+        snprintf(text, size, "Cancelled");
+    } else if(title->res == R_FBI_HTTP_RESPONSE_CODE) {
+        snprintf(text, size, "HTTP response code %lu", title->responseCode);
+    } else if(title->res == R_FBI_ERRNO) {
+        snprintf(text, size, "%s", strerror(title->err));
+    } else if(title->res == R_FBI_WRONG_SYSTEM) {
+        snprintf(text, size, "N3DS title");
+    } else if(R_FAILED(title->res)) {
+        snprintf(text, size, "Result 0x%08lX", title->res);
+    } else {
+        snprintf(text, size, "Not installed");
+    }
+}
+
+// Shows how each title of a queue install went.
+static void action_install_cdn_report(install_cdn_data* data) {
+    u32 installed = 0;
+    for(u32 i = 0; i < data->titleCount; i++) {
+        if(data->titles[i].installed) {
+            installed++;
+        }
+    }
+
+    if(installed == data->titleCount) {
+        prompt_display("Success", "Queued titles installed.", COLOR_TEXT, false, NULL, NULL, NULL, NULL);
+        return;
+    }
+
+    char failures[1024] = {'\0'};
+    size_t len = 0;
+
+    u32 listed = 0;
+    for(u32 i = 0; i < data->titleCount; i++) {
+        cdn_title* title = &data->titles[i];
+        if(title->installed) {
+            continue;
+        }
+
+        if(listed == 8) {
+            snprintf(failures + len, sizeof(failures) - len, "\n...and %lu more", data->titleCount - installed - listed);
+            break;
+        }
+
+        char reason[64];
+        action_install_cdn_describe_failure(title, reason, sizeof(reason));
+
+        len += snprintf(failures + len, sizeof(failures) - len, "\n%016llX: %s", title->titleId, reason);
+        listed++;
+    }
+
+    error_display(NULL, NULL, NULL, "Installed %lu of %lu queued titles.%s", installed, data->titleCount, failures);
+}
+
 static void action_install_cdn_update(ui_view* view, void* data, float* progress, char* text) {
     install_cdn_data* installData = (install_cdn_data*) data;
 
@@ -167,25 +985,18 @@ static void action_install_cdn_update(ui_view* view, void* data, float* progress
         ui_pop();
         info_destroy(view);
 
-        Result res = 0;
-
-        if(!installData->installInfo.premature) {
-            if(R_SUCCEEDED(res = AM_InstallTitleFinish())
-               && R_SUCCEEDED(res = AM_CommitImportTitles(((installData->ticket->titleId >> 32) & 0x8010) != 0 ? MEDIATYPE_NAND : MEDIATYPE_SD, 1, false, &installData->ticket->titleId))) {
-                if(installData->ticket->titleId == 0x0004013800000002 || installData->ticket->titleId == 0x0004013820000002) {
-                    res = AM_InstallFirm(installData->ticket->titleId);
-                }
+        // A title cut short by a cancel.
+        for(u32 i = 0; i < installData->titleCount; i++) {
+            if(installData->titles[i].started) {
+                AM_InstallTitleAbort();
+                installData->titles[i].started = false;
             }
         }
 
-        if(!installData->installInfo.premature && R_SUCCEEDED(res)) {
+        if(installData->ticket == NULL) {
+            action_install_cdn_report(installData);
+        } else if(!installData->installInfo.premature) {
             prompt_display("Success", "Install finished.", COLOR_TEXT, false, installData->ticket, NULL, ui_draw_ticket_info, NULL);
-        } else {
-            AM_InstallTitleAbort();
-
-            if(R_FAILED(res)) {
-                error_display_res(NULL, installData->ticket, ui_draw_ticket_info, res, "Failed to install CDN title.");
-            }
         }
 
         action_install_cdn_free_data(installData);
@@ -197,43 +1008,38 @@ static void action_install_cdn_update(ui_view* view, void* data, float* progress
         svcSignalEvent(installData->cancelEvent);
     }
 
-    *progress = installData->installInfo.currTotal != 0 ? (float) ((double) installData->installInfo.currProcessed / (double) installData->installInfo.currTotal) : 0;
-    snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%.2f MB / %.2f MB", installData->installInfo.processed, installData->installInfo.total, installData->installInfo.currProcessed / 1024.0 / 1024.0, installData->installInfo.currTotal / 1024.0 / 1024.0);
-}
-
-static void action_install_cdn_onresponse(ui_view* view, void* data, bool response) {
-    install_cdn_data* installData = (install_cdn_data*) data;
-
-    if(response) {
-        u8 n3ds = false;
-        if(R_SUCCEEDED(APT_CheckNew3DS(&n3ds)) && !n3ds && ((installData->ticket->titleId >> 28) & 0xF) == 2) {
-            error_display(NULL, installData->ticket, ui_draw_ticket_info, "Failed to install CDN title.\nAttempted to install N3DS title to O3DS.");
-
-            action_install_cdn_free_data(installData);
+    info_get_data_op_progress(&installData->installInfo, progress, text);
 
-            return;
-        }
+    if(installData->ticket == NULL && installData->laidOut) {
+        size_t len = strlen(text);
+        snprintf(text + len, PROGRESS_TEXT_MAX - len, "\nTitle %lu / %lu: %016llX", installData->currTitle + 1, installData->titleCount, installData->titles[installData->currTitle].titleId);
+    }
 
-        FS_MediaType dest = ((installData->ticket->titleId >> 32) & 0x8010) != 0 ? MEDIATYPE_NAND : MEDIATYPE_SD;
+    if(installData->lastWaitMs != 0) {
+        size_t len = strlen(text);
+        snprintf(text + len, PROGRESS_TEXT_MAX - len, "\nLast request: %lu ms (%s)", installData->lastWaitMs, installData->lastReused ? "reused" : "new connection");
+    }
 
-        AM_DeleteTitle(dest, installData->ticket->titleId);
-        if(dest == MEDIATYPE_SD) {
-            AM_QueryAvailableExternalTitleDatabase(NULL);
-        }
+    if(installData->resumeCount > 0) {
+        size_t len = strlen(text);
+        snprintf(text + len, PROGRESS_TEXT_MAX - len, "\nDownloads resumed: %lu", installData->resumeCount);
+    }
 
-        Result res = 0;
+    if(installData->cachedCount > 0) {
+        size_t len = strlen(text);
+        snprintf(text + len, PROGRESS_TEXT_MAX - len, "\nContents from cache: %lu", installData->cachedCount);
+    }
+}
 
-        if(R_SUCCEEDED(res = AM_InstallTitleBegin(dest, installData->ticket->titleId, false))) {
-            installData->cancelEvent = task_data_op(&installData->installInfo);
-            if(installData->cancelEvent != 0) {
-                info_display("Installing CDN Title", "Press B to cancel.", true, data, action_install_cdn_update, action_install_cdn_draw_top);
-            } else {
-                AM_InstallTitleAbort();
-            }
-        }
+static void action_install_cdn_onresponse(ui_view* view, void* data, bool response) {
+    install_cdn_data* installData = (install_cdn_data*) data;
 
-        if(R_FAILED(res) || installData->cancelEvent == 0) {
-            error_display(NULL, installData->ticket, ui_draw_ticket_info, "Failed to initiate CDN title installation.");
+    if(response) {
+        installData->cancelEvent = task_data_op(&installData->installInfo);
+        if(installData->cancelEvent != 0) {
+            info_display(installData->ticket != NULL ? "Installing CDN Title" : "Installing CDN Titles", "Press B to cancel.", true, data, action_install_cdn_update, action_install_cdn_draw_top);
+        } else {
+            error_display(NULL, installData->ticket, installData->ticket != NULL ? ui_draw_ticket_info : NULL, "Failed to initiate CDN title installation.");
 
             action_install_cdn_free_data(installData);
         }
@@ -242,31 +1048,67 @@ static void action_install_cdn_onresponse(ui_view* view, void* data, bool respon
     }
 }
 
-void action_install_cdn(ticket_info* info, bool* populated) {
+// Takes ownership of titleIds.
+static void action_install_cdn_titles(ticket_info* info, u64* titleIds, u32 count, const char* message) {
     install_cdn_data* data = (install_cdn_data*) calloc(1, sizeof(install_cdn_data));
     if(data == NULL) {
         error_display(NULL, NULL, NULL, "Failed to allocate install CDN data.");
 
+        free(titleIds);
         return;
     }
 
     data->ticket = info;
 
+    if((data->titles = (cdn_title*) calloc(count, sizeof(cdn_title))) == NULL) {
+        error_display(NULL, NULL, NULL, "Failed to allocate CDN title table.");
+
+        free(titleIds);
+        free(data);
+        return;
+    }
+
+    for(u32 i = 0; i < count; i++) {
+        data->titles[i].titleId = titleIds[i];
+    }
+
+    data->titleCount = count;
+    free(titleIds);
+
     data->responseCode = 0;
 
+    Result mutexRes = svcCreateMutex(&data->poolMutex, false);
+    if(R_FAILED(mutexRes)) {
+        error_display_res(NULL, info, info != NULL ? ui_draw_ticket_info : NULL, mutexRes, "Failed to create CDN connection pool mutex.");
+
+        free(data->titles);
+        free(data);
+        return;
+    }
+
+    httpclient_pool_init(&data->pool);
+
     data->installInfo.data = data;
 
+    data->installInfo.name = "CDN install";
+
     data->installInfo.op = DATAOP_COPY;
 
+    data->installInfo.ordered = true;
+
+    data->installInfo.autoChunkSize = true;
+
     data->installInfo.copyEmpty = false;
 
-    data->installInfo.total = 1;
+    // One index per title while sizing up; see action_install_cdn_lay_out.
+    data->installInfo.total = count;
 
     data->installInfo.isSrcDirectory = action_install_cdn_is_src_directory;
     data->installInfo.makeDstDirectory = action_install_cdn_make_dst_directory;
 
     data->installInfo.openSrc = action_install_cdn_open_src;
     data->installInfo.closeSrc = action_install_cdn_close_src;
+    data->installInfo.prescanSrcSize = action_install_cdn_prescan_src_size;
     data->installInfo.getSrcSize = action_install_cdn_get_src_size;
     data->installInfo.readSrc = action_install_cdn_read_src;
 
@@ -278,5 +1120,57 @@ void action_install_cdn(ticket_info* info, bool* populated) {
 
     data->cancelEvent = 0;
 
-    prompt_display("Confirmation", "Install the selected title from the CDN?", COLOR_TEXT, true, data, NULL, action_install_cdn_draw_top, action_install_cdn_onresponse);
+    prompt_display("Confirmation", message, COLOR_TEXT, true, data, NULL, action_install_cdn_draw_top, action_install_cdn_onresponse);
+}
+
+void action_install_cdn(ticket_info* info, bool* populated) {
+    u64* titleIds = (u64*) calloc(1, sizeof(u64));
+    if(titleIds == NULL) {
+        error_display(NULL, NULL, NULL, "Failed to allocate title ID buffer.");
+
+        return;
+    }
+
+    titleIds[0] = info->titleId;
+
+    action_install_cdn_titles(info, titleIds, 1, "Install the selected title from the CDN?");
+}
+
+void action_queue_cdn(ticket_info* info, bool* populated) {
+    for(u32 i = 0; i < cdn_queue_count; i++) {
+        if(cdn_queue[i] == info->titleId) {
+            cdn_queue[i] = cdn_queue[--cdn_queue_count];
+
+            prompt_display("Success", "Title removed from the CDN install queue.", COLOR_TEXT, false, info, NULL, ui_draw_ticket_info, NULL);
+            return;
+        }
+    }
+
+    u64* queue = (u64*) realloc(cdn_queue, (cdn_queue_count + 1) * sizeof(u64));
+    if(queue == NULL) {
+        error_display(NULL, info, ui_draw_ticket_info, "Failed to allocate CDN install queue.");
+
+        return;
+    }
+
+    cdn_queue = queue;
+    cdn_queue[cdn_queue_count++] = info->titleId;
+
+    prompt_display("Success", "Title added to the CDN install queue.", COLOR_TEXT, false, info, NULL, ui_draw_ticket_info, NULL);
+}
+
+void action_install_cdn_queue(ticket_info* info, bool* populated) {
+    if(cdn_queue_count == 0) {
+        prompt_display("Failure", "The CDN install queue is empty.\nAdd titles to it with \"Queue for CDN Install\".", COLOR_TEXT, false, info, NULL, ui_draw_ticket_info, NULL);
+        return;
+    }
+
+    // The queue is handed over whole and starts over empty.
+    u64* titleIds = cdn_queue;
+    u32 count = cdn_queue_count;
+
+    cdn_queue = NULL;
+    cdn_queue_count = 0;
+
+    action_install_cdn_titles(NULL, titleIds, count, "Install all queued titles from the CDN?");
 }
\ No newline at end of file
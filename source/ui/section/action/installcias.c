@@ -67,6 +67,18 @@ static Result action_install_cias_close_src(void* data, u32 index, bool succeede
     return res;
 }
 
+static Result action_install_cias_prescan_src_size(void* data, u32 index, u64* size) {
+    Result res = 0;
+
+    u32 handle = 0;
+    if(R_SUCCEEDED(res = action_install_cias_open_src(data, index, &handle))) {
+        res = FSFILE_GetSize(handle, size);
+        FSFILE_Close(handle);
+    }
+
+    return res;
+}
+
 static Result action_install_cias_get_src_size(void* data, u32 handle, u64* size) {
     return FSFILE_GetSize(handle, size);
 }
@@ -195,8 +207,7 @@ static void action_install_cias_update(ui_view* view, void* data, float* progres
         svcSignalEvent(installData->cancelEvent);
     }
 
-    *progress = installData->installInfo.currTotal != 0 ? (float) ((double) installData->installInfo.currProcessed / (double) installData->installInfo.currTotal) : 0;
-    snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%.2f MB / %.2f MB", installData->installInfo.processed, installData->installInfo.total, installData->installInfo.currProcessed / 1024.0 / 1024.0, installData->installInfo.currTotal / 1024.0 / 1024.0);
+    info_get_data_op_progress(&installData->installInfo, progress, text);
 }
 
 static void action_install_cias_onresponse(ui_view* view, void* data, bool response) {
@@ -232,8 +243,12 @@ static void action_install_cias_internal(file_info* info, bool* populated, bool
 
     data->installInfo.data = data;
 
+    data->installInfo.name = "CIA install";
+
     data->installInfo.op = DATAOP_COPY;
 
+    data->installInfo.autoChunkSize = true;
+
     data->installInfo.copyEmpty = false;
 
     data->installInfo.isSrcDirectory = action_install_cias_is_src_directory;
@@ -241,6 +256,7 @@ static void action_install_cias_internal(file_info* info, bool* populated, bool
 
     data->installInfo.openSrc = action_install_cias_open_src;
     data->installInfo.closeSrc = action_install_cias_close_src;
+    data->installInfo.prescanSrcSize = action_install_cias_prescan_src_size;
     data->installInfo.getSrcSize = action_install_cias_get_src_size;
     data->installInfo.readSrc = action_install_cias_read_src;
 
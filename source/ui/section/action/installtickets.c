@@ -126,8 +126,7 @@ static void action_install_tickets_update(ui_view* view, void* data, float* prog
         svcSignalEvent(installData->cancelEvent);
     }
 
-    *progress = installData->installInfo.currTotal != 0 ? (float) ((double) installData->installInfo.currProcessed / (double) installData->installInfo.currTotal) : 0;
-    snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%.2f MB / %.2f MB", installData->installInfo.processed, installData->installInfo.total, installData->installInfo.currProcessed / 1024.0 / 1024.0, installData->installInfo.currTotal / 1024.0 / 1024.0);
+    info_get_data_op_progress(&installData->installInfo, progress, text);
 }
 
 static void action_install_tickets_onresponse(ui_view* view, void* data, bool response) {
@@ -159,6 +158,8 @@ void action_install_tickets(file_info* info, bool* populated) {
 
     data->installInfo.data = data;
 
+    data->installInfo.name = "Ticket install";
+
     data->installInfo.op = DATAOP_COPY;
 
     data->installInfo.copyEmpty = false;
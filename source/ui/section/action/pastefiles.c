@@ -81,6 +81,25 @@ static Result action_paste_files_close_src(void* data, u32 index, bool succeeded
     return FSFILE_Close(handle);
 }
 
+static Result action_paste_files_prescan_src_size(void* data, u32 index, u64* size) {
+    paste_files_data* pasteData = (paste_files_data*) data;
+
+    if(util_is_dir(pasteData->base->archive, pasteData->contents[index])) {
+        *size = 0;
+        return 0;
+    }
+
+    Result res = 0;
+
+    u32 handle = 0;
+    if(R_SUCCEEDED(res = action_paste_files_open_src(data, index, &handle))) {
+        res = FSFILE_GetSize(handle, size);
+        FSFILE_Close(handle);
+    }
+
+    return res;
+}
+
 static Result action_paste_files_get_src_size(void* data, u32 handle, u64* size) {
     return FSFILE_GetSize(handle, size);
 }
@@ -138,7 +157,9 @@ static bool action_paste_files_error(void* data, u32 index, Result res) {
         }
     }
 
-    return index < pasteData->pasteInfo.total - 1;
+    // Workers finish out of order, so the index says nothing about what is left. The pool
+    // stops by itself once every item has been claimed; only a cancel ends it early.
+    return svcWaitSynchronization(pasteData->cancelEvent, 0) != 0;
 }
 
 static void action_paste_files_draw_top(ui_view* view, void* data, float x1, float y1, float x2, float y2) {
@@ -176,8 +197,7 @@ static void action_paste_files_update(ui_view* view, void* data, float* progress
         svcSignalEvent(pasteData->cancelEvent);
     }
 
-    *progress = pasteData->pasteInfo.currTotal != 0 ? (float) ((double) pasteData->pasteInfo.currProcessed / (double) pasteData->pasteInfo.currTotal) : 0;
-    snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%.2f MB / %.2f MB", pasteData->pasteInfo.processed, pasteData->pasteInfo.total, pasteData->pasteInfo.currProcessed / 1024.0 / 1024.0, pasteData->pasteInfo.currTotal / 1024.0 / 1024.0);
+    info_get_data_op_progress(&pasteData->pasteInfo, progress, text);
 }
 
 static void action_paste_files_onresponse(ui_view* view, void* data, bool response) {
@@ -212,8 +232,12 @@ void action_paste_contents(file_info* info, bool* populated) {
 
     data->pasteInfo.data = data;
 
+    data->pasteInfo.name = "Paste";
+
     data->pasteInfo.op = DATAOP_COPY;
 
+    data->pasteInfo.workers = DATAOP_WORKERS_MAX;
+
     data->pasteInfo.copyEmpty = true;
 
     data->pasteInfo.isSrcDirectory = action_paste_files_is_src_directory;
@@ -221,6 +245,7 @@ void action_paste_contents(file_info* info, bool* populated) {
 
     data->pasteInfo.openSrc = action_paste_files_open_src;
     data->pasteInfo.closeSrc = action_paste_files_close_src;
+    data->pasteInfo.prescanSrcSize = action_paste_files_prescan_src_size;
     data->pasteInfo.getSrcSize = action_paste_files_get_src_size;
     data->pasteInfo.readSrc = action_paste_files_read_src;
 
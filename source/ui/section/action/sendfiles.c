@@ -0,0 +1,320 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <3ds.h>
+
+#include "action.h"
+#include "../../error.h"
+#include "../../info.h"
+#include "../../prompt.h"
+#include "../../../net/netsend.h"
+#include "../../../screen.h"
+#include "../../../util.h"
+
+typedef struct {
+    file_info* base;
+    char** contents;
+
+    // Names sent to the receiver are relative to the parent of base.
+    size_t prefixLength;
+    u64 currSize;
+
+    netsend_conn conn;
+    volatile bool discovering;
+    char receiverText[128];
+
+    data_op_info sendInfo;
+    Handle cancelEvent;
+} send_files_data;
+
+static void action_send_files_get_name(send_files_data* data, u32 index, char* name) {
+    strncpy(name, data->contents[index] + data->prefixLength, PATH_MAX);
+    name[PATH_MAX - 1] = '\0';
+
+    size_t len = strlen(name);
+    if(len > 0 && name[len - 1] == '/') {
+        name[len - 1] = '\0';
+    }
+}
+
+static bool action_send_files_is_cancelled(void* data) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    return task_is_quit_all() || svcWaitSynchronization(sendData->cancelEvent, 0) == 0;
+}
+
+// The receiver is looked for once the first item is ready to go.
+static Result action_send_files_connect(send_files_data* data) {
+    if(data->conn.socket >= 0) {
+        return 0;
+    }
+
+    netsend_receiver receiver;
+
+    data->discovering = true;
+    int ret = netsend_discover(&receiver, NETSEND_DISCOVER_TIMEOUT, action_send_files_is_cancelled, data);
+    data->discovering = false;
+
+    if(ret < 0) {
+        return errno == ECANCELED ? R_FBI_CANCELLED : R_FBI_ERRNO;
+    }
+
+    struct in_addr addr = {receiver.address};
+    snprintf(data->receiverText, sizeof(data->receiverText), "Send to the receiver at %s?\nPairing code: %04lu\nCheck that fbirecv shows the same code.",
+             inet_ntoa(addr), receiver.code);
+
+    if(!prompt_display_wait("Confirmation", data->receiverText, COLOR_TEXT, data->base, ui_draw_file_info)) {
+        return R_FBI_CANCELLED;
+    }
+
+    return netsend_open(&data->conn, &receiver) < 0 ? R_FBI_ERRNO : 0;
+}
+
+static Result action_send_files_is_src_directory(void* data, u32 index, bool* isDirectory) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    *isDirectory = util_is_dir(sendData->base->archive, sendData->contents[index]);
+    return 0;
+}
+
+static Result action_send_files_make_dst_directory(void* data, u32 index) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    Result res = 0;
+    if(R_FAILED(res = action_send_files_connect(sendData))) {
+        return res;
+    }
+
+    char name[PATH_MAX];
+    action_send_files_get_name(sendData, index, name);
+
+    return netsend_send_directory(&sendData->conn, name) < 0 ? R_FBI_ERRNO : 0;
+}
+
+static Result action_send_files_open_src(void* data, u32 index, u32* handle) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    Result res = 0;
+
+    FS_Path* fsPath = util_make_path_utf8(sendData->contents[index]);
+    if(fsPath != NULL) {
+        res = FSUSER_OpenFile(handle, *sendData->base->archive, *fsPath, FS_OPEN_READ, 0);
+
+        util_free_path_utf8(fsPath);
+    } else {
+        res = R_FBI_OUT_OF_MEMORY;
+    }
+
+    return res;
+}
+
+static Result action_send_files_close_src(void* data, u32 index, bool succeeded, u32 handle) {
+    return FSFILE_Close(handle);
+}
+
+static Result action_send_files_prescan_src_size(void* data, u32 index, u64* size) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    if(util_is_dir(sendData->base->archive, sendData->contents[index])) {
+        *size = 0;
+        return 0;
+    }
+
+    Result res = 0;
+
+    u32 handle = 0;
+    if(R_SUCCEEDED(res = action_send_files_open_src(data, index, &handle))) {
+        res = FSFILE_GetSize(handle, size);
+        FSFILE_Close(handle);
+    }
+
+    return res;
+}
+
+static Result action_send_files_get_src_size(void* data, u32 handle, u64* size) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    Result res = FSFILE_GetSize(handle, size);
+    if(R_SUCCEEDED(res)) {
+        sendData->currSize = *size;
+    }
+
+    return res;
+}
+
+static Result action_send_files_read_src(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size) {
+    return FSFILE_Read(handle, bytesRead, offset, buffer, size);
+}
+
+static Result action_send_files_open_dst(void* data, u32 index, void* initialReadBlock, u32* handle) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    Result res = 0;
+    if(R_FAILED(res = action_send_files_connect(sendData))) {
+        return res;
+    }
+
+    char name[PATH_MAX];
+    action_send_files_get_name(sendData, index, name);
+
+    if(netsend_begin_file(&sendData->conn, name, sendData->currSize) < 0) {
+        return R_FBI_ERRNO;
+    }
+
+    // The data op only closes destinations with a non-zero handle.
+    *handle = 1;
+    return 0;
+}
+
+static Result action_send_files_close_dst(void* data, u32 index, bool succeeded, u32 handle) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    return netsend_finish_file(&sendData->conn, !succeeded) < 0 && succeeded ? R_FBI_ERRNO : 0;
+}
+
+static Result action_send_files_write_dst(void* data, u32 handle, u32* bytesWritten, void* buffer, u64 offset, u32 size) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    *bytesWritten = size;
+    return netsend_write_file(&sendData->conn, buffer, size) < 0 ? R_FBI_ERRNO : 0;
+}
+
+static bool action_send_files_error(void* data, u32 index, Result res) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    if(res == R_FBI_CANCELLED) {
+        prompt_display("Failure", "Send cancelled.", COLOR_TEXT, false, sendData->base, NULL, ui_draw_file_info, NULL);
+        return false;
+    }
+
+    char* path = sendData->contents[index];
+
+    volatile bool dismissed = false;
+    if(res == R_FBI_ERRNO) {
+        if(strlen(path) > 48) {
+            error_display_errno(&dismissed, sendData->base, ui_draw_file_info, errno, "Failed to send content.\n%.45s...", path);
+        } else {
+            error_display_errno(&dismissed, sendData->base, ui_draw_file_info, errno, "Failed to send content.\n%.48s", path);
+        }
+    } else {
+        if(strlen(path) > 48) {
+            error_display_res(&dismissed, sendData->base, ui_draw_file_info, res, "Failed to send content.\n%.45s...", path);
+        } else {
+            error_display_res(&dismissed, sendData->base, ui_draw_file_info, res, "Failed to send content.\n%.48s", path);
+        }
+    }
+
+    while(!dismissed) {
+        svcSleepThread(1000000);
+    }
+
+    // Connection problems would only fail every remaining item.
+    return res != R_FBI_ERRNO && index < sendData->sendInfo.total - 1;
+}
+
+static void action_send_files_draw_top(ui_view* view, void* data, float x1, float y1, float x2, float y2) {
+    ui_draw_file_info(view, ((send_files_data*) data)->base, x1, y1, x2, y2);
+}
+
+static void action_send_files_free_data(send_files_data* data) {
+    netsend_close(&data->conn, NETSEND_CLOSE_TIMEOUT);
+
+    util_free_contents(data->contents, data->sendInfo.total);
+    free(data);
+}
+
+static void action_send_files_update(ui_view* view, void* data, float* progress, char* text) {
+    send_files_data* sendData = (send_files_data*) data;
+
+    if(sendData->sendInfo.finished) {
+        ui_pop();
+        info_destroy(view);
+
+        if(!sendData->sendInfo.premature) {
+            prompt_display("Success", "Contents sent.", COLOR_TEXT, false, sendData->base, NULL, ui_draw_file_info, NULL);
+        }
+
+        action_send_files_free_data(sendData);
+
+        return;
+    }
+
+    if(hidKeysDown() & KEY_B) {
+        svcSignalEvent(sendData->cancelEvent);
+    }
+
+    info_get_data_op_progress(&sendData->sendInfo, progress, text);
+
+    if(sendData->discovering) {
+        size_t len = strlen(text);
+        snprintf(text + len, PROGRESS_TEXT_MAX - len, "\nWaiting for a receiver...");
+    }
+}
+
+static void action_send_files_onresponse(ui_view* view, void* data, bool response) {
+    send_files_data* sendData = (send_files_data*) data;
+    if(response) {
+        sendData->cancelEvent = task_data_op(&sendData->sendInfo);
+        if(sendData->cancelEvent != 0) {
+            info_display("Sending Contents", "Press B to cancel.", true, data, action_send_files_update, action_send_files_draw_top);
+        } else {
+            error_display(NULL, sendData->base, ui_draw_file_info, "Failed to initiate send operation.");
+        }
+    } else {
+        action_send_files_free_data(sendData);
+    }
+}
+
+void action_send_contents(file_info* info, bool* populated) {
+    send_files_data* data = (send_files_data*) calloc(1, sizeof(send_files_data));
+    if(data == NULL) {
+        error_display(NULL, NULL, NULL, "Failed to allocate send files data.");
+
+        return;
+    }
+
+    data->base = info;
+    data->conn.socket = -1;
+
+    char parentPath[PATH_MAX];
+    util_get_parent_path(parentPath, info->path, PATH_MAX);
+    data->prefixLength = strlen(parentPath);
+
+    data->sendInfo.data = data;
+
+    data->sendInfo.name = "Send";
+
+    data->sendInfo.op = DATAOP_COPY;
+
+    data->sendInfo.copyEmpty = true;
+
+    data->sendInfo.isSrcDirectory = action_send_files_is_src_directory;
+    data->sendInfo.makeDstDirectory = action_send_files_make_dst_directory;
+
+    data->sendInfo.openSrc = action_send_files_open_src;
+    data->sendInfo.closeSrc = action_send_files_close_src;
+    data->sendInfo.prescanSrcSize = action_send_files_prescan_src_size;
+    data->sendInfo.getSrcSize = action_send_files_get_src_size;
+    data->sendInfo.readSrc = action_send_files_read_src;
+
+    data->sendInfo.openDst = action_send_files_open_dst;
+    data->sendInfo.closeDst = action_send_files_close_dst;
+    data->sendInfo.writeDst = action_send_files_write_dst;
+
+    data->sendInfo.error = action_send_files_error;
+
+    data->cancelEvent = 0;
+
+    Result res = 0;
+    if(R_FAILED(res = util_populate_contents(&data->contents, &data->sendInfo.total, info->archive, info->path, true, true, NULL, NULL))) {
+        error_display_res(NULL, info, ui_draw_file_info, res, "Failed to retrieve content list.");
+
+        free(data);
+        return;
+    }
+
+    prompt_display("Confirmation", "Send the selected content to a network receiver?\nStart tools/fbirecv on the computer first.", COLOR_TEXT, true, data, NULL, action_send_files_draw_top, action_send_files_onresponse);
+}
\ No newline at end of file
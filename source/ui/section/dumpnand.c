@@ -1,20 +1,492 @@
+#include <arpa/inet.h>
+#include <errno.h>
 #include <malloc.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 #include <3ds.h>
 
 #include "task/task.h"
 #include "section.h"
+#include "../../hash/hash.h"
+#include "../../lz/lz.h"
+#include "../../net/netsend.h"
 #include "../error.h"
 #include "../info.h"
+#include "../list.h"
 #include "../prompt.h"
 #include "../../screen.h"
 
+#define DUMPNAND_JOURNAL_MAGIC 0x4A494246 // "FBIJ"
+#define DUMPNAND_Z_MAGIC 0x5A494246 // "FBIZ"
+#define DUMPNAND_Z_VERSION 1
+#define DUMPNAND_S_MAGIC 0x53494246 // "FBIS"
+#define DUMPNAND_S_VERSION 1
+#define DUMPNAND_D_MAGIC 0x44494246 // "FBID"
+#define DUMPNAND_D_VERSION 1
+#define DUMPNAND_M_MAGIC 0x4D494246 // "FBIM"
+#define DUMPNAND_M_VERSION 1
+
+#define DUMPNAND_BLOCK_SIZE (1024 * 512)
+
+// A checkpoint flushes the image, reads back the tail of the last chunk and records it in the journal.
+#define DUMPNAND_CHECKPOINT_INTERVAL (1024 * 1024 * 16)
+#define DUMPNAND_TAIL_SIZE (1024 * 64)
+
+// Sparse dumps skip zero-filled runs at this granularity.
+#define DUMPNAND_SPARSE_GRANULE (1024 * 64)
+#define DUMPNAND_SPARSE_EXTENTS_INITIAL 64
+
+typedef enum {
+    DUMPNAND_MODE_RAW,
+    DUMPNAND_MODE_RESUME,
+    DUMPNAND_MODE_COMPRESSED,
+    DUMPNAND_MODE_SPARSE,
+    DUMPNAND_MODE_DIFFERENTIAL,
+    DUMPNAND_MODE_NETWORK
+} dump_nand_mode;
+
+typedef struct {
+    u32 magic;
+    u32 tailSize;
+    u64 imageSize;
+    u64 checkpoint;
+    u32 tailChecksum;
+    u32 reserved;
+} dump_nand_journal;
+
+// Compressed images are a header, the blocks back to back, then an index with one entry per
+// DUMPNAND_BLOCK_SIZE bytes of NAND so that any offset can be read without decoding the rest.
+// All fields are little-endian; tools/fbiz.c reads and verifies this format.
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 blockSize;
+    u32 blockCount;
+    u64 imageSize;
+    u64 indexOffset;
+} dump_nand_z_header;
+
+#define DUMPNAND_Z_BLOCK_COMPRESSED 0x1
+
+typedef struct {
+    u64 offset;
+    u32 size;
+    u32 flags;
+    u32 checksum;
+    u32 reserved;
+} dump_nand_z_block;
+
+// Sparse images are a header, the non-zero data back to back, then an extent table mapping
+// that data to NAND offsets. Anything not covered by an extent is zero. All fields are
+// little-endian; tools/fbis.c expands this format to a raw image.
 typedef struct {
+    u32 magic;
+    u32 version;
+    u32 extentCount;
+    u32 reserved;
+    u64 imageSize;
+    u64 tableOffset;
+} dump_nand_s_header;
+
+typedef struct {
+    u64 imageOffset;
+    u64 dataOffset;
+    u64 length;
+} dump_nand_s_extent;
+
+// Differential dumps hash every DUMPNAND_BLOCK_SIZE block and store only those whose hash differs
+// from the manifest of the previous dump. A delta is a header, the changed blocks back to back, then
+// a table of block numbers; parentId names the manifest it was taken against (0 for a full base).
+// The manifest, /NAND.fbm, is a header followed by one hash per block, and is replaced after each
+// successful differential dump. All fields are little-endian; tools/fbid.c rebuilds images.
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 blockSize;
+    u32 blockCount;
+    u64 imageSize;
+    u64 parentId;
+    u64 id;
+    u32 changedCount;
+    u32 reserved;
+    u64 tableOffset;
+} dump_nand_d_header;
+
+typedef struct {
+    u32 block;
+    u32 size;
+    u64 dataOffset;
+    u64 hash;
+} dump_nand_d_block;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 blockSize;
+    u32 blockCount;
+    u64 imageSize;
+    u64 id;
+} dump_nand_manifest;
+
+typedef struct {
+    dump_nand_mode mode;
+
+    dump_nand_journal journal;
+    Handle journalHandle;
+
+    dump_nand_z_header header;
+    dump_nand_z_block* blocks;
+    u32 blockCount;
+    void* lzWork;
+
+    dump_nand_s_header sparseHeader;
+    dump_nand_s_extent* extents;
+    u32 extentCapacity;
+
+    dump_nand_manifest baseManifest;
+    u64* baseHashes;
+
+    dump_nand_d_header diffHeader;
+    dump_nand_d_block* changed;
+    u64* hashes;
+    char deltaPath[64];
+
+    // Network dumps stream the raw image to a receiver instead of the SD card.
+    netsend_conn conn;
+    u64 imageSize;
+    volatile bool discovering;
+    char receiverText[128];
+
+    char promptText[128];
+
     data_op_info dumpInfo;
     Handle cancelEvent;
 } dump_nand_data;
 
+static u32 dumpnand_checksum(const u8* data, u32 size) {
+    u32 hash = 0x811C9DC5;
+    for(u32 i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x01000193;
+    }
+
+    return hash;
+}
+
+static Result dumpnand_open_image(Handle* handle, u32 flags) {
+    FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_BINARY, 0, (u8*) ""}};
+    return FSUSER_OpenFileDirectly(handle, sdmcArchive, fsMakePath(PATH_UTF16, u"/NAND.bin"), flags, 0);
+}
+
+static Result dumpnand_open_z_image(Handle* handle, u32 flags) {
+    FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_BINARY, 0, (u8*) ""}};
+    return FSUSER_OpenFileDirectly(handle, sdmcArchive, fsMakePath(PATH_UTF16, u"/NAND.bin.fbz"), flags, 0);
+}
+
+static Result dumpnand_open_s_image(Handle* handle, u32 flags) {
+    FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_BINARY, 0, (u8*) ""}};
+    return FSUSER_OpenFileDirectly(handle, sdmcArchive, fsMakePath(PATH_UTF16, u"/NAND.bin.fbs"), flags, 0);
+}
+
+static Result dumpnand_open_delta(dump_nand_data* dumpData, Handle* handle, u32 flags) {
+    FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_BINARY, 0, (u8*) ""}};
+    return FSUSER_OpenFileDirectly(handle, sdmcArchive, fsMakePath(PATH_ASCII, dumpData->deltaPath), flags, 0);
+}
+
+static Result dumpnand_open_manifest(Handle* handle, u32 flags) {
+    FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_BINARY, 0, (u8*) ""}};
+    return FSUSER_OpenFileDirectly(handle, sdmcArchive, fsMakePath(PATH_UTF16, u"/NAND.fbm"), flags, 0);
+}
+
+static Result dumpnand_open_journal(Handle* handle, u32 flags) {
+    FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_BINARY, 0, (u8*) ""}};
+    return FSUSER_OpenFileDirectly(handle, sdmcArchive, fsMakePath(PATH_UTF16, u"/NAND.bin.journal"), flags, 0);
+}
+
+static Result dumpnand_delete_journal() {
+    Result res = 0;
+
+    FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_BINARY, 0, (void*) ""}};
+    if(R_SUCCEEDED(res = FSUSER_OpenArchive(&sdmcArchive))) {
+        res = FSUSER_DeleteFile(sdmcArchive, fsMakePath(PATH_UTF16, u"/NAND.bin.journal"));
+        FSUSER_CloseArchive(&sdmcArchive);
+    }
+
+    return res;
+}
+
+static Result dumpnand_write_journal(dump_nand_data* dumpData) {
+    u32 bytesWritten = 0;
+    return FSFILE_Write(dumpData->journalHandle, &bytesWritten, 0, &dumpData->journal, sizeof(dumpData->journal), FS_WRITE_FLUSH);
+}
+
+// Checks that an interrupted dump's journal is intact and still matches the tail of its image.
+static Result dumpnand_load_journal(dump_nand_data* dumpData) {
+    Result res = 0;
+
+    Handle journalHandle = 0;
+    if(R_SUCCEEDED(res = dumpnand_open_journal(&journalHandle, FS_OPEN_READ))) {
+        u32 bytesRead = 0;
+        if(R_SUCCEEDED(res = FSFILE_Read(journalHandle, &bytesRead, 0, &dumpData->journal, sizeof(dumpData->journal)))
+           && (bytesRead != sizeof(dumpData->journal) || dumpData->journal.magic != DUMPNAND_JOURNAL_MAGIC
+               || dumpData->journal.tailSize > DUMPNAND_TAIL_SIZE || dumpData->journal.tailSize > dumpData->journal.checkpoint)) {
+            res = R_FBI_BAD_DATA;
+        }
+
+        FSFILE_Close(journalHandle);
+    }
+
+    if(R_FAILED(res) || dumpData->journal.checkpoint == 0) {
+        return res;
+    }
+
+    Handle imageHandle = 0;
+    if(R_SUCCEEDED(res = dumpnand_open_image(&imageHandle, FS_OPEN_READ))) {
+        u64 imageSize = 0;
+        if(R_SUCCEEDED(res = FSFILE_GetSize(imageHandle, &imageSize))) {
+            if(imageSize >= dumpData->journal.checkpoint) {
+                u8* tail = (u8*) calloc(1, dumpData->journal.tailSize);
+                if(tail != NULL) {
+                    u32 bytesRead = 0;
+                    if(R_SUCCEEDED(res = FSFILE_Read(imageHandle, &bytesRead, dumpData->journal.checkpoint - dumpData->journal.tailSize, tail, dumpData->journal.tailSize))
+                       && (bytesRead != dumpData->journal.tailSize || dumpnand_checksum(tail, dumpData->journal.tailSize) != dumpData->journal.tailChecksum)) {
+                        res = R_FBI_BAD_DATA;
+                    }
+
+                    free(tail);
+                } else {
+                    res = R_FBI_OUT_OF_MEMORY;
+                }
+            } else {
+                res = R_FBI_BAD_DATA;
+            }
+        }
+
+        FSFILE_Close(imageHandle);
+    }
+
+    return res;
+}
+
+static Result dumpnand_checkpoint(dump_nand_data* dumpData, u32 handle, void* buffer, u64 offset, u32 size) {
+    Result res = 0;
+
+    u32 tailSize = size < DUMPNAND_TAIL_SIZE ? size : DUMPNAND_TAIL_SIZE;
+    u8* tail = (u8*) buffer + size - tailSize;
+
+    if(R_SUCCEEDED(res = FSFILE_Flush(handle))) {
+        u8* verify = (u8*) calloc(1, tailSize);
+        if(verify != NULL) {
+            u32 bytesRead = 0;
+            if(R_SUCCEEDED(res = FSFILE_Read(handle, &bytesRead, offset + size - tailSize, verify, tailSize))
+               && (bytesRead != tailSize || memcmp(verify, tail, tailSize) != 0)) {
+                res = R_FBI_BAD_DATA;
+            }
+
+            free(verify);
+        } else {
+            res = R_FBI_OUT_OF_MEMORY;
+        }
+    }
+
+    if(R_SUCCEEDED(res)) {
+        dumpData->journal.checkpoint = offset + size;
+        dumpData->journal.tailSize = tailSize;
+        dumpData->journal.tailChecksum = dumpnand_checksum(tail, tailSize);
+
+        res = dumpnand_write_journal(dumpData);
+    }
+
+    return res;
+}
+
+static bool dumpnand_is_zero(const void* data, u32 size) {
+    // Pool buffers are page aligned and granules are word multiples, so scan a word at a time.
+    const u32* words = (const u32*) data;
+    u32 count = size / sizeof(u32);
+
+    u32 i = 0;
+    for(; i + 4 <= count; i += 4) {
+        if((words[i] | words[i + 1] | words[i + 2] | words[i + 3]) != 0) {
+            return false;
+        }
+    }
+
+    for(; i < count; i++) {
+        if(words[i] != 0) {
+            return false;
+        }
+    }
+
+    const u8* bytes = (const u8*) data;
+    for(u32 j = count * sizeof(u32); j < size; j++) {
+        if(bytes[j] != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static Result dumpnand_write_sparse_run(dump_nand_data* dumpData, u32 handle, void* buffer, u64 imageOffset, u32 length) {
+    Result res = 0;
+
+    // tableOffset tracks the end of the data until the table is written.
+    u64 dataOffset = sizeof(dump_nand_s_header) + dumpData->sparseHeader.tableOffset;
+
+    u32 bytesWritten = 0;
+    if(R_FAILED(res = FSFILE_Write(handle, &bytesWritten, dataOffset, buffer, length, 0))) {
+        return res;
+    }
+
+    dump_nand_s_extent* last = dumpData->sparseHeader.extentCount > 0 ? &dumpData->extents[dumpData->sparseHeader.extentCount - 1] : NULL;
+    if(last != NULL && last->imageOffset + last->length == imageOffset && last->dataOffset + last->length == dataOffset) {
+        last->length += length;
+    } else {
+        if(dumpData->sparseHeader.extentCount >= dumpData->extentCapacity) {
+            u32 capacity = dumpData->extentCapacity > 0 ? dumpData->extentCapacity * 2 : DUMPNAND_SPARSE_EXTENTS_INITIAL;
+
+            dump_nand_s_extent* extents = (dump_nand_s_extent*) realloc(dumpData->extents, capacity * sizeof(dump_nand_s_extent));
+            if(extents == NULL) {
+                return R_FBI_OUT_OF_MEMORY;
+            }
+
+            dumpData->extents = extents;
+            dumpData->extentCapacity = capacity;
+        }
+
+        dump_nand_s_extent* extent = &dumpData->extents[dumpData->sparseHeader.extentCount++];
+        extent->imageOffset = imageOffset;
+        extent->dataOffset = dataOffset;
+        extent->length = length;
+    }
+
+    dumpData->sparseHeader.tableOffset += length;
+    return res;
+}
+
+static Result dumpnand_write_sparse(dump_nand_data* dumpData, u32 handle, void* buffer, u64 offset, u32 size) {
+    Result res = 0;
+
+    u32 runStart = 0;
+    bool inRun = false;
+
+    for(u32 pos = 0; pos < size && R_SUCCEEDED(res); pos += DUMPNAND_SPARSE_GRANULE) {
+        u32 granule = size - pos < DUMPNAND_SPARSE_GRANULE ? size - pos : DUMPNAND_SPARSE_GRANULE;
+
+        bool zero = dumpnand_is_zero((u8*) buffer + pos, granule);
+        if(!zero && !inRun) {
+            runStart = pos;
+            inRun = true;
+        } else if(zero && inRun) {
+            res = dumpnand_write_sparse_run(dumpData, handle, (u8*) buffer + runStart, offset + runStart, pos - runStart);
+            inRun = false;
+        }
+    }
+
+    if(R_SUCCEEDED(res) && inRun) {
+        res = dumpnand_write_sparse_run(dumpData, handle, (u8*) buffer + runStart, offset + runStart, size - runStart);
+    }
+
+    return res;
+}
+
+static Result dumpnand_load_manifest(dump_nand_data* dumpData) {
+    Result res = 0;
+
+    Handle manifestHandle = 0;
+    if(R_SUCCEEDED(res = dumpnand_open_manifest(&manifestHandle, FS_OPEN_READ))) {
+        dump_nand_manifest* manifest = &dumpData->baseManifest;
+
+        u32 bytesRead = 0;
+        if(R_SUCCEEDED(res = FSFILE_Read(manifestHandle, &bytesRead, 0, manifest, sizeof(*manifest)))) {
+            if(bytesRead == sizeof(*manifest) && manifest->magic == DUMPNAND_M_MAGIC && manifest->version == DUMPNAND_M_VERSION
+               && manifest->blockSize == DUMPNAND_BLOCK_SIZE && manifest->blockCount == (manifest->imageSize + DUMPNAND_BLOCK_SIZE - 1) / DUMPNAND_BLOCK_SIZE) {
+                u32 hashesSize = manifest->blockCount * sizeof(u64);
+                if((dumpData->baseHashes = (u64*) calloc(manifest->blockCount, sizeof(u64))) != NULL) {
+                    if(R_SUCCEEDED(res = FSFILE_Read(manifestHandle, &bytesRead, sizeof(*manifest), dumpData->baseHashes, hashesSize))
+                       && (bytesRead != hashesSize || hash64(dumpData->baseHashes, hashesSize) != manifest->id)) {
+                        res = R_FBI_BAD_DATA;
+                    }
+                } else {
+                    res = R_FBI_OUT_OF_MEMORY;
+                }
+            } else {
+                res = R_FBI_BAD_DATA;
+            }
+        }
+
+        FSFILE_Close(manifestHandle);
+    }
+
+    if(R_FAILED(res) && dumpData->baseHashes != NULL) {
+        free(dumpData->baseHashes);
+        dumpData->baseHashes = NULL;
+    }
+
+    return res;
+}
+
+static Result dumpnand_write_manifest(dump_nand_data* dumpData) {
+    Result res = 0;
+
+    dump_nand_manifest manifest;
+    manifest.magic = DUMPNAND_M_MAGIC;
+    manifest.version = DUMPNAND_M_VERSION;
+    manifest.blockSize = dumpData->diffHeader.blockSize;
+    manifest.blockCount = dumpData->diffHeader.blockCount;
+    manifest.imageSize = dumpData->diffHeader.imageSize;
+    manifest.id = dumpData->diffHeader.id;
+
+    u32 hashesSize = manifest.blockCount * sizeof(u64);
+
+    Handle manifestHandle = 0;
+    if(R_SUCCEEDED(res = dumpnand_open_manifest(&manifestHandle, FS_OPEN_WRITE | FS_OPEN_CREATE))) {
+        u32 bytesWritten = 0;
+        if(R_SUCCEEDED(res = FSFILE_Write(manifestHandle, &bytesWritten, 0, &manifest, sizeof(manifest), 0))
+           && R_SUCCEEDED(res = FSFILE_Write(manifestHandle, &bytesWritten, sizeof(manifest), dumpData->hashes, hashesSize, FS_WRITE_FLUSH))) {
+            res = FSFILE_SetSize(manifestHandle, sizeof(manifest) + hashesSize);
+        }
+
+        FSFILE_Close(manifestHandle);
+    }
+
+    return res;
+}
+
+static Result dumpnand_write_differential(dump_nand_data* dumpData, u32 handle, void* buffer, u64 offset, u32 size) {
+    u32 block = (u32) (offset / DUMPNAND_BLOCK_SIZE);
+    if(offset % DUMPNAND_BLOCK_SIZE != 0 || block >= dumpData->diffHeader.blockCount) {
+        return R_FBI_BAD_DATA;
+    }
+
+    u64 hash = hash64(buffer, size);
+    dumpData->hashes[block] = hash;
+
+    if(dumpData->baseHashes != NULL && dumpData->baseHashes[block] == hash) {
+        return 0;
+    }
+
+    // tableOffset tracks the end of the block data until the table is written.
+    u64 dataOffset = sizeof(dump_nand_d_header) + dumpData->diffHeader.tableOffset;
+
+    Result res = 0;
+
+    u32 bytesWritten = 0;
+    if(R_SUCCEEDED(res = FSFILE_Write(handle, &bytesWritten, dataOffset, buffer, size, 0))) {
+        dump_nand_d_block* entry = &dumpData->changed[dumpData->diffHeader.changedCount++];
+        entry->block = block;
+        entry->size = size;
+        entry->dataOffset = dataOffset;
+        entry->hash = hash;
+
+        dumpData->diffHeader.tableOffset += size;
+    }
+
+    return res;
+}
+
 static Result dumpnand_is_src_directory(void* data, u32 index, bool* isDirectory) {
     *isDirectory = false;
     return 0;
@@ -33,6 +505,18 @@ static Result dumpnand_close_src(void* data, u32 index, bool succeeded, u32 hand
     return FSFILE_Close(handle);
 }
 
+static Result dumpnand_prescan_src_size(void* data, u32 index, u64* size) {
+    Result res = 0;
+
+    u32 handle = 0;
+    if(R_SUCCEEDED(res = dumpnand_open_src(data, index, &handle))) {
+        res = FSFILE_GetSize(handle, size);
+        FSFILE_Close(handle);
+    }
+
+    return res;
+}
+
 static Result dumpnand_get_src_size(void* data, u32 handle, u64* size) {
     return FSFILE_GetSize(handle, size);
 }
@@ -41,22 +525,357 @@ static Result dumpnand_read_src(void* data, u32 handle, u32* bytesRead, void* bu
     return FSFILE_Read(handle, bytesRead, offset, buffer, size);
 }
 
+static Result dumpnand_transform_src(void* data, u32 index, void* src, u32 srcSize, void* dst, u32* dstSize) {
+    dump_nand_data* dumpData = (dump_nand_data*) data;
+
+    if(dumpData->header.blockCount >= dumpData->blockCount) {
+        return R_FBI_BAD_DATA;
+    }
+
+    dump_nand_z_block* block = &dumpData->blocks[dumpData->header.blockCount];
+    block->offset = dumpData->header.indexOffset;
+    block->checksum = dumpnand_checksum((u8*) src, srcSize);
+
+    // Blocks that do not shrink are stored as-is.
+    if((block->size = lz_compress((u8*) src, srcSize, (u8*) dst, srcSize - 1, dumpData->lzWork)) != 0) {
+        block->flags = DUMPNAND_Z_BLOCK_COMPRESSED;
+    } else {
+        memcpy(dst, src, srcSize);
+
+        block->size = srcSize;
+        block->flags = 0;
+    }
+
+    dumpData->header.blockCount++;
+    dumpData->header.indexOffset += block->size;
+
+    *dstSize = block->size;
+    return 0;
+}
+
+static Result dumpnand_get_resume_offset(void* data, u32 index, u64 size, u64* offset) {
+    dump_nand_data* dumpData = (dump_nand_data*) data;
+
+    *offset = 0;
+
+    switch(dumpData->mode) {
+        case DUMPNAND_MODE_RAW:
+            memset(&dumpData->journal, 0, sizeof(dumpData->journal));
+            dumpData->journal.magic = DUMPNAND_JOURNAL_MAGIC;
+            dumpData->journal.imageSize = size;
+            break;
+        case DUMPNAND_MODE_RESUME:
+            if(dumpData->journal.imageSize != size) {
+                return R_FBI_BAD_DATA;
+            }
+
+            *offset = dumpData->journal.checkpoint;
+            break;
+        case DUMPNAND_MODE_COMPRESSED:
+            // indexOffset tracks the end of the block data until the index is written.
+            memset(&dumpData->header, 0, sizeof(dumpData->header));
+            dumpData->header.magic = DUMPNAND_Z_MAGIC;
+            dumpData->header.version = DUMPNAND_Z_VERSION;
+            dumpData->header.blockSize = DUMPNAND_BLOCK_SIZE;
+            dumpData->header.imageSize = size;
+
+            dumpData->blockCount = (u32) ((size + DUMPNAND_BLOCK_SIZE - 1) / DUMPNAND_BLOCK_SIZE);
+
+            free(dumpData->blocks);
+            if((dumpData->blocks = (dump_nand_z_block*) calloc(dumpData->blockCount, sizeof(dump_nand_z_block))) == NULL) {
+                return R_FBI_OUT_OF_MEMORY;
+            }
+
+            break;
+        case DUMPNAND_MODE_SPARSE:
+            memset(&dumpData->sparseHeader, 0, sizeof(dumpData->sparseHeader));
+            dumpData->sparseHeader.magic = DUMPNAND_S_MAGIC;
+            dumpData->sparseHeader.version = DUMPNAND_S_VERSION;
+            dumpData->sparseHeader.imageSize = size;
+            break;
+        case DUMPNAND_MODE_DIFFERENTIAL: {
+            memset(&dumpData->diffHeader, 0, sizeof(dumpData->diffHeader));
+            dumpData->diffHeader.magic = DUMPNAND_D_MAGIC;
+            dumpData->diffHeader.version = DUMPNAND_D_VERSION;
+            dumpData->diffHeader.blockSize = DUMPNAND_BLOCK_SIZE;
+            dumpData->diffHeader.blockCount = (u32) ((size + DUMPNAND_BLOCK_SIZE - 1) / DUMPNAND_BLOCK_SIZE);
+            dumpData->diffHeader.imageSize = size;
+
+            // A manifest of a different NAND layout cannot serve as a base.
+            if(dumpData->baseHashes != NULL && dumpData->baseManifest.imageSize == size) {
+                dumpData->diffHeader.parentId = dumpData->baseManifest.id;
+            } else if(dumpData->baseHashes != NULL) {
+                free(dumpData->baseHashes);
+                dumpData->baseHashes = NULL;
+            }
+
+            free(dumpData->changed);
+            free(dumpData->hashes);
+            if((dumpData->changed = (dump_nand_d_block*) calloc(dumpData->diffHeader.blockCount, sizeof(dump_nand_d_block))) == NULL
+               || (dumpData->hashes = (u64*) calloc(dumpData->diffHeader.blockCount, sizeof(u64))) == NULL) {
+                return R_FBI_OUT_OF_MEMORY;
+            }
+
+            time_t t = time(NULL);
+            strftime(dumpData->deltaPath, sizeof(dumpData->deltaPath), "/NAND-%Y%m%d-%H%M%S.fbd", localtime(&t));
+            break;
+        }
+        case DUMPNAND_MODE_NETWORK:
+            dumpData->imageSize = size;
+            break;
+    }
+
+    return 0;
+}
+
+static bool dumpnand_is_cancelled(void* data) {
+    dump_nand_data* dumpData = (dump_nand_data*) data;
+
+    return task_is_quit_all() || svcWaitSynchronization(dumpData->cancelEvent, 0) == 0;
+}
+
+static Result dumpnand_open_network(dump_nand_data* dumpData, u32* handle) {
+    netsend_receiver receiver;
+
+    dumpData->discovering = true;
+    int ret = netsend_discover(&receiver, NETSEND_DISCOVER_TIMEOUT, dumpnand_is_cancelled, dumpData);
+    dumpData->discovering = false;
+
+    if(ret < 0) {
+        return errno == ECANCELED ? R_FBI_CANCELLED : R_FBI_ERRNO;
+    }
+
+    struct in_addr addr = {receiver.address};
+    snprintf(dumpData->receiverText, sizeof(dumpData->receiverText), "Send the NAND image to the receiver at %s?\nPairing code: %04lu\nCheck that fbirecv shows the same code.",
+             inet_ntoa(addr), receiver.code);
+
+    if(!prompt_display_wait("Confirmation", dumpData->receiverText, COLOR_TEXT, NULL, NULL)) {
+        return R_FBI_CANCELLED;
+    }
+
+    if(netsend_open(&dumpData->conn, &receiver) < 0) {
+        return R_FBI_ERRNO;
+    }
+
+    if(netsend_begin_file(&dumpData->conn, "NAND.bin", dumpData->imageSize) < 0) {
+        int err = errno;
+        netsend_close(&dumpData->conn, NETSEND_CLOSE_TIMEOUT);
+        errno = err;
+
+        return R_FBI_ERRNO;
+    }
+
+    // The data op only closes destinations with a non-zero handle.
+    *handle = 1;
+    return 0;
+}
+
 static Result dumpnand_open_dst(void* data, u32 index, void* initialReadBlock, u32* handle) {
-    FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_BINARY, 0, (u8*) ""}};
-    return FSUSER_OpenFileDirectly(handle, sdmcArchive, fsMakePath(PATH_UTF16, u"/NAND.bin"), FS_OPEN_WRITE | FS_OPEN_CREATE, 0);
+    dump_nand_data* dumpData = (dump_nand_data*) data;
+
+    if(dumpData->mode == DUMPNAND_MODE_NETWORK) {
+        return dumpnand_open_network(dumpData, handle);
+    }
+
+    Result res = 0;
+
+    if(dumpData->mode == DUMPNAND_MODE_DIFFERENTIAL) {
+        if(R_SUCCEEDED(res = dumpnand_open_delta(dumpData, handle, FS_OPEN_WRITE | FS_OPEN_CREATE))) {
+            u32 bytesWritten = 0;
+            if(R_FAILED(res = FSFILE_Write(*handle, &bytesWritten, 0, &dumpData->diffHeader, sizeof(dumpData->diffHeader), 0))) {
+                FSFILE_Close(*handle);
+            }
+        }
+
+        return res;
+    }
+
+    if(dumpData->mode == DUMPNAND_MODE_COMPRESSED || dumpData->mode == DUMPNAND_MODE_SPARSE) {
+        bool compressed = dumpData->mode == DUMPNAND_MODE_COMPRESSED;
+
+        if(R_SUCCEEDED(res = compressed ? dumpnand_open_z_image(handle, FS_OPEN_WRITE | FS_OPEN_CREATE) : dumpnand_open_s_image(handle, FS_OPEN_WRITE | FS_OPEN_CREATE))) {
+            u32 bytesWritten = 0;
+            if(R_FAILED(res = compressed ? FSFILE_Write(*handle, &bytesWritten, 0, &dumpData->header, sizeof(dumpData->header), 0)
+                                         : FSFILE_Write(*handle, &bytesWritten, 0, &dumpData->sparseHeader, sizeof(dumpData->sparseHeader), 0))) {
+                FSFILE_Close(*handle);
+            }
+        }
+
+        return res;
+    }
+
+    if(R_SUCCEEDED(res = dumpnand_open_journal(&dumpData->journalHandle, FS_OPEN_WRITE | FS_OPEN_CREATE))) {
+        if(R_SUCCEEDED(res = dumpnand_write_journal(dumpData))) {
+            res = dumpnand_open_image(handle, FS_OPEN_READ | FS_OPEN_WRITE | FS_OPEN_CREATE);
+        }
+
+        if(R_FAILED(res)) {
+            FSFILE_Close(dumpData->journalHandle);
+            dumpData->journalHandle = 0;
+        }
+    }
+
+    return res;
+}
+
+static Result dumpnand_finish_z_image(dump_nand_data* dumpData, u32 handle) {
+    Result res = 0;
+
+    u64 indexOffset = sizeof(dump_nand_z_header) + dumpData->header.indexOffset;
+    u32 indexSize = dumpData->header.blockCount * sizeof(dump_nand_z_block);
+
+    for(u32 i = 0; i < dumpData->header.blockCount; i++) {
+        dumpData->blocks[i].offset += sizeof(dump_nand_z_header);
+    }
+
+    dumpData->header.indexOffset = indexOffset;
+
+    u32 bytesWritten = 0;
+    if(R_SUCCEEDED(res = FSFILE_Write(handle, &bytesWritten, indexOffset, dumpData->blocks, indexSize, 0))
+       && R_SUCCEEDED(res = FSFILE_SetSize(handle, indexOffset + indexSize))) {
+        res = FSFILE_Write(handle, &bytesWritten, 0, &dumpData->header, sizeof(dumpData->header), FS_WRITE_FLUSH);
+    }
+
+    return res;
+}
+
+static Result dumpnand_finish_s_image(dump_nand_data* dumpData, u32 handle) {
+    Result res = 0;
+
+    u64 tableOffset = sizeof(dump_nand_s_header) + dumpData->sparseHeader.tableOffset;
+    u32 tableSize = dumpData->sparseHeader.extentCount * sizeof(dump_nand_s_extent);
+
+    dumpData->sparseHeader.tableOffset = tableOffset;
+
+    u32 bytesWritten = 0;
+    if((tableSize == 0 || R_SUCCEEDED(res = FSFILE_Write(handle, &bytesWritten, tableOffset, dumpData->extents, tableSize, 0)))
+       && R_SUCCEEDED(res = FSFILE_SetSize(handle, tableOffset + tableSize))) {
+        res = FSFILE_Write(handle, &bytesWritten, 0, &dumpData->sparseHeader, sizeof(dumpData->sparseHeader), FS_WRITE_FLUSH);
+    }
+
+    return res;
+}
+
+static Result dumpnand_finish_delta(dump_nand_data* dumpData, u32 handle) {
+    Result res = 0;
+
+    u64 tableOffset = sizeof(dump_nand_d_header) + dumpData->diffHeader.tableOffset;
+    u32 tableSize = dumpData->diffHeader.changedCount * sizeof(dump_nand_d_block);
+
+    dumpData->diffHeader.tableOffset = tableOffset;
+    dumpData->diffHeader.id = hash64(dumpData->hashes, dumpData->diffHeader.blockCount * sizeof(u64));
+
+    u32 bytesWritten = 0;
+    if((tableSize == 0 || R_SUCCEEDED(res = FSFILE_Write(handle, &bytesWritten, tableOffset, dumpData->changed, tableSize, 0)))
+       && R_SUCCEEDED(res = FSFILE_SetSize(handle, tableOffset + tableSize))
+       && R_SUCCEEDED(res = FSFILE_Write(handle, &bytesWritten, 0, &dumpData->diffHeader, sizeof(dumpData->diffHeader), FS_WRITE_FLUSH))) {
+        // The manifest only moves on once its delta is complete.
+        res = dumpnand_write_manifest(dumpData);
+    }
+
+    return res;
 }
 
 static Result dumpnand_close_dst(void* data, u32 index, bool succeeded, u32 handle) {
-    return FSFILE_Close(handle);
+    dump_nand_data* dumpData = (dump_nand_data*) data;
+
+    if(dumpData->mode == DUMPNAND_MODE_NETWORK) {
+        // Waits for the receiver to confirm the image landed intact.
+        Result res = netsend_finish_file(&dumpData->conn, !succeeded) < 0 && succeeded ? R_FBI_ERRNO : 0;
+
+        int err = errno;
+        netsend_close(&dumpData->conn, NETSEND_CLOSE_TIMEOUT);
+        errno = err;
+
+        return res;
+    }
+
+    if(dumpData->mode == DUMPNAND_MODE_DIFFERENTIAL) {
+        Result res = 0;
+        if(succeeded) {
+            res = dumpnand_finish_delta(dumpData, handle);
+        }
+
+        Result closeRes = FSFILE_Close(handle);
+        if(R_SUCCEEDED(res)) {
+            res = closeRes;
+        }
+
+        // An unfinished delta has no table and cannot be applied.
+        if(!succeeded || R_FAILED(res)) {
+            FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_BINARY, 0, (void*) ""}};
+            if(R_SUCCEEDED(FSUSER_OpenArchive(&sdmcArchive))) {
+                FSUSER_DeleteFile(sdmcArchive, fsMakePath(PATH_ASCII, dumpData->deltaPath));
+                FSUSER_CloseArchive(&sdmcArchive);
+            }
+        }
+
+        return res;
+    }
+
+    if(dumpData->mode == DUMPNAND_MODE_COMPRESSED || dumpData->mode == DUMPNAND_MODE_SPARSE) {
+        Result res = 0;
+        if(succeeded) {
+            res = dumpData->mode == DUMPNAND_MODE_COMPRESSED ? dumpnand_finish_z_image(dumpData, handle) : dumpnand_finish_s_image(dumpData, handle);
+        }
+
+        Result closeRes = FSFILE_Close(handle);
+        return R_SUCCEEDED(res) ? closeRes : res;
+    }
+
+    Result res = FSFILE_Close(handle);
+
+    if(dumpData->journalHandle != 0) {
+        FSFILE_Close(dumpData->journalHandle);
+        dumpData->journalHandle = 0;
+    }
+
+    if(succeeded && R_SUCCEEDED(res)) {
+        dumpnand_delete_journal();
+    }
+
+    return res;
 }
 
 static Result dumpnand_write_dst(void* data, u32 handle, u32* bytesWritten, void* buffer, u64 offset, u32 size) {
-    return FSFILE_Write(handle, bytesWritten, offset, buffer, size, 0);
+    dump_nand_data* dumpData = (dump_nand_data*) data;
+
+    if(dumpData->mode == DUMPNAND_MODE_COMPRESSED) {
+        return FSFILE_Write(handle, bytesWritten, sizeof(dump_nand_z_header) + offset, buffer, size, 0);
+    }
+
+    if(dumpData->mode == DUMPNAND_MODE_DIFFERENTIAL) {
+        // Unchanged blocks are still reported as written so that offsets keep tracking the NAND.
+        *bytesWritten = size;
+        return dumpnand_write_differential(dumpData, handle, buffer, offset, size);
+    }
+
+    if(dumpData->mode == DUMPNAND_MODE_SPARSE) {
+        // Zero runs are still reported as written so that offsets keep tracking the NAND.
+        *bytesWritten = size;
+        return dumpnand_write_sparse(dumpData, handle, buffer, offset, size);
+    }
+
+    if(dumpData->mode == DUMPNAND_MODE_NETWORK) {
+        *bytesWritten = size;
+        return netsend_write_file(&dumpData->conn, buffer, size) < 0 ? R_FBI_ERRNO : 0;
+    }
+
+    Result res = 0;
+
+    if(R_SUCCEEDED(res = FSFILE_Write(handle, bytesWritten, offset, buffer, size, 0))
+       && offset + *bytesWritten - dumpData->journal.checkpoint >= DUMPNAND_CHECKPOINT_INTERVAL) {
+        res = dumpnand_checkpoint(dumpData, handle, buffer, offset, *bytesWritten);
+    }
+
+    return res;
 }
 
 static bool dumpnand_error(void* data, u32 index, Result res) {
     if(res == R_FBI_CANCELLED) {
         prompt_display("Failure", "Dump cancelled.", COLOR_TEXT, false, NULL, NULL, NULL, NULL);
+    } else if(res == R_FBI_ERRNO) {
+        error_display_errno(NULL, NULL, NULL, errno, "Failed to dump NAND.");
     } else {
         error_display_res(NULL, NULL, NULL, res, "Failed to dump NAND.");
     }
@@ -64,6 +883,34 @@ static bool dumpnand_error(void* data, u32 index, Result res) {
     return false;
 }
 
+static void dumpnand_free_data(dump_nand_data* data) {
+    if(data->blocks != NULL) {
+        free(data->blocks);
+    }
+
+    if(data->lzWork != NULL) {
+        free(data->lzWork);
+    }
+
+    if(data->extents != NULL) {
+        free(data->extents);
+    }
+
+    if(data->baseHashes != NULL) {
+        free(data->baseHashes);
+    }
+
+    if(data->changed != NULL) {
+        free(data->changed);
+    }
+
+    if(data->hashes != NULL) {
+        free(data->hashes);
+    }
+
+    free(data);
+}
+
 static void dumpnand_update(ui_view* view, void* data, float* progress, char* text) {
     dump_nand_data* dumpData = (dump_nand_data*) data;
 
@@ -75,7 +922,7 @@ static void dumpnand_update(ui_view* view, void* data, float* progress, char* te
             prompt_display("Success", "NAND dumped.", COLOR_TEXT, false, NULL, NULL, NULL, NULL);
         }
 
-        free(dumpData);
+        dumpnand_free_data(dumpData);
 
         return;
     }
@@ -84,8 +931,12 @@ static void dumpnand_update(ui_view* view, void* data, float* progress, char* te
         svcSignalEvent(dumpData->cancelEvent);
     }
 
-    *progress = dumpData->dumpInfo.currTotal != 0 ? (float) ((double) dumpData->dumpInfo.currProcessed / (double) dumpData->dumpInfo.currTotal) : 0;
-    snprintf(text, PROGRESS_TEXT_MAX, "%.2f MB / %.2f MB", dumpData->dumpInfo.currProcessed / 1024.0f / 1024.0f, dumpData->dumpInfo.currTotal / 1024.0f / 1024.0f);
+    info_get_data_op_progress(&dumpData->dumpInfo, progress, text);
+
+    if(dumpData->discovering) {
+        size_t len = strlen(text);
+        snprintf(text + len, PROGRESS_TEXT_MAX - len, "\nWaiting for a receiver...");
+    }
 }
 
 static void dumpnand_onresponse(ui_view* view, void* data, bool response) {
@@ -99,22 +950,32 @@ static void dumpnand_onresponse(ui_view* view, void* data, bool response) {
             error_display(NULL, NULL, NULL, "Failed to initiate NAND dump.");
         }
     } else {
-        free(data);
+        dumpnand_free_data((dump_nand_data*) data);
     }
 }
 
-void dump_nand() {
+static dump_nand_data* dumpnand_create_data(dump_nand_mode mode) {
     dump_nand_data* data = (dump_nand_data*) calloc(1, sizeof(dump_nand_data));
     if(data == NULL) {
         error_display(NULL, NULL, NULL, "Failed to allocate dump NAND data.");
 
-        return;
+        return NULL;
     }
 
+    data->mode = mode;
+
+    data->journalHandle = 0;
+    data->conn.socket = -1;
+
     data->dumpInfo.data = data;
 
+    data->dumpInfo.name = "NAND dump";
+
     data->dumpInfo.op = DATAOP_COPY;
 
+    data->dumpInfo.chunkSize = DUMPNAND_BLOCK_SIZE;
+    data->dumpInfo.autoChunkSize = mode != DUMPNAND_MODE_COMPRESSED && mode != DUMPNAND_MODE_DIFFERENTIAL;
+
     data->dumpInfo.copyEmpty = true;
 
     data->dumpInfo.total = 1;
@@ -124,8 +985,14 @@ void dump_nand() {
 
     data->dumpInfo.openSrc = dumpnand_open_src;
     data->dumpInfo.closeSrc = dumpnand_close_src;
+    data->dumpInfo.prescanSrcSize = dumpnand_prescan_src_size;
     data->dumpInfo.getSrcSize = dumpnand_get_src_size;
     data->dumpInfo.readSrc = dumpnand_read_src;
+    data->dumpInfo.getResumeOffset = dumpnand_get_resume_offset;
+
+    if(mode == DUMPNAND_MODE_COMPRESSED) {
+        data->dumpInfo.transformSrc = dumpnand_transform_src;
+    }
 
     data->dumpInfo.openDst = dumpnand_open_dst;
     data->dumpInfo.closeDst = dumpnand_close_dst;
@@ -135,5 +1002,123 @@ void dump_nand() {
 
     data->cancelEvent = 0;
 
+    return data;
+}
+
+static void dumpnand_raw() {
+    dump_nand_data* data = dumpnand_create_data(DUMPNAND_MODE_RAW);
+    if(data == NULL) {
+        return;
+    }
+
     prompt_display("Confirmation", "Dump raw NAND image to the SD card?", COLOR_TEXT, true, data, NULL, NULL, dumpnand_onresponse);
+}
+
+static void dumpnand_resume() {
+    dump_nand_data* data = dumpnand_create_data(DUMPNAND_MODE_RESUME);
+    if(data == NULL) {
+        return;
+    }
+
+    Result res = 0;
+    if(R_FAILED(res = dumpnand_load_journal(data))) {
+        error_display_res(NULL, NULL, NULL, res, "No resumable NAND dump found.");
+
+        dumpnand_free_data(data);
+        return;
+    }
+
+    snprintf(data->promptText, sizeof(data->promptText), "Resume NAND dump from %.2f MB / %.2f MB?",
+             data->journal.checkpoint / 1024.0 / 1024.0, data->journal.imageSize / 1024.0 / 1024.0);
+
+    prompt_display("Confirmation", data->promptText, COLOR_TEXT, true, data, NULL, NULL, dumpnand_onresponse);
+}
+
+static void dumpnand_compressed() {
+    dump_nand_data* data = dumpnand_create_data(DUMPNAND_MODE_COMPRESSED);
+    if(data == NULL) {
+        return;
+    }
+
+    if((data->lzWork = malloc(LZ_WORK_SIZE)) == NULL) {
+        error_display(NULL, NULL, NULL, "Failed to allocate compression work buffer.");
+
+        dumpnand_free_data(data);
+        return;
+    }
+
+    prompt_display("Confirmation", "Dump compressed NAND image to the SD card?", COLOR_TEXT, true, data, NULL, NULL, dumpnand_onresponse);
+}
+
+static void dumpnand_sparse() {
+    dump_nand_data* data = dumpnand_create_data(DUMPNAND_MODE_SPARSE);
+    if(data == NULL) {
+        return;
+    }
+
+    prompt_display("Confirmation", "Dump sparse NAND image to the SD card?", COLOR_TEXT, true, data, NULL, NULL, dumpnand_onresponse);
+}
+
+static void dumpnand_differential() {
+    dump_nand_data* data = dumpnand_create_data(DUMPNAND_MODE_DIFFERENTIAL);
+    if(data == NULL) {
+        return;
+    }
+
+    // Without a usable manifest, every block counts as changed and the delta becomes a new base.
+    if(R_SUCCEEDED(dumpnand_load_manifest(data))) {
+        prompt_display("Confirmation", "Dump NAND blocks changed since the last differential dump?", COLOR_TEXT, true, data, NULL, NULL, dumpnand_onresponse);
+    } else {
+        prompt_display("Confirmation", "No previous manifest found.\nDump a full differential base image?", COLOR_TEXT, true, data, NULL, NULL, dumpnand_onresponse);
+    }
+}
+
+static void dumpnand_network() {
+    dump_nand_data* data = dumpnand_create_data(DUMPNAND_MODE_NETWORK);
+    if(data == NULL) {
+        return;
+    }
+
+    prompt_display("Confirmation", "Send raw NAND image to a network receiver?\nStart tools/fbirecv on the computer first.", COLOR_TEXT, true, data, NULL, NULL, dumpnand_onresponse);
+}
+
+#define DUMPNAND_MODE_COUNT 6
+
+static u32 dumpnand_mode_count = DUMPNAND_MODE_COUNT;
+static list_item dumpnand_mode_items[DUMPNAND_MODE_COUNT] = {
+        {"Dump NAND", COLOR_TEXT, dumpnand_raw},
+        {"Resume NAND Dump", COLOR_TEXT, dumpnand_resume},
+        {"Dump NAND (Compressed)", COLOR_TEXT, dumpnand_compressed},
+        {"Dump NAND (Sparse)", COLOR_TEXT, dumpnand_sparse},
+        {"Dump NAND (Differential)", COLOR_TEXT, dumpnand_differential},
+        {"Dump NAND (Network)", COLOR_TEXT, dumpnand_network},
+};
+
+static void dumpnand_mode_update(ui_view* view, void* data, list_item** items, u32** itemCount, list_item* selected, bool selectedTouched) {
+    if(hidKeysDown() & KEY_B) {
+        ui_pop();
+        list_destroy(view);
+
+        return;
+    }
+
+    if(selected != NULL && selected->data != NULL && (selectedTouched || (hidKeysDown() & KEY_A))) {
+        void(*action)() = (void(*)()) selected->data;
+
+        ui_pop();
+        list_destroy(view);
+
+        action();
+
+        return;
+    }
+
+    if(*itemCount != &dumpnand_mode_count || *items != dumpnand_mode_items) {
+        *itemCount = &dumpnand_mode_count;
+        *items = dumpnand_mode_items;
+    }
+}
+
+void dump_nand() {
+    list_display("Dump NAND", "A: Select, B: Return", NULL, dumpnand_mode_update, NULL);
 }
\ No newline at end of file
@@ -26,16 +26,17 @@ typedef struct {
     file_info parentDir;
 } files_data;
 
-#define FILES_ACTION_COUNT 3
+#define FILES_ACTION_COUNT 4
 
 static u32 files_action_count = FILES_ACTION_COUNT;
 static list_item files_action_items[FILES_ACTION_COUNT] = {
         {"Delete", COLOR_TEXT, action_delete_contents},
         {"Copy", COLOR_TEXT, action_copy_contents},
+        {"Send to network", COLOR_TEXT, action_send_contents},
         {"Paste", COLOR_TEXT, action_paste_contents},
 };
 
-#define CIA_FILES_ACTION_COUNT 5
+#define CIA_FILES_ACTION_COUNT 6
 
 static u32 cia_files_action_count = CIA_FILES_ACTION_COUNT;
 static list_item cia_files_action_items[CIA_FILES_ACTION_COUNT] = {
@@ -43,30 +44,33 @@ static list_item cia_files_action_items[CIA_FILES_ACTION_COUNT] = {
         {"Install and delete CIA", COLOR_TEXT, action_install_cias_delete},
         {"Delete", COLOR_TEXT, action_delete_contents},
         {"Copy", COLOR_TEXT, action_copy_contents},
+        {"Send to network", COLOR_TEXT, action_send_contents},
         {"Paste", COLOR_TEXT, action_paste_contents},
 };
 
-#define TICKET_FILES_ACTION_COUNT 4
+#define TICKET_FILES_ACTION_COUNT 5
 
 static u32 ticket_files_action_count = TICKET_FILES_ACTION_COUNT;
 static list_item ticket_files_action_items[TICKET_FILES_ACTION_COUNT] = {
         {"Install ticket", COLOR_TEXT, action_install_tickets},
         {"Delete", COLOR_TEXT, action_delete_contents},
         {"Copy", COLOR_TEXT, action_copy_contents},
+        {"Send to network", COLOR_TEXT, action_send_contents},
         {"Paste", COLOR_TEXT, action_paste_contents},
 };
 
-#define DIRECTORIES_ACTION_COUNT 4
+#define DIRECTORIES_ACTION_COUNT 5
 
 static u32 directories_action_count = DIRECTORIES_ACTION_COUNT;
 static list_item directories_action_items[DIRECTORIES_ACTION_COUNT] = {
         {"Delete all contents", COLOR_TEXT, action_delete_dir_contents},
         {"Delete", COLOR_TEXT, action_delete_dir},
         {"Copy", COLOR_TEXT, action_copy_contents},
+        {"Send to network", COLOR_TEXT, action_send_contents},
         {"Paste", COLOR_TEXT, action_paste_contents},
 };
 
-#define CIA_DIRECTORIES_ACTION_COUNT 7
+#define CIA_DIRECTORIES_ACTION_COUNT 8
 
 static u32 cia_directories_action_count = CIA_DIRECTORIES_ACTION_COUNT;
 static list_item cia_directories_action_items[CIA_DIRECTORIES_ACTION_COUNT] = {
@@ -76,10 +80,11 @@ static list_item cia_directories_action_items[CIA_DIRECTORIES_ACTION_COUNT] = {
         {"Delete all contents", COLOR_TEXT, action_delete_dir_contents},
         {"Delete", COLOR_TEXT, action_delete_dir},
         {"Copy", COLOR_TEXT, action_copy_contents},
+        {"Send to network", COLOR_TEXT, action_send_contents},
         {"Paste", COLOR_TEXT, action_paste_contents},
 };
 
-#define TICKET_DIRECTORIES_ACTION_COUNT 5
+#define TICKET_DIRECTORIES_ACTION_COUNT 6
 
 static u32 ticket_directories_action_count = TICKET_DIRECTORIES_ACTION_COUNT;
 static list_item ticket_directories_action_items[TICKET_DIRECTORIES_ACTION_COUNT] = {
@@ -87,10 +92,11 @@ static list_item ticket_directories_action_items[TICKET_DIRECTORIES_ACTION_COUNT
         {"Delete all contents", COLOR_TEXT, action_delete_dir_contents},
         {"Delete", COLOR_TEXT, action_delete_dir},
         {"Copy", COLOR_TEXT, action_copy_contents},
+        {"Send to network", COLOR_TEXT, action_send_contents},
         {"Paste", COLOR_TEXT, action_paste_contents},
 };
 
-#define CIA_TICKET_DIRECTORIES_ACTION_COUNT 8
+#define CIA_TICKET_DIRECTORIES_ACTION_COUNT 9
 
 static u32 cia_ticket_directories_action_count = CIA_TICKET_DIRECTORIES_ACTION_COUNT;
 static list_item cia_ticket_directories_action_items[CIA_TICKET_DIRECTORIES_ACTION_COUNT] = {
@@ -101,6 +107,7 @@ static list_item cia_ticket_directories_action_items[CIA_TICKET_DIRECTORIES_ACTI
         {"Delete all contents", COLOR_TEXT, action_delete_dir_contents},
         {"Delete", COLOR_TEXT, action_delete_dir},
         {"Copy", COLOR_TEXT, action_copy_contents},
+        {"Send to network", COLOR_TEXT, action_send_contents},
         {"Paste", COLOR_TEXT, action_paste_contents},
 };
 
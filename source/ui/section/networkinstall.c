@@ -1,9 +1,9 @@
 #include <arpa/inet.h>
 #include <sys/unistd.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <malloc.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <3ds.h>
 
@@ -12,58 +12,246 @@
 #include "../error.h"
 #include "../info.h"
 #include "../prompt.h"
+#include "../../net/httpd.h"
+#include "../../net/net.h"
+#include "../../net/netconfig.h"
+#include "../../net/netinstall.h"
+#include "../../hash/hash.h"
 #include "../../screen.h"
 
+// Give up on a sender that has gone quiet for this long.
+#define NETWORKINSTALL_TIMEOUT 30000
+
+// The final ack is sent from the UI thread, so don't hold it up for a sender that has gone away.
+#define NETWORKINSTALL_CLOSE_TIMEOUT 1000
+
+// Version 2 senders are told how far the install has got every this many bytes.
+#define NETWORKINSTALL_PROGRESS_INTERVAL (1024 * 1024)
+
+// Reports are best-effort; a stalled connection is noticed by the reader instead.
+#define NETWORKINSTALL_FRAME_TIMEOUT 1000
+
+// How long an install is kept open for a dropped sender to reconnect.
+#define NETWORKINSTALL_RESUME_TIMEOUT 60000
+
 typedef struct {
-    int serverSocket;
-    int clientSocket;
+    netinstall_session session;
+    bool accepted;
+    char confirmText[128];
+
+    // Result of the last benchmark, shown while waiting so back-to-back runs need no button presses.
+    char benchmarkText[128];
+
+    // Guards session.socket, which the reader swaps when a sender reconnects.
+    Handle socketMutex;
+    volatile bool reconnecting;
+
+    // Streams of a multi-stream install, attached on first use. Stream 0 is session.socket.
+    int streams[NETINSTALL_STREAMS_MAX];
+    u32 streamCount;
+
+    u64 installed;
+    u64 reported;
+    u64 startTime;
+
+    // Unpacking state for files sent as NETINSTALL_ENTRY_LZ blocks.
+    u8* packed;
+    u8* block;
+    u32 blockSize;
+    u32 blockOffset;
+    u64 unpackRemaining;
 
     u64 currTitleId;
     bool ticket;
 
+    // Digest of what has been written of the current file, checked against the manifest before
+    // the install is committed.
+    hash64_ctx hash;
+    bool verify;
+
+    // Body of an HTTP upload. The start of a chunked CIA is read early to size the install, and
+    // handed back out before the rest of the body.
+    httpd_body body;
+    u8 peek[0x20];
+    u32 peekSize;
+    u32 peekOffset;
+
+    Result result;
+
     data_op_info installInfo;
     Handle cancelEvent;
 } network_install_data;
 
-static int recvwait(int sockfd, void* buf, size_t len, int flags) {
-    errno = 0;
+static network_session_queue networkinstall_queue;
+static Handle networkinstall_listener;
 
-    int ret = 0;
-    size_t read = 0;
-    while(((ret = recv(sockfd, buf + read, len - read, flags)) >= 0 && (read += ret) < len) || errno == EAGAIN) {
-        errno = 0;
-    }
+static Result networkinstall_is_src_directory(void* data, u32 index, bool* isDirectory) {
+    *isDirectory = false;
+    return 0;
+}
+
+static Result networkinstall_make_dst_directory(void* data, u32 index) {
+    return 0;
+}
+
+static Result networkinstall_send_frame(network_install_data* data, u32 type, u32 index, u64 value, int timeoutMs) {
+    svcWaitSynchronization(data->socketMutex, U64_MAX);
+    int ret = netinstall_send_frame(data->session.socket, type, index, value, timeoutMs);
+    svcReleaseMutex(data->socketMutex);
 
-    return ret < 0 ? ret : (int) read;
+    return ret < 0 ? R_FBI_ERRNO : 0;
 }
 
-static int sendwait(int sockfd, void* buf, size_t len, int flags) {
-    errno = 0;
+static bool networkinstall_pop_session(netinstall_session* session, u64 token, u32 stream) {
+    svcWaitSynchronization(networkinstall_queue.mutex, U64_MAX);
+
+    bool popped = false;
+    for(u32 i = 0; i < networkinstall_queue.count && !popped; i++) {
+        netinstall_session* curr = &networkinstall_queue.sessions[i];
+        if(token == 0 || (curr->resume && curr->token == token && curr->stream == stream)) {
+            *session = networkinstall_queue.sessions[i];
+
+            networkinstall_queue.count--;
+            memmove(&networkinstall_queue.sessions[i], &networkinstall_queue.sessions[i + 1], (networkinstall_queue.count - i) * sizeof(netinstall_session));
 
-    int ret = 0;
-    size_t written = 0;
-    while(((ret = send(sockfd, buf + written, len - written, flags)) >= 0 && (written += ret) < len) || errno == EAGAIN) {
-        errno = 0;
+            popped = true;
+        }
     }
 
-    return ret < 0 ? ret : (int) written;
+    svcReleaseMutex(networkinstall_queue.mutex);
+
+    return popped;
 }
 
-static Result networkinstall_is_src_directory(void* data, u32 index, bool* isDirectory) {
-    *isDirectory = false;
-    return 0;
+// Called on the reader thread when the connection drops at offset into file index. Keeps the
+// install open while waiting for the sender to reconnect with the session token, then tells it
+// where to continue from.
+static void networkinstall_close_streams(network_install_data* data) {
+    for(u32 i = 1; i < NETINSTALL_STREAMS_MAX; i++) {
+        if(data->streams[i] >= 0) {
+            close(data->streams[i]);
+            data->streams[i] = -1;
+        }
+    }
+
+    data->streamCount = 1;
 }
 
-static Result networkinstall_make_dst_directory(void* data, u32 index) {
+static Result networkinstall_resume(network_install_data* data, u32 index, u64 offset) {
+    if(data->session.token == 0) {
+        return R_FBI_ERRNO;
+    }
+
+    int err = errno;
+
+    svcWaitSynchronization(data->socketMutex, U64_MAX);
+    close(data->session.socket);
+    data->session.socket = -1;
+    svcReleaseMutex(data->socketMutex);
+
+    // Whatever the other streams still hold is sent again over the resumed one.
+    networkinstall_close_streams(data);
+
+    data->reconnecting = true;
+
+    Result res = R_FBI_ERRNO;
+
+    u64 start = osGetTime();
+    while(res == R_FBI_ERRNO && osGetTime() - start < NETWORKINSTALL_RESUME_TIMEOUT) {
+        if(task_is_quit_all() || svcWaitSynchronization(data->cancelEvent, 0) == 0) {
+            res = R_FBI_CANCELLED;
+            break;
+        }
+
+        netinstall_session session;
+        if(!networkinstall_pop_session(&session, data->session.token, 0)) {
+            svcSleepThread(100000000);
+            continue;
+        }
+
+        svcWaitSynchronization(data->socketMutex, U64_MAX);
+        data->session.socket = session.socket;
+        svcReleaseMutex(data->socketMutex);
+
+        if(R_FAILED(res = networkinstall_send_frame(data, NETINSTALL_FRAME_RESUME, index, offset, NETWORKINSTALL_TIMEOUT))) {
+            err = errno;
+
+            svcWaitSynchronization(data->socketMutex, U64_MAX);
+            close(data->session.socket);
+            data->session.socket = -1;
+            svcReleaseMutex(data->socketMutex);
+        }
+    }
+
+    data->reconnecting = false;
+
+    errno = err;
+    return res;
+}
+
+// Finds the socket of a stream, waiting for it to attach.
+static Result networkinstall_get_stream(network_install_data* data, u32 stream, int* sock) {
+    if(stream == 0) {
+        *sock = data->session.socket;
+        return 0;
+    }
+
+    u64 start = osGetTime();
+    while(data->streams[stream] < 0) {
+        if(task_is_quit_all() || svcWaitSynchronization(data->cancelEvent, 0) == 0) {
+            return R_FBI_CANCELLED;
+        }
+
+        if(osGetTime() - start >= NETWORKINSTALL_TIMEOUT) {
+            errno = ETIMEDOUT;
+            return R_FBI_ERRNO;
+        }
+
+        netinstall_session session;
+        if(networkinstall_pop_session(&session, data->session.token, stream)) {
+            data->streams[stream] = session.socket;
+        } else {
+            svcSleepThread(10000000);
+        }
+    }
+
+    *sock = data->streams[stream];
     return 0;
 }
 
 static Result networkinstall_open_src(void* data, u32 index, u32* handle) {
     network_install_data* networkInstallData = (network_install_data*) data;
 
-    u8 ack = 1;
-    if(sendwait(networkInstallData->clientSocket, &ack, sizeof(ack), 0) < 0) {
-        return R_FBI_ERRNO;
+    *handle = index;
+
+    if(networkInstallData->session.version >= 2 && (networkInstallData->session.files[index].flags & NETINSTALL_ENTRY_LZ)) {
+        if(networkInstallData->block == NULL) {
+            if((networkInstallData->packed = (u8*) calloc(1, NETINSTALL_BLOCK_SIZE)) == NULL
+               || (networkInstallData->block = (u8*) calloc(1, NETINSTALL_BLOCK_SIZE)) == NULL) {
+                free(networkInstallData->packed);
+                networkInstallData->packed = NULL;
+
+                return R_FBI_OUT_OF_MEMORY;
+            }
+        }
+
+        networkInstallData->blockSize = 0;
+        networkInstallData->blockOffset = 0;
+        networkInstallData->unpackRemaining = networkInstallData->session.files[index].size;
+    }
+
+    if(networkInstallData->session.version == 0) {
+        httpd_body_init(&networkInstallData->body, &networkInstallData->session.request);
+
+        networkInstallData->peekSize = 0;
+        networkInstallData->peekOffset = 0;
+    }
+
+    // Version 2 senders and HTTP clients stream files without waiting to be asked.
+    if(networkInstallData->session.version == 1) {
+        if(netinstall_send_ack(networkInstallData->session.socket, true, NETWORKINSTALL_TIMEOUT) < 0) {
+            return R_FBI_ERRNO;
+        }
     }
 
     return 0;
@@ -73,33 +261,192 @@ static Result networkinstall_close_src(void* data, u32 index, bool succeeded, u3
     return 0;
 }
 
-static Result networkinstall_get_src_size(void* data, u32 handle, u64* size) {
+static Result networkinstall_prescan_src_size(void* data, u32 index, u64* size) {
     network_install_data* networkInstallData = (network_install_data*) data;
 
-    u64 netSize = 0;
-    if(recvwait(networkInstallData->clientSocket, &netSize, sizeof(netSize), 0) < 0) {
+    *size = networkInstallData->session.files[index].size;
+    return 0;
+}
+
+#define NETWORKINSTALL_ALIGN(size) (((u64) (size) + 0x3F) & ~0x3F)
+
+// Chunked uploads don't say how long they are, so the size is worked out from the CIA header.
+static Result networkinstall_get_http_size(network_install_data* data, u64* size) {
+    size_t got = 0;
+    if(httpd_body_read(data->session.socket, &data->body, data->peek, sizeof(data->peek), NETWORKINSTALL_TIMEOUT, &got) < 0) {
         return R_FBI_ERRNO;
     }
 
-    *size = __builtin_bswap64(netSize);
+    data->peekSize = sizeof(data->peek);
+    data->peekOffset = 0;
+
+    u8* cia = data->peek;
+    if(*(u32*) &cia[0x00] != 0x2020) {
+        return R_FBI_BAD_DATA;
+    }
+
+    *size = NETWORKINSTALL_ALIGN(*(u32*) &cia[0x00]) + NETWORKINSTALL_ALIGN(*(u32*) &cia[0x08]) + NETWORKINSTALL_ALIGN(*(u32*) &cia[0x0C])
+            + NETWORKINSTALL_ALIGN(*(u32*) &cia[0x10]) + NETWORKINSTALL_ALIGN(*(u64*) &cia[0x18]) + *(u32*) &cia[0x14];
+
+    data->session.files[0].size = *size;
+    data->session.totalSize = *size;
     return 0;
 }
 
+static Result networkinstall_get_src_size(void* data, u32 handle, u64* size) {
+    network_install_data* networkInstallData = (network_install_data*) data;
+
+    if(networkInstallData->session.version == 0 && networkInstallData->session.request.chunked) {
+        return networkinstall_get_http_size(networkInstallData, size);
+    }
+
+    if(networkInstallData->session.version != 1) {
+        *size = networkInstallData->session.files[handle].size;
+        return 0;
+    }
+
+    return netinstall_recv_size(networkInstallData->session.socket, size, NETWORKINSTALL_TIMEOUT) < 0 ? R_FBI_ERRNO : 0;
+}
+
+// Unpacks the next block into dst, or into data->block if dst is NULL.
+static Result networkinstall_recv_block(network_install_data* data, u32 index, u8* dst) {
+    if(data->unpackRemaining == 0) {
+        return R_FBI_BAD_DATA;
+    }
+
+    netinstall_file* file = &data->session.files[index];
+    u64 pos = file->size - data->unpackRemaining;
+
+    int sock = -1;
+    Result res = networkinstall_get_stream(data, netinstall_unit_stream(pos, file->flags, data->streamCount), &sock);
+    if(R_FAILED(res)) {
+        return res;
+    }
+
+    u32 rawSize = data->unpackRemaining < NETINSTALL_BLOCK_SIZE ? (u32) data->unpackRemaining : NETINSTALL_BLOCK_SIZE;
+    if(netinstall_recv_block(sock, dst != NULL ? dst : data->block, rawSize, data->packed, NULL, NETWORKINSTALL_TIMEOUT) < 0) {
+        return errno == EBADMSG ? R_FBI_BAD_DATA : R_FBI_ERRNO;
+    }
+
+    // Blocks unpacked straight into the caller's buffer leave nothing behind.
+    data->blockSize = dst != NULL ? 0 : rawSize;
+    data->blockOffset = 0;
+    data->unpackRemaining -= rawSize;
+
+    return 0;
+}
+
+static Result networkinstall_read_block(network_install_data* data, u32 index, u8* dst) {
+    Result res = 0;
+
+    // A block cut short by a dropped connection is sent again in full.
+    while((res = networkinstall_recv_block(data, index, dst)) == R_FBI_ERRNO
+          && R_SUCCEEDED(res = networkinstall_resume(data, index, data->session.files[index].size - data->unpackRemaining))) {
+    }
+
+    return res;
+}
+
 static Result networkinstall_read_src(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size) {
     network_install_data* networkInstallData = (network_install_data*) data;
 
-    int ret = 0;
-    if((ret = recvwait(networkInstallData->clientSocket, buffer, size, 0)) < 0) {
-        return R_FBI_ERRNO;
+    if(networkInstallData->session.version == 0) {
+        u32 filled = networkInstallData->peekSize - networkInstallData->peekOffset;
+        if(filled > size) {
+            filled = size;
+        }
+
+        memcpy(buffer, networkInstallData->peek + networkInstallData->peekOffset, filled);
+        networkInstallData->peekOffset += filled;
+
+        size_t got = 0;
+        if(filled < size && httpd_body_read(networkInstallData->session.socket, &networkInstallData->body, (u8*) buffer + filled, size - filled, NETWORKINSTALL_TIMEOUT, &got) < 0) {
+            return R_FBI_ERRNO;
+        }
+
+        *bytesRead = size;
+        return 0;
+    }
+
+    // Compressed blocks don't line up with chunks, so they are unpacked here on the reader
+    // thread, overlapping with the AM writes of the previous chunk.
+    if(networkInstallData->session.version >= 2 && (networkInstallData->session.files[handle].flags & NETINSTALL_ENTRY_LZ)) {
+        Result res = 0;
+
+        u32 filled = 0;
+        while(filled < size) {
+            if(networkInstallData->blockOffset == networkInstallData->blockSize) {
+                // Whole blocks that fit go straight into the transfer buffer, skipping the copy.
+                u64 remaining = networkInstallData->unpackRemaining;
+                u32 rawSize = remaining < NETINSTALL_BLOCK_SIZE ? (u32) remaining : NETINSTALL_BLOCK_SIZE;
+                bool direct = rawSize > 0 && rawSize <= size - filled;
+
+                if(R_FAILED(res = networkinstall_read_block(networkInstallData, handle, direct ? (u8*) buffer + filled : NULL))) {
+                    return res;
+                }
+
+                if(direct) {
+                    filled += rawSize;
+                    continue;
+                }
+            }
+
+            u32 n = networkInstallData->blockSize - networkInstallData->blockOffset;
+            if(n > size - filled) {
+                n = size - filled;
+            }
+
+            memcpy((u8*) buffer + filled, networkInstallData->block + networkInstallData->blockOffset, n);
+            networkInstallData->blockOffset += n;
+            filled += n;
+        }
+
+        *bytesRead = size;
+        return 0;
     }
 
-    *bytesRead = (u32) ret;
+    u32 received = 0;
+    while(received < size) {
+        u64 pos = offset + received;
+
+        // With several streams, read up to the end of the current stripe only. Files that get here
+        // are never sent as blocks.
+        u32 n = netinstall_unit_span(pos, size - received, 0, networkInstallData->streamCount);
+
+        int sock = -1;
+        size_t got = 0;
+
+        Result res = networkinstall_get_stream(networkInstallData, netinstall_unit_stream(pos, 0, networkInstallData->streamCount), &sock);
+        if(R_SUCCEEDED(res) && net_recv_all_partial(sock, (u8*) buffer + received, n, 0, NETWORKINSTALL_TIMEOUT, &got) >= 0) {
+            received += n;
+            continue;
+        }
+
+        received += got;
+
+        if(res == R_FBI_CANCELLED || R_FAILED(res = networkinstall_resume(networkInstallData, handle, offset + received))) {
+            return res;
+        }
+    }
+
+    *bytesRead = received;
     return 0;
 }
 
 static Result networkinstall_open_dst(void* data, u32 index, void* initialReadBlock, u32* handle) {
     network_install_data* networkInstallData = (network_install_data*) data;
 
+    networkInstallData->verify = networkInstallData->session.version >= 2 && (networkInstallData->session.files[index].flags & NETINSTALL_ENTRY_HASH);
+    if(networkInstallData->verify) {
+        hash64_init(&networkInstallData->hash);
+    }
+
+    // Benchmarks throw the data away.
+    if(networkInstallData->session.flags & NETINSTALL_MANIFEST_BENCHMARK) {
+        *handle = 1;
+        return 0;
+    }
+
     networkInstallData->ticket = *(u16*) initialReadBlock == 0x0100;
 
     Result res = 0;
@@ -141,6 +488,25 @@ static Result networkinstall_open_dst(void* data, u32 index, void* initialReadBl
 static Result networkinstall_close_dst(void* data, u32 index, bool succeeded, u32 handle) {
     network_install_data* networkInstallData = (network_install_data*) data;
 
+    if(networkInstallData->session.flags & NETINSTALL_MANIFEST_BENCHMARK) {
+        if(succeeded) {
+            networkinstall_send_frame(networkInstallData, NETINSTALL_FRAME_FILE_DONE, index, 0, NETWORKINSTALL_FRAME_TIMEOUT);
+        }
+
+        return 0;
+    }
+
+    // Abort rather than commit a title that doesn't match what the sender hashed.
+    if(succeeded && networkInstallData->verify && hash64_final(&networkInstallData->hash) != networkInstallData->session.files[index].hash) {
+        if(networkInstallData->ticket) {
+            AM_InstallTicketAbort(handle);
+        } else {
+            AM_CancelCIAInstall(handle);
+        }
+
+        return R_FBI_HASH_MISMATCH;
+    }
+
     if(succeeded) {
         Result res = 0;
 
@@ -154,6 +520,10 @@ static Result networkinstall_close_dst(void* data, u32 index, bool succeeded, u3
             }
         }
 
+        if(R_SUCCEEDED(res) && networkInstallData->session.version >= 2) {
+            networkinstall_send_frame(networkInstallData, NETINSTALL_FRAME_FILE_DONE, index, 0, NETWORKINSTALL_FRAME_TIMEOUT);
+        }
+
         return res;
     } else {
         if(networkInstallData->ticket) {
@@ -165,16 +535,52 @@ static Result networkinstall_close_dst(void* data, u32 index, bool succeeded, u3
 }
 
 static Result networkinstall_write_dst(void* data, u32 handle, u32* bytesWritten, void* buffer, u64 offset, u32 size) {
-    return FSFILE_Write(handle, bytesWritten, offset, buffer, size, 0);
+    network_install_data* networkInstallData = (network_install_data*) data;
+
+    Result res = 0;
+    if(networkInstallData->session.flags & NETINSTALL_MANIFEST_BENCHMARK) {
+        *bytesWritten = size;
+    } else {
+        res = FSFILE_Write(handle, bytesWritten, offset, buffer, size, 0);
+    }
+
+    if(R_SUCCEEDED(res) && networkInstallData->verify) {
+        hash64_update(&networkInstallData->hash, buffer, *bytesWritten);
+    }
+
+    if(R_SUCCEEDED(res) && networkInstallData->session.version >= 2) {
+        networkInstallData->installed += *bytesWritten;
+
+        if(networkInstallData->installed - networkInstallData->reported >= NETWORKINSTALL_PROGRESS_INTERVAL) {
+            networkInstallData->reported = networkInstallData->installed;
+            networkinstall_send_frame(networkInstallData, NETINSTALL_FRAME_PROGRESS, 0, networkInstallData->installed, NETWORKINSTALL_FRAME_TIMEOUT);
+        }
+    }
+
+    return res;
 }
 
 static bool networkinstall_error(void* data, u32 index, Result res) {
+    network_install_data* networkInstallData = (network_install_data*) data;
+
+    networkInstallData->result = res;
+
+    if(networkInstallData->session.version >= 2) {
+        networkinstall_send_frame(networkInstallData, NETINSTALL_FRAME_ERROR, index, (u32) res, NETWORKINSTALL_CLOSE_TIMEOUT);
+    }
+
     if(res == R_FBI_CANCELLED) {
         prompt_display("Failure", "Install cancelled.", COLOR_TEXT, false, NULL, NULL, NULL, NULL);
     } else if(res == R_FBI_ERRNO) {
         error_display_errno(NULL, NULL, NULL, errno, "Failed to install over the network.");
     } else if(res == R_FBI_WRONG_SYSTEM) {
         error_display(NULL, NULL, NULL, "Failed to install over the network.\nAttempted to install N3DS title to O3DS.");
+    } else if(res == R_FBI_BAD_DATA && networkInstallData->session.version == 0) {
+        error_display(NULL, NULL, NULL, "Failed to install over the network.\nChunked uploads must be CIA files.");
+    } else if(res == R_FBI_BAD_DATA) {
+        error_display(NULL, NULL, NULL, "Failed to install over the network.\nReceived a malformed compressed block.");
+    } else if(res == R_FBI_HASH_MISMATCH) {
+        error_display(NULL, NULL, NULL, "Failed to install over the network.\nThe received file does not match the sender's hash.");
     } else {
         error_display_res(NULL, NULL, NULL, res, "Failed to install over the network.");
     }
@@ -182,11 +588,66 @@ static bool networkinstall_error(void* data, u32 index, Result res) {
     return false;
 }
 
+// Answers an HTTP upload, handing keep-alive connections back to the listener for their next request.
+static void networkinstall_respond_http(network_install_data* data) {
+    int sock = data->session.socket;
+    bool keepAlive = false;
+
+    char json[64];
+    if(!data->accepted) {
+        httpd_send_json(sock, 403, "Forbidden", NULL, "{\"status\":\"declined\"}", false, NETWORKINSTALL_CLOSE_TIMEOUT);
+    } else if(data->installInfo.finished && !data->installInfo.premature) {
+        if(httpd_body_finish(sock, &data->body, NETWORKINSTALL_CLOSE_TIMEOUT) < 0) {
+            httpd_send_json(sock, 400, "Bad Request", NULL, "{\"status\":\"error\",\"error\":\"body continues past the end of the CIA\"}", false, NETWORKINSTALL_CLOSE_TIMEOUT);
+        } else {
+            snprintf(json, sizeof(json), "{\"status\":\"ok\",\"size\":%llu}", data->session.files[0].size);
+
+            keepAlive = data->session.request.keepAlive;
+            if(httpd_send_json(sock, 200, "OK", NULL, json, keepAlive, NETWORKINSTALL_CLOSE_TIMEOUT) < 0) {
+                keepAlive = false;
+            }
+        }
+    } else if(data->result == 0 || data->result == R_FBI_CANCELLED) {
+        httpd_send_json(sock, 500, "Internal Server Error", NULL, "{\"status\":\"cancelled\"}", false, NETWORKINSTALL_CLOSE_TIMEOUT);
+    } else {
+        snprintf(json, sizeof(json), "{\"status\":\"error\",\"result\":\"0x%08lX\"}", data->result);
+        httpd_send_json(sock, 500, "Internal Server Error", NULL, json, false, NETWORKINSTALL_CLOSE_TIMEOUT);
+    }
+
+    if(keepAlive) {
+        task_listen_network_keep(&networkinstall_queue, sock, data->session.address);
+        data->session.socket = -1;
+    }
+}
+
 static void networkinstall_close_client(network_install_data* data) {
-    u8 ack = 0;
-    sendwait(data->clientSocket, &ack, sizeof(ack), 0);
+    if(data->session.version == 0) {
+        networkinstall_respond_http(data);
+    } else if(data->session.version >= 2) {
+        if(data->accepted) {
+            networkinstall_send_frame(data, NETINSTALL_FRAME_DONE, 0, data->installInfo.premature, NETWORKINSTALL_CLOSE_TIMEOUT);
+        } else {
+            networkinstall_send_frame(data, NETINSTALL_FRAME_REJECT, 0, 0, NETWORKINSTALL_CLOSE_TIMEOUT);
+        }
+    } else {
+        netinstall_send_ack(data->session.socket, false, NETWORKINSTALL_CLOSE_TIMEOUT);
+    }
+
+    if(data->session.socket >= 0) {
+        close(data->session.socket);
+    }
+
+    networkinstall_close_streams(data);
+
+    free(data->session.files);
 
-    close(data->clientSocket);
+    free(data->packed);
+    free(data->block);
+    data->packed = NULL;
+    data->block = NULL;
+
+    memset(&data->session, 0, sizeof(data->session));
+    data->accepted = false;
 
     data->currTitleId = 0;
     data->cancelEvent = 0;
@@ -196,12 +657,26 @@ static void networkinstall_install_update(ui_view* view, void* data, float* prog
     network_install_data* networkInstallData = (network_install_data*) data;
 
     if(networkInstallData->installInfo.finished) {
+        bool benchmark = (networkInstallData->session.flags & NETINSTALL_MANIFEST_BENCHMARK) != 0;
+
+        if(benchmark) {
+            u64 elapsed = osGetTime() - networkInstallData->startTime;
+
+            if(networkInstallData->installInfo.premature) {
+                snprintf(networkInstallData->benchmarkText, sizeof(networkInstallData->benchmarkText), "Last benchmark stopped.");
+            } else {
+                snprintf(networkInstallData->benchmarkText, sizeof(networkInstallData->benchmarkText), "Last benchmark (%lu stream(s)):\n%.1f MiB in %.2f s (%.2f MiB/s)",
+                         networkInstallData->streamCount, networkInstallData->installed / 1024.0 / 1024.0, elapsed / 1000.0,
+                         elapsed != 0 ? networkInstallData->installed / 1024.0 / 1024.0 / (elapsed / 1000.0) : 0.0);
+            }
+        }
+
         networkinstall_close_client(networkInstallData);
 
         ui_pop();
         info_destroy(view);
 
-        if(!networkInstallData->installInfo.premature) {
+        if(!benchmark && !networkInstallData->installInfo.premature) {
             prompt_display("Success", "Install finished.", COLOR_TEXT, false, data, NULL, NULL, NULL);
         }
 
@@ -212,17 +687,52 @@ static void networkinstall_install_update(ui_view* view, void* data, float* prog
         svcSignalEvent(networkInstallData->cancelEvent);
     }
 
-    *progress = networkInstallData->installInfo.currTotal != 0 ? (float) ((double) networkInstallData->installInfo.currProcessed / (double) networkInstallData->installInfo.currTotal) : 0;
-    snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%.2f MB / %.2f MB", networkInstallData->installInfo.processed, networkInstallData->installInfo.total, networkInstallData->installInfo.currProcessed / 1024.0 / 1024.0, networkInstallData->installInfo.currTotal / 1024.0 / 1024.0);
+    info_get_data_op_progress(&networkInstallData->installInfo, progress, text);
+
+    if(networkInstallData->reconnecting) {
+        size_t len = strlen(text);
+        snprintf(text + len, PROGRESS_TEXT_MAX - len, "\nConnection lost, waiting for sender...");
+    }
 }
 
 static void networkinstall_confirm_onresponse(ui_view* view, void* data, bool response) {
     network_install_data* networkInstallData = (network_install_data*) data;
 
     if(response) {
+        networkInstallData->accepted = true;
+
+        // Senders that can resume or attach more streams get a token to connect with. Anyone on the
+        // network can connect, so it must not be guessable; 0 means no token.
+        if(networkInstallData->session.flags & (NETINSTALL_CAP_RESUME | NETINSTALL_CAP_STREAMS)) {
+            Result tokenRes = 0;
+            while(networkInstallData->session.token == 0
+                  && R_SUCCEEDED(tokenRes = PS_GenerateRandomBytes(&networkInstallData->session.token, sizeof(networkInstallData->session.token))));
+
+            if(R_FAILED(tokenRes)) {
+                error_display_res(NULL, NULL, NULL, tokenRes, "Failed to generate session token.");
+
+                networkinstall_close_client(networkInstallData);
+                return;
+            }
+        }
+
+        networkInstallData->streamCount = NETINSTALL_MANIFEST_GET_STREAMS(networkInstallData->session.flags);
+
+        if((networkInstallData->session.version >= 2
+            && R_FAILED(networkinstall_send_frame(networkInstallData, NETINSTALL_FRAME_ACCEPT, 0, networkInstallData->session.token, NETWORKINSTALL_TIMEOUT)))
+           || (networkInstallData->session.version == 0 && networkInstallData->session.request.expectContinue
+               && httpd_send_continue(networkInstallData->session.socket, NETWORKINSTALL_TIMEOUT) < 0)) {
+            error_display_errno(NULL, NULL, NULL, errno, "Failed to start installation.");
+
+            networkinstall_close_client(networkInstallData);
+            return;
+        }
+
+        networkInstallData->startTime = osGetTime();
         networkInstallData->cancelEvent = task_data_op(&networkInstallData->installInfo);
         if(networkInstallData->cancelEvent != 0) {
-            info_display("Installing Over Network", "Press B to cancel.", true, data, networkinstall_install_update, NULL);
+            bool benchmark = (networkInstallData->session.flags & NETINSTALL_MANIFEST_BENCHMARK) != 0;
+            info_display(benchmark ? "Network Benchmark" : "Installing Over Network", "Press B to cancel.", true, data, networkinstall_install_update, NULL);
         } else {
             error_display(NULL, NULL, NULL, "Failed to initiate installation.");
 
@@ -233,95 +743,157 @@ static void networkinstall_confirm_onresponse(ui_view* view, void* data, bool re
     }
 }
 
+static void networkinstall_start_listening() {
+    if(!networkinstall_queue.listening) {
+        networkinstall_listener = task_listen_network(&networkinstall_queue, NETINSTALL_PORT);
+    }
+}
+
+static void networkinstall_stop_listening() {
+    if(networkinstall_queue.listening && networkinstall_listener != 0) {
+        svcSignalEvent(networkinstall_listener);
+    }
+
+    networkinstall_listener = 0;
+}
+
 static void networkinstall_wait_update(ui_view* view, void* data, float* progress, char* text) {
     network_install_data* networkInstallData = (network_install_data*) data;
 
+    // The listener keeps running after returning, so senders can connect while other sections are open.
     if(hidKeysDown() & KEY_B) {
         ui_pop();
         info_destroy(view);
 
-        close(networkInstallData->serverSocket);
+        svcCloseHandle(networkInstallData->socketMutex);
         free(networkInstallData);
 
         return;
     }
 
-    struct sockaddr_in client;
-    socklen_t clientLen = sizeof(client);
+    if(hidKeysDown() & KEY_X) {
+        if(networkinstall_queue.listening) {
+            networkinstall_stop_listening();
+        } else {
+            networkinstall_start_listening();
+        }
+    }
 
-    int sock = accept(networkInstallData->serverSocket, (struct sockaddr*) &client, &clientLen);
-    if(sock >= 0) {
-        if(recvwait(sock, &networkInstallData->installInfo.total, sizeof(networkInstallData->installInfo.total), 0) < 0) {
-            close(sock);
+    if(networkinstall_pop_session(&networkInstallData->session, 0, 0)) {
+        netinstall_session* session = &networkInstallData->session;
 
-            error_display_errno(NULL, NULL, NULL, errno, "Failed to read file count.");
-            return;
-        }
+        if(session->resume) {
+            // Nothing is installing, so there is nothing left to resume.
+            networkinstall_close_client(networkInstallData);
+        } else {
+            networkInstallData->installed = 0;
+            networkInstallData->reported = 0;
+            networkInstallData->result = 0;
+
+            networkInstallData->installInfo.total = session->fileCount;
+
+            if(session->version == 0) {
+                // Only uploads sent with a Content-Length have a size before the body arrives.
+                if(session->request.chunked) {
+                    networkInstallData->installInfo.prescanSrcSize = NULL;
+
+                    snprintf(networkInstallData->confirmText, sizeof(networkInstallData->confirmText), "Install %.48s over HTTP?", session->files[0].name);
+                } else {
+                    networkInstallData->installInfo.prescanSrcSize = networkinstall_prescan_src_size;
+
+                    snprintf(networkInstallData->confirmText, sizeof(networkInstallData->confirmText), "Install %.48s over HTTP (%.1f MiB)?",
+                             session->files[0].name, session->totalSize / 1024.0 / 1024.0);
+                }
+            } else if(session->version >= 2) {
+                // The manifest already lists every size, so the whole install can be tracked up front.
+                networkInstallData->installInfo.prescanSrcSize = networkinstall_prescan_src_size;
+
+                snprintf(networkInstallData->confirmText, sizeof(networkInstallData->confirmText), "Install %lu file(s) (%.1f MiB)?",
+                         session->fileCount, session->totalSize / 1024.0 / 1024.0);
+            } else {
+                networkInstallData->installInfo.prescanSrcSize = NULL;
+
+                snprintf(networkInstallData->confirmText, sizeof(networkInstallData->confirmText), "Install the received file(s)?");
+            }
+
+            networkInstallData->installInfo.name = (session->flags & NETINSTALL_MANIFEST_BENCHMARK) ? "Network benchmark" : "Network install";
 
-        networkInstallData->installInfo.total = ntohl(networkInstallData->installInfo.total);
+            // Benchmarks don't touch the system, so they don't need confirming.
+            if(session->flags & NETINSTALL_MANIFEST_BENCHMARK) {
+                networkinstall_confirm_onresponse(view, data, true);
+            } else {
+                prompt_display("Confirmation", networkInstallData->confirmText, COLOR_TEXT, true, data, NULL, NULL, networkinstall_confirm_onresponse);
+            }
+        }
+    }
 
-        networkInstallData->clientSocket = sock;
-        prompt_display("Confirmation", "Install the received file(s)?", COLOR_TEXT, true, data, NULL, NULL, networkinstall_confirm_onresponse);
-    } else if(errno != EAGAIN) {
-        error_display_errno(NULL, NULL, NULL, errno, "Failed to open socket.");
+    if(networkinstall_queue.listening) {
+        struct in_addr addr = {networkinstall_queue.address != 0 ? networkinstall_queue.address : (in_addr_t) gethostid()};
+        const char* ip = inet_ntoa(addr);
+        snprintf(text, PROGRESS_TEXT_MAX, "Waiting for connection...\nIP: %s\nPort: %u\nHTTP: PUT http://%s:%u/<file>", ip, NETINSTALL_PORT, ip, NETINSTALL_PORT);
+    } else {
+        snprintf(text, PROGRESS_TEXT_MAX, "Not listening.\nPress X to start listening.");
     }
 
-    struct in_addr addr = {(in_addr_t) gethostid()};
-    snprintf(text, PROGRESS_TEXT_MAX, "Waiting for connection...\nIP: %s\nPort: 5000", inet_ntoa(addr));
+    if(networkInstallData->benchmarkText[0] != '\0') {
+        size_t len = strlen(text);
+        snprintf(text + len, PROGRESS_TEXT_MAX - len, "\n\n%s", networkInstallData->benchmarkText);
+    }
 }
 
 void networkinstall_open() {
-    network_install_data* data = (network_install_data*) calloc(1, sizeof(network_install_data));
-    if(data == NULL) {
-        error_display(NULL, NULL, NULL, "Failed to allocate network install data.");
+    if(networkinstall_queue.mutex == 0) {
+        Result mutexRes = svcCreateMutex(&networkinstall_queue.mutex, false);
+        if(R_FAILED(mutexRes)) {
+            error_display_res(NULL, NULL, NULL, mutexRes, "Failed to create network session queue mutex.");
 
-        return;
+            return;
+        }
     }
 
-    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
-    if(sock < 0) {
-        error_display_errno(NULL, NULL, NULL, errno, "Failed to open server socket.");
+    network_install_data* data = (network_install_data*) calloc(1, sizeof(network_install_data));
+    if(data == NULL) {
+        error_display(NULL, NULL, NULL, "Failed to allocate network install data.");
 
-        free(data);
         return;
     }
 
-    int bufSize = 1024 * 32;
-    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
-
-    struct sockaddr_in server;
-    server.sin_family = AF_INET;
-    server.sin_port = htons(5000);
-    server.sin_addr.s_addr = (in_addr_t) gethostid();
+    Result mutexRes = svcCreateMutex(&data->socketMutex, false);
+    if(R_FAILED(mutexRes)) {
+        error_display_res(NULL, NULL, NULL, mutexRes, "Failed to create network install socket mutex.");
 
-    if(bind(sock, (struct sockaddr*) &server, sizeof(server)) < 0) {
-        error_display_errno(NULL, NULL, NULL, errno, "Failed to bind server socket.");
-
-        close(sock);
         free(data);
         return;
     }
 
-    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    networkinstall_start_listening();
 
-    if(listen(sock, 5) < 0) {
-        error_display_errno(NULL, NULL, NULL, errno, "Failed to listen on server socket.");
+    data->session.socket = 0;
+    data->session.files = NULL;
+    data->accepted = false;
 
-        close(sock);
-        free(data);
-        return;
+    for(u32 i = 0; i < NETINSTALL_STREAMS_MAX; i++) {
+        data->streams[i] = -1;
     }
 
-    data->serverSocket = sock;
-    data->clientSocket = 0;
+    data->streamCount = 1;
 
     data->currTitleId = 0;
     data->ticket = false;
 
     data->installInfo.data = data;
 
+    data->installInfo.name = "Network install";
+
     data->installInfo.op = DATAOP_COPY;
 
+    data->installInfo.ordered = true;
+
+    // Socket reads wait until the whole chunk has arrived, so smaller chunks
+    // hand data to AM sooner.
+    data->installInfo.chunkSize = netconfig_get()->chunkSize;
+    data->installInfo.bufferCount = netconfig_get()->bufferCount;
+
     data->installInfo.copyEmpty = false;
 
     data->installInfo.isSrcDirectory = networkinstall_is_src_directory;
@@ -340,5 +912,5 @@ void networkinstall_open() {
 
     data->cancelEvent = 0;
 
-    info_display("Network Install", "B: Return", false, data, networkinstall_wait_update, NULL);
+    info_display("Network Install", "B: Return, X: Start/Stop Listening", false, data, networkinstall_wait_update, NULL);
 }
@@ -1,6 +1,9 @@
+#include <errno.h>
 #include <malloc.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include <3ds.h>
 
@@ -9,6 +12,7 @@
 #include "../error.h"
 #include "../info.h"
 #include "../prompt.h"
+#include "../../net/httpclient.h"
 #include "../../screen.h"
 #include "../../quirc/quirc_internal.h"
 
@@ -18,6 +22,28 @@
 #define URL_MAX 1024
 #define URLS_MAX 128
 
+#define QRINSTALL_TIMEOUT 30000
+
+typedef struct {
+    u32 index;
+
+    // Plain http:// URLs are fetched over kept-alive connections; anything else goes through httpc.
+    bool native;
+    httpcContext context;
+    httpclient_request request;
+
+    // Size of the whole body, and how much of it has been downloaded so far.
+    u64 size;
+    u64 offset;
+
+    // Set when the download broke off, until it is resumed, along with the failure. Broken
+    // sources have no open request or context.
+    bool broken;
+    Result res;
+    int err;
+    httpclient_retry retry;
+} qr_source;
+
 typedef struct {
     struct quirc* qrContext;
     char urls[URLS_MAX][URL_MAX];
@@ -31,6 +57,13 @@ typedef struct {
     u64 currTitleId;
     bool ticket;
 
+    httpclient_pool pool;
+
+    // The request for the next URL, pipelined behind the one being installed when both are on
+    // the same host.
+    qr_source* next;
+    u32 nextIndex;
+
     data_op_info installInfo;
     Handle installCancelEvent;
 } qr_install_data;
@@ -44,53 +77,378 @@ static Result qrinstall_make_dst_directory(void* data, u32 index) {
     return 0;
 }
 
-static Result qrinstall_open_src(void* data, u32 index, u32* handle) {
-    qr_install_data* qrInstallData = (qr_install_data*) data;
+static void qrinstall_close_request(qr_source* source) {
+    if(source->native) {
+        httpclient_finish(&source->request, QRINSTALL_TIMEOUT);
+    } else {
+        httpcCloseContext(&source->context);
+    }
+}
+
+static void qrinstall_close_source(qr_source* source) {
+    if(!source->broken) {
+        qrinstall_close_request(source);
+    }
+
+    free(source);
+}
+
+static void qrinstall_release_next(qr_install_data* data) {
+    if(data->next != NULL) {
+        qrinstall_close_source(data->next);
+        data->next = NULL;
+    }
+}
+
+// Sends the request for the URL after index straight away, so its response follows the current
+// one without another round trip.
+static void qrinstall_pipeline_next(qr_install_data* data, u32 index, qr_source* source) {
+    u32 next = index + 1;
+    if(!source->native || data->next != NULL || next >= data->installInfo.total || !httpclient_supports(data->urls[next])) {
+        return;
+    }
 
+    qr_source* nextSource = (qr_source*) calloc(1, sizeof(qr_source));
+    if(nextSource == NULL) {
+        return;
+    }
+
+    nextSource->index = next;
+    nextSource->native = true;
+
+    if(httpclient_send_after(&data->pool, &source->request, "GET", data->urls[next], &nextSource->request, QRINSTALL_TIMEOUT) < 0) {
+        free(nextSource);
+        return;
+    }
+
+    data->next = nextSource;
+    data->nextIndex = next;
+}
+
+static Result qrinstall_open_native(qr_install_data* data, u32 index, qr_source* source) {
+    if(!source->request.headRead && httpclient_read_head(&source->request, QRINSTALL_TIMEOUT) < 0) {
+        return R_FBI_ERRNO;
+    }
+
+    data->responseCode = (u32) source->request.status;
+    if(data->responseCode != 200) {
+        return R_FBI_HTTP_RESPONSE_CODE;
+    }
+
+    source->size = source->request.contentLength;
+    return 0;
+}
+
+static Result qrinstall_open_httpc(qr_install_data* data, u32 index, qr_source* source) {
     Result res = 0;
 
-    httpcContext* context = (httpcContext*) calloc(1, sizeof(httpcContext));
-    if(context != NULL) {
-        if(R_SUCCEEDED(res = httpcOpenContext(context, HTTPC_METHOD_GET, qrInstallData->urls[index], 1))) {
-            httpcSetSSLOpt(context, SSLCOPT_DisableVerify);
-            if(R_SUCCEEDED(res = httpcBeginRequest(context)) && R_SUCCEEDED(res = httpcGetResponseStatusCode(context, &qrInstallData->responseCode, 0))) {
-                if(qrInstallData->responseCode == 200) {
-                    *handle = (u32) context;
-                } else {
-                    res = R_FBI_HTTP_RESPONSE_CODE;
-                }
+    if(R_SUCCEEDED(res = httpcOpenContext(&source->context, HTTPC_METHOD_GET, data->urls[index], 1))) {
+        httpcSetSSLOpt(&source->context, SSLCOPT_DisableVerify);
+        if(R_SUCCEEDED(res = httpcBeginRequest(&source->context)) && R_SUCCEEDED(res = httpcGetResponseStatusCode(&source->context, &data->responseCode, 0))) {
+            if(data->responseCode != 200) {
+                res = R_FBI_HTTP_RESPONSE_CODE;
             }
+        }
 
-            if(R_FAILED(res)) {
-                httpcCloseContext(context);
+        u32 downloadSize = 0;
+        if(R_SUCCEEDED(res) && R_SUCCEEDED(res = httpcGetDownloadSizeState(&source->context, NULL, &downloadSize))) {
+            source->size = downloadSize;
+        }
+
+        if(R_FAILED(res)) {
+            httpcCloseContext(&source->context);
+        }
+    }
+
+    return res;
+}
+
+// Checks that a reopened httpc download carries on from where the broken one stopped, as
+// httpclient_read_head and the length check below do for native ones. httpc reports a size of 0
+// when the server sent no length.
+static Result qrinstall_check_httpc_range(qr_source* source, u32 responseCode) {
+    u32 downloadSize = 0;
+    Result res = httpcGetDownloadSizeState(&source->context, NULL, &downloadSize);
+    if(R_FAILED(res)) {
+        return res;
+    }
+
+    u64 expected = responseCode == 206 ? source->size - source->offset : source->size;
+    bool valid = downloadSize == 0 || downloadSize == expected;
+
+    // A partial body must start where it was asked to.
+    if(valid && responseCode == 206) {
+        char contentRange[64];
+        char* end = NULL;
+        valid = R_SUCCEEDED(httpcGetResponseHeader(&source->context, "Content-Range", contentRange, sizeof(contentRange)))
+                && strncasecmp(contentRange, "bytes ", 6) == 0 && strtoull(contentRange + 6, &end, 10) == source->offset && *end == '-';
+    }
+
+    if(!valid) {
+        // The file changed since the download started.
+        errno = EBADMSG;
+        return R_FBI_ERRNO;
+    }
+
+    return 0;
+}
+
+// Requests the rest of a broken download. Servers that ignore the range send the whole body,
+// whose start is skipped.
+static Result qrinstall_reopen_source(qr_install_data* data, qr_source* source) {
+    const char* url = data->urls[source->index];
+
+    if(source->native) {
+        if(httpclient_send_range(&data->pool, url, source->offset, &source->request, QRINSTALL_TIMEOUT) < 0) {
+            return R_FBI_ERRNO;
+        }
+
+        Result res = 0;
+        if(httpclient_read_head(&source->request, QRINSTALL_TIMEOUT) < 0) {
+            res = R_FBI_ERRNO;
+        } else if(source->request.status != 200 && source->request.status != 206) {
+            data->responseCode = (u32) source->request.status;
+            res = R_FBI_HTTP_RESPONSE_CODE;
+        } else if(source->request.hasLength && source->request.contentLength != source->size - source->offset) {
+            // The file changed size since the download started.
+            errno = EBADMSG;
+            res = R_FBI_ERRNO;
+        }
+
+        if(R_FAILED(res)) {
+            int err = errno;
+            httpclient_finish(&source->request, QRINSTALL_TIMEOUT);
+
+            errno = err;
+        }
+
+        return res;
+    }
+
+    Result res = 0;
+
+    if(R_SUCCEEDED(res = httpcOpenContext(&source->context, HTTPC_METHOD_GET, url, 1))) {
+        httpcSetSSLOpt(&source->context, SSLCOPT_DisableVerify);
+
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%llu-", source->offset);
+
+        if(R_SUCCEEDED(res = httpcAddRequestHeaderField(&source->context, "Range", range))
+           && R_SUCCEEDED(res = httpcBeginRequest(&source->context))
+           && R_SUCCEEDED(res = httpcGetResponseStatusCode(&source->context, &data->responseCode, 0))) {
+            if(data->responseCode != 200 && data->responseCode != 206) {
+                res = R_FBI_HTTP_RESPONSE_CODE;
+            } else {
+                res = qrinstall_check_httpc_range(source, data->responseCode);
+            }
+
+            if(R_SUCCEEDED(res) && data->responseCode == 200) {
+                u8 skipped[0x1000];
+                for(u64 remaining = source->offset; remaining > 0 && R_SUCCEEDED(res); ) {
+                    u32 size = remaining < sizeof(skipped) ? (u32) remaining : sizeof(skipped);
+                    u32 bytesRead = 0;
+
+                    res = httpcDownloadData(&source->context, skipped, size, &bytesRead);
+                    if(res == HTTPC_RESULTCODE_DOWNLOADPENDING || (R_SUCCEEDED(res) && bytesRead == size)) {
+                        res = 0;
+                    } else if(R_SUCCEEDED(res)) {
+                        res = R_FBI_HTTP_RESPONSE_CODE;
+                    }
+
+                    remaining -= bytesRead;
+                }
             }
         }
 
         if(R_FAILED(res)) {
-            free(context);
+            httpcCloseContext(&source->context);
         }
-    } else {
-        res = R_FBI_OUT_OF_MEMORY;
     }
 
     return res;
 }
 
+static void qrinstall_break_source(qr_source* source, Result res) {
+    source->res = res;
+    source->err = errno;
+    source->broken = true;
+
+    qrinstall_close_request(source);
+}
+
+typedef struct {
+    qr_install_data* data;
+    qr_source* source;
+
+    Result res;
+    bool cancelled;
+} qr_resume_attempt;
+
+static bool qrinstall_resume_wait(void* arg, u32 ms) {
+    qr_resume_attempt* attempt = (qr_resume_attempt*) arg;
+
+    attempt->cancelled = task_is_quit_all() || svcWaitSynchronization(attempt->data->installCancelEvent, (u64) ms * 1000000) == 0;
+    return !attempt->cancelled;
+}
+
+static int qrinstall_resume_reopen(void* arg) {
+    qr_resume_attempt* attempt = (qr_resume_attempt*) arg;
+    return R_FAILED(attempt->res = qrinstall_reopen_source(attempt->data, attempt->source)) ? -1 : 0;
+}
+
+static Result qrinstall_resume_source(qr_install_data* data, qr_source* source) {
+    qr_resume_attempt attempt = {data, source, source->res, false};
+
+    errno = source->err;
+    if(httpclient_resume(&source->retry, source->offset, qrinstall_resume_wait, qrinstall_resume_reopen, &attempt) < 0) {
+        return attempt.cancelled ? R_FBI_CANCELLED : attempt.res;
+    }
+
+    source->broken = false;
+    return 0;
+}
+
+static Result qrinstall_open_src(void* data, u32 index, u32* handle) {
+    qr_install_data* qrInstallData = (qr_install_data*) data;
+
+    qr_source* source = NULL;
+    if(qrInstallData->next != NULL && qrInstallData->nextIndex == index) {
+        source = qrInstallData->next;
+        qrInstallData->next = NULL;
+    } else {
+        qrinstall_release_next(qrInstallData);
+
+        if((source = (qr_source*) calloc(1, sizeof(qr_source))) == NULL) {
+            return R_FBI_OUT_OF_MEMORY;
+        }
+
+        source->index = index;
+        source->native = httpclient_supports(qrInstallData->urls[index]);
+
+        if(!source->native) {
+            Result res = qrinstall_open_httpc(qrInstallData, index, source);
+            if(R_FAILED(res)) {
+                free(source);
+                return res;
+            }
+
+            *handle = (u32) source;
+            return 0;
+        }
+
+        if(httpclient_send(&qrInstallData->pool, "GET", qrInstallData->urls[index], &source->request, QRINSTALL_TIMEOUT) < 0) {
+            free(source);
+            return R_FBI_ERRNO;
+        }
+    }
+
+    Result res = qrinstall_open_native(qrInstallData, index, source);
+    if(R_FAILED(res)) {
+        int err = errno;
+        qrinstall_close_source(source);
+
+        errno = err;
+        return res;
+    }
+
+    *handle = (u32) source;
+
+    qrinstall_pipeline_next(qrInstallData, index, source);
+    return 0;
+}
+
 static Result qrinstall_close_src(void* data, u32 index, bool succeeded, u32 handle) {
-    return httpcCloseContext((httpcContext*) handle);
+    qrinstall_close_source((qr_source*) handle);
+    return 0;
 }
 
-static Result qrinstall_get_src_size(void* data, u32 handle, u64* size) {
-    u32 downloadSize = 0;
-    Result res = httpcGetDownloadSizeState((httpcContext*) handle, NULL, &downloadSize);
+static Result qrinstall_prescan_src_size(void* data, u32 index, u64* size) {
+    qr_install_data* qrInstallData = (qr_install_data*) data;
+
+    Result res = 0;
+
+    if(httpclient_supports(qrInstallData->urls[index])) {
+        httpclient_request request;
+        if(httpclient_send(&qrInstallData->pool, "HEAD", qrInstallData->urls[index], &request, QRINSTALL_TIMEOUT) < 0) {
+            return R_FBI_ERRNO;
+        }
+
+        if(httpclient_read_head(&request, QRINSTALL_TIMEOUT) < 0) {
+            res = R_FBI_ERRNO;
+        } else if(request.status != 200) {
+            res = R_FBI_HTTP_RESPONSE_CODE;
+        } else {
+            *size = request.contentLength;
+        }
+
+        httpclient_finish(&request, QRINSTALL_TIMEOUT);
+        return res;
+    }
+
+    httpcContext context;
+    if(R_SUCCEEDED(res = httpcOpenContext(&context, HTTPC_METHOD_HEAD, qrInstallData->urls[index], 1))) {
+        httpcSetSSLOpt(&context, SSLCOPT_DisableVerify);
+
+        u32 responseCode = 0;
+        if(R_SUCCEEDED(res = httpcBeginRequest(&context)) && R_SUCCEEDED(res = httpcGetResponseStatusCode(&context, &responseCode, 0))) {
+            if(responseCode == 200) {
+                char contentLength[32] = {'\0'};
+                if(R_SUCCEEDED(res = httpcGetResponseHeader(&context, "Content-Length", contentLength, sizeof(contentLength)))) {
+                    *size = strtoull(contentLength, NULL, 10);
+                }
+            } else {
+                res = R_FBI_HTTP_RESPONSE_CODE;
+            }
+        }
+
+        httpcCloseContext(&context);
+    }
 
-    *size = downloadSize;
     return res;
 }
 
+static Result qrinstall_get_src_size(void* data, u32 handle, u64* size) {
+    *size = ((qr_source*) handle)->size;
+    return 0;
+}
+
 static Result qrinstall_read_src(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size) {
-    Result res = httpcDownloadData((httpcContext*) handle, buffer, size, bytesRead);
-    return res != HTTPC_RESULTCODE_DOWNLOADPENDING ? res : 0;
+    qr_install_data* qrInstallData = (qr_install_data*) data;
+    qr_source* source = (qr_source*) handle;
+
+    Result res = 0;
+    u32 copied = 0;
+
+    while(copied < size && source->offset < source->size) {
+        if(source->broken && R_FAILED(res = qrinstall_resume_source(qrInstallData, source))) {
+            break;
+        }
+
+        u32 downloaded = 0;
+        if(source->native) {
+            size_t received = 0;
+            if(httpclient_read(&source->request, (u8*) buffer + copied, size - copied, QRINSTALL_TIMEOUT, &received) < 0) {
+                qrinstall_break_source(source, R_FBI_ERRNO);
+            }
+
+            downloaded = (u32) received;
+        } else {
+            Result downloadRes = httpcDownloadData(&source->context, (u8*) buffer + copied, size - copied, &downloaded);
+            if(downloadRes != HTTPC_RESULTCODE_DOWNLOADPENDING && R_FAILED(downloadRes)) {
+                qrinstall_break_source(source, downloadRes);
+            }
+        }
+
+        copied += downloaded;
+        source->offset += downloaded;
+
+        if(!source->broken && downloaded == 0) {
+            break;
+        }
+    }
+
+    *bytesRead = copied;
+    return res;
 }
 
 static Result qrinstall_open_dst(void* data, u32 index, void* initialReadBlock, u32* handle) {
@@ -186,6 +544,12 @@ static bool qrinstall_error(void* data, u32 index, Result res) {
             } else {
                 error_display(&dismissed, NULL, NULL, "Failed to install from QR code.\n%.48s\nHTTP server returned response code %d", url, qrInstallData->responseCode);
             }
+        } else if(res == R_FBI_ERRNO) {
+            if(strlen(url) > 48) {
+                error_display_errno(&dismissed, NULL, NULL, errno, "Failed to install from QR code.\n%.45s...", url);
+            } else {
+                error_display_errno(&dismissed, NULL, NULL, errno, "Failed to install from QR code.\n%.48s", url);
+            }
         } else {
             if(strlen(url) > 48) {
                 error_display_res(&dismissed, NULL, NULL, res, "Failed to install from QR code.\n%.45s...", url);
@@ -206,6 +570,9 @@ static void qrinstall_install_update(ui_view* view, void* data, float* progress,
     qr_install_data* qrInstallData = (qr_install_data*) data;
 
     if(qrInstallData->installInfo.finished) {
+        qrinstall_release_next(qrInstallData);
+        httpclient_pool_close(&qrInstallData->pool);
+
         ui_pop();
         info_destroy(view);
 
@@ -220,8 +587,7 @@ static void qrinstall_install_update(ui_view* view, void* data, float* progress,
         svcSignalEvent(qrInstallData->installCancelEvent);
     }
 
-    *progress = qrInstallData->installInfo.currTotal != 0 ? (float) ((double) qrInstallData->installInfo.currProcessed / (double) qrInstallData->installInfo.currTotal) : 0;
-    snprintf(text, PROGRESS_TEXT_MAX, "%lu / %lu\n%.2f MB / %.2f MB", qrInstallData->installInfo.processed, qrInstallData->installInfo.total, qrInstallData->installInfo.currProcessed / 1024.0 / 1024.0, qrInstallData->installInfo.currTotal / 1024.0 / 1024.0);
+    info_get_data_op_progress(&qrInstallData->installInfo, progress, text);
 }
 
 static void qrinstall_confirm_onresponse(ui_view* view, void* data, bool response) {
@@ -262,6 +628,9 @@ static void qrinstall_free_data(qr_install_data* data) {
         data->tex = 0;
     }
 
+    qrinstall_release_next(data);
+    httpclient_pool_close(&data->pool);
+
     free(data);
 }
 
@@ -389,10 +758,18 @@ void qrinstall_open() {
     data->currTitleId = 0;
     data->ticket = false;
 
+    httpclient_pool_init(&data->pool);
+    data->next = NULL;
+
     data->installInfo.data = data;
 
+    data->installInfo.name = "QR install";
+
     data->installInfo.op = DATAOP_COPY;
 
+    // Leave room for the camera and QR decoding buffers, which a tuned chunk size would eat into.
+    data->installInfo.bufferCount = 2;
+
     data->installInfo.copyEmpty = false;
 
     data->installInfo.total = 0;
@@ -402,6 +779,7 @@ void qrinstall_open() {
 
     data->installInfo.openSrc = qrinstall_open_src;
     data->installInfo.closeSrc = qrinstall_close_src;
+    data->installInfo.prescanSrcSize = qrinstall_prescan_src_size;
     data->installInfo.getSrcSize = qrinstall_get_src_size;
     data->installInfo.readSrc = qrinstall_read_src;
 
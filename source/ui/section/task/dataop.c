@@ -1,5 +1,8 @@
 #include <malloc.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include <3ds.h>
 
@@ -7,26 +10,796 @@
 #include "../../error.h"
 #include "task.h"
 
+#define DATAOP_BUFFER_COUNT 4
+#define DATAOP_BUFFERS_MAX 8
+
+#define DATAOP_CHUNK_SIZE_DEFAULT (1024 * 256)
+#define DATAOP_CHUNK_SIZE_MIN (1024 * 64)
+#define DATAOP_CHUNK_SIZE_MAX (1024 * 1024)
+
+// Auto-tuned operations allocate every buffer at the largest size they may grow to,
+// which is kept within this budget across the whole pool.
+#define DATAOP_TUNE_POOL_BUDGET (1024 * 1024 * 2)
+
+#define DATAOP_TUNE_WINDOW 4
+
+// Each copy worker runs a reader thread next to it, so copies use fewer workers to keep
+// the thread count on the system core the same as a delete pool's.
+#define DATAOP_COPY_WORKERS_MAX (DATAOP_WORKERS_MAX / 2)
+
+#define DATAOP_RATE_INTERVAL (SYSCLOCK_ARM11 / 2)
+
+#define DATAOP_LOG_PATH "sdmc:/fbi/dataop.log"
+#define DATAOP_LOG_OLD_PATH "sdmc:/fbi/dataop.log.old"
+
+// Once the log grows past this, it replaces the previous one and a new log is started.
+#define DATAOP_LOG_MAX (1024 * 64)
+
+typedef struct {
+    void* buffers[DATAOP_BUFFERS_MAX];
+    u32 count;
+    u32 bufferSize;
+
+    void* free[DATAOP_BUFFERS_MAX];
+    u32 freeCount;
+
+    Handle semaphore;
+    Handle mutex;
+} data_op_buffer_pool;
+
+typedef struct {
+    bool enabled;
+    bool settled;
+
+    volatile u32 size;
+    s32 direction;
+    u32 reversals;
+
+    u32 bestSize;
+    u64 bestRate;
+
+    u64 lastTick;
+    u32 samples;
+    u64 sampleBytes;
+    u64 sampleTicks;
+} data_op_tuner;
+
 typedef struct {
     data_op_info* info;
 
+    data_op_buffer_pool pool;
+    data_op_tuner tuner;
+
+    u32 workerCount;
+    u32 nextIndex;
+    bool* isDirectory;
+
+    Handle progressMutex;
+    u64 rateTick;
+    u64 rateBytes;
+
+    u64 startTick;
+
+    Handle errorMutex;
+    u32 failed;
+    volatile bool stop;
+
     Handle cancelEvent;
 } data_op_data;
 
-static bool task_data_op_copy(data_op_data* data, u32 index) {
-    data->info->currProcessed = 0;
-    data->info->currTotal = 0;
+typedef struct {
+    data_op_data* data;
+    u32 id;
+
+    bool directories;
+} data_op_worker;
+
+typedef struct {
+    void* buffer;
+    u32 size;
+    u32 srcSize;
+} data_op_chunk;
+
+typedef struct {
+    data_op_data* data;
+    data_op_progress* progress;
+    u32 index;
+    u32 srcHandle;
+
+    // Filled chunks are passed from the reader to the writer in ring order,
+    // through the transform stage when the operation has one.
+    data_op_chunk chunks[DATAOP_BUFFERS_MAX];
+    Handle fullSemaphore;
+    Handle transformSemaphore;
+    Handle abortEvent;
+
+    volatile u32 produced;
+    volatile u32 transformed;
+    volatile u32 consumed;
+    volatile bool readDone;
+    volatile bool transformDone;
+    Result readRes;
+    Result transformRes;
+
+    // The transform stage swaps this buffer with each chunk it rewrites.
+    void* scratch;
+
+    u64 dstOffset;
+} data_op_pipeline;
+
+static bool task_data_op_is_cancelled(data_op_data* data) {
+    return task_is_quit_all() || svcWaitSynchronization(data->cancelEvent, 0) == 0;
+}
+
+static void task_data_op_stats_add(u32* chunks, u64* totalTicks, u64* minTicks, u64* maxTicks, u64 ticks) {
+    if(*chunks == 0 || ticks < *minTicks) {
+        *minTicks = ticks;
+    }
+
+    if(ticks > *maxTicks) {
+        *maxTicks = ticks;
+    }
+
+    *totalTicks += ticks;
+    (*chunks)++;
+}
+
+static void task_data_op_stats_merge(data_op_stats* dst, data_op_stats* src) {
+    if(src->readChunks > 0) {
+        if(dst->readChunks == 0 || src->readMinTicks < dst->readMinTicks) {
+            dst->readMinTicks = src->readMinTicks;
+        }
+
+        if(src->readMaxTicks > dst->readMaxTicks) {
+            dst->readMaxTicks = src->readMaxTicks;
+        }
+    }
+
+    if(src->writeChunks > 0) {
+        if(dst->writeChunks == 0 || src->writeMinTicks < dst->writeMinTicks) {
+            dst->writeMinTicks = src->writeMinTicks;
+        }
+
+        if(src->writeMaxTicks > dst->writeMaxTicks) {
+            dst->writeMaxTicks = src->writeMaxTicks;
+        }
+    }
+
+    dst->bytes += src->bytes;
+
+    dst->readChunks += src->readChunks;
+    dst->readTicks += src->readTicks;
+
+    dst->writeChunks += src->writeChunks;
+    dst->writeTicks += src->writeTicks;
+}
+
+static double task_data_op_ticks_to_ms(u64 ticks) {
+    return ticks * 1000.0 / SYSCLOCK_ARM11;
+}
+
+static void task_data_op_log(data_op_data* data) {
+    data_op_info* info = data->info;
+    data_op_stats* stats = &info->stats;
+
+    mkdir("sdmc:/fbi", 0777);
+
+    struct stat st;
+    if(stat(DATAOP_LOG_PATH, &st) == 0 && st.st_size >= DATAOP_LOG_MAX) {
+        // SD renames don't replace existing files.
+        remove(DATAOP_LOG_OLD_PATH);
+        rename(DATAOP_LOG_PATH, DATAOP_LOG_OLD_PATH);
+    }
+
+    FILE* fd = fopen(DATAOP_LOG_PATH, "a");
+    if(fd == NULL) {
+        return;
+    }
+
+    time_t t = time(NULL);
+    char timeText[32] = {'\0'};
+    strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", localtime(&t));
+
+    double elapsed = task_data_op_ticks_to_ms(svcGetSystemTick() - data->startTick) / 1000.0;
+
+    fprintf(fd, "%s %s: %s, %lu/%lu items, %lu failed, %llu bytes in %.2f s (%.2f MB/s)",
+            timeText, info->name != NULL ? info->name : "Data operation", data->stop ? "stopped" : "finished",
+            info->processed, info->total, data->failed, stats->bytes, elapsed, elapsed > 0 ? stats->bytes / elapsed / 1024.0 / 1024.0 : 0);
+
+    if(info->op == DATAOP_COPY) {
+        fprintf(fd, ", read %.2f s over %lu chunks (min/avg/max %.2f/%.2f/%.2f ms), write %.2f s over %lu chunks (min/avg/max %.2f/%.2f/%.2f ms), chunk size %lu, %lu worker(s)",
+                task_data_op_ticks_to_ms(stats->readTicks) / 1000.0, stats->readChunks, task_data_op_ticks_to_ms(stats->readMinTicks),
+                stats->readChunks > 0 ? task_data_op_ticks_to_ms(stats->readTicks / stats->readChunks) : 0, task_data_op_ticks_to_ms(stats->readMaxTicks),
+                task_data_op_ticks_to_ms(stats->writeTicks) / 1000.0, stats->writeChunks, task_data_op_ticks_to_ms(stats->writeMinTicks),
+                stats->writeChunks > 0 ? task_data_op_ticks_to_ms(stats->writeTicks / stats->writeChunks) : 0, task_data_op_ticks_to_ms(stats->writeMaxTicks),
+                info->currChunkSize, data->workerCount);
+    }
+
+    fprintf(fd, "\n");
+    fclose(fd);
+}
+
+static void task_data_op_update_rate(data_op_data* data, u64 doneBytes) {
+    data_op_info* info = data->info;
+
+    u64 now = svcGetSystemTick();
+    if(now - data->rateTick < DATAOP_RATE_INTERVAL) {
+        return;
+    }
+
+    svcWaitSynchronization(data->progressMutex, U64_MAX);
+
+    u64 elapsed = now - data->rateTick;
+    if(elapsed >= DATAOP_RATE_INTERVAL && doneBytes >= data->rateBytes) {
+        u64 rate = (doneBytes - data->rateBytes) * SYSCLOCK_ARM11 / elapsed;
+
+        // Exponential moving average, weighting the newest sample by a quarter.
+        info->bytesPerSecond = info->bytesPerSecond != 0 ? (info->bytesPerSecond * 3 + rate) / 4 : rate;
+
+        if(info->bytesPerSecond != 0 && info->totalBytes > doneBytes) {
+            info->estimatedRemaining = (info->totalBytes - doneBytes) / info->bytesPerSecond;
+        } else {
+            info->estimatedRemaining = 0;
+        }
+
+        data->rateTick = now;
+        data->rateBytes = doneBytes;
+    }
+
+    svcReleaseMutex(data->progressMutex);
+}
+
+static void task_data_op_update_progress(data_op_data* data) {
+    u64 currProcessed = 0;
+    u64 currTotal = 0;
+    u64 doneBytes = 0;
+
+    for(u32 i = 0; i < data->workerCount; i++) {
+        currProcessed += data->info->workerProgress[i].currProcessed;
+        currTotal += data->info->workerProgress[i].currTotal;
+        doneBytes += data->info->workerProgress[i].doneBytes;
+    }
+
+    data->info->currProcessed = currProcessed;
+    data->info->currTotal = currTotal;
+    data->info->doneBytes = doneBytes;
+
+    task_data_op_update_rate(data, doneBytes);
+}
+
+static Result task_data_op_pool_create(data_op_data* data) {
+    data_op_buffer_pool* pool = &data->pool;
+
+    u32 count = data->info->bufferCount;
+    if(count == 0) {
+        count = data->workerCount > 1 ? data->workerCount * 2 : DATAOP_BUFFER_COUNT;
+
+        // The transform stage holds a scratch buffer of its own.
+        if(data->info->transformSrc != NULL) {
+            count++;
+        }
+    }
+
+    if(count > DATAOP_BUFFERS_MAX) {
+        count = DATAOP_BUFFERS_MAX;
+    }
+
+    pool->bufferSize = data->tuner.size;
+    if(data->tuner.enabled) {
+        u32 max = (DATAOP_TUNE_POOL_BUDGET / count) & ~0xFFF;
+        if(max > DATAOP_CHUNK_SIZE_MAX) {
+            max = DATAOP_CHUNK_SIZE_MAX;
+        }
+
+        // A starting size above the budget is kept, but not grown any further.
+        if(max > pool->bufferSize) {
+            pool->bufferSize = max;
+        }
+    }
+
+    // Buffers are page aligned for FS/AM IPC mapping and are not zeroed, as
+    // every byte handed to writeDst has been filled by readSrc first.
+    for(pool->count = 0; pool->count < count; pool->count++) {
+        if((pool->buffers[pool->count] = memalign(0x1000, pool->bufferSize)) == NULL) {
+            break;
+        }
+
+        pool->free[pool->count] = pool->buffers[pool->count];
+    }
+
+    pool->freeCount = pool->count;
+
+    data->info->buffersTotal = pool->count;
+    data->info->buffersInUse = 0;
+
+    if(pool->count == 0) {
+        return R_FBI_OUT_OF_MEMORY;
+    }
+
+    Result res = 0;
+    if(R_SUCCEEDED(res = svcCreateSemaphore(&pool->semaphore, (s32) pool->count, (s32) pool->count))) {
+        if(R_FAILED(res = svcCreateMutex(&pool->mutex, false))) {
+            svcCloseHandle(pool->semaphore);
+            pool->semaphore = 0;
+        }
+    }
+
+    return res;
+}
+
+static void task_data_op_pool_destroy(data_op_data* data) {
+    data_op_buffer_pool* pool = &data->pool;
+
+    if(pool->mutex != 0) {
+        svcCloseHandle(pool->mutex);
+        pool->mutex = 0;
+    }
+
+    if(pool->semaphore != 0) {
+        svcCloseHandle(pool->semaphore);
+        pool->semaphore = 0;
+    }
+
+    for(u32 i = 0; i < pool->count; i++) {
+        free(pool->buffers[i]);
+        pool->buffers[i] = NULL;
+    }
+
+    pool->count = 0;
+    pool->freeCount = 0;
+}
+
+static void* task_data_op_pool_acquire(data_op_data* data, Handle abortEvent) {
+    data_op_buffer_pool* pool = &data->pool;
+
+    Handle handles[2] = {pool->semaphore, abortEvent};
+
+    s32 index = 0;
+    if(R_FAILED(svcWaitSynchronizationN(&index, handles, 2, false, U64_MAX)) || index != 0) {
+        return NULL;
+    }
+
+    svcWaitSynchronization(pool->mutex, U64_MAX);
+
+    void* buffer = pool->free[--pool->freeCount];
+    data->info->buffersInUse = pool->count - pool->freeCount;
+
+    svcReleaseMutex(pool->mutex);
+
+    return buffer;
+}
+
+static void task_data_op_pool_release(data_op_data* data, void* buffer) {
+    data_op_buffer_pool* pool = &data->pool;
+
+    svcWaitSynchronization(pool->mutex, U64_MAX);
+
+    pool->free[pool->freeCount++] = buffer;
+    data->info->buffersInUse = pool->count - pool->freeCount;
+
+    svcReleaseMutex(pool->mutex);
+
+    s32 prevCount = 0;
+    svcReleaseSemaphore(&prevCount, pool->semaphore, 1);
+}
+
+static void task_data_op_tuner_init(data_op_data* data) {
+    data_op_tuner* tuner = &data->tuner;
+
+    u32 size = data->info->chunkSize != 0 ? data->info->chunkSize : DATAOP_CHUNK_SIZE_DEFAULT;
+    if(size < DATAOP_CHUNK_SIZE_MIN) {
+        size = DATAOP_CHUNK_SIZE_MIN;
+    } else if(size > DATAOP_CHUNK_SIZE_MAX) {
+        size = DATAOP_CHUNK_SIZE_MAX;
+    }
+
+    // Concurrent workers would skew each other's measurements, and transformed
+    // chunks are framed at a fixed size.
+    tuner->enabled = data->info->autoChunkSize && data->workerCount == 1 && data->info->transformSrc == NULL;
+    tuner->settled = !tuner->enabled;
+
+    tuner->size = size;
+    tuner->direction = 1;
+    tuner->reversals = 0;
+
+    tuner->bestSize = size;
+    tuner->bestRate = 0;
+
+    data->info->currChunkSize = size;
+}
+
+static void task_data_op_tuner_update(data_op_data* data, u32 chunkSize) {
+    data_op_tuner* tuner = &data->tuner;
+
+    u64 now = svcGetSystemTick();
+    u64 lastTick = tuner->lastTick;
+    tuner->lastTick = now;
+
+    // Chunks read before the last size change, file tails and the first
+    // chunk of each file (which includes open latency) are not measured.
+    if(tuner->settled || lastTick == 0 || chunkSize != tuner->size) {
+        return;
+    }
+
+    tuner->sampleTicks += now - lastTick;
+    tuner->sampleBytes += chunkSize;
+    if(++tuner->samples < DATAOP_TUNE_WINDOW) {
+        return;
+    }
+
+    u64 rate = tuner->sampleTicks != 0 ? tuner->sampleBytes * SYSCLOCK_ARM11 / tuner->sampleTicks : 0;
+
+    tuner->samples = 0;
+    tuner->sampleBytes = 0;
+    tuner->sampleTicks = 0;
+
+    if(rate > tuner->bestRate) {
+        tuner->bestRate = rate;
+        tuner->bestSize = tuner->size;
+    } else {
+        tuner->direction = -tuner->direction;
+        tuner->reversals++;
+    }
+
+    u32 next = tuner->direction > 0 ? tuner->bestSize * 2 : tuner->bestSize / 2;
+    if(tuner->reversals == 0 && (next < DATAOP_CHUNK_SIZE_MIN || next > data->pool.bufferSize)) {
+        tuner->direction = -tuner->direction;
+        tuner->reversals++;
+
+        next = tuner->direction > 0 ? tuner->bestSize * 2 : tuner->bestSize / 2;
+    }
+
+    if(tuner->reversals >= 2 || next < DATAOP_CHUNK_SIZE_MIN || next > data->pool.bufferSize) {
+        tuner->settled = true;
+        next = tuner->bestSize;
+    }
+
+    tuner->size = next;
+    data->info->currChunkSize = next;
+}
+
+static void task_data_op_copy_read(data_op_pipeline* pipeline) {
+    data_op_info* info = pipeline->data->info;
+
+    Result res = 0;
+
+    u64 offset = pipeline->progress->currProcessed;
+    u32 slot = 0;
+    while(offset < pipeline->progress->currTotal) {
+        void* buffer = task_data_op_pool_acquire(pipeline->data, pipeline->abortEvent);
+        if(buffer == NULL) {
+            break;
+        }
+
+        if(task_data_op_is_cancelled(pipeline->data)) {
+            task_data_op_pool_release(pipeline->data, buffer);
+
+            res = R_FBI_CANCELLED;
+            break;
+        }
+
+        u32 currSize = pipeline->data->tuner.size;
+        if((u64) currSize > pipeline->progress->currTotal - offset) {
+            currSize = (u32) (pipeline->progress->currTotal - offset);
+        }
+
+        data_op_stats* stats = &pipeline->progress->stats;
+
+        u64 readStart = svcGetSystemTick();
+
+        u32 bytesRead = 0;
+        if(R_FAILED(res = info->readSrc(info->data, pipeline->srcHandle, &bytesRead, buffer, offset, currSize))) {
+            task_data_op_pool_release(pipeline->data, buffer);
+            break;
+        }
+
+        task_data_op_stats_add(&stats->readChunks, &stats->readTicks, &stats->readMinTicks, &stats->readMaxTicks, svcGetSystemTick() - readStart);
+
+        data_op_chunk* chunk = &pipeline->chunks[slot];
+        chunk->buffer = buffer;
+        chunk->size = currSize;
+        chunk->srcSize = currSize;
+
+        offset += currSize;
+        slot = (slot + 1) % DATAOP_BUFFERS_MAX;
+
+        pipeline->produced++;
+
+        s32 prevCount = 0;
+        svcReleaseSemaphore(&prevCount, pipeline->fullSemaphore, 1);
+    }
+
+    pipeline->readRes = res;
+    pipeline->readDone = true;
+
+    s32 prevCount = 0;
+    svcReleaseSemaphore(&prevCount, pipeline->fullSemaphore, 1);
+}
+
+static void task_data_op_copy_read_thread(void* arg) {
+    task_data_op_copy_read((data_op_pipeline*) arg);
+}
+
+static void task_data_op_copy_transform(data_op_pipeline* pipeline) {
+    data_op_info* info = pipeline->data->info;
+
+    Result res = 0;
+
+    while(true) {
+        svcWaitSynchronization(pipeline->fullSemaphore, U64_MAX);
+
+        if(pipeline->transformed == pipeline->produced) {
+            res = pipeline->readRes;
+            break;
+        }
+
+        if(pipeline->readDone && R_FAILED(pipeline->readRes)) {
+            res = pipeline->readRes;
+            break;
+        }
+
+        if(svcWaitSynchronization(pipeline->abortEvent, 0) == 0) {
+            break;
+        }
+
+        if(task_data_op_is_cancelled(pipeline->data)) {
+            res = R_FBI_CANCELLED;
+            break;
+        }
+
+        data_op_chunk* chunk = &pipeline->chunks[pipeline->transformed % DATAOP_BUFFERS_MAX];
+
+        u32 dstSize = 0;
+        if(R_FAILED(res = info->transformSrc(info->data, pipeline->index, chunk->buffer, chunk->size, pipeline->scratch, &dstSize))) {
+            break;
+        }
+
+        void* buffer = chunk->buffer;
+        chunk->buffer = pipeline->scratch;
+        chunk->size = dstSize;
+        pipeline->scratch = buffer;
+
+        pipeline->transformed++;
+
+        s32 prevCount = 0;
+        svcReleaseSemaphore(&prevCount, pipeline->transformSemaphore, 1);
+    }
+
+    if(R_FAILED(res)) {
+        svcSignalEvent(pipeline->abortEvent);
+    }
+
+    pipeline->transformRes = res;
+    pipeline->transformDone = true;
+
+    s32 prevCount = 0;
+    svcReleaseSemaphore(&prevCount, pipeline->transformSemaphore, 1);
+}
+
+static void task_data_op_copy_transform_thread(void* arg) {
+    task_data_op_copy_transform((data_op_pipeline*) arg);
+}
+
+static Result task_data_op_copy_write(data_op_pipeline* pipeline, u32* dstHandle) {
+    data_op_info* info = pipeline->data->info;
+
+    bool transform = info->transformSrc != NULL;
+
+    Result res = 0;
+
+    while(true) {
+        svcWaitSynchronization(transform ? pipeline->transformSemaphore : pipeline->fullSemaphore, U64_MAX);
+
+        u32 available = transform ? pipeline->transformed : pipeline->produced;
+        bool upstreamDone = transform ? pipeline->transformDone : pipeline->readDone;
+        Result upstreamRes = transform ? pipeline->transformRes : pipeline->readRes;
+
+        if(pipeline->consumed == available) {
+            res = upstreamRes;
+            break;
+        }
+
+        if(upstreamDone && R_FAILED(upstreamRes)) {
+            res = upstreamRes;
+            break;
+        }
+
+        if(task_data_op_is_cancelled(pipeline->data)) {
+            res = R_FBI_CANCELLED;
+            break;
+        }
+
+        data_op_chunk* chunk = &pipeline->chunks[pipeline->consumed % DATAOP_BUFFERS_MAX];
+
+        if(*dstHandle == 0 && R_FAILED(res = info->openDst(info->data, pipeline->index, chunk->buffer, dstHandle))) {
+            break;
+        }
+
+        data_op_stats* stats = &pipeline->progress->stats;
+
+        u64 writeStart = svcGetSystemTick();
+
+        u32 bytesWritten = 0;
+        if(R_FAILED(res = info->writeDst(info->data, *dstHandle, &bytesWritten, chunk->buffer, pipeline->dstOffset, chunk->size))) {
+            break;
+        }
+
+        task_data_op_stats_add(&stats->writeChunks, &stats->writeTicks, &stats->writeMinTicks, &stats->writeMaxTicks, svcGetSystemTick() - writeStart);
+        stats->bytes += bytesWritten;
+
+        pipeline->dstOffset += bytesWritten;
+
+        pipeline->progress->currProcessed += chunk->srcSize;
+        pipeline->progress->doneBytes += chunk->srcSize;
+        task_data_op_update_progress(pipeline->data);
+
+        if(pipeline->data->tuner.enabled) {
+            task_data_op_tuner_update(pipeline->data, chunk->size);
+        }
+
+        pipeline->consumed++;
+        task_data_op_pool_release(pipeline->data, chunk->buffer);
+    }
+
+    if(R_FAILED(res)) {
+        svcSignalEvent(pipeline->abortEvent);
+    }
+
+    return res;
+}
+
+static Result task_data_op_copy_pipeline(data_op_data* data, data_op_progress* progress, u32 index, u32 srcHandle, u32* dstHandle) {
+    Result res = 0;
+
+    data_op_pipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+
+    pipeline.data = data;
+    pipeline.progress = progress;
+    pipeline.index = index;
+    pipeline.srcHandle = srcHandle;
+    pipeline.dstOffset = progress->currProcessed;
+
+    data->tuner.lastTick = 0;
+
+    bool transform = data->info->transformSrc != NULL;
+
+    if(R_SUCCEEDED(res = svcCreateSemaphore(&pipeline.fullSemaphore, 0, DATAOP_BUFFERS_MAX + 1))) {
+        if(R_SUCCEEDED(res = svcCreateSemaphore(&pipeline.transformSemaphore, 0, DATAOP_BUFFERS_MAX + 1))) {
+            if(R_SUCCEEDED(res = svcCreateEvent(&pipeline.abortEvent, 1))) {
+                // Claim the scratch buffer before the reader can take the whole pool.
+                if(transform && (pipeline.scratch = task_data_op_pool_acquire(data, pipeline.abortEvent)) == NULL) {
+                    res = R_FBI_OUT_OF_MEMORY;
+                } else if(progress->currTotal - progress->currProcessed > data->tuner.size) {
+                    // Files that fit in a single chunk gain nothing from extra threads.
+                    Thread readThread = threadCreate(task_data_op_copy_read_thread, &pipeline, 0x4000, 0x18, 1, false);
+                    if(readThread != NULL) {
+                        Thread transformThread = NULL;
+                        if(!transform || (transformThread = threadCreate(task_data_op_copy_transform_thread, &pipeline, 0x4000, 0x18, 1, false)) != NULL) {
+                            res = task_data_op_copy_write(&pipeline, dstHandle);
+                        } else {
+                            svcSignalEvent(pipeline.abortEvent);
+                            res = R_FBI_THREAD_CREATE_FAILED;
+                        }
+
+                        threadJoin(readThread, U64_MAX);
+                        threadFree(readThread);
+
+                        if(transformThread != NULL) {
+                            threadJoin(transformThread, U64_MAX);
+                            threadFree(transformThread);
+                        }
+                    } else {
+                        res = R_FBI_THREAD_CREATE_FAILED;
+                    }
+                } else {
+                    task_data_op_copy_read(&pipeline);
+
+                    if(transform) {
+                        task_data_op_copy_transform(&pipeline);
+                    }
+
+                    res = task_data_op_copy_write(&pipeline, dstHandle);
+                }
+
+                // Hand back chunks that were read but never written.
+                while(pipeline.consumed < pipeline.produced) {
+                    task_data_op_pool_release(data, pipeline.chunks[pipeline.consumed++ % DATAOP_BUFFERS_MAX].buffer);
+                }
+
+                if(pipeline.scratch != NULL) {
+                    task_data_op_pool_release(data, pipeline.scratch);
+                }
+
+                svcCloseHandle(pipeline.abortEvent);
+            }
+
+            svcCloseHandle(pipeline.transformSemaphore);
+        }
+
+        svcCloseHandle(pipeline.fullSemaphore);
+    }
+
+    return res;
+}
+
+static bool task_data_op_error(data_op_data* data, u32 index, Result res) {
+    bool cont = false;
+
+    svcWaitSynchronization(data->errorMutex, U64_MAX);
+
+    data->failed++;
+
+    // Only the first failure of a stopped operation is reported.
+    if(!data->stop) {
+        cont = data->info->error(data->info->data, index, res);
+        if(!cont) {
+            data->stop = true;
+        }
+    }
+
+    svcReleaseMutex(data->errorMutex);
+
+    return cont;
+}
+
+static bool task_data_op_is_src_directory(data_op_data* data, u32 index, bool* isDirectory, Result* res) {
+    if(data->isDirectory != NULL) {
+        *isDirectory = data->isDirectory[index];
+        return true;
+    }
+
+    *isDirectory = false;
+    return data->info->isSrcDirectory == NULL || R_SUCCEEDED(*res = data->info->isSrcDirectory(data->info->data, index, isDirectory));
+}
+
+static Result task_data_op_resume(data_op_data* data, data_op_progress* progress, u32 index) {
+    Result res = 0;
+
+    u64 offset = 0;
+    if(R_SUCCEEDED(res = data->info->getResumeOffset(data->info->data, index, progress->currTotal, &offset)) && offset > 0) {
+        if(offset > progress->currTotal) {
+            offset = progress->currTotal;
+        }
+
+        // Count skipped bytes as done without letting them inflate the measured rate.
+        svcWaitSynchronization(data->progressMutex, U64_MAX);
+
+        progress->currProcessed = offset;
+        progress->doneBytes += offset;
+        data->rateBytes += offset;
+
+        svcReleaseMutex(data->progressMutex);
+    }
+
+    return res;
+}
+
+static bool task_data_op_copy(data_op_worker* worker, u32 index) {
+    data_op_data* data = worker->data;
+    data_op_progress* progress = &data->info->workerProgress[worker->id];
+
+    progress->index = index;
+    progress->currProcessed = 0;
+    progress->currTotal = 0;
+
+    memset(&progress->stats, 0, sizeof(progress->stats));
+
+    task_data_op_update_progress(data);
 
     Result res = 0;
 
     bool isDir = false;
-    if(R_SUCCEEDED(res = data->info->isSrcDirectory(data->info->data, index, &isDir)) && isDir) {
+    if(task_data_op_is_src_directory(data, index, &isDir, &res) && isDir) {
         res = data->info->makeDstDirectory(data->info->data, index);
-    } else {
+    } else if(R_SUCCEEDED(res)) {
         u32 srcHandle = 0;
         if(R_SUCCEEDED(res = data->info->openSrc(data->info->data, index, &srcHandle))) {
-            if(R_SUCCEEDED(res = data->info->getSrcSize(data->info->data, srcHandle, &data->info->currTotal))) {
-                if(data->info->currTotal == 0) {
+            if(R_SUCCEEDED(res = data->info->getSrcSize(data->info->data, srcHandle, &progress->currTotal))
+               && (data->info->getResumeOffset == NULL || R_SUCCEEDED(res = task_data_op_resume(data, progress, index)))) {
+                task_data_op_update_progress(data);
+
+                if(progress->currTotal == progress->currProcessed) {
                     if(data->info->copyEmpty) {
                         u32 dstHandle = 0;
                         if(R_SUCCEEDED(res = data->info->openDst(data->info->data, index, NULL, &dstHandle))) {
@@ -34,54 +807,15 @@ static bool task_data_op_copy(data_op_data* data, u32 index) {
                         }
                     }
                 } else {
-                    u32 bufferSize = 1024 * 256;
-                    u8* buffer = (u8*) calloc(1, bufferSize);
-                    if(buffer != NULL) {
-                        u32 dstHandle = 0;
+                    u32 dstHandle = 0;
 
-                        bool firstRun = true;
-                        while(data->info->currProcessed < data->info->currTotal) {
-                            if(task_is_quit_all() || svcWaitSynchronization(data->cancelEvent, 0) == 0) {
-                                res = R_FBI_CANCELLED;
-                                break;
-                            }
-
-                            u32 currSize = bufferSize;
-                            if((u64) currSize > data->info->currTotal - data->info->currProcessed) {
-                                currSize = (u32) (data->info->currTotal - data->info->currProcessed);
-                            }
-
-                            u32 bytesRead = 0;
-                            u32 bytesWritten = 0;
-                            if(R_FAILED(res = data->info->readSrc(data->info->data, srcHandle, &bytesRead, buffer, data->info->currProcessed, currSize))) {
-                                break;
-                            }
-
-                            if(firstRun) {
-                                firstRun = false;
-
-                                if(R_FAILED(res = data->info->openDst(data->info->data, index, buffer, &dstHandle))) {
-                                    break;
-                                }
-                            }
-
-                            if(R_FAILED(res = data->info->writeDst(data->info->data, dstHandle, &bytesWritten, buffer, data->info->currProcessed, currSize))) {
-                                break;
-                            }
-
-                            data->info->currProcessed += bytesWritten;
-                        }
+                    res = task_data_op_copy_pipeline(data, progress, index, srcHandle, &dstHandle);
 
-                        if(dstHandle != 0) {
-                            Result closeDstRes = data->info->closeDst(data->info->data, index, res == 0, dstHandle);
-                            if(R_SUCCEEDED(res)) {
-                                res = closeDstRes;
-                            }
+                    if(dstHandle != 0) {
+                        Result closeDstRes = data->info->closeDst(data->info->data, index, res == 0, dstHandle);
+                        if(R_SUCCEEDED(res)) {
+                            res = closeDstRes;
                         }
-
-                        free(buffer);
-                    } else {
-                        res = R_FBI_OUT_OF_MEMORY;
                     }
                 }
             }
@@ -93,22 +827,161 @@ static bool task_data_op_copy(data_op_data* data, u32 index) {
         }
     }
 
+    svcWaitSynchronization(data->progressMutex, U64_MAX);
+    task_data_op_stats_merge(&data->info->stats, &progress->stats);
+    svcReleaseMutex(data->progressMutex);
+
     if(R_FAILED(res)) {
-        return data->info->error(data->info->data, index, res);
+        return task_data_op_error(data, index, res);
     }
 
     return true;
 }
 
-static bool task_data_op_delete(data_op_data* data, u32 index) {
+static bool task_data_op_delete(data_op_worker* worker, u32 index) {
+    data_op_data* data = worker->data;
+
     Result res = 0;
     if(R_FAILED(res = data->info->delete(data->info->data, index))) {
-        return data->info->error(data->info->data, index, res);
+        return task_data_op_error(data, index, res);
     }
 
     return true;
 }
 
+static bool task_data_op_process(data_op_worker* worker, u32 index) {
+    switch(worker->data->info->op) {
+        case DATAOP_COPY:
+            return task_data_op_copy(worker, index);
+        case DATAOP_DELETE:
+            return task_data_op_delete(worker, index);
+        default:
+            return false;
+    }
+}
+
+static void task_data_op_worker_thread(void* arg) {
+    data_op_worker* worker = (data_op_worker*) arg;
+    data_op_data* data = worker->data;
+
+    while(!data->stop) {
+        if(task_data_op_is_cancelled(data)) {
+            task_data_op_error(data, data->info->processed, R_FBI_CANCELLED);
+            break;
+        }
+
+        u32 index = AtomicPostIncrement(&data->nextIndex);
+        if(index >= data->info->total) {
+            break;
+        }
+
+        if(data->isDirectory != NULL && data->isDirectory[index] != worker->directories) {
+            continue;
+        }
+
+        if(!task_data_op_process(worker, index)) {
+            data->stop = true;
+            break;
+        }
+
+        AtomicIncrement(&data->info->processed);
+    }
+}
+
+static void task_data_op_run_workers(data_op_data* data, bool directories) {
+    data_op_worker workers[DATAOP_WORKERS_MAX];
+    Thread threads[DATAOP_WORKERS_MAX];
+
+    data->nextIndex = 0;
+
+    u32 threadCount = 0;
+    for(u32 i = 0; i < data->workerCount; i++) {
+        workers[i].data = data;
+        workers[i].id = i;
+        workers[i].directories = directories;
+
+        // The data operation thread acts as the first worker.
+        if(i > 0 && (threads[threadCount] = threadCreate(task_data_op_worker_thread, &workers[i], 0x4000, 0x18, 1, false)) != NULL) {
+            threadCount++;
+        }
+    }
+
+    task_data_op_worker_thread(&workers[0]);
+
+    for(u32 i = 0; i < threadCount; i++) {
+        threadJoin(threads[i], U64_MAX);
+        threadFree(threads[i]);
+    }
+}
+
+static void task_data_op_run_serial(data_op_data* data, bool directories) {
+    data_op_worker worker;
+    worker.data = data;
+    worker.id = 0;
+    worker.directories = directories;
+
+    for(u32 index = 0; index < data->info->total && !data->stop; index++) {
+        if(data->isDirectory != NULL && data->isDirectory[index] != directories) {
+            continue;
+        }
+
+        if(!task_data_op_process(&worker, index)) {
+            data->stop = true;
+            break;
+        }
+
+        data->info->processed++;
+    }
+}
+
+static void task_data_op_run_pool(data_op_data* data) {
+    // Directories are handled one at a time in list order so that parents exist
+    // before their children are copied, and are only deleted once emptied.
+    data->isDirectory = (bool*) calloc(data->info->total, sizeof(bool));
+    if(data->isDirectory == NULL) {
+        task_data_op_error(data, 0, R_FBI_OUT_OF_MEMORY);
+        return;
+    }
+
+    for(u32 i = 0; i < data->info->total && data->info->isSrcDirectory != NULL; i++) {
+        Result res = 0;
+        if(R_FAILED(res = data->info->isSrcDirectory(data->info->data, i, &data->isDirectory[i]))) {
+            if(!task_data_op_error(data, i, res)) {
+                break;
+            }
+        }
+    }
+
+    if(!data->stop) {
+        if(data->info->op == DATAOP_DELETE) {
+            task_data_op_run_workers(data, false);
+            task_data_op_run_serial(data, true);
+        } else {
+            task_data_op_run_serial(data, true);
+            task_data_op_run_workers(data, false);
+        }
+    }
+
+    free(data->isDirectory);
+    data->isDirectory = NULL;
+}
+
+static void task_data_op_prescan(data_op_data* data) {
+    data_op_info* info = data->info;
+
+    info->prescanning = true;
+
+    // Sizes are best-effort; sources that cannot be measured count as empty.
+    for(u32 i = 0; i < info->total && !task_data_op_is_cancelled(data); i++) {
+        u64 size = 0;
+        if(R_SUCCEEDED(info->prescanSrcSize(info->data, i, &size))) {
+            info->totalBytes += size;
+        }
+    }
+
+    info->prescanning = false;
+}
+
 static void task_data_op_thread(void* arg) {
     data_op_data* data = (data_op_data*) arg;
 
@@ -117,28 +990,39 @@ static void task_data_op_thread(void* arg) {
 
     data->info->processed = 0;
 
-    for(data->info->processed = 0; data->info->processed < data->info->total; data->info->processed++) {
-        bool cont = false;
+    if(data->info->prescanSrcSize != NULL) {
+        task_data_op_prescan(data);
+    }
 
-        switch(data->info->op) {
-            case DATAOP_COPY:
-                cont = task_data_op_copy(data, data->info->processed);
-                break;
-            case DATAOP_DELETE:
-                cont = task_data_op_delete(data, data->info->processed);
-                break;
-            default:
-                break;
-        }
+    data->startTick = svcGetSystemTick();
+    data->rateTick = data->startTick;
 
-        if(!cont) {
-            data->info->premature = true;
-            break;
+    if(data->workerCount > 1) {
+        task_data_op_run_pool(data);
+    } else {
+        for(data->info->processed = 0; data->info->processed < data->info->total; data->info->processed++) {
+            data_op_worker worker;
+            worker.data = data;
+            worker.id = 0;
+            worker.directories = false;
+
+            if(!task_data_op_process(&worker, data->info->processed)) {
+                data->stop = true;
+                break;
+            }
         }
     }
 
+    data->info->premature = data->stop;
+
+    task_data_op_log(data);
+
+    task_data_op_pool_destroy(data);
+
     data->info->finished = true;
 
+    svcCloseHandle(data->progressMutex);
+    svcCloseHandle(data->errorMutex);
     svcCloseHandle(data->cancelEvent);
     free(data);
 }
@@ -151,6 +1035,18 @@ static void task_data_op_reset_info(data_op_info* info) {
 
     info->currProcessed = 0;
     info->currTotal = 0;
+
+    info->buffersTotal = 0;
+    info->buffersInUse = 0;
+
+    info->prescanning = false;
+    info->totalBytes = 0;
+    info->doneBytes = 0;
+    info->bytesPerSecond = 0;
+    info->estimatedRemaining = 0;
+
+    memset(info->workerProgress, 0, sizeof(info->workerProgress));
+    memset(&info->stats, 0, sizeof(info->stats));
 }
 
 Handle task_data_op(data_op_info* info) {
@@ -169,6 +1065,12 @@ Handle task_data_op(data_op_info* info) {
 
     data->info = info;
 
+    data->workerCount = 1;
+    if(!info->ordered && info->workers > 1) {
+        u32 max = info->op == DATAOP_COPY ? DATAOP_COPY_WORKERS_MAX : DATAOP_WORKERS_MAX;
+        data->workerCount = info->workers < max ? info->workers : max;
+    }
+
     Result eventRes = svcCreateEvent(&data->cancelEvent, 1);
     if(R_FAILED(eventRes)) {
         error_display_res(NULL, NULL, NULL, eventRes, "Failed to create data operation cancel event.");
@@ -177,9 +1079,47 @@ Handle task_data_op(data_op_info* info) {
         return 0;
     }
 
+    Result mutexRes = svcCreateMutex(&data->errorMutex, false);
+    if(R_FAILED(mutexRes)) {
+        error_display_res(NULL, NULL, NULL, mutexRes, "Failed to create data operation error mutex.");
+
+        svcCloseHandle(data->cancelEvent);
+        free(data);
+        return 0;
+    }
+
+    Result progressMutexRes = svcCreateMutex(&data->progressMutex, false);
+    if(R_FAILED(progressMutexRes)) {
+        error_display_res(NULL, NULL, NULL, progressMutexRes, "Failed to create data operation progress mutex.");
+
+        svcCloseHandle(data->errorMutex);
+        svcCloseHandle(data->cancelEvent);
+        free(data);
+        return 0;
+    }
+
+    task_data_op_tuner_init(data);
+
+    if(info->op == DATAOP_COPY) {
+        Result poolRes = task_data_op_pool_create(data);
+        if(R_FAILED(poolRes)) {
+            error_display_res(NULL, NULL, NULL, poolRes, "Failed to create data operation buffer pool.");
+
+            task_data_op_pool_destroy(data);
+            svcCloseHandle(data->progressMutex);
+            svcCloseHandle(data->errorMutex);
+            svcCloseHandle(data->cancelEvent);
+            free(data);
+            return 0;
+        }
+    }
+
     if(threadCreate(task_data_op_thread, data, 0x4000, 0x18, 1, true) == NULL) {
         error_display(NULL, NULL, NULL, "Failed to create data operation thread.");
 
+        task_data_op_pool_destroy(data);
+        svcCloseHandle(data->progressMutex);
+        svcCloseHandle(data->errorMutex);
         svcCloseHandle(data->cancelEvent);
         free(data);
         return 0;
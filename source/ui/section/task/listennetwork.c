@@ -0,0 +1,352 @@
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <poll.h>
+#include <string.h>
+
+#include <3ds.h>
+
+#include "../../error.h"
+#include "../../../net/httpd.h"
+#include "../../../net/net.h"
+#include "../../../net/netconfig.h"
+#include "../../../net/netinstall.h"
+#include "task.h"
+
+// How often the listener wakes up to check for cancellation.
+#define LISTEN_POLL_INTERVAL 100
+
+#define LISTEN_HANDSHAKE_TIMEOUT 5000
+
+// Keep-alive HTTP connections left without a new request for this long are closed.
+#define LISTEN_IDLE_TIMEOUT 30000
+
+#define LISTEN_CAPABILITIES (NETINSTALL_CAP_LZ | NETINSTALL_CAP_RESUME | NETINSTALL_CAP_STREAMS)
+
+typedef struct {
+    network_session_queue* queue;
+    u16 port;
+
+    Handle cancelEvent;
+} listen_network_data;
+
+static int task_listen_network_open(listen_network_data* data) {
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if(sock < 0) {
+        error_display_errno(NULL, NULL, NULL, errno, "Failed to open server socket.");
+        return -1;
+    }
+
+    int bufSize = (int) netconfig_get()->recvBufferSize;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+
+    struct sockaddr_in server;
+    server.sin_family = AF_INET;
+    server.sin_port = htons(data->port);
+    server.sin_addr.s_addr = (in_addr_t) gethostid();
+
+    if(bind(sock, (struct sockaddr*) &server, sizeof(server)) < 0) {
+        error_display_errno(NULL, NULL, NULL, errno, "Failed to bind server socket.");
+
+        close(sock);
+        return -1;
+    }
+
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+    if(listen(sock, 5) < 0) {
+        error_display_errno(NULL, NULL, NULL, errno, "Failed to listen on server socket.");
+
+        close(sock);
+        return -1;
+    }
+
+    data->queue->address = server.sin_addr.s_addr;
+    data->queue->port = data->port;
+
+    return sock;
+}
+
+// Requests that are turned away have their body left unread, so the connection is closed after the response.
+static bool task_listen_network_read_http(int sock, const u32* first, netinstall_session* session) {
+    httpd_request* request = &session->request;
+    if(httpd_read_request(sock, (const char*) first, sizeof(*first), request, LISTEN_HANDSHAKE_TIMEOUT) < 0) {
+        if(errno == EMSGSIZE) {
+            httpd_send_json(sock, 431, "Request Header Fields Too Large", NULL, "{\"status\":\"error\",\"error\":\"request head too large\"}", false, LISTEN_HANDSHAKE_TIMEOUT);
+        } else if(errno == EBADMSG) {
+            httpd_send_json(sock, 400, "Bad Request", NULL, "{\"status\":\"error\",\"error\":\"malformed request\"}", false, LISTEN_HANDSHAKE_TIMEOUT);
+        }
+
+        return false;
+    }
+
+    if(strcmp(request->method, "PUT") != 0 && strcmp(request->method, "POST") != 0) {
+        httpd_send_json(sock, 405, "Method Not Allowed", "Allow: PUT, POST\r\n", "{\"status\":\"error\",\"error\":\"upload files with PUT or POST\"}", false, LISTEN_HANDSHAKE_TIMEOUT);
+        return false;
+    }
+
+    if(!request->chunked && !request->hasLength) {
+        httpd_send_json(sock, 411, "Length Required", NULL, "{\"status\":\"error\",\"error\":\"send Content-Length or chunked encoding\"}", false, LISTEN_HANDSHAKE_TIMEOUT);
+        return false;
+    }
+
+    if(!request->chunked && request->contentLength == 0) {
+        httpd_send_json(sock, 400, "Bad Request", NULL, "{\"status\":\"error\",\"error\":\"empty body\"}", false, LISTEN_HANDSHAKE_TIMEOUT);
+        return false;
+    }
+
+    if((session->files = (netinstall_file*) calloc(1, sizeof(netinstall_file))) == NULL) {
+        httpd_send_json(sock, 500, "Internal Server Error", NULL, "{\"status\":\"error\",\"error\":\"out of memory\"}", false, LISTEN_HANDSHAKE_TIMEOUT);
+        return false;
+    }
+
+    // The file is named after the last component of the request path.
+    char* query = strchr(request->path, '?');
+    if(query != NULL) {
+        *query = '\0';
+    }
+
+    char* name = strrchr(request->path, '/');
+    name = name != NULL ? name + 1 : request->path;
+
+    strncpy(session->files[0].name, *name != '\0' ? name : "upload", sizeof(session->files[0].name) - 1);
+
+    // Chunked uploads have their size worked out from the CIA header once the install starts.
+    session->files[0].size = request->contentLength;
+
+    session->version = 0;
+    session->fileCount = 1;
+    session->totalSize = request->contentLength;
+
+    return true;
+}
+
+static void task_listen_network_handshake(listen_network_data* data, int sock, u32 address) {
+    netinstall_session session;
+    memset(&session, 0, sizeof(session));
+
+    session.socket = sock;
+    session.address = address;
+
+    u32 first = 0;
+    if(net_recv_all(sock, &first, sizeof(first), 0, LISTEN_HANDSHAKE_TIMEOUT) < 0) {
+        close(sock);
+        return;
+    }
+
+    if(httpd_is_request(&first)) {
+        if(!task_listen_network_read_http(sock, &first, &session)) {
+            free(session.files);
+            close(sock);
+            return;
+        }
+    } else if(ntohl(first) == NETINSTALL_MAGIC) {
+        if(netinstall_read_manifest(sock, &session, LISTEN_CAPABILITIES, LISTEN_HANDSHAKE_TIMEOUT) < 0) {
+            close(sock);
+            return;
+        }
+    } else {
+        session.version = 1;
+        session.fileCount = ntohl(first);
+    }
+
+    network_session_queue* queue = data->queue;
+
+    svcWaitSynchronization(queue->mutex, U64_MAX);
+
+    bool queued = queue->count < NETWORK_SESSIONS_MAX;
+    if(queued) {
+        queue->sessions[queue->count++] = session;
+    }
+
+    svcReleaseMutex(queue->mutex);
+
+    // Turn the sender away rather than leave it waiting on a full queue.
+    if(!queued) {
+        if(session.version == 0) {
+            httpd_send_json(sock, 503, "Service Unavailable", NULL, "{\"status\":\"busy\"}", false, LISTEN_HANDSHAKE_TIMEOUT);
+        } else if(session.version >= 2) {
+            netinstall_send_frame(sock, NETINSTALL_FRAME_REJECT, 0, 0, LISTEN_HANDSHAKE_TIMEOUT);
+        } else {
+            netinstall_send_ack(sock, false, LISTEN_HANDSHAKE_TIMEOUT);
+        }
+
+        free(session.files);
+        close(sock);
+    }
+}
+
+static void task_listen_network_thread(void* arg) {
+    listen_network_data* data = (listen_network_data*) arg;
+    network_session_queue* queue = data->queue;
+
+    // Idle keep-alive connections are watched alongside the server socket.
+    int idle[NETWORK_IDLE_MAX];
+    u32 idleAddress[NETWORK_IDLE_MAX];
+    u64 idleSince[NETWORK_IDLE_MAX];
+    u32 idleCount = 0;
+
+    int serverSocket = task_listen_network_open(data);
+    if(serverSocket >= 0) {
+        while(!task_is_quit_all() && svcWaitSynchronization(data->cancelEvent, 0) != 0) {
+            svcWaitSynchronization(queue->mutex, U64_MAX);
+
+            for(u32 i = 0; i < queue->idleCount; i++) {
+                if(idleCount < NETWORK_IDLE_MAX) {
+                    idle[idleCount] = queue->idle[i];
+                    idleAddress[idleCount] = queue->idleAddress[i];
+                    idleSince[idleCount] = osGetTime();
+                    idleCount++;
+                } else {
+                    close(queue->idle[i]);
+                }
+            }
+
+            queue->idleCount = 0;
+
+            svcReleaseMutex(queue->mutex);
+
+            struct pollfd fds[NETWORK_IDLE_MAX + 1];
+            fds[0].fd = serverSocket;
+            fds[0].events = POLLIN;
+            fds[0].revents = 0;
+
+            for(u32 i = 0; i < idleCount; i++) {
+                fds[i + 1].fd = idle[i];
+                fds[i + 1].events = POLLIN;
+                fds[i + 1].revents = 0;
+            }
+
+            int ready = poll(fds, idleCount + 1, LISTEN_POLL_INTERVAL);
+            if(ready < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+
+                error_display_errno(NULL, NULL, NULL, errno, "Failed to wait for connections.");
+                break;
+            }
+
+            // Walk backwards so removing an entry doesn't skip the next one.
+            for(u32 i = idleCount; i > 0; i--) {
+                u32 curr = i - 1;
+
+                bool readable = (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+                if(!readable && osGetTime() - idleSince[curr] < LISTEN_IDLE_TIMEOUT) {
+                    continue;
+                }
+
+                int sock = idle[curr];
+                u32 address = idleAddress[curr];
+
+                idleCount--;
+                idle[curr] = idle[idleCount];
+                idleAddress[curr] = idleAddress[idleCount];
+                idleSince[curr] = idleSince[idleCount];
+
+                if(readable) {
+                    task_listen_network_handshake(data, sock, address);
+                } else {
+                    close(sock);
+                }
+            }
+
+            if(!(fds[0].revents & POLLIN)) {
+                continue;
+            }
+
+            struct sockaddr_in client;
+            socklen_t clientLen = sizeof(client);
+
+            int sock = accept(serverSocket, (struct sockaddr*) &client, &clientLen);
+            if(sock >= 0) {
+                // Accepted sockets aren't guaranteed to inherit the server socket's buffer size.
+                int bufSize = (int) netconfig_get()->recvBufferSize;
+                setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+
+                task_listen_network_handshake(data, sock, client.sin_addr.s_addr);
+            } else if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                error_display_errno(NULL, NULL, NULL, errno, "Failed to accept connection.");
+                break;
+            }
+        }
+
+        close(serverSocket);
+    }
+
+    for(u32 i = 0; i < idleCount; i++) {
+        close(idle[i]);
+    }
+
+    svcWaitSynchronization(queue->mutex, U64_MAX);
+
+    for(u32 i = 0; i < queue->idleCount; i++) {
+        close(queue->idle[i]);
+    }
+
+    queue->idleCount = 0;
+    queue->listening = false;
+
+    svcReleaseMutex(queue->mutex);
+
+    svcCloseHandle(data->cancelEvent);
+    free(data);
+}
+
+Handle task_listen_network(network_session_queue* queue, u16 port) {
+    if(queue == NULL || queue->mutex == 0) {
+        return 0;
+    }
+
+    listen_network_data* data = (listen_network_data*) calloc(1, sizeof(listen_network_data));
+    if(data == NULL) {
+        error_display(NULL, NULL, NULL, "Failed to allocate network listener data.");
+
+        return 0;
+    }
+
+    data->queue = queue;
+    data->port = port;
+
+    Result eventRes = svcCreateEvent(&data->cancelEvent, 1);
+    if(R_FAILED(eventRes)) {
+        error_display_res(NULL, NULL, NULL, eventRes, "Failed to create network listener cancel event.");
+
+        free(data);
+        return 0;
+    }
+
+    queue->listening = true;
+
+    if(threadCreate(task_listen_network_thread, data, 0x4000, 0x18, 1, true) == NULL) {
+        error_display(NULL, NULL, NULL, "Failed to create network listener thread.");
+
+        queue->listening = false;
+
+        svcCloseHandle(data->cancelEvent);
+        free(data);
+        return 0;
+    }
+
+    return data->cancelEvent;
+}
+
+void task_listen_network_keep(network_session_queue* queue, int socket, u32 address) {
+    svcWaitSynchronization(queue->mutex, U64_MAX);
+
+    bool kept = queue->listening && queue->idleCount < NETWORK_IDLE_MAX;
+    if(kept) {
+        queue->idle[queue->idleCount] = socket;
+        queue->idleAddress[queue->idleCount] = address;
+        queue->idleCount++;
+    }
+
+    svcReleaseMutex(queue->mutex);
+
+    if(!kept) {
+        close(socket);
+    }
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <sys/syslimits.h>
 
 #include "../../list.h"
+#include "../../../net/netinstall.h"
 
 typedef struct {
     char shortDescription[0x100];
@@ -72,6 +73,9 @@ typedef struct {
 #define R_FBI_ERRNO MAKERESULT(RL_PERMANENT, RS_INTERNAL, RM_APPLICATION, 2)
 #define R_FBI_HTTP_RESPONSE_CODE MAKERESULT(RL_PERMANENT, RS_INTERNAL, RM_APPLICATION, 3)
 #define R_FBI_WRONG_SYSTEM MAKERESULT(RL_PERMANENT, RS_NOTSUPPORTED, RM_APPLICATION, 4)
+#define R_FBI_THREAD_CREATE_FAILED MAKERESULT(RL_PERMANENT, RS_INTERNAL, RM_APPLICATION, 5)
+#define R_FBI_BAD_DATA MAKERESULT(RL_PERMANENT, RS_INVALIDSTATE, RM_APPLICATION, 6)
+#define R_FBI_HASH_MISMATCH MAKERESULT(RL_PERMANENT, RS_INVALIDSTATE, RM_APPLICATION, 7)
 
 #define R_FBI_OUT_OF_MEMORY MAKERESULT(RL_FATAL, RS_OUTOFRESOURCE, RM_APPLICATION, RD_OUT_OF_MEMORY)
 
@@ -80,11 +84,57 @@ typedef enum {
     DATAOP_DELETE
 } DataOp;
 
+#define DATAOP_WORKERS_MAX 4
+
+// Timings are in system ticks (SYSCLOCK_ARM11 per second).
+typedef struct {
+    u64 bytes;
+
+    u32 readChunks;
+    u64 readTicks;
+    u64 readMinTicks;
+    u64 readMaxTicks;
+
+    u32 writeChunks;
+    u64 writeTicks;
+    u64 writeMinTicks;
+    u64 writeMaxTicks;
+} data_op_stats;
+
+typedef struct {
+    u32 index;
+
+    u64 currProcessed;
+    u64 currTotal;
+
+    u64 doneBytes;
+
+    data_op_stats stats;
+} data_op_progress;
+
 typedef struct {
     void* data;
 
+    // Used to label the operation in the transfer log.
+    const char* name;
+
     DataOp op;
 
+    // Concurrency
+    u32 workers;
+    bool ordered;
+
+    // Transfer buffers; bufferCount caps the pool, 0 selects the default.
+    u32 bufferCount;
+    u32 buffersTotal;
+    u32 buffersInUse;
+
+    // Chunk size hint, 0 selects the default. With autoChunkSize, the size is
+    // ramped from measured throughput; currChunkSize reports the size in use.
+    u32 chunkSize;
+    bool autoChunkSize;
+    u32 currChunkSize;
+
     // Copy
     bool copyEmpty;
 
@@ -97,15 +147,37 @@ typedef struct {
     u64 currProcessed;
     u64 currTotal;
 
+    data_op_progress workerProgress[DATAOP_WORKERS_MAX];
+
+    // Whole-operation totals. totalBytes is summed by prescanSrcSize when set,
+    // and clients may add to it as they learn about more data.
+    bool prescanning;
+    u64 totalBytes;
+    u64 doneBytes;
+    u64 bytesPerSecond;
+    u64 estimatedRemaining;
+
+    data_op_stats stats;
+
     Result (*isSrcDirectory)(void* data, u32 index, bool* isDirectory);
     Result (*makeDstDirectory)(void* data, u32 index);
 
     Result (*openSrc)(void* data, u32 index, u32* handle);
     Result (*closeSrc)(void* data, u32 index, bool succeeded, u32 handle);
 
+    Result (*prescanSrcSize)(void* data, u32 index, u64* size);
+
     Result (*getSrcSize)(void* data, u32 handle, u64* size);
     Result (*readSrc)(void* data, u32 handle, u32* bytesRead, void* buffer, u64 offset, u32 size);
 
+    // Optional; continues a copy from a byte offset of an existing destination.
+    Result (*getResumeOffset)(void* data, u32 index, u64 size, u64* offset);
+
+    // Optional stage between readSrc and writeDst, run on its own thread in chunk order. It
+    // rewrites a chunk into dst, which holds chunkSize bytes. Progress counts source bytes,
+    // while writeDst offsets advance by the transformed sizes. Disables autoChunkSize.
+    Result (*transformSrc)(void* data, u32 index, void* src, u32 srcSize, void* dst, u32* dstSize);
+
     Result (*openDst)(void* data, u32 index, void* initialReadBlock, u32* handle);
     Result (*closeDst)(void* data, u32 index, bool succeeded, u32 handle);
 
@@ -118,6 +190,27 @@ typedef struct {
     bool (*error)(void* data, u32 index, Result res);
 } data_op_info;
 
+#define NETWORK_SESSIONS_MAX 4
+#define NETWORK_IDLE_MAX 4
+
+// Owned by the caller, including the mutex guarding sessions and count. The
+// listener fills in address, port and listening.
+typedef struct {
+    Handle mutex;
+
+    netinstall_session sessions[NETWORK_SESSIONS_MAX];
+    u32 count;
+
+    // Keep-alive HTTP connections handed back to the listener to wait for their next request.
+    int idle[NETWORK_IDLE_MAX];
+    u32 idleAddress[NETWORK_IDLE_MAX];
+    u32 idleCount;
+
+    u32 address;
+    u16 port;
+    volatile bool listening;
+} network_session_queue;
+
 bool task_is_quit_all();
 void task_quit_all();
 
@@ -125,6 +218,9 @@ Handle task_capture_cam(Handle* mutex, u16* buffer, s16 width, s16 height);
 
 Handle task_data_op(data_op_info* info);
 
+Handle task_listen_network(network_session_queue* queue, u16 port);
+void task_listen_network_keep(network_session_queue* queue, int socket, u32 address);
+
 void task_clear_ext_save_data(list_item* items, u32* count);
 Handle task_populate_ext_save_data(list_item* items, u32* count, u32 max);
 
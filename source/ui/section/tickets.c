@@ -17,11 +17,13 @@ typedef struct {
     bool populated;
 } tickets_data;
 
-#define TICKETS_ACTION_COUNT 2
+#define TICKETS_ACTION_COUNT 4
 
 static u32 tickets_action_count = TICKETS_ACTION_COUNT;
 static list_item tickets_action_items[TICKETS_ACTION_COUNT] = {
         {"Install from CDN", COLOR_TEXT, action_install_cdn},
+        {"Queue for CDN Install", COLOR_TEXT, action_queue_cdn},
+        {"Install CDN Queue", COLOR_TEXT, action_install_cdn_queue},
         {"Delete Ticket", COLOR_TEXT, action_delete_ticket},
 };
 
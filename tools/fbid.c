@@ -0,0 +1,137 @@
+// Rebuilds raw NAND images from FBI's Dump NAND (Differential) deltas (NAND-*.fbd).
+//
+// Build: cc -O2 -o fbid tools/fbid.c source/hash/hash.c
+// Usage: fbid <output.bin> <base.fbd> [delta.fbd ...]
+//
+// The first delta must be a full base, taken when no manifest existed. Each following delta must
+// have been taken against the one before it; every stored block is checked against its hash.
+
+#define _FILE_OFFSET_BITS 64
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../source/hash/hash.h"
+
+#define FBID_MAGIC 0x44494246 // "FBID"
+#define FBID_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t blockCount;
+    uint64_t imageSize;
+    uint64_t parentId;
+    uint64_t id;
+    uint32_t changedCount;
+    uint32_t reserved;
+    uint64_t tableOffset;
+} fbid_header;
+
+typedef struct {
+    uint32_t block;
+    uint32_t size;
+    uint64_t dataOffset;
+    uint64_t hash;
+} fbid_block;
+
+static int fbid_apply(const char* path, int out, fbid_header* prev, int first) {
+    int in = open(path, O_RDONLY);
+    if(in < 0) {
+        perror(path);
+        return -1;
+    }
+
+    int ret = -1;
+
+    fbid_header header;
+    fbid_block* blocks = NULL;
+    uint8_t* buffer = NULL;
+
+    if(pread(in, &header, sizeof(header), 0) != sizeof(header) || header.magic != FBID_MAGIC) {
+        fprintf(stderr, "%s: not a NAND delta\n", path);
+        goto done;
+    }
+
+    if(header.version != FBID_VERSION || header.tableOffset == 0 || header.blockSize == 0
+       || header.blockCount != (header.imageSize + header.blockSize - 1) / header.blockSize || header.changedCount > header.blockCount) {
+        fprintf(stderr, "%s: unsupported or incomplete delta\n", path);
+        goto done;
+    }
+
+    if(first ? header.parentId != 0 : (header.parentId != prev->id || header.imageSize != prev->imageSize || header.blockSize != prev->blockSize)) {
+        fprintf(stderr, "%s: does not follow the %s\n", path, first ? "start of the chain; the first delta must be a full base" : "previous delta");
+        goto done;
+    }
+
+    size_t tableSize = header.changedCount * sizeof(fbid_block);
+    if((blocks = (fbid_block*) malloc(tableSize > 0 ? tableSize : 1)) == NULL || (buffer = (uint8_t*) malloc(header.blockSize)) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        goto done;
+    }
+
+    if(pread(in, blocks, tableSize, (off_t) header.tableOffset) != (ssize_t) tableSize) {
+        fprintf(stderr, "%s: failed to read block table\n", path);
+        goto done;
+    }
+
+    if(first && ftruncate(out, (off_t) header.imageSize) < 0) {
+        perror("ftruncate");
+        goto done;
+    }
+
+    for(uint32_t i = 0; i < header.changedCount; i++) {
+        fbid_block* block = &blocks[i];
+
+        if(block->block >= header.blockCount || block->size > header.blockSize
+           || pread(in, buffer, block->size, (off_t) block->dataOffset) != (ssize_t) block->size || hash64(buffer, block->size) != block->hash) {
+            fprintf(stderr, "%s: block %" PRIu32 " is corrupt\n", path, block->block);
+            goto done;
+        }
+
+        if(pwrite(out, buffer, block->size, (off_t) block->block * header.blockSize) != (ssize_t) block->size) {
+            perror("pwrite");
+            goto done;
+        }
+    }
+
+    printf("%s: %" PRIu32 " of %" PRIu32 " blocks\n", path, header.changedCount, header.blockCount);
+
+    *prev = header;
+    ret = 0;
+
+done:
+    free(buffer);
+    free(blocks);
+    close(in);
+
+    return ret;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        fprintf(stderr, "Usage: %s <output.bin> <base.fbd> [delta.fbd ...]\n", argv[0]);
+        return 2;
+    }
+
+    int out = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(out < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fbid_header prev = {0};
+    for(int i = 2; i < argc; i++) {
+        if(fbid_apply(argv[i], out, &prev, i == 2) < 0) {
+            close(out);
+            return 1;
+        }
+    }
+
+    close(out);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,556 @@
+// Receives NAND dumps and files sent by FBI's "send to network" destinations.
+//
+// Build: cc -O2 -o fbirecv tools/fbirecv.c source/hash/hash.c
+// Usage: fbirecv [-1] [-a device] [-p port] [outdir]
+//
+// Speaks the protocol described in source/net/netsend.h. Announces itself on the local network
+// until the device connects, along with a pairing code that the device shows for the user to
+// check before sending anything. It then stores whatever the device sends under outdir (the
+// current directory by default) with the same relative paths. Files are written to a .part file
+// next to their final name and only renamed into place once they match the device's hash. -a
+// aims the announcements at the device instead of broadcasting them, -p changes the TCP port the
+// device connects to and -1 exits after one session.
+
+#define _FILE_OFFSET_BITS 64
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../source/hash/hash.h"
+#include "../source/net/netsend.h"
+
+#define FBIRECV_BEACON_INTERVAL 1000
+
+// The device only goes quiet between chunks while it reads its source.
+#define FBIRECV_TIMEOUT 60000
+
+#define FBIRECV_BUFFER_SIZE (1024 * 1024)
+
+// Converts between host and big-endian order, in either direction.
+static uint64_t fbirecv_be64(uint64_t value) {
+    uint8_t bytes[8];
+    for(int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t) (value >> (56 - i * 8));
+    }
+
+    uint64_t result;
+    memcpy(&result, bytes, sizeof(result));
+    return result;
+}
+
+static int fbirecv_recv_all(int sock, void* buf, size_t len) {
+    uint8_t* p = (uint8_t*) buf;
+
+    while(len > 0) {
+        struct pollfd pfd = {sock, POLLIN, 0};
+
+        int ready = poll(&pfd, 1, FBIRECV_TIMEOUT);
+        if(ready < 0 && errno == EINTR) {
+            continue;
+        } else if(ready <= 0) {
+            if(ready == 0) {
+                errno = ETIMEDOUT;
+            }
+
+            return -1;
+        }
+
+        ssize_t ret = recv(sock, p, len, 0);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        } else if(ret == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+
+        p += ret;
+        len -= (size_t) ret;
+    }
+
+    return 0;
+}
+
+static int fbirecv_send_all(int sock, const void* buf, size_t len) {
+    const uint8_t* p = (const uint8_t*) buf;
+
+    while(len > 0) {
+        ssize_t ret = send(sock, p, len, MSG_NOSIGNAL);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        p += ret;
+        len -= (size_t) ret;
+    }
+
+    return 0;
+}
+
+static int fbirecv_send_status(int sock, uint32_t status) {
+    uint32_t netStatus = htonl(status);
+    return fbirecv_send_all(sock, &netStatus, sizeof(netStatus));
+}
+
+// Names must stay inside the output directory: relative, without empty, "." or ".." components.
+static int fbirecv_check_name(const char* name) {
+    if(name[0] == '/') {
+        return 0;
+    }
+
+    const char* curr = name;
+    while(*curr != '\0') {
+        const char* end = strchr(curr, '/');
+        size_t len = end != NULL ? (size_t) (end - curr) : strlen(curr);
+
+        if(len == 0 || (len == 1 && curr[0] == '.') || (len == 2 && curr[0] == '.' && curr[1] == '.')) {
+            return 0;
+        }
+
+        curr += len;
+        if(*curr == '/') {
+            curr++;
+        }
+    }
+
+    return 1;
+}
+
+// Creates every directory along path, including path itself.
+static int fbirecv_make_dirs(char* path) {
+    for(char* curr = strchr(path + 1, '/'); ; curr = strchr(curr + 1, '/')) {
+        if(curr != NULL) {
+            *curr = '\0';
+        }
+
+        int ret = mkdir(path, 0777);
+        int err = errno;
+
+        if(curr != NULL) {
+            *curr = '/';
+        }
+
+        if(ret < 0 && err != EEXIST) {
+            errno = err;
+            return -1;
+        }
+
+        if(curr == NULL) {
+            return 0;
+        }
+    }
+}
+
+static int fbirecv_receive_file(int sock, const char* outDir, const char* name, int nameOk, uint64_t expected) {
+    static uint8_t buffer[FBIRECV_BUFFER_SIZE];
+
+    char path[PATH_MAX];
+    char partPath[PATH_MAX + 8];
+    snprintf(path, sizeof(path), "%s/%s", outDir, name);
+    snprintf(partPath, sizeof(partPath), "%s.part", path);
+
+    uint32_t status = nameOk ? NETSEND_STATUS_OK : NETSEND_STATUS_BAD_NAME;
+
+    int fd = -1;
+    if(status == NETSEND_STATUS_OK) {
+        char* slash = strrchr(path, '/');
+        *slash = '\0';
+        int ret = fbirecv_make_dirs(path);
+        *slash = '/';
+
+        if(ret < 0 || (fd = open(partPath, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+            perror(partPath);
+            status = NETSEND_STATUS_IO_ERROR;
+        }
+    }
+
+    hash64_ctx ctx;
+    hash64_init(&ctx);
+
+    uint64_t received = 0;
+
+    // The body is drained even when it can't be stored, so the session can carry on.
+    while(1) {
+        uint32_t length = 0;
+        if(fbirecv_recv_all(sock, &length, sizeof(length)) < 0) {
+            perror("recv");
+
+            if(fd >= 0) {
+                close(fd);
+                unlink(partPath);
+            }
+
+            return -1;
+        }
+
+        length = ntohl(length);
+        if(length == 0 || length == NETSEND_CHUNK_ABORT) {
+            uint64_t hash = 0;
+            if(length == 0 && fbirecv_recv_all(sock, &hash, sizeof(hash)) < 0) {
+                perror("recv");
+
+                if(fd >= 0) {
+                    close(fd);
+                    unlink(partPath);
+                }
+
+                return -1;
+            }
+
+            if(length == NETSEND_CHUNK_ABORT) {
+                status = NETSEND_STATUS_ABORTED;
+            } else if(status == NETSEND_STATUS_OK && fbirecv_be64(hash) != hash64_final(&ctx)) {
+                status = NETSEND_STATUS_HASH_MISMATCH;
+            }
+
+            break;
+        }
+
+        while(length > 0) {
+            uint32_t n = length < sizeof(buffer) ? length : (uint32_t) sizeof(buffer);
+            if(fbirecv_recv_all(sock, buffer, n) < 0) {
+                perror("recv");
+
+                if(fd >= 0) {
+                    close(fd);
+                    unlink(partPath);
+                }
+
+                return -1;
+            }
+
+            length -= n;
+            received += n;
+
+            if(status == NETSEND_STATUS_OK) {
+                hash64_update(&ctx, buffer, n);
+
+                if(write(fd, buffer, n) != (ssize_t) n) {
+                    perror(partPath);
+                    status = NETSEND_STATUS_IO_ERROR;
+                }
+            }
+        }
+
+        if(expected > 0) {
+            printf("\r%s: %.1f / %.1f MiB", name, received / 1024.0 / 1024.0, expected / 1024.0 / 1024.0);
+        } else {
+            printf("\r%s: %.1f MiB", name, received / 1024.0 / 1024.0);
+        }
+
+        fflush(stdout);
+    }
+
+    if(fd >= 0) {
+        if(status == NETSEND_STATUS_OK && fsync(fd) < 0) {
+            perror(partPath);
+            status = NETSEND_STATUS_IO_ERROR;
+        }
+
+        close(fd);
+
+        if(status == NETSEND_STATUS_OK && rename(partPath, path) < 0) {
+            perror(path);
+            status = NETSEND_STATUS_IO_ERROR;
+        }
+
+        if(status != NETSEND_STATUS_OK) {
+            unlink(partPath);
+        }
+    }
+
+    switch(status) {
+        case NETSEND_STATUS_OK:
+            printf("\r%s: %.1f MiB received.\n", name, received / 1024.0 / 1024.0);
+            break;
+        case NETSEND_STATUS_BAD_NAME:
+            printf("\r%s: refused, the name leaves the output directory.\n", name);
+            break;
+        case NETSEND_STATUS_HASH_MISMATCH:
+            printf("\r%s: discarded, the contents do not match the device's hash.\n", name);
+            break;
+        case NETSEND_STATUS_ABORTED:
+            printf("\r%s: cancelled by the device.\n", name);
+            break;
+        default:
+            printf("\r%s: could not be stored.\n", name);
+            break;
+    }
+
+    return fbirecv_send_status(sock, status);
+}
+
+static int fbirecv_session(int sock, const char* outDir) {
+    netsend_hello hello;
+    if(fbirecv_recv_all(sock, &hello, sizeof(hello)) < 0 || ntohl(hello.magic) != NETSEND_MAGIC) {
+        fprintf(stderr, "Connection did not speak the FBI send protocol.\n");
+        return -1;
+    }
+
+    netsend_hello reply;
+    reply.magic = htonl(NETSEND_MAGIC);
+    reply.version = htonl(NETSEND_VERSION);
+
+    if(fbirecv_send_all(sock, &reply, sizeof(reply)) < 0) {
+        perror("send");
+        return -1;
+    }
+
+    if(ntohl(hello.version) != NETSEND_VERSION) {
+        fprintf(stderr, "Device speaks protocol version %" PRIu32 ", expected %d.\n", ntohl(hello.version), NETSEND_VERSION);
+        return -1;
+    }
+
+    while(1) {
+        netsend_entry entry;
+        if(fbirecv_recv_all(sock, &entry, sizeof(entry)) < 0) {
+            perror("recv");
+            return -1;
+        }
+
+        uint32_t type = ntohl(entry.type);
+        uint32_t nameLength = ntohl(entry.nameLength);
+
+        char name[NETSEND_NAME_MAX + 1];
+        if(nameLength > NETSEND_NAME_MAX) {
+            fprintf(stderr, "Device sent an overlong name.\n");
+            return -1;
+        }
+
+        if(fbirecv_recv_all(sock, name, nameLength) < 0) {
+            perror("recv");
+            return -1;
+        }
+
+        name[nameLength] = '\0';
+
+        if(type == NETSEND_ENTRY_END) {
+            return fbirecv_send_status(sock, NETSEND_STATUS_OK);
+        } else if(type == NETSEND_ENTRY_DIRECTORY) {
+            uint32_t status = NETSEND_STATUS_OK;
+
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", outDir, name);
+
+            // An empty name is the output directory itself.
+            if(nameLength > 0 && !fbirecv_check_name(name)) {
+                status = NETSEND_STATUS_BAD_NAME;
+            } else if(fbirecv_make_dirs(path) < 0) {
+                perror(path);
+                status = NETSEND_STATUS_IO_ERROR;
+            }
+
+            if(fbirecv_send_status(sock, status) < 0) {
+                perror("send");
+                return -1;
+            }
+        } else if(type == NETSEND_ENTRY_FILE) {
+            if(fbirecv_receive_file(sock, outDir, name, nameLength > 0 && fbirecv_check_name(name), fbirecv_be64(entry.size)) < 0) {
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "Device sent an unknown entry type %" PRIu32 ".\n", type);
+            return -1;
+        }
+    }
+}
+
+static int fbirecv_listen(const char* port) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    struct addrinfo* addrs = NULL;
+    int err = getaddrinfo(NULL, port, &hints, &addrs);
+    if(err != 0) {
+        fprintf(stderr, "%s: %s\n", port, gai_strerror(err));
+        return -1;
+    }
+
+    int sock = socket(addrs->ai_family, addrs->ai_socktype, addrs->ai_protocol);
+    if(sock >= 0) {
+        int one = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        if(bind(sock, addrs->ai_addr, addrs->ai_addrlen) < 0 || listen(sock, 1) < 0) {
+            close(sock);
+            sock = -1;
+        }
+    }
+
+    if(sock < 0) {
+        perror("listen");
+    }
+
+    freeaddrinfo(addrs);
+    return sock;
+}
+
+static int fbirecv_beacon_socket(const char* device, struct sockaddr_in* target) {
+    memset(target, 0, sizeof(*target));
+    target->sin_family = AF_INET;
+    target->sin_port = htons(NETSEND_PORT);
+    target->sin_addr.s_addr = htonl(INADDR_BROADCAST);
+
+    if(device != NULL) {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        struct addrinfo* addrs = NULL;
+        int err = getaddrinfo(device, NULL, &hints, &addrs);
+        if(err != 0) {
+            fprintf(stderr, "%s: %s\n", device, gai_strerror(err));
+            return -1;
+        }
+
+        target->sin_addr = ((struct sockaddr_in*) addrs->ai_addr)->sin_addr;
+        freeaddrinfo(addrs);
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+
+    return sock;
+}
+
+// The device shows this code next to the beacon's address, so the user can tell this receiver from any other.
+static uint32_t fbirecv_pick_code() {
+    uint32_t seed = 0;
+
+    FILE* fd = fopen("/dev/urandom", "rb");
+    if(fd == NULL || fread(&seed, 1, sizeof(seed), fd) != sizeof(seed)) {
+        seed = (uint32_t) time(NULL) ^ ((uint32_t) getpid() << 16);
+    }
+
+    if(fd != NULL) {
+        fclose(fd);
+    }
+
+    return seed % NETSEND_CODE_MAX;
+}
+
+int main(int argc, char** argv) {
+    int once = 0;
+    const char* device = NULL;
+    const char* port = "5001";
+
+    int opt;
+    while((opt = getopt(argc, argv, "1a:p:")) != -1) {
+        switch(opt) {
+            case '1':
+                once = 1;
+                break;
+            case 'a':
+                device = optarg;
+                break;
+            case 'p':
+                port = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-1] [-a device] [-p port] [outdir]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if(argc - optind > 1) {
+        fprintf(stderr, "Usage: %s [-1] [-a device] [-p port] [outdir]\n", argv[0]);
+        return 2;
+    }
+
+    const char* outDir = optind < argc ? argv[optind] : ".";
+
+    char outPath[PATH_MAX];
+    snprintf(outPath, sizeof(outPath), "%s", outDir);
+    if(fbirecv_make_dirs(outPath) < 0) {
+        perror(outDir);
+        return 1;
+    }
+
+    int listenSock = fbirecv_listen(port);
+    if(listenSock < 0) {
+        return 1;
+    }
+
+    struct sockaddr_in target;
+    int beaconSock = fbirecv_beacon_socket(device, &target);
+    if(beaconSock < 0) {
+        close(listenSock);
+        return 1;
+    }
+
+    uint32_t code = fbirecv_pick_code();
+
+    netsend_beacon beacon;
+    beacon.magic = htonl(NETSEND_MAGIC);
+    beacon.version = htonl(NETSEND_VERSION);
+    beacon.port = htonl((uint32_t) atoi(port));
+    beacon.code = htonl(code);
+
+    printf("Waiting for the device to send to %s...\nPairing code: %04" PRIu32 "\n", outDir, code);
+
+    int ret = 0;
+    while(1) {
+        if(sendto(beaconSock, &beacon, sizeof(beacon), 0, (struct sockaddr*) &target, sizeof(target)) < 0) {
+            perror("sendto");
+        }
+
+        struct pollfd pfd = {listenSock, POLLIN, 0};
+        if(poll(&pfd, 1, FBIRECV_BEACON_INTERVAL) <= 0) {
+            continue;
+        }
+
+        struct sockaddr_in client;
+        socklen_t clientLen = sizeof(client);
+
+        int sock = accept(listenSock, (struct sockaddr*) &client, &clientLen);
+        if(sock < 0) {
+            perror("accept");
+            continue;
+        }
+
+        printf("Device %s connected.\n", inet_ntoa(client.sin_addr));
+
+        ret = fbirecv_session(sock, outDir);
+        close(sock);
+
+        printf(ret < 0 ? "Session failed.\n" : "Session finished.\n");
+
+        if(once) {
+            break;
+        }
+    }
+
+    close(beaconSock);
+    close(listenSock);
+
+    return ret < 0 ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+// Expands sparse NAND images (NAND.bin.fbs) written by FBI's Dump NAND (Sparse) to raw images.
+//
+// Build: cc -O2 -o fbis tools/fbis.c
+// Usage: fbis <image.fbs> <output.bin>
+//
+// The output is sized to the full NAND and only the stored extents are written, so zero regions
+// stay holes on filesystems that support sparse files.
+
+#define _FILE_OFFSET_BITS 64
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define FBIS_MAGIC 0x53494246 // "FBIS"
+#define FBIS_VERSION 1
+
+#define FBIS_COPY_SIZE (1024 * 1024)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t extentCount;
+    uint32_t reserved;
+    uint64_t imageSize;
+    uint64_t tableOffset;
+} fbis_header;
+
+typedef struct {
+    uint64_t imageOffset;
+    uint64_t dataOffset;
+    uint64_t length;
+} fbis_extent;
+
+int main(int argc, char** argv) {
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s <image.fbs> <output.bin>\n", argv[0]);
+        return 2;
+    }
+
+    int in = open(argv[1], O_RDONLY);
+    if(in < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fbis_header header;
+    if(pread(in, &header, sizeof(header), 0) != sizeof(header) || header.magic != FBIS_MAGIC) {
+        fprintf(stderr, "%s: not a sparse NAND image\n", argv[1]);
+        return 1;
+    }
+
+    if(header.version != FBIS_VERSION || header.tableOffset == 0) {
+        fprintf(stderr, "%s: unsupported or incomplete image\n", argv[1]);
+        return 1;
+    }
+
+    size_t tableSize = header.extentCount * sizeof(fbis_extent);
+    fbis_extent* extents = (fbis_extent*) malloc(tableSize > 0 ? tableSize : 1);
+    char* buffer = (char*) malloc(FBIS_COPY_SIZE);
+    if(extents == NULL || buffer == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if(pread(in, extents, tableSize, (off_t) header.tableOffset) != (ssize_t) tableSize) {
+        fprintf(stderr, "%s: failed to read extent table\n", argv[1]);
+        return 1;
+    }
+
+    int out = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(out < 0 || ftruncate(out, (off_t) header.imageSize) < 0) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    uint64_t stored = 0;
+    for(uint32_t i = 0; i < header.extentCount; i++) {
+        fbis_extent* extent = &extents[i];
+        if(extent->imageOffset + extent->length > header.imageSize) {
+            fprintf(stderr, "Extent %" PRIu32 " lies outside the image\n", i);
+            return 1;
+        }
+
+        for(uint64_t pos = 0; pos < extent->length;) {
+            size_t size = extent->length - pos < FBIS_COPY_SIZE ? (size_t) (extent->length - pos) : FBIS_COPY_SIZE;
+
+            if(pread(in, buffer, size, (off_t) (extent->dataOffset + pos)) != (ssize_t) size) {
+                fprintf(stderr, "Extent %" PRIu32 ": truncated data\n", i);
+                return 1;
+            }
+
+            if(pwrite(out, buffer, size, (off_t) (extent->imageOffset + pos)) != (ssize_t) size) {
+                perror(argv[2]);
+                return 1;
+            }
+
+            pos += size;
+        }
+
+        stored += extent->length;
+    }
+
+    printf("%" PRIu32 " extents, %" PRIu64 " of %" PRIu64 " bytes non-zero\n", header.extentCount, stored, header.imageSize);
+
+    close(out);
+    close(in);
+    free(buffer);
+    free(extents);
+
+    return 0;
+}
\ No newline at end of file
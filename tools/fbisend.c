@@ -0,0 +1,858 @@
+// Sends CIAs and tickets to FBI's Network Install.
+//
+// Build: cc -O2 -o fbisend tools/fbisend.c source/hash/hash.c source/lz/lz.c
+// Usage: fbisend [-1] [-n] [-u] [-s streams] [-p port] <host> <file> [file ...]
+//        fbisend -b mib [-s streams] [-p port] <host>
+//
+// Speaks protocol version 2 (see source/net/netinstall.h) and falls back to version 1 when the
+// device does not answer the hello. Files that shrink are compressed when the device supports
+// it, and a dropped connection is resumed where the device left off. -1 forces version 1, -n
+// leaves the file hashes out of the manifest, -u disables compression and -s spreads the data
+// over several connections. -b sends mib MiB of throwaway data over 1 up to -s streams and
+// reports the throughput of each.
+
+#define _FILE_OFFSET_BITS 64
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../source/hash/hash.h"
+#include "../source/lz/lz.h"
+#include "../source/net/netinstall.h"
+
+#define FBISEND_CHUNK_SIZE (128 * 1024)
+#define FBISEND_HELLO_TIMEOUT 3000
+
+// A connection that accepts no data for this long is treated as dropped.
+#define FBISEND_IDLE_TIMEOUT 30000
+
+// The device notices a drop within its own idle timeout and then waits a minute for us.
+#define FBISEND_RESUME_WINDOW 90
+#define FBISEND_RESUME_WAIT 60000
+
+typedef struct {
+    // NULL for generated benchmark data.
+    const char* path;
+    const char* name;
+    uint64_t size;
+    uint64_t hash;
+    int hasHash;
+
+    // Set by the scan when the file shrinks; cleared again if the device can't unpack it.
+    int compress;
+    uint64_t packedSize;
+} fbisend_file;
+
+typedef struct {
+    int sock;
+
+    netinstall_frame frame;
+    size_t frameFill;
+
+    uint64_t totalSize;
+    int failed;
+    int done;
+
+    // Set by the device when it can resume; dropped marks a lost connection worth resuming.
+    uint64_t token;
+    int dropped;
+
+    // Set for benchmarks, which only report the final throughput.
+    int quiet;
+
+    // Extra connections of a multi-stream install; stream 0 is sock.
+    int streams[NETINSTALL_STREAMS_MAX];
+    int streamCount;
+} fbisend_session;
+
+// Converts between host and big-endian order, in either direction.
+static uint64_t fbisend_be64(uint64_t value) {
+    uint8_t bytes[8];
+    for(int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t) (value >> (56 - i * 8));
+    }
+
+    uint64_t result;
+    memcpy(&result, bytes, sizeof(result));
+    return result;
+}
+
+static int fbisend_connect(const char* host, const char* port, int quiet) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* addrs = NULL;
+    int err = getaddrinfo(host, port, &hints, &addrs);
+    if(err != 0) {
+        fprintf(stderr, "%s: %s\n", host, gai_strerror(err));
+        return -1;
+    }
+
+    int sock = -1;
+    for(struct addrinfo* addr = addrs; addr != NULL && sock < 0; addr = addr->ai_next) {
+        if((sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) >= 0 && connect(sock, addr->ai_addr, addr->ai_addrlen) < 0) {
+            close(sock);
+            sock = -1;
+        }
+    }
+
+    if(sock < 0 && !quiet) {
+        perror(host);
+    }
+
+    freeaddrinfo(addrs);
+    return sock;
+}
+
+// Waits for the socket up to timeoutMs (negative waits forever); returns 1, 0 on timeout or -1.
+static int fbisend_wait(int sock, short events, int timeoutMs) {
+    struct pollfd pfd = {sock, events, 0};
+
+    int ret;
+    while((ret = poll(&pfd, 1, timeoutMs)) < 0 && errno == EINTR);
+
+    return ret;
+}
+
+static int fbisend_send_all(int sock, const void* buf, size_t len) {
+    const uint8_t* p = (const uint8_t*) buf;
+
+    while(len > 0) {
+        ssize_t ret = send(sock, p, len, MSG_NOSIGNAL);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        p += ret;
+        len -= (size_t) ret;
+    }
+
+    return 0;
+}
+
+static int fbisend_recv_all(int sock, void* buf, size_t len, int timeoutMs) {
+    uint8_t* p = (uint8_t*) buf;
+
+    while(len > 0) {
+        int ready = fbisend_wait(sock, POLLIN, timeoutMs);
+        if(ready <= 0) {
+            if(ready == 0) {
+                errno = ETIMEDOUT;
+            }
+
+            return -1;
+        }
+
+        ssize_t ret = recv(sock, p, len, 0);
+        if(ret <= 0) {
+            if(ret < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if(ret == 0) {
+                errno = ECONNRESET;
+            }
+
+            return -1;
+        }
+
+        p += ret;
+        len -= (size_t) ret;
+    }
+
+    return 0;
+}
+
+// Packs a block with its header into out, which must hold 4 + NETINSTALL_BLOCK_SIZE bytes, and
+// returns the packed size. Blocks that don't shrink are stored as they are.
+static size_t fbisend_pack_block(const uint8_t* raw, uint32_t rawSize, uint8_t* out) {
+    static uint32_t work[LZ_WORK_SIZE / sizeof(uint32_t)];
+
+    uint32_t header = rawSize;
+
+    uint32_t packedSize = rawSize > 1 ? lz_compress(raw, rawSize, out + 4, rawSize - 1, work) : 0;
+    if(packedSize > 0) {
+        header = NETINSTALL_BLOCK_LZ | packedSize;
+    } else {
+        memcpy(out + 4, raw, rawSize);
+    }
+
+    uint32_t netHeader = htonl(header);
+    memcpy(out, &netHeader, sizeof(netHeader));
+
+    return 4 + (header & ~NETINSTALL_BLOCK_LZ);
+}
+
+// Hashes the file and measures how well it compresses, as requested.
+static int fbisend_scan_file(fbisend_file* file, int hash, int compress) {
+    static uint8_t buffer[NETINSTALL_BLOCK_SIZE];
+    static uint8_t packed[4 + NETINSTALL_BLOCK_SIZE];
+
+    if(!hash && !compress) {
+        return 0;
+    }
+
+    FILE* fd = fopen(file->path, "rb");
+    if(fd == NULL) {
+        perror(file->path);
+        return -1;
+    }
+
+    hash64_ctx ctx;
+    hash64_init(&ctx);
+
+    size_t n;
+    while((n = fread(buffer, 1, sizeof(buffer), fd)) > 0) {
+        if(hash) {
+            hash64_update(&ctx, buffer, (uint32_t) n);
+        }
+
+        if(compress) {
+            file->packedSize += fbisend_pack_block(buffer, (uint32_t) n, packed);
+        }
+    }
+
+    int ret = ferror(fd) ? -1 : 0;
+    if(ret < 0) {
+        perror(file->path);
+    }
+
+    fclose(fd);
+
+    if(hash) {
+        file->hash = hash64_final(&ctx);
+        file->hasHash = 1;
+    }
+
+    file->compress = compress && file->packedSize < file->size;
+    return ret;
+}
+
+static void fbisend_handle_frame(fbisend_session* session) {
+    netinstall_frame* frame = &session->frame;
+
+    uint32_t type = ntohl(frame->type);
+    uint32_t index = ntohl(frame->index);
+    uint64_t value = fbisend_be64(frame->value);
+
+    switch(type) {
+        case NETINSTALL_FRAME_ACCEPT:
+            session->token = value;
+            break;
+        case NETINSTALL_FRAME_PROGRESS:
+            if(session->quiet) {
+                break;
+            }
+
+            printf("\rInstalled %.1f / %.1f MiB", value / 1024.0 / 1024.0, session->totalSize / 1024.0 / 1024.0);
+            fflush(stdout);
+            break;
+        case NETINSTALL_FRAME_FILE_DONE:
+            if(!session->quiet) {
+                printf("\rFile %" PRIu32 " installed.\n", index + 1);
+            }
+
+            break;
+        case NETINSTALL_FRAME_ERROR:
+            printf("\nDevice failed to install file %" PRIu32 ": result 0x%08" PRIX32 ".\n", index + 1, (uint32_t) value);
+            session->failed = 1;
+            break;
+        case NETINSTALL_FRAME_REJECT:
+            printf("Install declined on the device.\n");
+            session->failed = 1;
+            session->done = 1;
+            break;
+        case NETINSTALL_FRAME_DONE:
+            session->failed |= value != 0;
+            session->done = 1;
+            break;
+        default:
+            break;
+    }
+}
+
+// Reads whatever part of the next frame is available; returns -1 if the connection is gone.
+static int fbisend_read_frames(fbisend_session* session) {
+    uint8_t* frame = (uint8_t*) &session->frame;
+
+    ssize_t ret = recv(session->sock, frame + session->frameFill, sizeof(session->frame) - session->frameFill, MSG_DONTWAIT);
+    if(ret <= 0) {
+        if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return 0;
+        }
+
+        if(ret == 0) {
+            errno = ECONNRESET;
+        }
+
+        return -1;
+    }
+
+    session->frameFill += (size_t) ret;
+    if(session->frameFill == sizeof(session->frame)) {
+        session->frameFill = 0;
+        fbisend_handle_frame(session);
+    }
+
+    return 0;
+}
+
+// Sends buf over sock, interleaved with the device's reports so an error stops the stream early.
+static int fbisend_send_stream(fbisend_session* session, int sock, const uint8_t* buf, size_t len) {
+    size_t sent = 0;
+    while(sent < len && !session->failed) {
+        struct pollfd pfds[2] = {{session->sock, POLLIN, 0}, {sock, POLLOUT, 0}};
+        if(sock == session->sock) {
+            pfds[0].events |= POLLOUT;
+        }
+
+        int ready = poll(pfds, sock == session->sock ? 1 : 2, FBISEND_IDLE_TIMEOUT);
+        if(ready <= 0) {
+            if(ready < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if(ready == 0) {
+                errno = ETIMEDOUT;
+            }
+
+            perror("poll");
+            session->dropped = 1;
+            return -1;
+        }
+
+        struct pollfd* out = sock == session->sock ? &pfds[0] : &pfds[1];
+
+        if((pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) && fbisend_read_frames(session) < 0) {
+            perror("recv");
+            session->dropped = 1;
+            return -1;
+        }
+
+        if(out->revents & (POLLOUT | POLLHUP | POLLERR)) {
+            ssize_t ret = send(sock, buf + sent, len - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if(ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                // The device may have dropped the stream after an error; collect its reports first.
+                int sendErr = errno;
+
+                while(!session->done && fbisend_wait(session->sock, POLLIN, 1000) > 0 && fbisend_read_frames(session) == 0);
+
+                if(!session->failed) {
+                    errno = sendErr;
+                    perror("send");
+                    session->dropped = 1;
+                }
+
+                return -1;
+            }
+
+            if(ret > 0) {
+                sent += (size_t) ret;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Streams the files from offset into file index onwards, then waits for the device to finish.
+static int fbisend_stream(fbisend_session* session, fbisend_file* files, int fileCount, uint32_t index, uint64_t offset) {
+    static uint8_t buffer[FBISEND_CHUNK_SIZE];
+    static uint8_t packed[4 + NETINSTALL_BLOCK_SIZE];
+
+    for(int i = (int) index; i < fileCount && !session->failed; i++, offset = 0) {
+        FILE* fd = NULL;
+        if(files[i].path != NULL && ((fd = fopen(files[i].path, "rb")) == NULL || fseeko(fd, (off_t) offset, SEEK_SET) < 0)) {
+            perror(files[i].path);
+
+            if(fd != NULL) {
+                fclose(fd);
+            }
+
+            return -1;
+        }
+
+        // Each read is one unit: a block, a stripe when spread over streams, or a chunk otherwise.
+        size_t unitSize = files[i].compress ? NETINSTALL_BLOCK_SIZE : session->streamCount > 1 ? NETINSTALL_STRIPE_SIZE : sizeof(buffer);
+
+        uint64_t pos = offset;
+        while(pos < files[i].size && !session->failed) {
+            size_t n = files[i].size - pos < unitSize ? (size_t) (files[i].size - pos) : unitSize;
+            if(fd == NULL) {
+                for(size_t j = 0; j < n; j++) {
+                    buffer[j] = (uint8_t) (rand() >> 7);
+                }
+            } else if(fread(buffer, 1, n, fd) != n) {
+                fprintf(stderr, "%s: file changed while sending\n", files[i].path);
+                fclose(fd);
+                return -1;
+            }
+
+            int stream = (int) ((pos / unitSize) % (uint64_t) session->streamCount);
+            int sock = stream == 0 ? session->sock : session->streams[stream];
+
+            pos += n;
+
+            int ret = files[i].compress ? fbisend_send_stream(session, sock, packed, fbisend_pack_block(buffer, (uint32_t) n, packed))
+                                        : fbisend_send_stream(session, sock, buffer, n);
+            if(ret < 0) {
+                if(fd != NULL) {
+                    fclose(fd);
+                }
+
+                return -1;
+            }
+        }
+
+        if(fd != NULL) {
+            fclose(fd);
+        }
+    }
+
+    while(!session->done) {
+        if(fbisend_wait(session->sock, POLLIN, -1) < 0 || fbisend_read_frames(session) < 0) {
+            perror("recv");
+            session->dropped = 1;
+            return -1;
+        }
+    }
+
+    return session->failed ? -1 : 0;
+}
+
+// Returns 0 if the device answered with a version 2 hello.
+static int fbisend_hello(int sock, netinstall_hello_reply* reply) {
+    netinstall_hello hello;
+    hello.magic = htonl(NETINSTALL_MAGIC);
+    hello.version = htonl(NETINSTALL_VERSION);
+
+    if(fbisend_send_all(sock, &hello, sizeof(hello)) < 0
+       || fbisend_recv_all(sock, reply, sizeof(*reply), FBISEND_HELLO_TIMEOUT) < 0) {
+        return -1;
+    }
+
+    return ntohl(reply->magic) == NETINSTALL_MAGIC && ntohl(reply->version) >= 2 ? 0 : -1;
+}
+
+// Connects another stream to the install, or reconnects stream 0 to resume it.
+static int fbisend_attach(const char* host, const char* port, uint64_t token, int stream) {
+    int sock = fbisend_connect(host, port, 1);
+    if(sock < 0) {
+        return -1;
+    }
+
+    netinstall_hello_reply reply;
+
+    netinstall_manifest manifest;
+    manifest.flags = htonl(NETINSTALL_MANIFEST_RESUME);
+    manifest.fileCount = htonl((uint32_t) stream);
+    manifest.totalSize = 0;
+
+    uint64_t netToken = fbisend_be64(token);
+
+    if(fbisend_hello(sock, &reply) < 0 || fbisend_send_all(sock, &manifest, sizeof(manifest)) < 0 || fbisend_send_all(sock, &netToken, sizeof(netToken)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+static void fbisend_close_streams(fbisend_session* session) {
+    for(int i = 1; i < session->streamCount; i++) {
+        close(session->streams[i]);
+    }
+
+    session->streamCount = 1;
+}
+
+// Reconnects after a drop and asks the device where to continue from.
+static int fbisend_resume(fbisend_session* session, const char* host, const char* port, uint32_t* index, uint64_t* offset) {
+    time_t deadline = time(NULL) + FBISEND_RESUME_WINDOW;
+
+    // The device carries on over the resumed stream alone.
+    fbisend_close_streams(session);
+
+    while(time(NULL) < deadline) {
+        close(session->sock);
+        sleep(1);
+
+        if((session->sock = fbisend_attach(host, port, session->token, 0)) < 0) {
+            continue;
+        }
+
+        // The device answers once it has given up on the old connection.
+        netinstall_frame frame;
+        while(fbisend_recv_all(session->sock, &frame, sizeof(frame), FBISEND_RESUME_WAIT) == 0) {
+            uint32_t type = ntohl(frame.type);
+            if(type == NETINSTALL_FRAME_RESUME) {
+                *index = ntohl(frame.index);
+                *offset = fbisend_be64(frame.value);
+
+                session->frameFill = 0;
+                session->dropped = 0;
+                return 0;
+            } else if(type == NETINSTALL_FRAME_REJECT) {
+                fprintf(stderr, "The device is no longer holding the install open.\n");
+                return -1;
+            }
+        }
+    }
+
+    fprintf(stderr, "Gave up reconnecting.\n");
+    return -1;
+}
+
+// Returns 1 if the device answered the hello, 0 if it should be retried as version 1, -1 on error.
+static int fbisend_send_v2(int* sock, const char* host, const char* port, fbisend_file* files, int fileCount, int streams, int benchmark) {
+    netinstall_hello_reply reply;
+    if(fbisend_hello(*sock, &reply) < 0) {
+        return 0;
+    }
+
+    fbisend_session session;
+    memset(&session, 0, sizeof(session));
+    session.sock = *sock;
+    session.streamCount = 1;
+    session.quiet = benchmark;
+
+    uint32_t flags = ntohl(reply.capabilities) & NETINSTALL_CAP_RESUME;
+
+    if(streams > 1) {
+        if(!(ntohl(reply.capabilities) & NETINSTALL_CAP_STREAMS) || streams > (int) ntohl(reply.maxStreams)) {
+            fprintf(stderr, "The device does not accept %d streams.\n", streams);
+            return -1;
+        }
+
+        flags |= NETINSTALL_CAP_STREAMS | NETINSTALL_MANIFEST_STREAMS(streams);
+    }
+
+    if(benchmark) {
+        flags |= NETINSTALL_MANIFEST_BENCHMARK;
+    }
+
+    uint64_t packedTotal = 0;
+    uint64_t packedFrom = 0;
+
+    for(int i = 0; i < fileCount; i++) {
+        session.totalSize += files[i].size;
+
+        if(files[i].compress && (ntohl(reply.capabilities) & NETINSTALL_CAP_LZ)) {
+            flags |= NETINSTALL_CAP_LZ;
+
+            packedTotal += files[i].packedSize;
+            packedFrom += files[i].size;
+        } else {
+            files[i].compress = 0;
+        }
+    }
+
+    if(flags & NETINSTALL_CAP_LZ) {
+        printf("Compressing %.1f MiB to %.1f MiB.\n", packedFrom / 1024.0 / 1024.0, packedTotal / 1024.0 / 1024.0);
+    }
+
+    netinstall_manifest manifest;
+    manifest.flags = htonl(flags);
+    manifest.fileCount = htonl((uint32_t) fileCount);
+    manifest.totalSize = fbisend_be64(session.totalSize);
+
+    if(fbisend_send_all(*sock, &manifest, sizeof(manifest)) < 0) {
+        perror("send");
+        return -1;
+    }
+
+    for(int i = 0; i < fileCount; i++) {
+        size_t nameLength = strlen(files[i].name);
+        if(nameLength > NETINSTALL_NAME_MAX) {
+            nameLength = NETINSTALL_NAME_MAX;
+        }
+
+        netinstall_entry entry;
+        entry.size = fbisend_be64(files[i].size);
+        entry.hash = fbisend_be64(files[i].hash);
+        entry.flags = htonl((files[i].hasHash ? NETINSTALL_ENTRY_HASH : 0) | (files[i].compress ? NETINSTALL_ENTRY_LZ : 0));
+        entry.nameLength = htonl((uint32_t) nameLength);
+
+        if(fbisend_send_all(*sock, &entry, sizeof(entry)) < 0 || fbisend_send_all(*sock, files[i].name, nameLength) < 0) {
+            perror("send");
+            return -1;
+        }
+    }
+
+    if(!benchmark) {
+        printf("Waiting for the device to accept %d file(s)...\n", fileCount);
+    }
+
+    if(fbisend_recv_all(*sock, &session.frame, sizeof(session.frame), -1) < 0) {
+        perror("recv");
+        return -1;
+    }
+
+    fbisend_handle_frame(&session);
+    if(session.done || ntohl(session.frame.type) != NETINSTALL_FRAME_ACCEPT) {
+        return -1;
+    }
+
+    for(; session.streamCount < streams; session.streamCount++) {
+        if((session.streams[session.streamCount] = fbisend_attach(host, port, session.token, session.streamCount)) < 0) {
+            fprintf(stderr, "Failed to open stream %d.\n", session.streamCount + 1);
+
+            fbisend_close_streams(&session);
+            return -1;
+        }
+    }
+
+    uint32_t index = 0;
+    uint64_t offset = 0;
+
+    int ret;
+    while((ret = fbisend_stream(&session, files, fileCount, index, offset)) < 0 && session.dropped && session.token != 0) {
+        printf("\nConnection lost; reconnecting to resume...\n");
+
+        if(fbisend_resume(&session, host, port, &index, &offset) < 0) {
+            break;
+        }
+
+        if(index >= (uint32_t) fileCount || offset > files[index].size) {
+            fprintf(stderr, "The device asked to resume at an invalid position.\n");
+            break;
+        }
+
+        printf("Resuming file %" PRIu32 " at %" PRIu64 " bytes.\n", index + 1, offset);
+    }
+
+    *sock = session.sock;
+
+    fbisend_close_streams(&session);
+
+    if(!benchmark) {
+        printf(ret < 0 ? "\nInstall failed.\n" : "\nInstall finished.\n");
+    } else if(ret < 0) {
+        printf("\n");
+    }
+
+    return ret < 0 ? -1 : 1;
+}
+
+static int fbisend_send_v1(int sock, fbisend_file* files, int fileCount) {
+    static uint8_t buffer[FBISEND_CHUNK_SIZE];
+
+    uint32_t count = htonl((uint32_t) fileCount);
+    if(fbisend_send_all(sock, &count, sizeof(count)) < 0) {
+        perror("send");
+        return -1;
+    }
+
+    printf("Waiting for the device to accept %d file(s)...\n", fileCount);
+
+    for(int i = 0; i < fileCount; i++) {
+        uint8_t ack = 0;
+        if(fbisend_recv_all(sock, &ack, sizeof(ack), -1) < 0) {
+            perror("recv");
+            return -1;
+        }
+
+        if(ack == 0) {
+            printf("Install %s on the device.\n", i == 0 ? "declined" : "stopped");
+            return -1;
+        }
+
+        FILE* fd = fopen(files[i].path, "rb");
+        if(fd == NULL) {
+            perror(files[i].path);
+            return -1;
+        }
+
+        uint64_t size = fbisend_be64(files[i].size);
+        int ret = fbisend_send_all(sock, &size, sizeof(size));
+
+        size_t n;
+        while(ret == 0 && (n = fread(buffer, 1, sizeof(buffer), fd)) > 0) {
+            ret = fbisend_send_all(sock, buffer, n);
+        }
+
+        fclose(fd);
+
+        if(ret < 0) {
+            perror("send");
+            return -1;
+        }
+
+        printf("Sent %s.\n", files[i].name);
+    }
+
+    uint8_t ack = 1;
+    fbisend_recv_all(sock, &ack, sizeof(ack), -1);
+
+    printf("Install finished.\n");
+    return 0;
+}
+
+// Sends size bytes of throwaway data over 1 up to maxStreams streams and reports the throughput of each.
+static int fbisend_benchmark(const char* host, const char* port, uint64_t size, int maxStreams) {
+    fbisend_file file;
+    memset(&file, 0, sizeof(file));
+    file.name = "benchmark";
+    file.size = size;
+
+    for(int streams = 1; streams <= maxStreams; streams++) {
+        int sock = fbisend_connect(host, port, 0);
+        if(sock < 0) {
+            return -1;
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        int ret = fbisend_send_v2(&sock, host, port, &file, 1, streams, 1);
+
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        close(sock);
+
+        if(ret <= 0) {
+            fprintf(stderr, "Benchmark over %d stream(s) failed.\n", streams);
+            return -1;
+        }
+
+        double seconds = (double) (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%d stream(s): %.2f MiB/s\n", streams, size / 1024.0 / 1024.0 / seconds);
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int v1 = 0;
+    int hashes = 1;
+    int compress = 1;
+    int streams = 0;
+    int benchmark = 0;
+    const char* port = "5000";
+
+    int opt;
+    while((opt = getopt(argc, argv, "1nus:b:p:")) != -1) {
+        switch(opt) {
+            case '1':
+                v1 = 1;
+                break;
+            case 'n':
+                hashes = 0;
+                break;
+            case 'u':
+                compress = 0;
+                break;
+            case 's':
+                streams = atoi(optarg);
+                break;
+            case 'b':
+                benchmark = atoi(optarg);
+                break;
+            case 'p':
+                port = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-1] [-n] [-u] [-s streams] [-p port] <host> <file> [file ...]\n       %s -b mib [-s streams] [-p port] <host>\n", argv[0], argv[0]);
+                return 2;
+        }
+    }
+
+    if(streams < 0 || streams > NETINSTALL_STREAMS_MAX || benchmark < 0 || (benchmark > 0 && v1)) {
+        fprintf(stderr, "Between 1 and %d streams can be used, and benchmarks need version 2\n", NETINSTALL_STREAMS_MAX);
+        return 2;
+    }
+
+    if(benchmark > 0) {
+        if(argc - optind != 1) {
+            fprintf(stderr, "Usage: %s [-1] [-n] [-u] [-s streams] [-p port] <host> <file> [file ...]\n       %s -b mib [-s streams] [-p port] <host>\n", argv[0], argv[0]);
+            return 2;
+        }
+
+        return fbisend_benchmark(argv[optind], port, (uint64_t) benchmark * 1024 * 1024, streams > 0 ? streams : NETINSTALL_STREAMS_MAX) < 0 ? 1 : 0;
+    }
+
+    if(argc - optind < 2) {
+        fprintf(stderr, "Usage: %s [-1] [-n] [-u] [-s streams] [-p port] <host> <file> [file ...]\n       %s -b mib [-s streams] [-p port] <host>\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    const char* host = argv[optind];
+    int fileCount = argc - optind - 1;
+
+    if(fileCount > NETINSTALL_FILES_MAX) {
+        fprintf(stderr, "At most %d files can be sent at once\n", NETINSTALL_FILES_MAX);
+        return 2;
+    }
+
+    fbisend_file* files = (fbisend_file*) calloc((size_t) fileCount, sizeof(fbisend_file));
+    if(files == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for(int i = 0; i < fileCount; i++) {
+        fbisend_file* file = &files[i];
+        file->path = argv[optind + 1 + i];
+
+        const char* slash = strrchr(file->path, '/');
+        file->name = slash != NULL ? slash + 1 : file->path;
+
+        struct stat st;
+        if(stat(file->path, &st) < 0 || !S_ISREG(st.st_mode)) {
+            fprintf(stderr, "%s: not a regular file\n", file->path);
+            free(files);
+            return 1;
+        }
+
+        file->size = (uint64_t) st.st_size;
+
+        if(!v1 && fbisend_scan_file(file, hashes, compress) < 0) {
+            free(files);
+            return 1;
+        }
+    }
+
+    int ret = -1;
+
+    int sock = fbisend_connect(host, port, 0);
+    if(sock >= 0) {
+        if(!v1) {
+            ret = fbisend_send_v2(&sock, host, port, files, fileCount, streams > 0 ? streams : 1, 0);
+            if(ret == 0) {
+                printf("Device did not answer the version 2 hello; retrying with version 1.\n");
+
+                close(sock);
+                sock = fbisend_connect(host, port, 0);
+            }
+        }
+
+        if(sock >= 0 && (v1 || ret == 0)) {
+            ret = fbisend_send_v1(sock, files, fileCount);
+        }
+
+        if(sock >= 0) {
+            close(sock);
+        }
+    }
+
+    free(files);
+    return ret < 0 ? 1 : 0;
+}
\ No newline at end of file
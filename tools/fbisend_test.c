@@ -0,0 +1,476 @@
+// Loopback integration test for the network install protocol (source/net/netinstall.h).
+//
+// Build: cc -O2 -o fbisend_test tools/fbisend_test.c source/hash/hash.c source/lz/lz.c source/net/net.c source/net/netinstall.c
+// Usage: fbisend_test <path to fbisend>
+//
+// Stands in for the device on 127.0.0.1 and runs fbisend against it, receiving through the same
+// source/net/netinstall.c reader the device uses. Covers version 2 installs with and without
+// compression, over several streams and resumed after a dropped connection, an install declined
+// on the device and a version 1 install. Every file received is compared with the one sent.
+
+#define _FILE_OFFSET_BITS 64
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../source/hash/hash.h"
+#include "../source/net/net.h"
+#include "../source/net/netinstall.h"
+
+#define FBISEND_TEST_TIMEOUT 10000
+#define FBISEND_TEST_TOKEN 0x0123456789ABCDEFULL
+
+// Every capability, as a current device offers.
+#define FBISEND_TEST_CAPABILITIES (NETINSTALL_CAP_LZ | NETINSTALL_CAP_RESUME | NETINSTALL_CAP_STREAMS)
+
+#define FBISEND_TEST_FILE_COUNT 3
+
+typedef struct {
+    const char* name;
+    size_t size;
+    int compressible;
+
+    uint8_t* data;
+    char path[PATH_MAX];
+} fbisend_test_file;
+
+typedef struct {
+    const char* name;
+    const char* opts[4];
+
+    int v1;
+    int reject;
+
+    // Drops stream 0 once this many bytes of the first file are in, 0 to never drop.
+    uint64_t dropAt;
+
+    // Requires at least one LZ block to arrive.
+    int expectLz;
+} fbisend_test_case;
+
+static fbisend_test_file files[FBISEND_TEST_FILE_COUNT] = {
+    {"random.cia", 1024 * 1024 + 1234, 0},
+    {"pattern.cia", 300 * 1024 + 77, 1},
+    {"empty.tik", 0, 0}
+};
+
+static const fbisend_test_case cases[] = {
+    {"v2 uncompressed", {"-u"}, 0, 0, 0, 0},
+    {"v2 compressed", {NULL}, 0, 0, 0, 1},
+    {"v2 unhashed", {"-n", "-u"}, 0, 0, 0, 0},
+    {"v2 over 3 streams", {"-s", "3"}, 0, 0, 0, 1},
+    {"v2 uncompressed over 4 streams", {"-u", "-s", "4"}, 0, 0, 0, 0},
+    {"v2 resumed", {"-u"}, 0, 0, 256 * 1024, 0},
+    {"v2 compressed, resumed", {NULL}, 0, 0, 256 * 1024, 1},
+    {"v2 declined", {NULL}, 0, 1, 0, 0},
+    {"v1", {"-1"}, 1, 0, 0, 0}
+};
+
+static int listener = -1;
+static char port[8];
+
+static int fbisend_test_recv(int sock, void* buf, size_t len) {
+    return net_recv_all(sock, buf, len, 0, FBISEND_TEST_TIMEOUT) < 0 ? -1 : 0;
+}
+
+static int fbisend_test_listen() {
+    if((listener = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t addrLen = sizeof(addr);
+    if(bind(listener, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(listener, NETINSTALL_STREAMS_MAX) < 0
+       || getsockname(listener, (struct sockaddr*) &addr, &addrLen) < 0) {
+        perror("listen");
+        return -1;
+    }
+
+    snprintf(port, sizeof(port), "%u", ntohs(addr.sin_port));
+    return 0;
+}
+
+static int fbisend_test_accept() {
+    if(net_wait(listener, POLLIN, FBISEND_TEST_TIMEOUT) <= 0) {
+        fprintf(stderr, "fbisend did not connect\n");
+        return -1;
+    }
+
+    int sock = accept(listener, NULL, NULL);
+    if(sock < 0) {
+        perror("accept");
+        return -1;
+    }
+
+    // As on the device, where the helpers only wait in poll() for non-blocking sockets.
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    return sock;
+}
+
+static int fbisend_test_make_files(const char* dir) {
+    for(int i = 0; i < FBISEND_TEST_FILE_COUNT; i++) {
+        fbisend_test_file* file = &files[i];
+
+        if((file->data = (uint8_t*) malloc(file->size + 1)) == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+
+        for(size_t j = 0; j < file->size; j++) {
+            file->data[j] = file->compressible ? (uint8_t) "FBI network install "[(j / 7) % 20] : (uint8_t) (rand() >> 7);
+        }
+
+        snprintf(file->path, sizeof(file->path), "%s/%s", dir, file->name);
+
+        FILE* fd = fopen(file->path, "wb");
+        if(fd == NULL || fwrite(file->data, 1, file->size, fd) != file->size || fclose(fd) != 0) {
+            perror(file->path);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void fbisend_test_remove_files(const char* dir) {
+    for(int i = 0; i < FBISEND_TEST_FILE_COUNT; i++) {
+        if(files[i].path[0] != '\0') {
+            remove(files[i].path);
+        }
+
+        free(files[i].data);
+    }
+
+    rmdir(dir);
+}
+
+static pid_t fbisend_test_spawn(const char* fbisend, const fbisend_test_case* tc) {
+    const char* argv[16];
+    int argc = 0;
+
+    argv[argc++] = fbisend;
+    for(int i = 0; i < 4 && tc->opts[i] != NULL; i++) {
+        argv[argc++] = tc->opts[i];
+    }
+
+    argv[argc++] = "-p";
+    argv[argc++] = port;
+    argv[argc++] = "127.0.0.1";
+
+    for(int i = 0; i < FBISEND_TEST_FILE_COUNT; i++) {
+        argv[argc++] = files[i].path;
+    }
+
+    argv[argc] = NULL;
+
+    // Buffered output would otherwise be written again by the child.
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        // Keep the sender's progress out of the test output.
+        freopen("/dev/null", "w", stdout);
+
+        execv(fbisend, (char* const*) argv);
+        perror(fbisend);
+        _exit(127);
+    } else if(pid < 0) {
+        perror("fork");
+    }
+
+    return pid;
+}
+
+// Reads a sender's hello and manifest through the device's own reader.
+static int fbisend_test_hello(int sock, netinstall_session* session) {
+    memset(session, 0, sizeof(*session));
+
+    uint32_t magic = 0;
+    if(fbisend_test_recv(sock, &magic, sizeof(magic)) < 0 || ntohl(magic) != NETINSTALL_MAGIC
+       || netinstall_read_manifest(sock, session, FBISEND_TEST_CAPABILITIES, FBISEND_TEST_TIMEOUT) < 0) {
+        return -1;
+    }
+
+    return session->version == NETINSTALL_VERSION ? 0 : -1;
+}
+
+// Answers the hello of a stream attaching to the install, or of stream 0 coming back to resume it.
+static int fbisend_test_attach(int sock, uint32_t stream) {
+    netinstall_session session;
+    if(fbisend_test_hello(sock, &session) < 0) {
+        fprintf(stderr, "Stream %" PRIu32 " did not attach\n", stream);
+        return -1;
+    }
+
+    if(!session.resume || session.stream != stream || session.token != FBISEND_TEST_TOKEN) {
+        fprintf(stderr, "Stream %" PRIu32 " attached with a bad manifest\n", stream);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int fbisend_test_check_manifest(const netinstall_session* session) {
+    if(session->resume || session->fileCount != FBISEND_TEST_FILE_COUNT) {
+        fprintf(stderr, "Manifest lists %" PRIu32 " files\n", session->fileCount);
+        return -1;
+    }
+
+    for(int i = 0; i < FBISEND_TEST_FILE_COUNT; i++) {
+        const netinstall_file* file = &session->files[i];
+
+        if(strcmp(file->name, files[i].name) != 0 || file->size != files[i].size) {
+            fprintf(stderr, "Entry %d is %s, %" PRIu64 " bytes\n", i, file->name, file->size);
+            return -1;
+        }
+
+        if((file->flags & NETINSTALL_ENTRY_HASH) && file->hash != hash64(files[i].data, (uint32_t) files[i].size)) {
+            fprintf(stderr, "Entry %d has the wrong hash\n", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int fbisend_test_receive_file(int* streams, uint32_t* streamCount, uint32_t* attached, int index, const netinstall_file* file,
+                                     const fbisend_test_case* tc, int* dropped, uint32_t* lzBlocks) {
+    static uint8_t packed[NETINSTALL_BLOCK_SIZE];
+
+    uint8_t* data = (uint8_t*) malloc(file->size + 1);
+    if(data == NULL) {
+        return -1;
+    }
+
+    int res = 0;
+
+    uint64_t pos = 0;
+    while(pos < file->size && res == 0) {
+        uint32_t n = netinstall_unit_span(pos, (uint32_t) (file->size - pos), file->flags, *streamCount);
+        int sock = streams[netinstall_unit_stream(pos, file->flags, *streamCount)];
+
+        bool compressed = false;
+        if((file->flags & NETINSTALL_ENTRY_LZ) ? netinstall_recv_block(sock, data + pos, n, packed, &compressed, FBISEND_TEST_TIMEOUT) < 0
+                                               : fbisend_test_recv(sock, data + pos, n) < 0) {
+            fprintf(stderr, "Lost file %d at %" PRIu64 "\n", index, pos);
+            res = -1;
+            break;
+        }
+
+        *lzBlocks += compressed;
+        pos += n;
+
+        if(tc->dropAt != 0 && !*dropped && index == 0 && pos >= tc->dropAt) {
+            *dropped = 1;
+
+            // Whatever the sender has queued past pos is lost with the connection.
+            for(uint32_t j = 0; j < *attached; j++) {
+                close(streams[j]);
+            }
+
+            *streamCount = 1;
+            *attached = 1;
+
+            if((streams[0] = fbisend_test_accept()) < 0 || fbisend_test_attach(streams[0], 0) < 0
+               || netinstall_send_frame(streams[0], NETINSTALL_FRAME_RESUME, (uint32_t) index, pos, FBISEND_TEST_TIMEOUT) < 0) {
+                res = -1;
+            }
+        }
+    }
+
+    if(res == 0 && memcmp(data, files[index].data, file->size) != 0) {
+        fprintf(stderr, "File %d differs\n", index);
+        res = -1;
+    }
+
+    free(data);
+    return res;
+}
+
+static int fbisend_test_receive_v2(int* sock, const fbisend_test_case* tc) {
+    netinstall_session session;
+    if(fbisend_test_hello(*sock, &session) < 0) {
+        fprintf(stderr, "Bad hello\n");
+        return -1;
+    }
+
+    int res = fbisend_test_check_manifest(&session);
+    if(res == 0 && tc->reject) {
+        res = netinstall_send_frame(*sock, NETINSTALL_FRAME_REJECT, 0, 0, FBISEND_TEST_TIMEOUT);
+
+        free(session.files);
+        return res;
+    }
+
+    if(res == 0) {
+        res = netinstall_send_frame(*sock, NETINSTALL_FRAME_ACCEPT, 0, FBISEND_TEST_TOKEN, FBISEND_TEST_TIMEOUT);
+    }
+
+    int streams[NETINSTALL_STREAMS_MAX] = {*sock};
+    uint32_t streamCount = NETINSTALL_MANIFEST_GET_STREAMS(session.flags);
+
+    uint32_t attached = 1;
+    for(; attached < streamCount && res == 0; attached++) {
+        if((streams[attached] = fbisend_test_accept()) < 0 || fbisend_test_attach(streams[attached], attached) < 0) {
+            res = -1;
+        }
+    }
+
+    int dropped = 0;
+    uint32_t lzBlocks = 0;
+
+    for(int i = 0; i < FBISEND_TEST_FILE_COUNT && res == 0; i++) {
+        res = fbisend_test_receive_file(streams, &streamCount, &attached, i, &session.files[i], tc, &dropped, &lzBlocks);
+
+        if(res == 0) {
+            res = netinstall_send_frame(streams[0], NETINSTALL_FRAME_FILE_DONE, (uint32_t) i, 0, FBISEND_TEST_TIMEOUT);
+        }
+    }
+
+    if(res == 0) {
+        res = netinstall_send_frame(streams[0], NETINSTALL_FRAME_DONE, 0, 0, FBISEND_TEST_TIMEOUT);
+    }
+
+    if(res == 0 && tc->dropAt != 0 && !dropped) {
+        fprintf(stderr, "The connection was never dropped\n");
+        res = -1;
+    }
+
+    if(res == 0 && tc->expectLz && lzBlocks == 0) {
+        fprintf(stderr, "No block was compressed\n");
+        res = -1;
+    }
+
+    for(uint32_t i = 1; i < attached; i++) {
+        close(streams[i]);
+    }
+
+    free(session.files);
+
+    *sock = streams[0];
+    return res;
+}
+
+static int fbisend_test_receive_v1(int sock) {
+    uint32_t count = 0;
+    if(fbisend_test_recv(sock, &count, sizeof(count)) < 0 || ntohl(count) != FBISEND_TEST_FILE_COUNT) {
+        fprintf(stderr, "Bad file count\n");
+        return -1;
+    }
+
+    for(int i = 0; i < FBISEND_TEST_FILE_COUNT; i++) {
+        uint64_t size = 0;
+        if(netinstall_send_ack(sock, true, FBISEND_TEST_TIMEOUT) < 0 || netinstall_recv_size(sock, &size, FBISEND_TEST_TIMEOUT) < 0
+           || size != files[i].size) {
+            fprintf(stderr, "Bad size for file %d\n", i);
+            return -1;
+        }
+
+        uint8_t* data = (uint8_t*) malloc(files[i].size + 1);
+        if(data == NULL) {
+            return -1;
+        }
+
+        int res = fbisend_test_recv(sock, data, files[i].size);
+        if(res == 0 && memcmp(data, files[i].data, files[i].size) != 0) {
+            fprintf(stderr, "File %d differs\n", i);
+            res = -1;
+        }
+
+        free(data);
+
+        if(res < 0) {
+            return -1;
+        }
+    }
+
+    return netinstall_send_ack(sock, false, FBISEND_TEST_TIMEOUT);
+}
+
+static int fbisend_test_run(const char* fbisend, const fbisend_test_case* tc) {
+    pid_t pid = fbisend_test_spawn(fbisend, tc);
+    if(pid < 0) {
+        return -1;
+    }
+
+    int res = -1;
+
+    int sock = fbisend_test_accept();
+    if(sock >= 0) {
+        res = tc->v1 ? fbisend_test_receive_v1(sock) : fbisend_test_receive_v2(&sock, tc);
+
+        // Let the sender read the last frame before the connection goes.
+        uint8_t rest = 0;
+        while(res == 0 && net_recv_all(sock, &rest, sizeof(rest), 0, FBISEND_TEST_TIMEOUT) > 0);
+
+        close(sock);
+    }
+
+    if(res < 0) {
+        kill(pid, SIGKILL);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    int expected = tc->reject ? 1 : 0;
+    if(res == 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != expected)) {
+        fprintf(stderr, "fbisend exited with status %d instead of %d\n", WIFEXITED(status) ? WEXITSTATUS(status) : -1, expected);
+        res = -1;
+    }
+
+    return res;
+}
+
+int main(int argc, char** argv) {
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s <path to fbisend>\n", argv[0]);
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    srand(1);
+
+    char dir[] = "/tmp/fbisend_test.XXXXXX";
+    if(mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    int failed = 0;
+
+    if(fbisend_test_listen() < 0 || fbisend_test_make_files(dir) < 0) {
+        failed = 1;
+    } else {
+        for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            int res = fbisend_test_run(argv[1], &cases[i]);
+            printf("%s: %s\n", res == 0 ? "PASS" : "FAIL", cases[i].name);
+
+            failed |= res != 0;
+        }
+    }
+
+    if(listener >= 0) {
+        close(listener);
+    }
+
+    fbisend_test_remove_files(dir);
+    return failed;
+}
\ No newline at end of file
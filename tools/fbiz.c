@@ -0,0 +1,142 @@
+// Verifies and unpacks compressed NAND images (NAND.bin.fbz) written by FBI's Dump NAND (Compressed).
+//
+// Build: cc -O2 -o fbiz tools/fbiz.c source/lz/lz.c
+// Usage: fbiz <image.fbz> [output.bin]
+//
+// Every block is decompressed and checked against its index checksum. If an output path is given,
+// the raw NAND image is written there as well.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../source/lz/lz.h"
+
+#define FBIZ_MAGIC 0x5A494246 // "FBIZ"
+#define FBIZ_VERSION 1
+
+#define FBIZ_BLOCK_COMPRESSED 0x1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t blockCount;
+    uint64_t imageSize;
+    uint64_t indexOffset;
+} fbiz_header;
+
+typedef struct {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t flags;
+    uint32_t checksum;
+    uint32_t reserved;
+} fbiz_block;
+
+static uint32_t fbiz_checksum(const uint8_t* data, uint32_t size) {
+    uint32_t hash = 0x811C9DC5;
+    for(uint32_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x01000193;
+    }
+
+    return hash;
+}
+
+static int fbiz_read_at(FILE* fd, uint64_t offset, void* buffer, size_t size) {
+    return fseeko(fd, (off_t) offset, SEEK_SET) == 0 && fread(buffer, 1, size, fd) == size ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <image.fbz> [output.bin]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if(in == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fbiz_header header;
+    if(fbiz_read_at(in, 0, &header, sizeof(header)) < 0 || header.magic != FBIZ_MAGIC) {
+        fprintf(stderr, "%s: not a compressed NAND image\n", argv[1]);
+        return 1;
+    }
+
+    if(header.version != FBIZ_VERSION || header.indexOffset == 0 || header.blockSize == 0
+       || header.blockCount != (header.imageSize + header.blockSize - 1) / header.blockSize) {
+        fprintf(stderr, "%s: unsupported or incomplete image\n", argv[1]);
+        return 1;
+    }
+
+    fbiz_block* blocks = (fbiz_block*) calloc(header.blockCount, sizeof(fbiz_block));
+    uint8_t* stored = (uint8_t*) malloc(header.blockSize);
+    uint8_t* raw = (uint8_t*) malloc(header.blockSize);
+    if(blocks == NULL || stored == NULL || raw == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if(fbiz_read_at(in, header.indexOffset, blocks, header.blockCount * sizeof(fbiz_block)) < 0) {
+        fprintf(stderr, "%s: failed to read block index\n", argv[1]);
+        return 1;
+    }
+
+    FILE* out = NULL;
+    if(argc > 2 && (out = fopen(argv[2], "wb")) == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    uint64_t storedTotal = 0;
+    uint32_t failed = 0;
+
+    for(uint32_t i = 0; i < header.blockCount; i++) {
+        fbiz_block* block = &blocks[i];
+
+        uint64_t remaining = header.imageSize - (uint64_t) i * header.blockSize;
+        uint32_t rawSize = remaining < header.blockSize ? (uint32_t) remaining : header.blockSize;
+
+        int32_t size = -1;
+        if(block->size <= header.blockSize && fbiz_read_at(in, block->offset, stored, block->size) == 0) {
+            if(block->flags & FBIZ_BLOCK_COMPRESSED) {
+                size = lz_decompress(stored, block->size, raw, header.blockSize);
+            } else {
+                memcpy(raw, stored, block->size);
+                size = (int32_t) block->size;
+            }
+        }
+
+        if(size != (int32_t) rawSize || fbiz_checksum(raw, rawSize) != block->checksum) {
+            fprintf(stderr, "Block %" PRIu32 " at 0x%" PRIX64 ": corrupt\n", i, (uint64_t) i * header.blockSize);
+
+            // Keep the output aligned to NAND offsets.
+            memset(raw, 0, rawSize);
+            failed++;
+        }
+
+        if(out != NULL && fwrite(raw, 1, rawSize, out) != rawSize) {
+            perror(argv[2]);
+            return 1;
+        }
+
+        storedTotal += block->size;
+    }
+
+    printf("%" PRIu32 " blocks, %" PRIu64 " bytes stored as %" PRIu64 " (%.1f%%), %" PRIu32 " corrupt\n",
+           header.blockCount, header.imageSize, storedTotal, header.imageSize > 0 ? storedTotal * 100.0 / header.imageSize : 0, failed);
+
+    if(out != NULL) {
+        fclose(out);
+    }
+
+    fclose(in);
+    free(raw);
+    free(stored);
+    free(blocks);
+
+    return failed > 0 ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,731 @@
+// Loopback test for the HTTP client (source/net/httpclient.h).
+//
+// Build: cc -O2 -o httpclient_test tools/httpclient_test.c source/net/httpclient.c source/net/httpd.c source/net/net.c source/net/netconfig.c
+// Usage: httpclient_test
+//
+// Runs a small HTTP/1.1 server on 127.0.0.1 whose responses name the connection they came over,
+// the request's place on it and its path. Checks that a pool reuses a kept-alive connection, that
+// pipelined responses are matched to their requests in order, and that requests are sent again
+// on a new connection when the server closes the one they were sent or pipelined on. Range
+// requests are checked against servers that honour the range, ignore it, answer from the wrong
+// offset or don't say where the answer starts, along with resuming a download that broke off
+// through httpclient_resume.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../source/net/httpclient.h"
+#include "../source/net/httpd.h"
+#include "../source/net/net.h"
+
+#define HTTPCLIENT_TEST_TIMEOUT 5000
+
+// Requests whose path contains this have their connection closed right after the response, which
+// still claims to keep it alive, as a server dropping an idle connection would.
+#define HTTPCLIENT_TEST_CLOSE "close"
+// Requests whose path starts with this are answered with a chunked body.
+#define HTTPCLIENT_TEST_CHUNKED "/chunked"
+
+// Requests for these paths are answered with the test file. The first honours ranges, the second
+// ignores them, the third answers them from one byte further on and the fourth leaves out the
+// Content-Range header. The last sends half the file and closes the connection unless a range is
+// asked for.
+#define HTTPCLIENT_TEST_RANGE "/range"
+#define HTTPCLIENT_TEST_NO_RANGE "/norange"
+#define HTTPCLIENT_TEST_BAD_RANGE "/badrange"
+#define HTTPCLIENT_TEST_UNNAMED_RANGE "/unnamedrange"
+#define HTTPCLIENT_TEST_TRUNCATED "/truncated"
+
+#define HTTPCLIENT_TEST_FILE_SIZE (256 * 1024 + 123)
+
+typedef struct {
+    char path[HTTPD_PATH_MAX];
+    bool keepAlive;
+
+    bool hasRange;
+    uint64_t rangeStart;
+} httpclient_test_request;
+
+typedef struct {
+    const char* path;
+    uint32_t conn;
+    uint32_t seq;
+    bool reused;
+} httpclient_test_response;
+
+static int listener = -1;
+static uint16_t port = 0;
+
+static uint8_t file[HTTPCLIENT_TEST_FILE_SIZE];
+
+static int httpclient_test_listen() {
+    if((listener = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t addrLen = sizeof(addr);
+    if(bind(listener, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(listener, HTTPCLIENT_POOL_MAX) < 0
+       || getsockname(listener, (struct sockaddr*) &addr, &addrLen) < 0) {
+        perror("listen");
+        return -1;
+    }
+
+    port = ntohs(addr.sin_port);
+    return 0;
+}
+
+// Parses a request with the same head reader the client uses, which leaves the Range header to
+// the caller.
+static int httpclient_test_read_request(int sock, httpclient_test_request* request) {
+    char head[HTTPD_HEAD_MAX];
+    if(httpd_read_head(sock, head, sizeof(head), 0, HTTPCLIENT_TEST_TIMEOUT) < 0) {
+        return -1;
+    }
+
+    char* pos = head;
+    char* line = httpd_next_line(&pos);
+
+    char method[8];
+    if(sscanf(line, "%7s %255s HTTP/1.1", method, request->path) != 2) {
+        return -1;
+    }
+
+    request->keepAlive = true;
+    request->hasRange = false;
+
+    while((line = httpd_next_line(&pos)) != NULL && *line != '\0') {
+        char* name = NULL;
+        char* value = NULL;
+        if(httpd_split_header(line, &name, &value) < 0) {
+            return -1;
+        }
+
+        if(strcasecmp(name, "Connection") == 0 && strcasecmp(value, "close") == 0) {
+            request->keepAlive = false;
+        } else if(strcasecmp(name, "Range") == 0 && sscanf(value, "bytes=%" SCNu64 "-", &request->rangeStart) == 1) {
+            request->hasRange = true;
+        }
+    }
+
+    return 0;
+}
+
+static bool httpclient_test_has_prefix(const char* path, const char* prefix) {
+    return strncmp(path, prefix, strlen(prefix)) == 0;
+}
+
+// Sends the test file, or the range of it asked for. Returns 1 if the connection is to be closed
+// after.
+static int httpclient_test_respond_file(int sock, const httpclient_test_request* request) {
+    uint64_t start = 0;
+    if(request->hasRange && !httpclient_test_has_prefix(request->path, HTTPCLIENT_TEST_NO_RANGE)) {
+        start = request->rangeStart + (httpclient_test_has_prefix(request->path, HTTPCLIENT_TEST_BAD_RANGE) ? 1 : 0);
+    }
+
+    uint64_t len = HTTPCLIENT_TEST_FILE_SIZE - start;
+
+    char head[256];
+    int headLen = 0;
+    if(start > 0 && httpclient_test_has_prefix(request->path, HTTPCLIENT_TEST_UNNAMED_RANGE)) {
+        headLen = snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\nContent-Length: %" PRIu64 "\r\n\r\n", len);
+    } else if(start > 0) {
+        headLen = snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %" PRIu64 "-%d/%d\r\nContent-Length: %" PRIu64 "\r\n\r\n",
+                           start, HTTPCLIENT_TEST_FILE_SIZE - 1, HTTPCLIENT_TEST_FILE_SIZE, len);
+    } else {
+        headLen = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %" PRIu64 "\r\n\r\n", len);
+    }
+
+    bool truncate = !request->hasRange && httpclient_test_has_prefix(request->path, HTTPCLIENT_TEST_TRUNCATED);
+    if(truncate) {
+        len /= 2;
+    }
+
+    if(net_send_all(sock, head, (size_t) headLen, MSG_NOSIGNAL, HTTPCLIENT_TEST_TIMEOUT) < 0
+       || net_send_all(sock, file + start, (size_t) len, MSG_NOSIGNAL, HTTPCLIENT_TEST_TIMEOUT) < 0) {
+        return -1;
+    }
+
+    return truncate ? 1 : 0;
+}
+
+// Returns 1 if the connection is to be closed after.
+static int httpclient_test_respond(int sock, uint32_t conn, uint32_t seq, const httpclient_test_request* request) {
+    if(httpclient_test_has_prefix(request->path, HTTPCLIENT_TEST_RANGE) || httpclient_test_has_prefix(request->path, HTTPCLIENT_TEST_NO_RANGE)
+       || httpclient_test_has_prefix(request->path, HTTPCLIENT_TEST_BAD_RANGE) || httpclient_test_has_prefix(request->path, HTTPCLIENT_TEST_UNNAMED_RANGE)
+       || httpclient_test_has_prefix(request->path, HTTPCLIENT_TEST_TRUNCATED)) {
+        return httpclient_test_respond_file(sock, request);
+    }
+
+    char body[HTTPD_PATH_MAX + 64];
+    int bodyLen = snprintf(body, sizeof(body), "conn=%" PRIu32 " seq=%" PRIu32 " path=%s", conn, seq, request->path);
+
+    char response[HTTPD_PATH_MAX + 256];
+    int len = 0;
+    if(httpclient_test_has_prefix(request->path, HTTPCLIENT_TEST_CHUNKED)) {
+        // Split in two chunks, so the client has to cross a chunk boundary.
+        int half = bodyLen / 2;
+        len = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n%x\r\n%.*s\r\n%x;ext=1\r\n%s\r\n0\r\n\r\n",
+                       half, half, body, bodyLen - half, body + half);
+    } else {
+        len = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s", bodyLen, body);
+    }
+
+    if(net_send_all(sock, response, (size_t) len, MSG_NOSIGNAL, HTTPCLIENT_TEST_TIMEOUT) < 0) {
+        return -1;
+    }
+
+    return strstr(request->path, HTTPCLIENT_TEST_CLOSE) != NULL ? 1 : 0;
+}
+
+static void httpclient_test_serve_conn(int sock, uint32_t conn) {
+    for(uint32_t seq = 1; ; seq++) {
+        httpclient_test_request request;
+        if(httpclient_test_read_request(sock, &request) < 0 || httpclient_test_respond(sock, conn, seq, &request) != 0 || !request.keepAlive) {
+            return;
+        }
+    }
+}
+
+// Serves every connection in a process of its own, so ones the pool keeps idle don't hold up the
+// rest.
+static pid_t httpclient_test_spawn_server() {
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    if(pid == 0) {
+        signal(SIGCHLD, SIG_IGN);
+
+        for(uint32_t conn = 1; ; conn++) {
+            int sock = accept(listener, NULL, NULL);
+            if(sock < 0) {
+                _exit(1);
+            }
+
+            if(fork() == 0) {
+                close(listener);
+
+                // As on the device, where the helpers only wait in poll() for non-blocking sockets.
+                fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+                httpclient_test_serve_conn(sock, conn);
+                _exit(0);
+            }
+
+            close(sock);
+        }
+    }
+
+    return pid;
+}
+
+static int httpclient_test_send(httpclient_pool* pool, const httpclient_request* prev, const char* path, httpclient_request* request) {
+    char url[HTTPCLIENT_PATH_MAX];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u%s", port, path);
+
+    int ret = prev != NULL ? httpclient_send_after(pool, prev, "GET", url, request, HTTPCLIENT_TEST_TIMEOUT)
+                           : httpclient_send(pool, "GET", url, request, HTTPCLIENT_TEST_TIMEOUT);
+    if(ret < 0) {
+        fprintf(stderr, "sending %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+// Reads the response to request and checks that it answers path.
+static int httpclient_test_read(httpclient_request* request, const char* path, httpclient_test_response* response) {
+    if(httpclient_read_head(request, HTTPCLIENT_TEST_TIMEOUT) < 0) {
+        fprintf(stderr, "reading the head for %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char body[HTTPD_PATH_MAX + 64];
+    size_t received = 0;
+    if(httpclient_read(request, body, sizeof(body) - 1, HTTPCLIENT_TEST_TIMEOUT, &received) < 0) {
+        fprintf(stderr, "reading the body for %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    body[received] = '\0';
+
+    response->reused = request->reused;
+    httpclient_finish(request, HTTPCLIENT_TEST_TIMEOUT);
+
+    char bodyPath[HTTPD_PATH_MAX];
+    if(request->status != 200 || sscanf(body, "conn=%" SCNu32 " seq=%" SCNu32 " path=%255s", &response->conn, &response->seq, bodyPath) != 3
+       || strcmp(bodyPath, path) != 0) {
+        fprintf(stderr, "expected the response to %s, got %d: %s\n", path, request->status, body);
+        return -1;
+    }
+
+    response->path = path;
+    return 0;
+}
+
+static int httpclient_test_expect(const httpclient_test_response* response, uint32_t conn, uint32_t seq) {
+    if(response->conn != conn || response->seq != seq) {
+        fprintf(stderr, "expected %s as request %" PRIu32 " on connection %" PRIu32 ", got request %" PRIu32 " on connection %" PRIu32 "\n",
+                response->path, seq, conn, response->seq, response->conn);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int httpclient_test_keep_alive(httpclient_pool* pool) {
+    static const char* paths[] = {"/a.tmd", HTTPCLIENT_TEST_CHUNKED "/b", "/c.app"};
+
+    httpclient_test_response first;
+    for(uint32_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        httpclient_request request;
+        httpclient_test_response response;
+        if(httpclient_test_send(pool, NULL, paths[i], &request) < 0 || httpclient_test_read(&request, paths[i], &response) < 0) {
+            return -1;
+        }
+
+        if(i == 0) {
+            first = response;
+        }
+
+        if(httpclient_test_expect(&response, first.conn, i + 1) < 0) {
+            return -1;
+        }
+
+        if(response.reused != (i > 0)) {
+            fprintf(stderr, "%s was%s sent on a reused connection\n", paths[i], response.reused ? "" : " not");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int httpclient_test_pipelining(httpclient_pool* pool) {
+    static const char* paths[] = {"/p1", HTTPCLIENT_TEST_CHUNKED "/p2", "/p3", "/p4"};
+    static const uint32_t count = sizeof(paths) / sizeof(paths[0]);
+
+    httpclient_request requests[sizeof(paths) / sizeof(paths[0])];
+    for(uint32_t i = 0; i < count; i++) {
+        if(httpclient_test_send(pool, i > 0 ? &requests[i - 1] : NULL, paths[i], &requests[i]) < 0) {
+            return -1;
+        }
+
+        if(requests[i].conn != requests[0].conn) {
+            fprintf(stderr, "%s was not pipelined behind %s\n", paths[i], paths[0]);
+            return -1;
+        }
+    }
+
+    // Responses must be read in order.
+    if(httpclient_read_head(&requests[count - 1], HTTPCLIENT_TEST_TIMEOUT) == 0 || errno != EINVAL) {
+        fprintf(stderr, "read the response to %s ahead of the others\n", paths[count - 1]);
+        return -1;
+    }
+
+    httpclient_test_response first;
+    for(uint32_t i = 0; i < count; i++) {
+        httpclient_test_response response;
+        if(httpclient_test_read(&requests[i], paths[i], &response) < 0) {
+            return -1;
+        }
+
+        if(i == 0) {
+            first = response;
+        }
+
+        if(httpclient_test_expect(&response, first.conn, first.seq + i) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int httpclient_test_resend(httpclient_pool* pool) {
+    static const char* closing = "/" HTTPCLIENT_TEST_CLOSE;
+    static const char* after = "/after";
+
+    httpclient_request request;
+    httpclient_test_response closed;
+    if(httpclient_test_send(pool, NULL, closing, &request) < 0 || httpclient_test_read(&request, closing, &closed) < 0) {
+        return -1;
+    }
+
+    // The pool still holds the connection the server closed, and tries it first.
+    httpclient_test_response response;
+    if(httpclient_test_send(pool, NULL, after, &request) < 0 || httpclient_test_read(&request, after, &response) < 0) {
+        return -1;
+    }
+
+    if(response.conn == closed.conn) {
+        fprintf(stderr, "%s was answered on the closed connection\n", after);
+        return -1;
+    }
+
+    return httpclient_test_expect(&response, response.conn, 1);
+}
+
+static int httpclient_test_pipelined_resend(httpclient_pool* pool) {
+    static const char* paths[] = {"/q1-" HTTPCLIENT_TEST_CLOSE, HTTPCLIENT_TEST_CHUNKED "/q2", "/q3"};
+    static const uint32_t count = sizeof(paths) / sizeof(paths[0]);
+
+    httpclient_request requests[sizeof(paths) / sizeof(paths[0])];
+    for(uint32_t i = 0; i < count; i++) {
+        if(httpclient_test_send(pool, i > 0 ? &requests[i - 1] : NULL, paths[i], &requests[i]) < 0) {
+            return -1;
+        }
+    }
+
+    // The server answers the first and closes the connection on the rest, which must come back on
+    // a new one, still in order.
+    httpclient_test_response responses[sizeof(paths) / sizeof(paths[0])];
+    for(uint32_t i = 0; i < count; i++) {
+        if(httpclient_test_read(&requests[i], paths[i], &responses[i]) < 0) {
+            return -1;
+        }
+    }
+
+    if(responses[1].conn == responses[0].conn) {
+        fprintf(stderr, "%s was answered on the closed connection\n", paths[1]);
+        return -1;
+    }
+
+    for(uint32_t i = 1; i < count; i++) {
+        if(httpclient_test_expect(&responses[i], responses[1].conn, i) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void httpclient_test_url(const char* path, char* url) {
+    snprintf(url, HTTPCLIENT_PATH_MAX, "http://127.0.0.1:%u%s", port, path);
+}
+
+// Reads the rest of the body into buf, which holds the file from offset on, and compares it with
+// the file. Stops at the first error, leaving offset at the end of what arrived.
+static int httpclient_test_read_file(httpclient_request* request, uint8_t* buf, uint64_t* offset) {
+    while(*offset < HTTPCLIENT_TEST_FILE_SIZE) {
+        size_t size = HTTPCLIENT_TEST_FILE_SIZE - *offset;
+        if(size > 0x4000) {
+            size = 0x4000;
+        }
+
+        size_t received = 0;
+        int ret = httpclient_read(request, buf + *offset, size, HTTPCLIENT_TEST_TIMEOUT, &received);
+
+        *offset += received;
+
+        if(ret < 0) {
+            return -1;
+        }
+
+        if(received < size) {
+            break;
+        }
+    }
+
+    if(*offset != HTTPCLIENT_TEST_FILE_SIZE || memcmp(buf, file, HTTPCLIENT_TEST_FILE_SIZE) != 0) {
+        fprintf(stderr, "the body read does not match the file\n");
+        errno = EBADMSG;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Fetches path from offset on, with the start of the file already in place.
+static int httpclient_test_fetch_range(httpclient_pool* pool, const char* path, uint64_t offset, int status) {
+    static uint8_t buf[HTTPCLIENT_TEST_FILE_SIZE];
+    memcpy(buf, file, offset);
+
+    char url[HTTPCLIENT_PATH_MAX];
+    httpclient_test_url(path, url);
+
+    httpclient_request request;
+    if(httpclient_send_range(pool, url, offset, &request, HTTPCLIENT_TEST_TIMEOUT) < 0 || httpclient_read_head(&request, HTTPCLIENT_TEST_TIMEOUT) < 0) {
+        fprintf(stderr, "requesting %s from %" PRIu64 ": %s\n", path, offset, strerror(errno));
+        return -1;
+    }
+
+    int res = 0;
+    if(request.status != status || !request.hasLength || request.contentLength != HTTPCLIENT_TEST_FILE_SIZE - offset) {
+        fprintf(stderr, "expected %d with %" PRIu64 " bytes for %s, got %d with %" PRIu64 "\n", status, HTTPCLIENT_TEST_FILE_SIZE - offset, path,
+                request.status, request.contentLength);
+        res = -1;
+    } else {
+        res = httpclient_test_read_file(&request, buf, &offset);
+    }
+
+    httpclient_finish(&request, HTTPCLIENT_TEST_TIMEOUT);
+    return res;
+}
+
+static int httpclient_test_range(httpclient_pool* pool) {
+    return httpclient_test_fetch_range(pool, HTTPCLIENT_TEST_RANGE, 12345, 206);
+}
+
+static int httpclient_test_range_ignored(httpclient_pool* pool) {
+    // The start of the whole body is skipped.
+    return httpclient_test_fetch_range(pool, HTTPCLIENT_TEST_NO_RANGE, 12345, 200);
+}
+
+// Checks that a partial response to a range request on path is turned away.
+static int httpclient_test_reject_range(httpclient_pool* pool, const char* path, const char* what) {
+    char url[HTTPCLIENT_PATH_MAX];
+    httpclient_test_url(path, url);
+
+    httpclient_request request;
+    if(httpclient_send_range(pool, url, 12345, &request, HTTPCLIENT_TEST_TIMEOUT) < 0) {
+        perror("send");
+        return -1;
+    }
+
+    int ret = httpclient_read_head(&request, HTTPCLIENT_TEST_TIMEOUT);
+    int err = errno;
+    httpclient_finish(&request, HTTPCLIENT_TEST_TIMEOUT);
+
+    if(ret == 0 || err != EBADMSG) {
+        fprintf(stderr, "a range %s was %s\n", what, ret == 0 ? "accepted" : strerror(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int httpclient_test_range_mismatched(httpclient_pool* pool) {
+    return httpclient_test_reject_range(pool, HTTPCLIENT_TEST_BAD_RANGE, "answered from the wrong offset");
+}
+
+static int httpclient_test_range_unnamed(httpclient_pool* pool) {
+    return httpclient_test_reject_range(pool, HTTPCLIENT_TEST_UNNAMED_RANGE, "answered without a Content-Range");
+}
+
+typedef struct {
+    httpclient_pool* pool;
+    const char* url;
+    httpclient_request request;
+    uint64_t offset;
+
+    // Fails every reopen with this errno instead, if set.
+    int fail;
+    bool cancel;
+
+    uint32_t waits;
+    uint32_t waited;
+    uint32_t reopens;
+} httpclient_test_download;
+
+// Records the wait instead of sleeping through it.
+static bool httpclient_test_download_wait(void* arg, uint32_t ms) {
+    httpclient_test_download* download = (httpclient_test_download*) arg;
+
+    download->waits++;
+    download->waited += ms;
+
+    return !download->cancel;
+}
+
+// Reopens the download the way qrinstall and installcdn do.
+static int httpclient_test_download_reopen(void* arg) {
+    httpclient_test_download* download = (httpclient_test_download*) arg;
+
+    download->reopens++;
+
+    if(download->fail != 0) {
+        errno = download->fail;
+        return -1;
+    }
+
+    if(httpclient_send_range(download->pool, download->url, download->offset, &download->request, HTTPCLIENT_TEST_TIMEOUT) < 0) {
+        return -1;
+    }
+
+    if(httpclient_read_head(&download->request, HTTPCLIENT_TEST_TIMEOUT) < 0 || download->request.contentLength != HTTPCLIENT_TEST_FILE_SIZE - download->offset) {
+        int err = download->request.headRead ? EBADMSG : errno;
+        httpclient_finish(&download->request, HTTPCLIENT_TEST_TIMEOUT);
+
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int httpclient_test_resume(httpclient_pool* pool) {
+    static uint8_t buf[HTTPCLIENT_TEST_FILE_SIZE];
+
+    char url[HTTPCLIENT_PATH_MAX];
+    httpclient_test_url(HTTPCLIENT_TEST_TRUNCATED, url);
+
+    httpclient_test_download download;
+    memset(&download, 0, sizeof(download));
+    download.pool = pool;
+    download.url = url;
+
+    if(httpclient_send(pool, "GET", url, &download.request, HTTPCLIENT_TEST_TIMEOUT) < 0 || httpclient_read_head(&download.request, HTTPCLIENT_TEST_TIMEOUT) < 0) {
+        perror("request");
+        return -1;
+    }
+
+    int ret = httpclient_test_read_file(&download.request, buf, &download.offset);
+    httpclient_finish(&download.request, HTTPCLIENT_TEST_TIMEOUT);
+
+    if(ret == 0 || download.offset == 0) {
+        fprintf(stderr, "the download did not break off partway\n");
+        return -1;
+    }
+
+    httpclient_retry retry;
+    memset(&retry, 0, sizeof(retry));
+
+    if(httpclient_resume(&retry, download.offset, httpclient_test_download_wait, httpclient_test_download_reopen, &download) < 0) {
+        perror("resume");
+        return -1;
+    }
+
+    ret = httpclient_test_read_file(&download.request, buf, &download.offset);
+    httpclient_finish(&download.request, HTTPCLIENT_TEST_TIMEOUT);
+
+    if(ret < 0 || download.request.status != 206 || download.waits != 1 || download.waited != HTTPCLIENT_RESUME_DELAY) {
+        fprintf(stderr, "resumed with %d after %" PRIu32 " wait(s) of %" PRIu32 " ms in all\n", download.request.status, download.waits, download.waited);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int httpclient_test_resume_attempts(httpclient_pool* pool) {
+    httpclient_test_download download;
+    memset(&download, 0, sizeof(download));
+    download.fail = EHOSTUNREACH;
+
+    httpclient_retry retry;
+    memset(&retry, 0, sizeof(retry));
+
+    // Each wait doubles, until the attempts run out with the last attempt's error.
+    uint32_t waited = (HTTPCLIENT_RESUME_DELAY << HTTPCLIENT_RESUME_ATTEMPTS) - HTTPCLIENT_RESUME_DELAY;
+    if(httpclient_resume(&retry, 1000, httpclient_test_download_wait, httpclient_test_download_reopen, &download) == 0 || errno != EHOSTUNREACH
+       || download.reopens != HTTPCLIENT_RESUME_ATTEMPTS || download.waited != waited) {
+        fprintf(stderr, "gave up after %" PRIu32 " attempt(s) and %" PRIu32 " ms: %s\n", download.reopens, download.waited, strerror(errno));
+        return -1;
+    }
+
+    // None are left for the same offset.
+    errno = EIO;
+    if(httpclient_resume(&retry, 1000, httpclient_test_download_wait, httpclient_test_download_reopen, &download) == 0 || errno != EIO
+       || download.reopens != HTTPCLIENT_RESUME_ATTEMPTS) {
+        fprintf(stderr, "tried again without progress\n");
+        return -1;
+    }
+
+    // Progress starts them over.
+    if(httpclient_resume(&retry, 2000, httpclient_test_download_wait, httpclient_test_download_reopen, &download) == 0
+       || download.reopens != HTTPCLIENT_RESUME_ATTEMPTS * 2) {
+        fprintf(stderr, "did not start over after progress\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int httpclient_test_resume_cancelled(httpclient_pool* pool) {
+    httpclient_test_download download;
+    memset(&download, 0, sizeof(download));
+    download.cancel = true;
+
+    httpclient_retry retry;
+    memset(&retry, 0, sizeof(retry));
+
+    if(httpclient_resume(&retry, 1000, httpclient_test_download_wait, httpclient_test_download_reopen, &download) == 0 || errno != ECANCELED
+       || download.reopens != 0) {
+        fprintf(stderr, "a cancelled wait was followed by %" PRIu32 " attempt(s)\n", download.reopens);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if(argc != 1) {
+        fprintf(stderr, "Usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    for(uint32_t i = 0; i < HTTPCLIENT_TEST_FILE_SIZE; i++) {
+        file[i] = (uint8_t) (i * 31 + (i >> 8));
+    }
+
+    int failed = 0;
+
+    pid_t server = -1;
+    if(httpclient_test_listen() < 0 || (server = httpclient_test_spawn_server()) < 0) {
+        failed = 1;
+    } else {
+        static const struct {
+            const char* name;
+            int (*run)(httpclient_pool* pool);
+        } cases[] = {
+            {"keep-alive reuse", httpclient_test_keep_alive},
+            {"pipelined responses in order", httpclient_test_pipelining},
+            {"resent after the server closed", httpclient_test_resend},
+            {"pipelined requests resent after the server closed", httpclient_test_pipelined_resend},
+            {"range honoured", httpclient_test_range},
+            {"range ignored", httpclient_test_range_ignored},
+            {"range answered from the wrong offset", httpclient_test_range_mismatched},
+            {"range answered without a Content-Range", httpclient_test_range_unnamed},
+            {"download resumed after breaking off", httpclient_test_resume},
+            {"resume attempts back off and start over", httpclient_test_resume_attempts},
+            {"resume cancelled while waiting", httpclient_test_resume_cancelled}
+        };
+
+        for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            httpclient_pool pool;
+            httpclient_pool_init(&pool);
+
+            int res = cases[i].run(&pool);
+            printf("%s: %s\n", res == 0 ? "PASS" : "FAIL", cases[i].name);
+
+            httpclient_pool_close(&pool);
+
+            failed |= res != 0;
+        }
+    }
+
+    if(server > 0) {
+        kill(server, SIGKILL);
+        waitpid(server, NULL, 0);
+    }
+
+    if(listener >= 0) {
+        close(listener);
+    }
+
+    return failed;
+}
\ No newline at end of file
@@ -0,0 +1,465 @@
+// Loopback test for the HTTP upload server (source/net/httpd.h).
+//
+// Build: cc -O2 -o httpd_test tools/httpd_test.c source/net/httpd.c source/net/net.c source/hash/hash.c
+// Usage: httpd_test [path to curl]
+//
+// Serves uploads on 127.0.0.1 the way the network install listener does, and pushes files at it
+// with curl: with Content-Length, chunked, after Expect: 100-continue and several over one kept-alive
+// connection. Raw requests then check that the whole head has to arrive within one timeout, that
+// oversized heads are turned away, and that chunk sizes other than bare hex digits are refused.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../source/hash/hash.h"
+#include "../source/net/httpd.h"
+#include "../source/net/net.h"
+
+// Short enough for the slow head case to run past it, long enough for curl to keep up.
+#define HTTPD_TEST_HEAD_TIMEOUT 1000
+#define HTTPD_TEST_TIMEOUT 10000
+
+typedef struct {
+    const char* name;
+    size_t size;
+
+    uint8_t* data;
+    char path[PATH_MAX];
+} httpd_test_file;
+
+static httpd_test_file files[] = {
+    {"large.cia", 2 * 1024 * 1024 + 321},
+    {"small.tik", 2468}
+};
+
+static int listener = -1;
+static uint16_t port = 0;
+
+static int httpd_test_listen() {
+    if((listener = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t addrLen = sizeof(addr);
+    if(bind(listener, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(listener, 4) < 0
+       || getsockname(listener, (struct sockaddr*) &addr, &addrLen) < 0) {
+        perror("listen");
+        return -1;
+    }
+
+    port = ntohs(addr.sin_port);
+    return 0;
+}
+
+// Answers requests on one connection until it closes, as task_listen_network_read_http does.
+static void httpd_test_serve_conn(int sock) {
+    for(uint32_t seq = 1; ; seq++) {
+        char first[4];
+        if(net_recv_all(sock, first, sizeof(first), 0, HTTPD_TEST_TIMEOUT) < 0 || !httpd_is_request(first)) {
+            return;
+        }
+
+        httpd_request request;
+        if(httpd_read_request(sock, first, sizeof(first), &request, HTTPD_TEST_HEAD_TIMEOUT) < 0) {
+            if(errno == EMSGSIZE) {
+                httpd_send_json(sock, 431, "Request Header Fields Too Large", NULL, "{\"status\":\"error\"}", false, HTTPD_TEST_TIMEOUT);
+            } else if(errno == EBADMSG) {
+                httpd_send_json(sock, 400, "Bad Request", NULL, "{\"status\":\"error\"}", false, HTTPD_TEST_TIMEOUT);
+            }
+
+            return;
+        }
+
+        if(request.expectContinue && httpd_send_continue(sock, HTTPD_TEST_TIMEOUT) < 0) {
+            return;
+        }
+
+        httpd_body body;
+        httpd_body_init(&body, &request);
+
+        hash64_ctx hash;
+        hash64_init(&hash);
+
+        uint64_t size = 0;
+
+        static uint8_t buf[0x10000];
+        size_t received = 0;
+        do {
+            if(httpd_body_read_some(sock, &body, buf, sizeof(buf), HTTPD_TEST_TIMEOUT, &received) < 0) {
+                if(errno == EBADMSG) {
+                    httpd_send_json(sock, 400, "Bad Request", NULL, "{\"status\":\"error\"}", false, HTTPD_TEST_TIMEOUT);
+                }
+
+                return;
+            }
+
+            hash64_update(&hash, buf, (uint32_t) received);
+            size += received;
+        } while(received == sizeof(buf));
+
+        if(httpd_body_finish(sock, &body, HTTPD_TEST_TIMEOUT) < 0) {
+            if(errno == EBADMSG) {
+                httpd_send_json(sock, 400, "Bad Request", NULL, "{\"status\":\"error\"}", false, HTTPD_TEST_TIMEOUT);
+            }
+
+            return;
+        }
+
+        char json[160];
+        snprintf(json, sizeof(json), "{\"status\":\"ok\",\"size\":%" PRIu64 ",\"hash\":\"%016" PRIx64 "\",\"request\":%" PRIu32 ",\"continued\":%d}",
+                 size, hash64_final(&hash), seq, request.expectContinue);
+
+        if(httpd_send_json(sock, 200, "OK", NULL, json, request.keepAlive, HTTPD_TEST_TIMEOUT) < 0 || !request.keepAlive) {
+            return;
+        }
+    }
+}
+
+static pid_t httpd_test_spawn_server() {
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    if(pid == 0) {
+        while(true) {
+            int sock = accept(listener, NULL, NULL);
+            if(sock < 0) {
+                _exit(1);
+            }
+
+            // As on the device, where the helpers only wait in poll() for non-blocking sockets.
+            fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+            httpd_test_serve_conn(sock);
+            close(sock);
+        }
+    }
+
+    return pid;
+}
+
+static int httpd_test_make_files(const char* dir) {
+    for(size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        httpd_test_file* file = &files[i];
+        if((file->data = (uint8_t*) malloc(file->size)) == NULL) {
+            return -1;
+        }
+
+        for(size_t j = 0; j < file->size; j++) {
+            file->data[j] = (uint8_t) rand();
+        }
+
+        snprintf(file->path, sizeof(file->path), "%s/%s", dir, file->name);
+
+        FILE* fd = fopen(file->path, "wb");
+        if(fd == NULL || fwrite(file->data, 1, file->size, fd) != file->size || fclose(fd) != 0) {
+            perror(file->path);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void httpd_test_remove_files(const char* dir) {
+    for(size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        if(files[i].path[0] != '\0') {
+            remove(files[i].path);
+        }
+
+        free(files[i].data);
+    }
+
+    rmdir(dir);
+}
+
+// Returns whether out holds the response the server gives to file as the seq'th request on its
+// connection. curl asks to continue on its own for larger files, so that is only checked when
+// continued is set.
+static int httpd_test_check_upload(const char* out, const httpd_test_file* file, uint32_t seq, int continued) {
+    char expected[160];
+    snprintf(expected, sizeof(expected), "\"status\":\"ok\",\"size\":%lu,\"hash\":\"%016" PRIx64 "\",\"request\":%" PRIu32 ",",
+             (unsigned long) file->size, hash64(file->data, (uint32_t) file->size), seq);
+
+    if(strstr(out, expected) == NULL || (continued && strstr(out, "\"continued\":1}") == NULL)) {
+        fprintf(stderr, "expected %s%s\n     got %s\n", expected, continued ? "\"continued\":1}" : "...", out);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int httpd_test_curl(const char* curl, const char* args, char* out, size_t size) {
+    char command[PATH_MAX * 4];
+    snprintf(command, sizeof(command), "%s -s -S --max-time 20 %s", curl, args);
+
+    FILE* pipe = popen(command, "r");
+    if(pipe == NULL) {
+        perror("popen");
+        return -1;
+    }
+
+    size_t len = fread(out, 1, size - 1, pipe);
+    out[len] = '\0';
+
+    int status = pclose(pipe);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "curl failed: %s\n", command);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int httpd_test_curl_length(const char* curl) {
+    char args[PATH_MAX * 2];
+    snprintf(args, sizeof(args), "-T '%s' http://127.0.0.1:%u/", files[0].path, port);
+
+    char out[1024];
+    return httpd_test_curl(curl, args, out, sizeof(out)) < 0 ? -1 : httpd_test_check_upload(out, &files[0], 1, 0);
+}
+
+static int httpd_test_curl_chunked(const char* curl) {
+    char args[PATH_MAX * 2];
+    snprintf(args, sizeof(args), "-T - http://127.0.0.1:%u/upload.cia < '%s'", port, files[0].path);
+
+    char out[1024];
+    return httpd_test_curl(curl, args, out, sizeof(out)) < 0 ? -1 : httpd_test_check_upload(out, &files[0], 1, 0);
+}
+
+static int httpd_test_curl_continue(const char* curl) {
+    // Without the interim response, curl would sit out the whole expect timeout and the server
+    // would give up on the body first.
+    char args[PATH_MAX * 2];
+    snprintf(args, sizeof(args), "-H 'Expect: 100-continue' --expect100-timeout 15 -T '%s' http://127.0.0.1:%u/", files[1].path, port);
+
+    char out[1024];
+    return httpd_test_curl(curl, args, out, sizeof(out)) < 0 ? -1 : httpd_test_check_upload(out, &files[1], 1, 1);
+}
+
+static int httpd_test_curl_keep_alive(const char* curl) {
+    char args[PATH_MAX * 4];
+    snprintf(args, sizeof(args), "-T '%s' http://127.0.0.1:%u/ -T '%s' http://127.0.0.1:%u/ -T '%s' http://127.0.0.1:%u/",
+             files[1].path, port, files[0].path, port, files[1].path, port);
+
+    char out[1024];
+    if(httpd_test_curl(curl, args, out, sizeof(out)) < 0) {
+        return -1;
+    }
+
+    // Each response is its own JSON object, in request order.
+    char* second = strstr(out, "}{");
+    char* third = second != NULL ? strstr(second + 1, "}{") : NULL;
+    if(third == NULL) {
+        fprintf(stderr, "expected three responses, got %s\n", out);
+        return -1;
+    }
+
+    second[1] = '\0';
+    third[1] = '\0';
+
+    if(httpd_test_check_upload(out, &files[1], 1, 0) < 0 || httpd_test_check_upload(second + 2, &files[0], 2, 0) < 0
+       || httpd_test_check_upload(third + 2, &files[1], 3, 0) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Sends a request in pieces, waiting gapMs before each after the first, and reads the response
+// until the server closes the connection.
+static int httpd_test_raw(const char** pieces, int gapMs, char* out, size_t size) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if(sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    if(connect(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(sock);
+        return -1;
+    }
+
+    for(size_t i = 0; pieces[i] != NULL; i++) {
+        if(i > 0) {
+            usleep(gapMs * 1000);
+        }
+
+        // The server may already have given up; what it sent back says how far it got.
+        if(send(sock, pieces[i], strlen(pieces[i]), MSG_NOSIGNAL) < 0) {
+            break;
+        }
+    }
+
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+    size_t len = 0;
+    while(len < size - 1) {
+        size_t received = 0;
+        net_recv_all_partial(sock, out + len, size - 1 - len, 0, HTTPD_TEST_TIMEOUT, &received);
+        len += received;
+
+        if(received == 0) {
+            break;
+        }
+    }
+
+    out[len] = '\0';
+
+    close(sock);
+    return 0;
+}
+
+static int httpd_test_expect_status(const char** pieces, int gapMs, const char* status) {
+    char out[1024];
+    if(httpd_test_raw(pieces, gapMs, out, sizeof(out)) < 0) {
+        return -1;
+    }
+
+    // An empty status expects the connection to be closed without a response.
+    if(status[0] != '\0' ? strncmp(out, status, strlen(status)) != 0 : out[0] != '\0') {
+        fprintf(stderr, "expected %s, got %s\n", status[0] != '\0' ? status : "no response", out[0] != '\0' ? out : "no response");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int httpd_test_split_head() {
+    const char* pieces[] = {"PUT /a HTTP/1.1\r\n", "Content-Length: 5\r\n", "Connection: close\r\n\r\nhello", NULL};
+    return httpd_test_expect_status(pieces, HTTPD_TEST_HEAD_TIMEOUT / 5, "HTTP/1.1 200 ");
+}
+
+static int httpd_test_slow_head() {
+    // Every gap is within the timeout, but the head as a whole is not.
+    const char* pieces[] = {"PUT /a HTTP/1.1\r\n", "Host: x\r\n", "Content-Length: 5\r\n", "Connection: close\r\n", "\r\nhello", NULL};
+    return httpd_test_expect_status(pieces, HTTPD_TEST_HEAD_TIMEOUT * 2 / 5, "");
+}
+
+static int httpd_test_large_head() {
+    static char header[HTTPD_HEAD_MAX + 64];
+    snprintf(header, sizeof(header), "X-Filler: %0*d\r\n\r\n", HTTPD_HEAD_MAX, 0);
+
+    const char* pieces[] = {"PUT /a HTTP/1.1\r\n", header, NULL};
+    return httpd_test_expect_status(pieces, 0, "HTTP/1.1 431 ");
+}
+
+static int httpd_test_chunk_size(const char* size, const char* status) {
+    char chunk[64];
+    snprintf(chunk, sizeof(chunk), "%s\r\n0123456789abcdef\r\n0\r\n\r\n", size);
+
+    const char* pieces[] = {"PUT /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n", chunk, NULL};
+    return httpd_test_expect_status(pieces, 0, status);
+}
+
+static int httpd_test_chunk_plain() {
+    return httpd_test_chunk_size("10", "HTTP/1.1 200 ");
+}
+
+static int httpd_test_chunk_extension() {
+    return httpd_test_chunk_size("10 ;name=value", "HTTP/1.1 200 ");
+}
+
+static int httpd_test_chunk_signed() {
+    return httpd_test_chunk_size("+10", "HTTP/1.1 400 ") < 0 || httpd_test_chunk_size("-1", "HTTP/1.1 400 ") < 0 ? -1 : 0;
+}
+
+static int httpd_test_chunk_prefixed() {
+    return httpd_test_chunk_size("0x10", "HTTP/1.1 400 ") < 0 || httpd_test_chunk_size(" 10", "HTTP/1.1 400 ") < 0 ? -1 : 0;
+}
+
+static int httpd_test_chunk_overflow() {
+    return httpd_test_chunk_size("10000000000000010", "HTTP/1.1 400 ");
+}
+
+int main(int argc, char** argv) {
+    if(argc > 2) {
+        fprintf(stderr, "Usage: %s [path to curl]\n", argv[0]);
+        return 2;
+    }
+
+    const char* curl = argc > 1 ? argv[1] : "curl";
+
+    signal(SIGPIPE, SIG_IGN);
+    srand(1);
+
+    char dir[] = "/tmp/httpd_test.XXXXXX";
+    if(mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    int failed = 0;
+
+    pid_t server = -1;
+    if(httpd_test_listen() < 0 || httpd_test_make_files(dir) < 0 || (server = httpd_test_spawn_server()) < 0) {
+        failed = 1;
+    } else {
+        static const struct {
+            const char* name;
+            int (*curl)(const char* curl);
+            int (*raw)();
+        } cases[] = {
+            {"curl upload with Content-Length", httpd_test_curl_length, NULL},
+            {"curl chunked upload", httpd_test_curl_chunked, NULL},
+            {"curl upload after 100 Continue", httpd_test_curl_continue, NULL},
+            {"curl uploads over one connection", httpd_test_curl_keep_alive, NULL},
+            {"head split across sends", NULL, httpd_test_split_head},
+            {"head slower than the timeout", NULL, httpd_test_slow_head},
+            {"oversized head", NULL, httpd_test_large_head},
+            {"chunk size", NULL, httpd_test_chunk_plain},
+            {"chunk size with extension", NULL, httpd_test_chunk_extension},
+            {"chunk size with a sign", NULL, httpd_test_chunk_signed},
+            {"chunk size with a prefix", NULL, httpd_test_chunk_prefixed},
+            {"chunk size overflowing", NULL, httpd_test_chunk_overflow}
+        };
+
+        for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            int res = cases[i].curl != NULL ? cases[i].curl(curl) : cases[i].raw();
+            printf("%s: %s\n", res == 0 ? "PASS" : "FAIL", cases[i].name);
+
+            failed |= res != 0;
+        }
+    }
+
+    if(server > 0) {
+        kill(server, SIGKILL);
+        waitpid(server, NULL, 0);
+    }
+
+    if(listener >= 0) {
+        close(listener);
+    }
+
+    httpd_test_remove_files(dir);
+    return failed;
+}
\ No newline at end of file